@@ -0,0 +1,183 @@
+// Replacing a file so that a reader polling for it sees either the old file or the complete new one, never a partly
+// written one. The data goes into a temporary file in the same folder, pre-sized to its final length and written
+// through a memory mapping, which is flushed and then renamed over the target in one step. There is a Win32 and a
+// POSIX version, for the tool itself and for testing and benchmarking on other platforms.
+#ifdef _WIN32
+    #include <windows.h>
+    typedef wchar_t PathChar;
+#else
+    #include <fcntl.h>
+    #include <stdio.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    typedef char PathChar;
+#endif
+
+
+int const ATOMIC_PATH_MAX = 1024;
+
+
+struct AtomicFile {
+    PathChar target[ ATOMIC_PATH_MAX ];
+    PathChar temp[ ATOMIC_PATH_MAX ];
+    uint8_t* data; // Mapped contents of the temporary file, NULL for an empty file
+    size_t size;
+    #ifdef _WIN32
+        HANDLE file;
+        HANDLE mapping;
+    #else
+        int file;
+    #endif
+};
+
+
+static void closeAtomicFile( struct AtomicFile* file ) {
+    #ifdef _WIN32
+        if( file->data ) {
+            UnmapViewOfFile( file->data );
+        }
+        if( file->mapping ) {
+            CloseHandle( file->mapping );
+        }
+        if( file->file != INVALID_HANDLE_VALUE ) {
+            CloseHandle( file->file );
+        }
+        file->mapping = NULL;
+        file->file = INVALID_HANDLE_VALUE;
+    #else
+        if( file->data ) {
+            munmap( file->data, file->size );
+        }
+        if( file->file >= 0 ) {
+            close( file->file );
+        }
+        file->file = -1;
+    #endif
+    file->data = NULL;
+}
+
+
+// Creates the temporary file for replacing `filename` with `size` bytes, and maps it. Returns zero on failure.
+// Otherwise write the contents to `file->data` (NULL when `size` is zero), then call `commitAtomicFile` or
+// `abortAtomicFile`
+static int beginAtomicFile( struct AtomicFile* file, PathChar const* filename, size_t size ) {
+    memset( file, 0, sizeof( *file ) );
+    file->size = size;
+    #ifdef _WIN32
+        file->file = INVALID_HANDLE_VALUE;
+        if( swprintf( file->target, ATOMIC_PATH_MAX, L"%ls", filename ) < 0 ||
+            swprintf( file->temp, ATOMIC_PATH_MAX, L"%ls.%lu.tmp", filename, GetCurrentProcessId() ) < 0 ) {
+            return 0;
+        }
+        file->file = CreateFileW( file->temp, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL, NULL );
+        if( file->file == INVALID_HANDLE_VALUE ) {
+            return 0;
+        }
+        if( size > 0 ) {
+            // Creating the mapping also extends the file to its full size, in one allocation
+            file->mapping = CreateFileMappingW( file->file, NULL, PAGE_READWRITE, (DWORD)( (uint64_t) size >> 32 ),
+                (DWORD) size, NULL );
+            file->data = file->mapping ? (uint8_t*) MapViewOfFile( file->mapping, FILE_MAP_WRITE, 0, 0, size ) : NULL;
+            if( !file->data ) {
+                closeAtomicFile( file );
+                DeleteFileW( file->temp );
+                return 0;
+            }
+        }
+    #else
+        file->file = -1;
+        if( snprintf( file->target, ATOMIC_PATH_MAX, "%s", filename ) >= ATOMIC_PATH_MAX ||
+            snprintf( file->temp, ATOMIC_PATH_MAX, "%s.%ld.tmp", filename, (long) getpid() ) >= ATOMIC_PATH_MAX ) {
+            return 0;
+        }
+        file->file = open( file->temp, O_RDWR | O_CREAT | O_TRUNC, 0666 );
+        if( file->file < 0 ) {
+            return 0;
+        }
+        if( size > 0 ) {
+            void* data = MAP_FAILED;
+            if( ftruncate( file->file, (off_t) size ) == 0 ) {
+                data = mmap( NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file->file, 0 );
+            }
+            if( data == MAP_FAILED ) {
+                closeAtomicFile( file );
+                unlink( file->temp );
+                return 0;
+            }
+            file->data = (uint8_t*) data;
+        }
+    #endif
+    return 1;
+}
+
+
+// Flushes the temporary file to disk and renames it over the target
+static int commitAtomicFile( struct AtomicFile* file ) {
+    int result = 1;
+    #ifdef _WIN32
+        if( file->data && !FlushViewOfFile( file->data, 0 ) ) {
+            result = 0;
+        }
+        UnmapViewOfFile( file->data );
+        file->data = NULL;
+        if( !FlushFileBuffers( file->file ) ) {
+            result = 0;
+        }
+        closeAtomicFile( file );
+        if( result ) {
+            // A reader which opened the target without FILE_SHARE_DELETE blocks the rename, so give it a moment
+            result = 0;
+            for( int attempt = 0; attempt < 20 && !result; ++attempt ) {
+                result = MoveFileExW( file->temp, file->target, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH );
+                if( !result ) {
+                    Sleep( 10 );
+                }
+            }
+        }
+        if( !result ) {
+            DeleteFileW( file->temp );
+        }
+    #else
+        if( file->data && msync( file->data, file->size, MS_SYNC ) != 0 ) {
+            result = 0;
+        }
+        if( file->data ) {
+            munmap( file->data, file->size );
+            file->data = NULL;
+        }
+        if( fsync( file->file ) != 0 ) {
+            result = 0;
+        }
+        closeAtomicFile( file );
+        if( !result || rename( file->temp, file->target ) != 0 ) {
+            unlink( file->temp );
+            result = 0;
+        }
+    #endif
+    return result;
+}
+
+
+// Throws away the temporary file, leaving the target as it was
+static void abortAtomicFile( struct AtomicFile* file ) {
+    closeAtomicFile( file );
+    #ifdef _WIN32
+        DeleteFileW( file->temp );
+    #else
+        unlink( file->temp );
+    #endif
+}
+
+
+static int writeFileAtomic( PathChar const* filename, void const* data, size_t size ) {
+    struct AtomicFile file;
+    if( !beginAtomicFile( &file, filename, size ) ) {
+        return 0;
+    }
+    if( size > 0 ) {
+        memcpy( file.data, data, size );
+    }
+    return commitAtomicFile( &file );
+}
@@ -0,0 +1,111 @@
+// Finds the uniform borders around a snippet, so they can be trimmed off when it is saved. The color of the top-left
+// pixel is taken as the border color, and the borders are the rows and columns, from each edge in, where every pixel is
+// within a small tolerance of it. Rows are scanned four pixels at a time with SSE2, and columns are never walked: the
+// left and right borders are narrowed by scanning the start and end of each row, only as far as the narrowest seen.
+
+
+int const TRIM_TOLERANCE = 8; // Largest difference in any color channel for a pixel to still count as border
+
+
+// Index of the first of `count` pixels which differs from `color` by more than `tolerance` in a color channel, or
+// `count` if none does. Alpha is ignored
+static int firstTrimMismatch( uint32_t const* row, int count, uint32_t color, int tolerance ) {
+    int x = 0;
+    #ifdef PIXELS_SSE2
+        __m128i const border = _mm_set1_epi32( (int) color );
+        __m128i const limit = _mm_set1_epi8( (char) tolerance );
+        __m128i const channels = _mm_set1_epi32( 0x00ffffff );
+        __m128i const zero = _mm_setzero_si128();
+        for( ; x + 4 <= count; x += 4 ) {
+            __m128i px = _mm_loadu_si128( (__m128i const*)( row + x ) );
+            __m128i diff = _mm_or_si128( _mm_subs_epu8( px, border ), _mm_subs_epu8( border, px ) );
+            __m128i over = _mm_and_si128( _mm_subs_epu8( diff, limit ), channels );
+            if( _mm_movemask_epi8( _mm_cmpeq_epi8( over, zero ) ) != 0xffff ) {
+                break; // Find which of the four it is below
+            }
+        }
+    #endif
+    for( ; x < count; ++x ) {
+        for( int shift = 0; shift < 24; shift += 8 ) {
+            int d = (int)( ( row[ x ] >> shift ) & 0xff ) - (int)( ( color >> shift ) & 0xff );
+            if( d > tolerance || d < -tolerance ) {
+                return x;
+            }
+        }
+    }
+    return count;
+}
+
+
+// One past the index of the last of `count` pixels which differs from `color` by more than `tolerance` in a color
+// channel, or 0 if none does
+static int lastTrimMismatch( uint32_t const* row, int count, uint32_t color, int tolerance ) {
+    int end = count;
+    #ifdef PIXELS_SSE2
+        __m128i const border = _mm_set1_epi32( (int) color );
+        __m128i const limit = _mm_set1_epi8( (char) tolerance );
+        __m128i const channels = _mm_set1_epi32( 0x00ffffff );
+        __m128i const zero = _mm_setzero_si128();
+        for( ; end >= 4; end -= 4 ) {
+            __m128i px = _mm_loadu_si128( (__m128i const*)( row + end - 4 ) );
+            __m128i diff = _mm_or_si128( _mm_subs_epu8( px, border ), _mm_subs_epu8( border, px ) );
+            __m128i over = _mm_and_si128( _mm_subs_epu8( diff, limit ), channels );
+            if( _mm_movemask_epi8( _mm_cmpeq_epi8( over, zero ) ) != 0xffff ) {
+                break;
+            }
+        }
+    #endif
+    for( ; end > 0; --end ) {
+        if( firstTrimMismatch( row + end - 1, 1, color, tolerance ) == 0 ) {
+            return end;
+        }
+    }
+    return 0;
+}
+
+
+// The part of `image` inside its uniform borders, in the coordinates of `image`. If the whole image is one color,
+// there is nothing to trim down to, and all of it is returned
+static struct PixelRect findTrimRect( struct PixelBuffer const* image, int tolerance ) {
+    struct PixelRect all = { 0, 0, image->width, image->height };
+    if( image->width < 1 || image->height < 1 ) {
+        return all;
+    }
+    uint32_t color = image->pixels[ 0 ];
+    int w = image->width;
+    int top = 0;
+    while( top < image->height && firstTrimMismatch( pixelRow( image, top ), w, color, tolerance ) == w ) {
+        ++top;
+    }
+    if( top == image->height ) {
+        return all;
+    }
+    int bottom = image->height;
+    while( firstTrimMismatch( pixelRow( image, bottom - 1 ), w, color, tolerance ) == w ) {
+        --bottom;
+    }
+
+    // Each row only needs to be scanned up to the narrowest left and right borders found so far, which for most
+    // content is a few pixels
+    int left = w;
+    int right = 0;
+    for( int y = top; y < bottom && ( left > 0 || right < w ); ++y ) {
+        uint32_t const* row = pixelRow( image, y );
+        left = firstTrimMismatch( row, left, color, tolerance );
+        int end = lastTrimMismatch( row + right, w - right, color, tolerance );
+        right = end > 0 ? right + end : right;
+    }
+    struct PixelRect trim = { left, top, right, bottom };
+    return trim;
+}
+
+
+// The part of the bitmap pixels to save: the part inside `crop`, and of that, the part inside the uniform borders if
+// `trim` is set. The encoders read the pixels through the stride of `pixels`, so nothing is copied
+static struct PixelBuffer croppedPixels( struct PixelBuffer const* pixels, struct PixelRect crop, int trim ) {
+    struct PixelBuffer view = cropPixelBuffer( pixels, crop );
+    if( trim ) {
+        view = cropPixelBuffer( &view, findTrimRect( &view, TRIM_TOLERANCE ) );
+    }
+    return view;
+}
@@ -0,0 +1,164 @@
+// Growable byte buffer for building files in memory, and a matching bounds-checked reader. Integers are written as
+// LEB128 varints, with zigzag encoding for signed values, so small numbers take a single byte. Nothing in here depends
+// on windows.h.
+#include <stdarg.h>
+#include <stdio.h>
+
+
+struct ByteBuffer {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+    int failed; // Set if an allocation failed. Further writes are ignored, so this only needs checking at the end
+};
+
+
+static int reserveBytes( struct ByteBuffer* buffer, size_t count ) {
+    if( buffer->failed ) {
+        return 0;
+    }
+    if( buffer->size + count <= buffer->capacity ) {
+        return 1;
+    }
+    size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+    while( capacity < buffer->size + count ) {
+        capacity *= 2;
+    }
+    uint8_t* data = (uint8_t*) realloc( buffer->data, capacity );
+    if( !data ) {
+        buffer->failed = 1;
+        return 0;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 1;
+}
+
+
+static void appendBytes( struct ByteBuffer* buffer, void const* data, size_t count ) {
+    if( reserveBytes( buffer, count ) ) {
+        memcpy( buffer->data + buffer->size, data, count );
+        buffer->size += count;
+    }
+}
+
+
+static void appendByte( struct ByteBuffer* buffer, uint8_t value ) {
+    if( reserveBytes( buffer, 1 ) ) {
+        buffer->data[ buffer->size++ ] = value;
+    }
+}
+
+
+static void appendUint32( struct ByteBuffer* buffer, uint32_t value ) {
+    uint8_t bytes[ 4 ] = { (uint8_t) value, (uint8_t)( value >> 8 ), (uint8_t)( value >> 16 ), (uint8_t)( value >> 24 ) };
+    appendBytes( buffer, bytes, 4 );
+}
+
+
+static void appendVarint( struct ByteBuffer* buffer, uint64_t value ) {
+    uint8_t bytes[ 10 ];
+    int count = 0;
+    do {
+        bytes[ count ] = (uint8_t)( value & 0x7f );
+        value >>= 7;
+        bytes[ count++ ] |= value ? 0x80 : 0;
+    } while( value );
+    appendBytes( buffer, bytes, count );
+}
+
+
+static void appendSignedVarint( struct ByteBuffer* buffer, int64_t value ) {
+    appendVarint( buffer, ( (uint64_t) value << 1 ) ^ (uint64_t)( value >> 63 ) );
+}
+
+
+// printf-style formatted text, without the terminating zero
+static void appendFormat( struct ByteBuffer* buffer, char const* format, ... ) {
+    va_list args;
+    va_start( args, format );
+    char text[ 256 ];
+    int length = vsnprintf( text, sizeof( text ), format, args );
+    va_end( args );
+    if( length < 0 ) {
+        buffer->failed = 1;
+    } else if( length < (int) sizeof( text ) ) {
+        appendBytes( buffer, text, (size_t) length );
+    } else if( reserveBytes( buffer, (size_t) length + 1 ) ) {
+        va_start( args, format );
+        vsnprintf( (char*)( buffer->data + buffer->size ), (size_t) length + 1, format, args );
+        va_end( args );
+        buffer->size += length;
+    }
+}
+
+
+static void releaseByteBuffer( struct ByteBuffer* buffer ) {
+    free( buffer->data );
+    memset( buffer, 0, sizeof( *buffer ) );
+}
+
+
+struct ByteReader {
+    uint8_t const* data;
+    size_t size;
+    size_t position;
+    int failed; // Set on reading past the end, or a malformed value. Reads after that return zero
+};
+
+
+static uint8_t readByte( struct ByteReader* reader ) {
+    if( reader->failed || reader->position >= reader->size ) {
+        reader->failed = 1;
+        return 0;
+    }
+    return reader->data[ reader->position++ ];
+}
+
+
+static uint16_t readUint16( struct ByteReader* reader ) {
+    uint16_t value = readByte( reader );
+    value |= (uint16_t)( readByte( reader ) << 8 );
+    return value;
+}
+
+
+static uint32_t readUint32( struct ByteReader* reader ) {
+    uint32_t value = readByte( reader );
+    value |= (uint32_t) readByte( reader ) << 8;
+    value |= (uint32_t) readByte( reader ) << 16;
+    value |= (uint32_t) readByte( reader ) << 24;
+    return value;
+}
+
+
+static uint64_t readVarint( struct ByteReader* reader ) {
+    uint64_t value = 0;
+    for( int shift = 0; shift < 64; shift += 7 ) {
+        uint8_t byte = readByte( reader );
+        value |= (uint64_t)( byte & 0x7f ) << shift;
+        if( !( byte & 0x80 ) ) {
+            return value;
+        }
+    }
+    reader->failed = 1;
+    return 0;
+}
+
+
+static int64_t readSignedVarint( struct ByteReader* reader ) {
+    uint64_t value = readVarint( reader );
+    return (int64_t)( value >> 1 ) ^ -(int64_t)( value & 1 );
+}
+
+
+// Returns a pointer to the next `count` bytes and skips past them, or NULL if there are not that many left
+static uint8_t const* readBytes( struct ByteReader* reader, size_t count ) {
+    if( reader->failed || reader->size - reader->position < count ) {
+        reader->failed = 1;
+        return NULL;
+    }
+    uint8_t const* bytes = reader->data + reader->position;
+    reader->position += count;
+    return bytes;
+}
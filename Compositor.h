@@ -0,0 +1,471 @@
+// Final render of freehand strokes at the native resolution of the snippet. The image is split into tiles, each tile
+// gets a list of the strokes whose bounds touch it, and the tiles are rendered in parallel by a small work-stealing
+// pool. Coverage is computed from the distance to the stroke's polyline, optionally supersampled. Nothing in here
+// depends on windows.h.
+#include <atomic>
+#include <thread>
+
+
+int const COMPOSITE_TILE = 64; // Tile size, in pixels
+int const COMPOSITE_MAX_THREADS = 64;
+
+
+// A polyline to be drawn with a round pen, of either a fixed width or a width given at each vertex. `color` is BGRA, with straight (not premultiplied) alpha. Overlapping parts
+// of the same stroke are only blended once, so semitransparent strokes look the same as when drawn by GDI+.
+struct CompositeStroke {
+    float const* vertices; // x, y pairs
+    int vertexCount;
+    float width; // Width of the pen, or the widest it gets when `widths` is set
+    uint32_t color;
+    float const* widths; // Width of the pen at each vertex, changing linearly in between, or NULL to use `width`
+};
+
+
+// Everything the workers share. Each worker owns a range of tiles packed into a single 64-bit value (first tile in the
+// high half, end in the low half). It takes tiles from the front of its own range, and when that runs dry, steals
+// from the back of another worker's range.
+struct CompositeJob {
+    struct PixelBuffer* target;
+    struct CompositeStroke const* strokes;
+    int supersampling;
+    int tilesX;
+    int tilesY;
+    int* binStarts; // For tile i, `bins[ binStarts[ i ] ]` to `bins[ binStarts[ i + 1 ] ]` are the strokes touching it
+    int* bins;
+    int workerCount;
+    std::atomic<uint64_t> ranges[ COMPOSITE_MAX_THREADS ];
+};
+
+
+static struct PixelRect compositeStrokeBounds( struct CompositeStroke const* stroke ) {
+    struct PixelRect bounds = { 0, 0, 0, 0 };
+    if( stroke->vertexCount < 1 ) {
+        return bounds;
+    }
+    float x0 = stroke->vertices[ 0 ], y0 = stroke->vertices[ 1 ], x1 = x0, y1 = y0;
+    for( int i = 1; i < stroke->vertexCount; ++i ) {
+        float x = stroke->vertices[ i * 2 ], y = stroke->vertices[ i * 2 + 1 ];
+        x0 = x < x0 ? x : x0;
+        y0 = y < y0 ? y : y0;
+        x1 = x > x1 ? x : x1;
+        y1 = y > y1 ? y : y1;
+    }
+    float margin = stroke->width * 0.5f + 1.0f;
+    bounds.left = (int) floorf( x0 - margin );
+    bounds.top = (int) floorf( y0 - margin );
+    bounds.right = (int) ceilf( x1 + margin );
+    bounds.bottom = (int) ceilf( y1 + margin );
+    return bounds;
+}
+
+
+// A segment drawn with a round pen, set up for computing its coverage a row of pixels at a time
+struct SegmentCover {
+    float x0, y0;
+    float sx, sy; // From the start of the segment to its end
+    float invLength; // One over the squared length, or zero for a dot
+    float halfWidth; // Half width of the pen at the start, and how much it changes to the end
+    float widthChange;
+    float sharpness;
+    float weight; // Of each sub-pixel sample
+    int samples;
+};
+
+
+// Max's the coverage of pixels `x` to `end` of row `y` by the segment into `row`, indexed by x
+static void coverSpanScalar( float* row, int x, int end, int y, struct SegmentCover const* segment ) {
+    struct SegmentCover const s = *segment;
+    for( ; x < end; ++x ) {
+        float sum = 0.0f;
+        for( int j = 0; j < s.samples; ++j ) {
+            for( int i = 0; i < s.samples; ++i ) {
+                float dx = x + ( i + 0.5f ) / s.samples - s.x0;
+                float dy = y + ( j + 0.5f ) / s.samples - s.y0;
+                float t = ( dx * s.sx + dy * s.sy ) * s.invLength;
+                t = t < 0.0f ? 0.0f : ( t > 1.0f ? 1.0f : t );
+                dx -= t * s.sx;
+                dy -= t * s.sy;
+                float c = ( s.halfWidth + s.widthChange * t - sqrtf( dx * dx + dy * dy ) ) * s.sharpness + 0.5f;
+                sum += c < 0.0f ? 0.0f : ( c > 1.0f ? 1.0f : c );
+            }
+        }
+        float c = sum * s.weight;
+        row[ x ] = c > row[ x ] ? c : row[ x ];
+    }
+}
+
+
+#ifdef PIXELS_SSE2
+    static void coverSpanSse2( float* row, int x, int end, int y, struct SegmentCover const* segment ) {
+        struct SegmentCover const s = *segment;
+        __m128 const zero = _mm_setzero_ps();
+        __m128 const one = _mm_set1_ps( 1.0f );
+        for( ; x + 4 <= end; x += 4 ) {
+            __m128 sum = zero;
+            for( int j = 0; j < s.samples; ++j ) {
+                float py = y + ( j + 0.5f ) / s.samples - s.y0;
+                for( int i = 0; i < s.samples; ++i ) {
+                    float px = x + ( i + 0.5f ) / s.samples - s.x0;
+                    __m128 dx = _mm_add_ps( _mm_setr_ps( 0.0f, 1.0f, 2.0f, 3.0f ), _mm_set1_ps( px ) );
+                    __m128 dy = _mm_set1_ps( py );
+                    __m128 t = _mm_mul_ps( _mm_add_ps( _mm_mul_ps( dx, _mm_set1_ps( s.sx ) ),
+                        _mm_mul_ps( dy, _mm_set1_ps( s.sy ) ) ), _mm_set1_ps( s.invLength ) );
+                    t = _mm_min_ps( _mm_max_ps( t, zero ), one );
+                    dx = _mm_sub_ps( dx, _mm_mul_ps( t, _mm_set1_ps( s.sx ) ) );
+                    dy = _mm_sub_ps( dy, _mm_mul_ps( t, _mm_set1_ps( s.sy ) ) );
+                    __m128 d = _mm_sqrt_ps( _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) ) );
+                    __m128 h = _mm_add_ps( _mm_set1_ps( s.halfWidth ), _mm_mul_ps( t, _mm_set1_ps( s.widthChange ) ) );
+                    __m128 c = _mm_add_ps( _mm_mul_ps( _mm_sub_ps( h, d ),
+                        _mm_set1_ps( s.sharpness ) ), _mm_set1_ps( 0.5f ) );
+                    sum = _mm_add_ps( sum, _mm_min_ps( _mm_max_ps( c, zero ), one ) );
+                }
+            }
+            __m128 c = _mm_mul_ps( sum, _mm_set1_ps( s.weight ) );
+            _mm_storeu_ps( row + x, _mm_max_ps( _mm_loadu_ps( row + x ), c ) );
+        }
+        coverSpanScalar( row, x, end, y, segment );
+    }
+#endif
+
+
+#ifdef PIXELS_AVX2
+    CPU_TARGET( "avx2" ) static void coverSpanAvx2( float* row, int x, int end, int y,
+        struct SegmentCover const* segment ) {
+
+        struct SegmentCover const s = *segment;
+        __m256 const zero = _mm256_setzero_ps();
+        __m256 const one = _mm256_set1_ps( 1.0f );
+        for( ; x + 8 <= end; x += 8 ) {
+            __m256 sum = zero;
+            for( int j = 0; j < s.samples; ++j ) {
+                float py = y + ( j + 0.5f ) / s.samples - s.y0;
+                for( int i = 0; i < s.samples; ++i ) {
+                    float px = x + ( i + 0.5f ) / s.samples - s.x0;
+                    __m256 dx = _mm256_add_ps( _mm256_setr_ps( 0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f ),
+                        _mm256_set1_ps( px ) );
+                    __m256 dy = _mm256_set1_ps( py );
+                    __m256 t = _mm256_mul_ps( _mm256_add_ps( _mm256_mul_ps( dx, _mm256_set1_ps( s.sx ) ),
+                        _mm256_mul_ps( dy, _mm256_set1_ps( s.sy ) ) ), _mm256_set1_ps( s.invLength ) );
+                    t = _mm256_min_ps( _mm256_max_ps( t, zero ), one );
+                    dx = _mm256_sub_ps( dx, _mm256_mul_ps( t, _mm256_set1_ps( s.sx ) ) );
+                    dy = _mm256_sub_ps( dy, _mm256_mul_ps( t, _mm256_set1_ps( s.sy ) ) );
+                    __m256 d = _mm256_sqrt_ps( _mm256_add_ps( _mm256_mul_ps( dx, dx ), _mm256_mul_ps( dy, dy ) ) );
+                    __m256 h = _mm256_add_ps( _mm256_set1_ps( s.halfWidth ),
+                        _mm256_mul_ps( t, _mm256_set1_ps( s.widthChange ) ) );
+                    __m256 c = _mm256_add_ps( _mm256_mul_ps( _mm256_sub_ps( h, d ),
+                        _mm256_set1_ps( s.sharpness ) ), _mm256_set1_ps( 0.5f ) );
+                    sum = _mm256_add_ps( sum, _mm256_min_ps( _mm256_max_ps( c, zero ), one ) );
+                }
+            }
+            __m256 c = _mm256_mul_ps( sum, _mm256_set1_ps( s.weight ) );
+            _mm256_storeu_ps( row + x, _mm256_max_ps( _mm256_loadu_ps( row + x ), c ) );
+        }
+        coverSpanSse2( row, x, end, y, segment );
+    }
+#endif
+
+
+// Coverage of the pixels of `rect` by the segment (x0, y0) - (x1, y1) drawn with a round pen, max'ed into `coverage`
+// (one float per pixel of `rect`, `rect.right - rect.left` per row). The half width of the pen goes from `halfWidth`
+// to `halfWidthEnd` along the segment. With supersampling, each pixel is the average of `samples` x `samples`
+// sub-pixel coverages.
+static void coverSegment( float* coverage, struct PixelRect rect, float x0, float y0, float x1, float y1,
+    float halfWidth, float halfWidthEnd, int samples ) {
+
+    int width = rect.right - rect.left;
+    struct SegmentCover segment;
+    segment.x0 = x0;
+    segment.y0 = y0;
+    segment.sx = x1 - x0;
+    segment.sy = y1 - y0;
+    float lengthSq = segment.sx * segment.sx + segment.sy * segment.sy;
+    segment.invLength = lengthSq > 0.0f ? 1.0f / lengthSq : 0.0f;
+    segment.halfWidth = halfWidth;
+    segment.widthChange = halfWidthEnd - halfWidth;
+    segment.sharpness = (float) samples; // Edge falloff is one sub-pixel wide
+    segment.weight = 1.0f / ( samples * samples );
+    segment.samples = samples;
+
+    // Only the pixels near the segment
+    float margin = ( halfWidth > halfWidthEnd ? halfWidth : halfWidthEnd ) + 1.0f;
+    struct PixelRect near = { (int) floorf( ( x0 < x1 ? x0 : x1 ) - margin ), (int) floorf( ( y0 < y1 ? y0 : y1 ) - margin ),
+        (int) ceilf( ( x0 > x1 ? x0 : x1 ) + margin ), (int) ceilf( ( y0 > y1 ? y0 : y1 ) + margin ) };
+    near = intersectPixelRect( near, rect );
+
+    for( int y = near.top; y < near.bottom; ++y ) {
+        float* row = coverage + ( y - rect.top ) * width - rect.left;
+        cpuKernels.coverSpan( row, near.left, near.right, y, &segment );
+    }
+}
+
+
+// Blends `color` over `count` pixels of `row`, with each pixel's alpha scaled by its coverage
+static void blendSpanScalar( uint32_t* row, float const* coverage, int count, uint32_t color ) {
+    float alpha = ( color >> 24 ) / 255.0f;
+    float b = (float)( color & 0xff ), g = (float)( ( color >> 8 ) & 0xff ), r = (float)( ( color >> 16 ) & 0xff );
+    for( int x = 0; x < count; ++x ) {
+        float a = coverage[ x ] * alpha;
+        if( a <= 0.0f ) {
+            continue;
+        }
+        uint32_t p = row[ x ];
+        float ia = 1.0f - a;
+        uint32_t ob = (uint32_t)( b * a + ( p & 0xff ) * ia + 0.5f );
+        uint32_t og = (uint32_t)( g * a + ( ( p >> 8 ) & 0xff ) * ia + 0.5f );
+        uint32_t orr = (uint32_t)( r * a + ( ( p >> 16 ) & 0xff ) * ia + 0.5f );
+        uint32_t oa = (uint32_t)( 255.0f * a + ( p >> 24 ) * ia + 0.5f );
+        row[ x ] = ob | ( og << 8 ) | ( orr << 16 ) | ( oa << 24 );
+    }
+}
+
+
+// The vector variants blend every pixel and keep the old value where there is no coverage. The math is the same, in
+// the same order, so they match the scalar version exactly
+#ifdef PIXELS_SSE2
+    static void blendSpanSse2( uint32_t* row, float const* coverage, int count, uint32_t color ) {
+        __m128 const alpha = _mm_set1_ps( ( color >> 24 ) / 255.0f );
+        __m128 const b = _mm_set1_ps( (float)( color & 0xff ) ), g = _mm_set1_ps( (float)( ( color >> 8 ) & 0xff ) );
+        __m128 const r = _mm_set1_ps( (float)( ( color >> 16 ) & 0xff ) ), opaque = _mm_set1_ps( 255.0f );
+        __m128 const one = _mm_set1_ps( 1.0f ), half = _mm_set1_ps( 0.5f );
+        __m128i const low = _mm_set1_epi32( 0xff );
+        int x = 0;
+        for( ; x + 4 <= count; x += 4 ) {
+            __m128 a = _mm_mul_ps( _mm_loadu_ps( coverage + x ), alpha );
+            __m128i covered = _mm_castps_si128( _mm_cmpgt_ps( a, _mm_setzero_ps() ) );
+            if( _mm_movemask_epi8( covered ) == 0 ) {
+                continue;
+            }
+            __m128i p = _mm_loadu_si128( (__m128i const*)( row + x ) );
+            __m128 ia = _mm_sub_ps( one, a );
+            __m128 pb = _mm_cvtepi32_ps( _mm_and_si128( p, low ) );
+            __m128 pg = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( p, 8 ), low ) );
+            __m128 pr = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( p, 16 ), low ) );
+            __m128 pa = _mm_cvtepi32_ps( _mm_srli_epi32( p, 24 ) );
+            __m128i ob = _mm_cvttps_epi32( _mm_add_ps( _mm_add_ps( _mm_mul_ps( b, a ), _mm_mul_ps( pb, ia ) ), half ) );
+            __m128i og = _mm_cvttps_epi32( _mm_add_ps( _mm_add_ps( _mm_mul_ps( g, a ), _mm_mul_ps( pg, ia ) ), half ) );
+            __m128i orr = _mm_cvttps_epi32( _mm_add_ps( _mm_add_ps( _mm_mul_ps( r, a ), _mm_mul_ps( pr, ia ) ),
+                half ) );
+            __m128i oa = _mm_cvttps_epi32( _mm_add_ps( _mm_add_ps( _mm_mul_ps( opaque, a ), _mm_mul_ps( pa, ia ) ),
+                half ) );
+            __m128i blended = _mm_or_si128( _mm_or_si128( ob, _mm_slli_epi32( og, 8 ) ),
+                _mm_or_si128( _mm_slli_epi32( orr, 16 ), _mm_slli_epi32( oa, 24 ) ) );
+            blended = _mm_or_si128( _mm_and_si128( covered, blended ), _mm_andnot_si128( covered, p ) );
+            _mm_storeu_si128( (__m128i*)( row + x ), blended );
+        }
+        blendSpanScalar( row + x, coverage + x, count - x, color );
+    }
+#endif
+
+
+#ifdef PIXELS_AVX2
+    CPU_TARGET( "avx2" ) static void blendSpanAvx2( uint32_t* row, float const* coverage, int count, uint32_t color ) {
+        __m256 const alpha = _mm256_set1_ps( ( color >> 24 ) / 255.0f );
+        __m256 const b = _mm256_set1_ps( (float)( color & 0xff ) );
+        __m256 const g = _mm256_set1_ps( (float)( ( color >> 8 ) & 0xff ) );
+        __m256 const r = _mm256_set1_ps( (float)( ( color >> 16 ) & 0xff ) ), opaque = _mm256_set1_ps( 255.0f );
+        __m256 const one = _mm256_set1_ps( 1.0f ), half = _mm256_set1_ps( 0.5f );
+        __m256i const low = _mm256_set1_epi32( 0xff );
+        int x = 0;
+        for( ; x + 8 <= count; x += 8 ) {
+            __m256 a = _mm256_mul_ps( _mm256_loadu_ps( coverage + x ), alpha );
+            __m256 covered = _mm256_cmp_ps( a, _mm256_setzero_ps(), _CMP_GT_OQ );
+            if( _mm256_movemask_ps( covered ) == 0 ) {
+                continue;
+            }
+            __m256i p = _mm256_loadu_si256( (__m256i const*)( row + x ) );
+            __m256 ia = _mm256_sub_ps( one, a );
+            __m256 pb = _mm256_cvtepi32_ps( _mm256_and_si256( p, low ) );
+            __m256 pg = _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_srli_epi32( p, 8 ), low ) );
+            __m256 pr = _mm256_cvtepi32_ps( _mm256_and_si256( _mm256_srli_epi32( p, 16 ), low ) );
+            __m256 pa = _mm256_cvtepi32_ps( _mm256_srli_epi32( p, 24 ) );
+            __m256i ob = _mm256_cvttps_epi32( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( b, a ),
+                _mm256_mul_ps( pb, ia ) ), half ) );
+            __m256i og = _mm256_cvttps_epi32( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( g, a ),
+                _mm256_mul_ps( pg, ia ) ), half ) );
+            __m256i orr = _mm256_cvttps_epi32( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( r, a ),
+                _mm256_mul_ps( pr, ia ) ), half ) );
+            __m256i oa = _mm256_cvttps_epi32( _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( opaque, a ),
+                _mm256_mul_ps( pa, ia ) ), half ) );
+            __m256i blended = _mm256_or_si256( _mm256_or_si256( ob, _mm256_slli_epi32( og, 8 ) ),
+                _mm256_or_si256( _mm256_slli_epi32( orr, 16 ), _mm256_slli_epi32( oa, 24 ) ) );
+            blended = _mm256_blendv_epi8( p, blended, _mm256_castps_si256( covered ) );
+            _mm256_storeu_si256( (__m256i*)( row + x ), blended );
+        }
+        blendSpanSse2( row + x, coverage + x, count - x, color );
+    }
+#endif
+
+
+// Blend `color` over the pixels of `rect`, with each pixel's alpha scaled by its coverage
+static void blendCoverage( struct PixelBuffer* target, struct PixelRect rect, float const* coverage, uint32_t color ) {
+    int width = rect.right - rect.left;
+    for( int y = rect.top; y < rect.bottom; ++y ) {
+        cpuKernels.blendSpan( pixelRow( target, y ) + rect.left, coverage + ( y - rect.top ) * width, width, color );
+    }
+}
+
+
+// Render all strokes binned to tile `index`, in order
+static void compositeTile( struct CompositeJob* job, int index, float* coverage ) {
+    int tx = index % job->tilesX;
+    int ty = index / job->tilesX;
+    struct PixelRect rect = { tx * COMPOSITE_TILE, ty * COMPOSITE_TILE, ( tx + 1 ) * COMPOSITE_TILE,
+        ( ty + 1 ) * COMPOSITE_TILE };
+    struct PixelRect image = { 0, 0, job->target->width, job->target->height };
+    rect = intersectPixelRect( rect, image );
+    size_t area = (size_t)( rect.right - rect.left ) * ( rect.bottom - rect.top );
+
+    for( int b = job->binStarts[ index ]; b < job->binStarts[ index + 1 ]; ++b ) {
+        struct CompositeStroke const* stroke = &job->strokes[ job->bins[ b ] ];
+        memset( coverage, 0, sizeof( float ) * area );
+        float const* v = stroke->vertices;
+        float const* w = stroke->widths;
+        float halfWidth = ( w ? w[ 0 ] : stroke->width ) * 0.5f;
+        if( stroke->vertexCount == 1 ) {
+            coverSegment( coverage, rect, v[ 0 ], v[ 1 ], v[ 0 ], v[ 1 ], halfWidth, halfWidth, job->supersampling );
+        }
+        for( int i = 0; i + 1 < stroke->vertexCount; ++i ) {
+            float halfWidthEnd = w ? w[ i + 1 ] * 0.5f : halfWidth;
+            coverSegment( coverage, rect, v[ i * 2 ], v[ i * 2 + 1 ], v[ i * 2 + 2 ], v[ i * 2 + 3 ], halfWidth,
+                halfWidthEnd, job->supersampling );
+            halfWidth = halfWidthEnd;
+        }
+        blendCoverage( job->target, rect, coverage, stroke->color );
+    }
+}
+
+
+// Take the next tile from the front of a worker's own range, or -1 if it is empty
+static int popTile( std::atomic<uint64_t>* range ) {
+    uint64_t r = range->load();
+    while( (uint32_t)( r >> 32 ) < (uint32_t) r ) {
+        if( range->compare_exchange_weak( r, r + ( (uint64_t) 1 << 32 ) ) ) {
+            return (int)( r >> 32 );
+        }
+    }
+    return -1;
+}
+
+
+// Take a tile from the back of another worker's range, or -1 if it is empty
+static int stealTile( std::atomic<uint64_t>* range ) {
+    uint64_t r = range->load();
+    while( (uint32_t)( r >> 32 ) < (uint32_t) r ) {
+        if( range->compare_exchange_weak( r, r - 1 ) ) {
+            return (int)( (uint32_t) r - 1 );
+        }
+    }
+    return -1;
+}
+
+
+static void compositeWorker( struct CompositeJob* job, int worker ) {
+    float* coverage = (float*) malloc( sizeof( float ) * COMPOSITE_TILE * COMPOSITE_TILE );
+    if( !coverage ) {
+        return; // Other workers will steal the tiles
+    }
+    for( ;; ) {
+        int tile = popTile( &job->ranges[ worker ] );
+        for( int i = 1; tile < 0 && i < job->workerCount; ++i ) {
+            tile = stealTile( &job->ranges[ ( worker + i ) % job->workerCount ] );
+        }
+        if( tile < 0 ) {
+            break;
+        }
+        compositeTile( job, tile, coverage );
+    }
+    free( coverage );
+}
+
+
+// Draw `strokes` over `target`, in order. `supersampling` is the number of samples per pixel along each axis (1 for
+// plain distance-based anti-aliasing), and `threads` the number of threads to use, or 0 for one per core. Returns
+// zero if out of memory, in which case `target` is left untouched.
+static int compositeStrokes( struct PixelBuffer* target, struct CompositeStroke const* strokes, int count,
+    int supersampling, int threads ) {
+
+    struct CompositeJob* job = new struct CompositeJob();
+    job->target = target;
+    job->strokes = strokes;
+    job->supersampling = supersampling < 1 ? 1 : supersampling;
+    job->tilesX = ( target->width + COMPOSITE_TILE - 1 ) / COMPOSITE_TILE;
+    job->tilesY = ( target->height + COMPOSITE_TILE - 1 ) / COMPOSITE_TILE;
+    int tileCount = job->tilesX * job->tilesY;
+
+    // Bin the strokes by bounds: count per tile, then prefix sum, then fill. Each tile's list stays in stroke order
+    struct PixelRect* bounds = (struct PixelRect*) malloc( sizeof( struct PixelRect ) * ( count > 0 ? count : 1 ) );
+    job->binStarts = (int*) calloc( tileCount + 1, sizeof( int ) );
+    if( !bounds || !job->binStarts ) {
+        free( bounds );
+        free( job->binStarts );
+        delete job;
+        return 0;
+    }
+    struct PixelRect image = { 0, 0, target->width, target->height };
+    for( int pass = 0; pass < 2; ++pass ) {
+        for( int s = 0; s < count; ++s ) {
+            if( pass == 0 ) {
+                bounds[ s ] = intersectPixelRect( compositeStrokeBounds( &strokes[ s ] ), image );
+            }
+            if( pixelRectEmpty( bounds[ s ] ) ) {
+                continue;
+            }
+            for( int ty = bounds[ s ].top / COMPOSITE_TILE; ty <= ( bounds[ s ].bottom - 1 ) / COMPOSITE_TILE; ++ty ) {
+                for( int tx = bounds[ s ].left / COMPOSITE_TILE; tx <= ( bounds[ s ].right - 1 ) / COMPOSITE_TILE; ++tx ) {
+                    int tile = ty * job->tilesX + tx;
+                    if( pass == 0 ) {
+                        ++job->binStarts[ tile + 1 ];
+                    } else {
+                        job->bins[ job->binStarts[ tile ]++ ] = s;
+                    }
+                }
+            }
+        }
+        if( pass == 0 ) {
+            for( int i = 0; i < tileCount; ++i ) {
+                job->binStarts[ i + 1 ] += job->binStarts[ i ];
+            }
+            job->bins = (int*) malloc( sizeof( int ) * ( job->binStarts[ tileCount ] + 1 ) );
+            if( !job->bins ) {
+                free( bounds );
+                free( job->binStarts );
+                delete job;
+                return 0;
+            }
+        } else {
+            // Filling advanced each start to the end of its list, so shift them back
+            for( int i = tileCount; i > 0; --i ) {
+                job->binStarts[ i ] = job->binStarts[ i - 1 ];
+            }
+            job->binStarts[ 0 ] = 0;
+        }
+    }
+    free( bounds );
+
+    // Split the tiles into one contiguous range per worker. The calling thread is worker 0
+    if( threads <= 0 ) {
+        threads = (int) std::thread::hardware_concurrency();
+    }
+    threads = threads < 1 ? 1 : ( threads > COMPOSITE_MAX_THREADS ? COMPOSITE_MAX_THREADS : threads );
+    threads = threads > tileCount ? ( tileCount > 0 ? tileCount : 1 ) : threads;
+    job->workerCount = threads;
+    for( int i = 0; i < threads; ++i ) {
+        uint64_t first = (uint64_t) tileCount * i / threads;
+        uint64_t end = (uint64_t) tileCount * ( i + 1 ) / threads;
+        job->ranges[ i ].store( ( first << 32 ) | end );
+    }
+    std::thread* workers[ COMPOSITE_MAX_THREADS ] = {};
+    for( int i = 1; i < threads; ++i ) {
+        workers[ i ] = new std::thread( compositeWorker, job, i );
+    }
+    compositeWorker( job, 0 );
+    for( int i = 1; i < threads; ++i ) {
+        workers[ i ]->join();
+        delete workers[ i ];
+    }
+
+    free( job->binStarts );
+    free( job->bins );
+    delete job;
+    return 1;
+}
@@ -0,0 +1,293 @@
+// Binding of the kernels in `cpuKernels` (see CpuFeatures.h) to the variants for an instruction set level, and a
+// self-test running every variant the processor supports against the scalar version on random input. Comes after all
+// the kernels it binds. Nothing in here depends on windows.h.
+
+
+// Kernels with a variant for each level. Levels without a faster variant of a kernel leave it NULL, and get the one of
+// the level below. There are no AVX-512 variants: that level binds the AVX2 ones
+struct CpuKernelVariants {
+    enum CpuIsa isa;
+    struct CpuKernels kernels;
+};
+
+static struct CpuKernelVariants const cpuKernelVariants[] = {
+    { CPU_ISA_SCALAR, { opaqueRowScalar, sumPixelsScalar, averageSumsScalar, filterCostScalar, filterRowScalar,
+        coverSpanScalar, blendSpanScalar, outlineHitScalar } },
+    #ifdef PIXELS_SSE2
+        { CPU_ISA_SSE2, { opaqueRowSse2, sumPixelsSse2, averageSumsSse2, filterCostSse2, filterRowSse2,
+            coverSpanSse2, blendSpanSse2, outlineHitSse2 } },
+        { CPU_ISA_SSE41, { NULL, NULL, NULL, NULL, filterRowSse41, NULL, NULL, NULL } },
+    #endif
+    #ifdef PIXELS_AVX2
+        { CPU_ISA_AVX2, { opaqueRowAvx2, sumPixelsAvx2, averageSumsAvx2, filterCostAvx2, filterRowAvx2,
+            coverSpanAvx2, blendSpanAvx2, outlineHitAvx2 } },
+    #endif
+};
+
+int const CPU_KERNEL_VARIANT_COUNT = sizeof( cpuKernelVariants ) / sizeof( *cpuKernelVariants );
+
+
+static void mergeCpuKernels( struct CpuKernels* kernels, struct CpuKernels const* variant ) {
+    kernels->opaqueRow = variant->opaqueRow ? variant->opaqueRow : kernels->opaqueRow;
+    kernels->sumPixels = variant->sumPixels ? variant->sumPixels : kernels->sumPixels;
+    kernels->averageSums = variant->averageSums ? variant->averageSums : kernels->averageSums;
+    kernels->filterCost = variant->filterCost ? variant->filterCost : kernels->filterCost;
+    kernels->filterRow = variant->filterRow ? variant->filterRow : kernels->filterRow;
+    kernels->coverSpan = variant->coverSpan ? variant->coverSpan : kernels->coverSpan;
+    kernels->blendSpan = variant->blendSpan ? variant->blendSpan : kernels->blendSpan;
+    kernels->outlineHit = variant->outlineHit ? variant->outlineHit : kernels->outlineHit;
+}
+
+
+// Fills in `kernels` with the fastest variants up to level `isa`, which must be supported
+static void selectCpuKernels( enum CpuIsa isa, struct CpuKernels* kernels ) {
+    memset( kernels, 0, sizeof( *kernels ) );
+    for( int i = 0; i < CPU_KERNEL_VARIANT_COUNT && cpuKernelVariants[ i ].isa <= isa; ++i ) {
+        mergeCpuKernels( kernels, &cpuKernelVariants[ i ].kernels );
+    }
+}
+
+
+// Binds `cpuKernels` for level `isa`, or the level detected if that is lower. Returns the level bound. Must not be
+// called while other threads may be running the kernels
+static enum CpuIsa bindCpuKernels( enum CpuIsa isa ) {
+    isa = isa < cpuIsaDetected ? isa : cpuIsaDetected;
+    selectCpuKernels( isa, &cpuKernels );
+    return isa;
+}
+
+
+static enum CpuIsa cpuKernelsIsa = bindCpuKernels( cpuIsaDetected ); // The level `cpuKernels` is bound for
+
+
+static uint32_t selfTestRandom( uint32_t* state ) {
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+
+// A random float from `low` to `high`
+static float selfTestFloat( uint32_t* state, float low, float high ) {
+    return low + ( high - low ) * ( selfTestRandom( state ) >> 8 ) / 16777216.0f;
+}
+
+
+int const SELF_TEST_ROUNDS = 200;
+int const SELF_TEST_SIZE = 300; // Most bytes, pixels or points in a round, enough for a few vectors and a tail
+
+
+// Each test runs a kernel of `variant` and the same one of `scalar` on the same random input, and returns non-zero if
+// they differ, or -1 if `variant` has no such kernel
+static int selfTestOpaqueRow( struct CpuKernels const* variant, struct CpuKernels const* scalar, uint32_t* seed ) {
+    if( !variant->opaqueRow ) {
+        return -1;
+    }
+    uint32_t in[ SELF_TEST_SIZE ], expected[ SELF_TEST_SIZE ], out[ SELF_TEST_SIZE ];
+    int count = (int)( selfTestRandom( seed ) % SELF_TEST_SIZE );
+    for( int i = 0; i < count; ++i ) {
+        in[ i ] = selfTestRandom( seed );
+    }
+    scalar->opaqueRow( expected, in, count );
+    variant->opaqueRow( out, in, count );
+    return memcmp( expected, out, sizeof( uint32_t ) * count ) != 0;
+}
+
+
+// Sums starting from random values, as the cells of a pixelated row do
+static int selfTestSumPixels( struct CpuKernels const* variant, struct CpuKernels const* scalar, uint32_t* seed ) {
+    if( !variant->sumPixels ) {
+        return -1;
+    }
+    uint32_t row[ SELF_TEST_SIZE ], expected[ 4 ], out[ 4 ];
+    int count = (int)( selfTestRandom( seed ) % SELF_TEST_SIZE );
+    for( int i = 0; i < count; ++i ) {
+        row[ i ] = selfTestRandom( seed );
+    }
+    for( int c = 0; c < 4; ++c ) {
+        expected[ c ] = out[ c ] = selfTestRandom( seed ) >> 8;
+    }
+    scalar->sumPixels( row, count, expected );
+    variant->sumPixels( row, count, out );
+    return memcmp( expected, out, sizeof( out ) ) != 0;
+}
+
+
+// Sums of `n` random pixels for a random `n`. Every few rounds the sums are all at their highest or a multiple of
+// `n`, where rounding is most likely to go wrong
+static int selfTestAverageSums( struct CpuKernels const* variant, struct CpuKernels const* scalar, uint32_t* seed ) {
+    if( !variant->averageSums ) {
+        return -1;
+    }
+    uint32_t sums[ SELF_TEST_SIZE * 4 ], expected[ SELF_TEST_SIZE ], out[ SELF_TEST_SIZE ];
+    int count = (int)( selfTestRandom( seed ) % SELF_TEST_SIZE );
+    uint32_t n = 1 + selfTestRandom( seed ) % ( selfTestRandom( seed ) & 1 ? 16 : REDACT_MAX_DIVISOR + 100 );
+    uint32_t kind = selfTestRandom( seed ) % 4;
+    for( int i = 0; i < count * 4; ++i ) {
+        uint32_t sum = selfTestRandom( seed ) % ( 255 * n + 1 );
+        sums[ i ] = kind == 0 ? 255 * n : ( kind == 1 ? sum / n * n : sum );
+    }
+    struct RedactDivisor divisor = redactDivisor( n );
+    scalar->averageSums( sums, expected, count, &divisor );
+    variant->averageSums( sums, out, count, &divisor );
+    return memcmp( expected, out, sizeof( uint32_t ) * count ) != 0;
+}
+
+
+static int selfTestFilterCost( struct CpuKernels const* variant, struct CpuKernels const* scalar, uint32_t* seed ) {
+    if( !variant->filterCost ) {
+        return -1;
+    }
+    uint8_t filtered[ SELF_TEST_SIZE ];
+    int size = (int)( selfTestRandom( seed ) % SELF_TEST_SIZE );
+    for( int i = 0; i < size; ++i ) {
+        filtered[ i ] = (uint8_t) selfTestRandom( seed );
+    }
+    return scalar->filterCost( filtered, size ) != variant->filterCost( filtered, size );
+}
+
+
+// Every filter type, for RGB and 16-bit RGB rows. Half the rounds use only a few distinct byte values, so the Paeth
+// predictor often has ties to break
+static int selfTestFilterRow( struct CpuKernels const* variant, struct CpuKernels const* scalar, uint32_t* seed ) {
+    if( !variant->filterRow ) {
+        return -1;
+    }
+    uint8_t buffers[ 2 ][ 8 + SELF_TEST_SIZE ] = {};
+    uint8_t expected[ SELF_TEST_SIZE ], out[ SELF_TEST_SIZE ];
+    int bpp = selfTestRandom( seed ) & 1 ? 3 : 6;
+    int size = (int)( selfTestRandom( seed ) % SELF_TEST_SIZE );
+    uint8_t mask = selfTestRandom( seed ) & 1 ? 0xff : 0x03;
+    uint8_t* row = buffers[ 0 ] + 8;
+    uint8_t* prior = buffers[ 1 ] + 8;
+    for( int i = 0; i < size; ++i ) {
+        row[ i ] = (uint8_t) selfTestRandom( seed ) & mask;
+        prior[ i ] = (uint8_t) selfTestRandom( seed ) & mask;
+    }
+    for( int type = 1; type <= 4; ++type ) {
+        scalar->filterRow( type, row, prior, size, bpp, expected );
+        variant->filterRow( type, row, prior, size, bpp, out );
+        if( memcmp( expected, out, size ) != 0 ) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+// The vector variants add up the sub-pixel offsets in another order, so coverage may differ in the last bits
+static int selfTestCoverSpan( struct CpuKernels const* variant, struct CpuKernels const* scalar, uint32_t* seed ) {
+    if( !variant->coverSpan ) {
+        return -1;
+    }
+    float expected[ SELF_TEST_SIZE ], out[ SELF_TEST_SIZE ];
+    struct SegmentCover segment;
+    segment.x0 = selfTestFloat( seed, -10.0f, SELF_TEST_SIZE + 10.0f );
+    segment.y0 = selfTestFloat( seed, -10.0f, 10.0f );
+    segment.sx = selfTestFloat( seed, -50.0f, 50.0f );
+    segment.sy = selfTestFloat( seed, -10.0f, 10.0f );
+    float lengthSq = segment.sx * segment.sx + segment.sy * segment.sy;
+    segment.invLength = lengthSq > 0.0f ? 1.0f / lengthSq : 0.0f;
+    segment.halfWidth = selfTestFloat( seed, 0.5f, 8.0f );
+    segment.widthChange = selfTestFloat( seed, -0.5f, 8.0f ) - segment.halfWidth;
+    segment.samples = 1 + (int)( selfTestRandom( seed ) % 3 );
+    segment.sharpness = (float) segment.samples;
+    segment.weight = 1.0f / ( segment.samples * segment.samples );
+    int x = (int)( selfTestRandom( seed ) % SELF_TEST_SIZE );
+    int end = x + (int)( selfTestRandom( seed ) % ( SELF_TEST_SIZE - x + 1 ) );
+    int y = (int)( selfTestRandom( seed ) % 8 ) - 4;
+    for( int i = 0; i < SELF_TEST_SIZE; ++i ) {
+        expected[ i ] = out[ i ] = selfTestRandom( seed ) & 1 ? selfTestFloat( seed, 0.0f, 1.0f ) : 0.0f;
+    }
+    scalar->coverSpan( expected, x, end, y, &segment );
+    variant->coverSpan( out, x, end, y, &segment );
+    for( int i = 0; i < SELF_TEST_SIZE; ++i ) {
+        if( fabsf( expected[ i ] - out[ i ] ) > 1e-4f ) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+static int selfTestBlendSpan( struct CpuKernels const* variant, struct CpuKernels const* scalar, uint32_t* seed ) {
+    if( !variant->blendSpan ) {
+        return -1;
+    }
+    uint32_t expected[ SELF_TEST_SIZE ], out[ SELF_TEST_SIZE ];
+    float coverage[ SELF_TEST_SIZE ];
+    int count = (int)( selfTestRandom( seed ) % SELF_TEST_SIZE );
+    uint32_t color = selfTestRandom( seed );
+    for( int i = 0; i < count; ++i ) {
+        expected[ i ] = out[ i ] = selfTestRandom( seed );
+        coverage[ i ] = selfTestRandom( seed ) & 1 ? selfTestFloat( seed, 0.0f, 1.0f ) : 0.0f;
+    }
+    scalar->blendSpan( expected, coverage, count, color );
+    variant->blendSpan( out, coverage, count, color );
+    return memcmp( expected, out, sizeof( uint32_t ) * count ) != 0;
+}
+
+
+// A random polygon, which may cross itself, hit at random points around it
+static int selfTestOutlineHit( struct CpuKernels const* variant, struct CpuKernels const* scalar, uint32_t* seed ) {
+    if( !variant->outlineHit ) {
+        return -1;
+    }
+    float points[ SELF_TEST_SIZE / 4 * 2 ];
+    int count = 3 + (int)( selfTestRandom( seed ) % ( SELF_TEST_SIZE / 4 - 3 ) );
+    for( int i = 0; i < count * 2; ++i ) {
+        points[ i ] = selfTestFloat( seed, 0.0f, 100.0f );
+    }
+    for( int hit = 0; hit < 16; ++hit ) {
+        float x = selfTestFloat( seed, -10.0f, 110.0f ), y = selfTestFloat( seed, -10.0f, 110.0f );
+        float limit = selfTestFloat( seed, 0.0f, 25.0f );
+        if( scalar->outlineHit( points, count, x, y, limit ) != variant->outlineHit( points, count, x, y, limit ) ) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+struct CpuKernelTest {
+    char const* name;
+    int (*run)( struct CpuKernels const* variant, struct CpuKernels const* scalar, uint32_t* seed );
+};
+
+static struct CpuKernelTest const cpuKernelTests[] = {
+    { "opaqueRow", selfTestOpaqueRow },
+    { "sumPixels", selfTestSumPixels },
+    { "averageSums", selfTestAverageSums },
+    { "filterCost", selfTestFilterCost },
+    { "filterRow", selfTestFilterRow },
+    { "coverSpan", selfTestCoverSpan },
+    { "blendSpan", selfTestBlendSpan },
+    { "outlineHit", selfTestOutlineHit },
+};
+
+
+// Runs each variant of each kernel, for the levels the processor supports, against the scalar version, and appends a
+// line per variant to `report` saying whether they matched. Returns the number of variants which didn't
+static int selfTestCpuKernels( struct ByteBuffer* report ) {
+    int failures = 0;
+    struct CpuKernels const* scalar = &cpuKernelVariants[ 0 ].kernels;
+    for( int i = 1; i < CPU_KERNEL_VARIANT_COUNT && cpuKernelVariants[ i ].isa <= cpuIsaDetected; ++i ) {
+        struct CpuKernels const* variant = &cpuKernelVariants[ i ].kernels;
+        for( size_t t = 0; t < sizeof( cpuKernelTests ) / sizeof( *cpuKernelTests ); ++t ) {
+            struct CpuKernelTest const* test = &cpuKernelTests[ t ];
+            uint32_t seed = 0x9e3779b9u;
+            int mismatches = test->run( variant, scalar, &seed );
+            if( mismatches < 0 ) {
+                continue;
+            }
+            for( int round = 1; round < SELF_TEST_ROUNDS; ++round ) {
+                mismatches += test->run( variant, scalar, &seed );
+            }
+            failures += mismatches > 0;
+            appendFormat( report, "%s %s: %s\n", test->name, cpuIsaNames[ cpuKernelVariants[ i ].isa ],
+                mismatches ? "MISMATCH" : "ok" );
+        }
+    }
+    return failures;
+}
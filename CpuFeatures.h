@@ -0,0 +1,128 @@
+// Which instruction sets the processor supports, and the table of kernels picked for it. The hot kernels (pixel
+// conversion, redaction, PNG filtering, stroke coverage and blending, hit testing) come in a scalar version and one
+// for each instruction set that pays off for them, and are called through `cpuKernels`. The table is filled in by
+// `bindCpuKernels` (see CpuDispatch.h), from the variants defined next to each kernel. Nothing in here depends on
+// windows.h.
+#ifdef PIXELS_SSE2
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #else
+        #include <cpuid.h>
+    #endif
+    #include <immintrin.h>
+    #define PIXELS_AVX2 1
+    // Lets a function use instructions beyond those the rest of the build targets. MSVC needs no flag for that
+    #ifdef _MSC_VER
+        #define CPU_TARGET( isa )
+    #else
+        #define CPU_TARGET( isa ) __attribute__(( target( isa ) ))
+    #endif
+#endif
+
+
+// Instruction set levels, each including the ones before
+enum CpuIsa {
+    CPU_ISA_SCALAR,
+    CPU_ISA_SSE2,
+    CPU_ISA_SSE41,
+    CPU_ISA_AVX2,
+    CPU_ISA_AVX512, // Foundation and byte/word instructions
+    CPU_ISA_COUNT,
+};
+
+static char const* const cpuIsaNames[ CPU_ISA_COUNT ] = { "scalar", "sse2", "sse4.1", "avx2", "avx512" };
+
+
+#ifdef PIXELS_SSE2
+    static void cpuId( int leaf, int subleaf, uint32_t regs[ 4 ] ) {
+        #ifdef _MSC_VER
+            int values[ 4 ];
+            __cpuidex( values, leaf, subleaf );
+            for( int i = 0; i < 4; ++i ) {
+                regs[ i ] = (uint32_t) values[ i ];
+            }
+        #else
+            __cpuid_count( leaf, subleaf, regs[ 0 ], regs[ 1 ], regs[ 2 ], regs[ 3 ] );
+        #endif
+    }
+
+
+    // Register state the operating system saves on context switches. Only valid if CPUID reports OSXSAVE
+    static uint64_t cpuSavedState( void ) {
+        #ifdef _MSC_VER
+            return _xgetbv( 0 );
+        #else
+            uint32_t low, high;
+            __asm__ volatile( "xgetbv" : "=a"( low ), "=d"( high ) : "c"( 0 ) );
+            return ( (uint64_t) high << 32 ) | low;
+        #endif
+    }
+#endif
+
+
+// The highest level both the processor and the operating system support. AVX registers are only usable if the
+// operating system saves them, which it reports through XGETBV
+static enum CpuIsa detectCpuIsa( void ) {
+    #ifdef PIXELS_SSE2
+        uint32_t regs[ 4 ];
+        cpuId( 0, 0, regs );
+        uint32_t maxLeaf = regs[ 0 ];
+        cpuId( 1, 0, regs );
+        if( !( regs[ 3 ] & ( 1u << 26 ) ) ) {
+            return CPU_ISA_SCALAR;
+        }
+        if( !( regs[ 2 ] & ( 1u << 19 ) ) ) {
+            return CPU_ISA_SSE2;
+        }
+        int avx = ( regs[ 2 ] & ( 1u << 27 ) ) && ( regs[ 2 ] & ( 1u << 28 ) );
+        uint64_t state = avx ? cpuSavedState() : 0;
+        if( maxLeaf < 7 || ( state & 0x6 ) != 0x6 ) {
+            return CPU_ISA_SSE41;
+        }
+        cpuId( 7, 0, regs );
+        if( !( regs[ 1 ] & ( 1u << 5 ) ) ) {
+            return CPU_ISA_SSE41;
+        }
+        if( ( state & 0xe6 ) != 0xe6 || !( regs[ 1 ] & ( 1u << 16 ) ) || !( regs[ 1 ] & ( 1u << 30 ) ) ) {
+            return CPU_ISA_AVX2;
+        }
+        return CPU_ISA_AVX512;
+    #else
+        return CPU_ISA_SCALAR;
+    #endif
+}
+
+
+static enum CpuIsa const cpuIsaDetected = detectCpuIsa();
+
+
+// The level named `name`, as in `cpuIsaNames`, or CPU_ISA_COUNT if there is none
+static enum CpuIsa findCpuIsa( char const* name ) {
+    int isa = 0;
+    while( isa < CPU_ISA_COUNT && strcmp( cpuIsaNames[ isa ], name ) != 0 ) {
+        ++isa;
+    }
+    return (enum CpuIsa) isa;
+}
+
+
+struct SegmentCover;
+struct RedactDivisor;
+
+
+// One entry per kernel. Each is documented where its variants are defined
+struct CpuKernels {
+    void (*opaqueRow)( uint32_t* out, uint32_t const* in, int count );
+    void (*sumPixels)( uint32_t const* row, int count, uint32_t* sums );
+    void (*averageSums)( uint32_t const* sums, uint32_t* out, int count, struct RedactDivisor const* divisor );
+    uint32_t (*filterCost)( uint8_t const* filtered, int size );
+    void (*filterRow)( int type, uint8_t const* row, uint8_t const* prior, int size, int bpp, uint8_t* out );
+    void (*coverSpan)( float* row, int x, int end, int y, struct SegmentCover const* segment );
+    void (*blendSpan)( uint32_t* row, float const* coverage, int count, uint32_t color );
+    int (*outlineHit)( float const* points, int pointCount, float x, float y, float limit );
+};
+
+
+// Bound for `cpuIsaDetected` before main runs (see CpuDispatch.h), so the kernels can be called from anywhere in the
+// program. The tool binds them again for a lower level if asked to with --force-isa
+static struct CpuKernels cpuKernels;
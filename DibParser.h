@@ -0,0 +1,174 @@
+// Parser for packed device independent bitmaps, the format of the CF_DIB and CF_DIBV5 clipboard formats: a
+// BITMAPINFOHEADER, BITMAPV4HEADER or BITMAPV5HEADER, then color masks and a color table if there are any, then the
+// rows, bottom-up unless the height is negative. Uncompressed 24 and 32-bit images are supported, with BI_BITFIELDS
+// masks for 32-bit. Every size and offset is checked against the size of the data, so anything malformed or truncated
+// is rejected rather than read past. 32-bit images in BGRX order (which is what screenshots are) are read in place,
+// a bottom-up image through a negative stride, so their rows go to the encoder without being copied. Nothing in here
+// depends on windows.h.
+
+
+int const DIB_INFO_HEADER_SIZE = 40; // BITMAPINFOHEADER
+int const DIB_V4_HEADER_SIZE = 108; // BITMAPV4HEADER, which adds the masks (at offset 40) and color space
+int const DIB_V5_HEADER_SIZE = 124; // BITMAPV5HEADER
+int const DIB_MAX_SIZE = 65536; // Largest width or height accepted
+uint32_t const DIB_RGB = 0; // Values of `biCompression`
+uint32_t const DIB_BITFIELDS = 3;
+uint32_t const DIB_ALPHABITFIELDS = 6;
+
+
+struct DibImage {
+    int width;
+    int height;
+    int bitCount; // 24 or 32
+    int topDown; // Non-zero if the first row in memory is the top one
+    uint32_t masks[ 4 ]; // Red, green, blue and alpha. Alpha may be zero, for none. Only for 32-bit
+    uint8_t const* bits; // The first row in memory
+    size_t rowBytes; // Rows are padded to a multiple of four bytes
+};
+
+
+// Parses the header of a packed DIB of `size` bytes, and finds its rows. Returns zero if it is malformed, truncated
+// or in a format which isn't supported, in which case `dib` is left undefined
+static int parseDib( uint8_t const* data, size_t size, struct DibImage* dib ) {
+    struct ByteReader reader = { data, size, 0, 0 };
+    uint32_t headerSize = readUint32( &reader );
+    int32_t width = (int32_t) readUint32( &reader );
+    int32_t height = (int32_t) readUint32( &reader );
+    uint16_t planes = readUint16( &reader );
+    uint16_t bitCount = readUint16( &reader );
+    uint32_t compression = readUint32( &reader );
+    readBytes( &reader, 12 ); // Image size, and resolution, which aren't needed
+    uint32_t colorsUsed = readUint32( &reader );
+    readUint32( &reader ); // Important colors
+    if( reader.failed || ( headerSize != (uint32_t) DIB_INFO_HEADER_SIZE && 
+        headerSize != (uint32_t) DIB_V4_HEADER_SIZE && headerSize != (uint32_t) DIB_V5_HEADER_SIZE ) ) {
+        return 0;
+    }
+    if( planes != 1 || width <= 0 || width > DIB_MAX_SIZE || height == 0 || height < -DIB_MAX_SIZE || 
+        height > DIB_MAX_SIZE || ( bitCount != 24 && bitCount != 32 ) ) {
+        return 0;
+    }
+
+    // The masks are part of the V4 and V5 headers, and follow the plain info header
+    uint32_t masks[ 4 ] = { 0x00ff0000, 0x0000ff00, 0x000000ff, 0 };
+    if( compression == DIB_BITFIELDS || compression == DIB_ALPHABITFIELDS ) {
+        if( bitCount != 32 ) {
+            return 0;
+        }
+        // The info header is only followed by an alpha mask with BI_ALPHABITFIELDS
+        int maskCount = compression == DIB_BITFIELDS && headerSize == (uint32_t) DIB_INFO_HEADER_SIZE ? 3 : 4;
+        for( int i = 0; i < maskCount; ++i ) {
+            masks[ i ] = readUint32( &reader );
+        }
+    } else if( compression != DIB_RGB ) {
+        return 0; // Run length encoded, or embedded JPEG or PNG
+    }
+    if( headerSize > (uint32_t) DIB_INFO_HEADER_SIZE ) {
+        readBytes( &reader, headerSize - reader.position ); // The rest of the V4 or V5 header
+    }
+
+    // A color table is allowed even for images which don't use one
+    if( colorsUsed > 256 || !readBytes( &reader, (size_t) colorsUsed * 4 ) ) {
+        return 0;
+    }
+    size_t rowBytes = ( ( (size_t) width * bitCount + 31 ) / 32 ) * 4;
+    size_t rows = (size_t)( height < 0 ? -height : height );
+    if( rows > ( size - reader.position ) / rowBytes ) {
+        return 0;
+    }
+    uint8_t const* bits = readBytes( &reader, rowBytes * rows );
+    for( int i = 0; i < 3; ++i ) {
+        if( masks[ i ] == 0 ) {
+            return 0;
+        }
+    }
+
+    dib->width = width;
+    dib->height = (int) rows;
+    dib->bitCount = bitCount;
+    dib->topDown = height < 0;
+    memcpy( dib->masks, masks, sizeof( masks ) );
+    dib->bits = bits;
+    dib->rowBytes = rowBytes;
+    return 1;
+}
+
+
+// How to get a channel out of a 32-bit pixel: the bits under `mask`, shifted down by `shift`, go up to `max`
+struct DibChannel {
+    uint32_t mask;
+    int shift;
+    uint32_t max;
+};
+
+
+static struct DibChannel dibChannel( uint32_t mask ) {
+    struct DibChannel channel = { mask, 0, 0 };
+    while( mask && !( ( mask >> channel.shift ) & 1 ) ) {
+        ++channel.shift;
+    }
+    channel.max = mask >> channel.shift;
+    return channel;
+}
+
+
+// Scales a channel of `value` to 0-255. A channel without a mask is 255
+static uint32_t dibChannelValue( struct DibChannel const* channel, uint32_t value ) {
+    uint32_t bits = ( value & channel->mask ) >> channel->shift;
+    if( channel->max == 0xff || channel->max == 0 ) {
+        return channel->max ? bits : 0xff;
+    }
+    return (uint32_t)( ( (uint64_t) bits * 255 + channel->max / 2 ) / channel->max );
+}
+
+
+// Makes `pixels` a top-down view of the image. 32-bit BGRX images are viewed in place and `*allocated` is set to NULL.
+// Anything else is converted into a newly allocated buffer, which is put in `*allocated` for the caller to free.
+// Returns zero if out of memory
+static int dibPixels( struct DibImage const* dib, struct PixelBuffer* pixels, uint32_t** allocated ) {
+    *allocated = NULL;
+    int stride = (int)( dib->rowBytes / 4 );
+    uint8_t const* top = dib->topDown ? dib->bits : dib->bits + dib->rowBytes * ( dib->height - 1 );
+    if( dib->bitCount == 32 && dib->masks[ 0 ] == 0x00ff0000 && dib->masks[ 1 ] == 0x0000ff00 && 
+        dib->masks[ 2 ] == 0x000000ff && ( (uintptr_t) dib->bits & 3 ) == 0 ) {
+        pixels->pixels = (uint32_t*) top;
+        pixels->width = dib->width;
+        pixels->height = dib->height;
+        pixels->stride = dib->topDown ? stride : -stride;
+        return 1;
+    }
+
+    uint32_t* out = (uint32_t*) malloc( sizeof( uint32_t ) * (size_t) dib->width * dib->height );
+    if( !out ) {
+        return 0;
+    }
+    ptrdiff_t step = dib->topDown ? (ptrdiff_t) dib->rowBytes : -(ptrdiff_t) dib->rowBytes;
+    struct DibChannel channels[ 4 ];
+    for( int i = 0; i < 4; ++i ) {
+        channels[ i ] = dibChannel( dib->masks[ i ] );
+    }
+    for( int y = 0; y < dib->height; ++y ) {
+        uint8_t const* in = top + step * y;
+        uint32_t* row = out + (size_t) y * dib->width;
+        if( dib->bitCount == 24 ) {
+            for( int x = 0; x < dib->width; ++x ) {
+                row[ x ] = 0xff000000 | ( (uint32_t) in[ x * 3 + 2 ] << 16 ) | ( (uint32_t) in[ x * 3 + 1 ] << 8 ) | 
+                    in[ x * 3 ];
+            }
+        } else {
+            for( int x = 0; x < dib->width; ++x ) {
+                uint32_t value;
+                memcpy( &value, in + x * 4, 4 ); // The rows may not be aligned
+                row[ x ] = ( dibChannelValue( &channels[ 3 ], value ) << 24 ) | 
+                    ( dibChannelValue( &channels[ 0 ], value ) << 16 ) | 
+                    ( dibChannelValue( &channels[ 1 ], value ) << 8 ) | dibChannelValue( &channels[ 2 ], value );
+            }
+        }
+    }
+    *allocated = out;
+    pixels->pixels = out;
+    pixels->width = dib->width;
+    pixels->height = dib->height;
+    pixels->stride = dib->width;
+    return 1;
+}
@@ -0,0 +1,261 @@
+// Edge detection used to snap the region selection to window and panel borders. A Sobel pass over a captured frame
+// is reduced to per-band projections: for every column, the number of strong vertical-edge pixels in each band of
+// rows, and for every row, the number of strong horizontal-edge pixels in each band of columns. The projections are
+// stored as prefix sums over the bands, so the edge strength along any segment is found with two lookups.
+
+
+int const EDGE_BAND = 32; // Rows (or columns) per band. Must be a multiple of 8
+int const EDGE_THRESHOLD = 64; // Minimum Sobel response (max is 1020) for a pixel to count as an edge
+float const EDGE_SNAP_RATIO = 0.5f; // Fraction of a segment which needs to be edge pixels for it to be snapped to
+
+
+struct EdgeMap {
+    int width;
+    int height;
+    int bandsX; // Number of column bands
+    int bandsY; // Number of row bands
+    uint32_t* verticalPrefix; // ( bandsY + 1 ) * width entries: vertical-edge pixels per column, summed over row bands
+    uint32_t* horizontalPrefix; // ( bandsX + 1 ) * height entries: horizontal-edge pixels per row, summed over column bands
+};
+
+
+// Converts a row of BGRA pixels to 8-bit luma (Rec. 601 weights in 8-bit fixed point)
+static void lumaRow( uint32_t const* in, uint8_t* out, int width ) {
+    int x = 0;
+    #ifdef PIXELS_SSE2
+        __m128i const zero = _mm_setzero_si128();
+        __m128i const weights = _mm_set_epi16( 0, 77, 150, 29, 0, 77, 150, 29 );
+        for( ; x + 8 <= width; x += 8 ) {
+            __m128i sums[ 4 ];
+            for( int i = 0; i < 2; ++i ) {
+                __m128i px = _mm_loadu_si128( (__m128i const*)( in + x + i * 4 ) );
+                // Each madd gives two partial sums per pixel, (b*29 + g*150) and (r*77), add them together
+                __m128i lo = _mm_madd_epi16( _mm_unpacklo_epi8( px, zero ), weights );
+                __m128i hi = _mm_madd_epi16( _mm_unpackhi_epi8( px, zero ), weights );
+                sums[ i * 2 + 0 ] = _mm_add_epi32( lo, _mm_srli_epi64( lo, 32 ) );
+                sums[ i * 2 + 1 ] = _mm_add_epi32( hi, _mm_srli_epi64( hi, 32 ) );
+            }
+            // Gather the per-pixel sums (lanes 0 and 2 of each register) into two registers of four
+            __m128i a = _mm_unpacklo_epi64( _mm_shuffle_epi32( sums[ 0 ], 0x08 ), _mm_shuffle_epi32( sums[ 1 ], 0x08 ) );
+            __m128i b = _mm_unpacklo_epi64( _mm_shuffle_epi32( sums[ 2 ], 0x08 ), _mm_shuffle_epi32( sums[ 3 ], 0x08 ) );
+            __m128i luma = _mm_packs_epi32( _mm_srli_epi32( a, 8 ), _mm_srli_epi32( b, 8 ) );
+            _mm_storel_epi64( (__m128i*)( out + x ), _mm_packus_epi16( luma, zero ) );
+        }
+    #endif
+    for( ; x < width; ++x ) {
+        uint32_t c = in[ x ];
+        out[ x ] = (uint8_t)( ( ( c & 0xff ) * 29 + ( ( c >> 8 ) & 0xff ) * 150 + ( ( c >> 16 ) & 0xff ) * 77 ) >> 8 );
+    }
+}
+
+
+static int popcount8( unsigned int v ) {
+    v = v - ( ( v >> 1 ) & 0x55 );
+    v = ( v & 0x33 ) + ( ( v >> 2 ) & 0x33 );
+    return (int)( ( v + ( v >> 4 ) ) & 0x0f );
+}
+
+
+// Sobel pass for the inner pixels of row `y`, given the luma of rows y-1, y and y+1. Adds 1 to `columnHits[ x ]` for
+// every vertical-edge pixel, and returns horizontal-edge pixel counts per column band in `bandHits`.
+static void edgeRow( uint8_t const* above, uint8_t const* row, uint8_t const* below, int width,
+    uint16_t* columnHits, uint32_t* bandHits ) {
+
+    int x = 1;
+    #ifdef PIXELS_SSE2
+        __m128i const zero = _mm_setzero_si128();
+        __m128i const threshold = _mm_set1_epi16( EDGE_THRESHOLD - 1 );
+        for( ; x + 8 <= width - 1; x += 8 ) {
+            // 16-bit luma of the 3x3 neighbourhood of 8 pixels at a time
+            __m128i a0 = _mm_unpacklo_epi8( _mm_loadl_epi64( (__m128i const*)( above + x - 1 ) ), zero );
+            __m128i a1 = _mm_unpacklo_epi8( _mm_loadl_epi64( (__m128i const*)( above + x ) ), zero );
+            __m128i a2 = _mm_unpacklo_epi8( _mm_loadl_epi64( (__m128i const*)( above + x + 1 ) ), zero );
+            __m128i r0 = _mm_unpacklo_epi8( _mm_loadl_epi64( (__m128i const*)( row + x - 1 ) ), zero );
+            __m128i r2 = _mm_unpacklo_epi8( _mm_loadl_epi64( (__m128i const*)( row + x + 1 ) ), zero );
+            __m128i b0 = _mm_unpacklo_epi8( _mm_loadl_epi64( (__m128i const*)( below + x - 1 ) ), zero );
+            __m128i b1 = _mm_unpacklo_epi8( _mm_loadl_epi64( (__m128i const*)( below + x ) ), zero );
+            __m128i b2 = _mm_unpacklo_epi8( _mm_loadl_epi64( (__m128i const*)( below + x + 1 ) ), zero );
+
+            __m128i gx = _mm_sub_epi16( _mm_add_epi16( _mm_add_epi16( a2, b2 ), _mm_add_epi16( r2, r2 ) ),
+                _mm_add_epi16( _mm_add_epi16( a0, b0 ), _mm_add_epi16( r0, r0 ) ) );
+            __m128i gy = _mm_sub_epi16( _mm_add_epi16( _mm_add_epi16( b0, b2 ), _mm_add_epi16( b1, b1 ) ),
+                _mm_add_epi16( _mm_add_epi16( a0, a2 ), _mm_add_epi16( a1, a1 ) ) );
+            gx = _mm_max_epi16( gx, _mm_sub_epi16( zero, gx ) );
+            gy = _mm_max_epi16( gy, _mm_sub_epi16( zero, gy ) );
+
+            // Masks are -1 for edge pixels, so subtracting them counts the hits
+            __m128i vertical = _mm_cmpgt_epi16( gx, threshold );
+            __m128i horizontal = _mm_cmpgt_epi16( gy, threshold );
+            __m128i hits = _mm_loadu_si128( (__m128i const*)( columnHits + x ) );
+            _mm_storeu_si128( (__m128i*)( columnHits + x ), _mm_sub_epi16( hits, vertical ) );
+            int bits = _mm_movemask_epi8( _mm_packs_epi16( horizontal, zero ) ) & 0xff;
+            if( bits ) {
+                // The 8 pixels can straddle two column bands, as we start at x = 1
+                int split = EDGE_BAND - x % EDGE_BAND;
+                if( split >= 8 ) {
+                    bandHits[ x / EDGE_BAND ] += popcount8( (unsigned int) bits );
+                } else {
+                    bandHits[ x / EDGE_BAND ] += popcount8( (unsigned int) bits & ( ( 1u << split ) - 1 ) );
+                    bandHits[ x / EDGE_BAND + 1 ] += popcount8( (unsigned int) bits >> split );
+                }
+            }
+        }
+    #endif
+    for( ; x < width - 1; ++x ) {
+        int gx = ( above[ x + 1 ] + 2 * row[ x + 1 ] + below[ x + 1 ] ) - ( above[ x - 1 ] + 2 * row[ x - 1 ] + below[ x - 1 ] );
+        int gy = ( below[ x - 1 ] + 2 * below[ x ] + below[ x + 1 ] ) - ( above[ x - 1 ] + 2 * above[ x ] + above[ x + 1 ] );
+        if( abs( gx ) >= EDGE_THRESHOLD ) {
+            ++columnHits[ x ];
+        }
+        if( abs( gy ) >= EDGE_THRESHOLD ) {
+            ++bandHits[ x / EDGE_BAND ];
+        }
+    }
+}
+
+
+// Builds the edge projections for `frame`. Returns FALSE (and leaves `map` empty) if memory could not be allocated.
+static int buildEdgeMap( struct PixelBuffer const* frame, struct EdgeMap* map ) {
+    int width = frame->width;
+    int height = frame->height;
+    memset( map, 0, sizeof( *map ) );
+    if( width < 3 || height < 3 ) {
+        return 0;
+    }
+    int bandsX = ( width + EDGE_BAND - 1 ) / EDGE_BAND;
+    int bandsY = ( height + EDGE_BAND - 1 ) / EDGE_BAND;
+    uint32_t* verticalPrefix = (uint32_t*) malloc( sizeof( uint32_t ) * (size_t)( bandsY + 1 ) * width );
+    uint32_t* horizontalPrefix = (uint32_t*) malloc( sizeof( uint32_t ) * (size_t)( bandsX + 1 ) * height );
+    uint8_t* luma = (uint8_t*) malloc( (size_t) width * 3 );
+    uint16_t* columnHits = (uint16_t*) calloc( (size_t) width, sizeof( uint16_t ) );
+    uint32_t* bandHits = (uint32_t*) malloc( sizeof( uint32_t ) * bandsX );
+    if( !verticalPrefix || !horizontalPrefix || !luma || !columnHits || !bandHits ) {
+        free( verticalPrefix );
+        free( horizontalPrefix );
+        free( luma );
+        free( columnHits );
+        free( bandHits );
+        return 0;
+    }
+
+    memset( verticalPrefix, 0, sizeof( uint32_t ) * width );
+    for( int y = 0; y < height; ++y ) {
+        horizontalPrefix[ y ] = 0;
+    }
+
+    // Rolling window of three luma rows
+    uint8_t* rows[ 3 ] = { luma, luma + width, luma + width * 2 };
+    lumaRow( pixelRow( frame, 0 ), rows[ 0 ], width );
+    lumaRow( pixelRow( frame, 1 ), rows[ 1 ], width );
+    for( int y = 0; y < height; ++y ) {
+        memset( bandHits, 0, sizeof( uint32_t ) * bandsX );
+        if( y > 0 && y < height - 1 ) {
+            lumaRow( pixelRow( frame, y + 1 ), rows[ 2 ], width );
+            edgeRow( rows[ 0 ], rows[ 1 ], rows[ 2 ], width, columnHits, bandHits );
+            uint8_t* t = rows[ 0 ];
+            rows[ 0 ] = rows[ 1 ];
+            rows[ 1 ] = rows[ 2 ];
+            rows[ 2 ] = t;
+        }
+
+        // Horizontal edges: accumulate this row's hits over the column bands
+        uint32_t sum = 0;
+        for( int b = 0; b < bandsX; ++b ) {
+            sum += bandHits[ b ];
+            horizontalPrefix[ (size_t)( b + 1 ) * height + y ] = sum;
+        }
+
+        // Vertical edges: at the end of each row band, fold the column hits into the prefix sums
+        if( ( y + 1 ) % EDGE_BAND == 0 || y == height - 1 ) {
+            int band = y / EDGE_BAND;
+            uint32_t const* prev = verticalPrefix + (size_t) band * width;
+            uint32_t* next = verticalPrefix + (size_t)( band + 1 ) * width;
+            for( int x = 0; x < width; ++x ) {
+                next[ x ] = prev[ x ] + columnHits[ x ];
+            }
+            memset( columnHits, 0, sizeof( uint16_t ) * width );
+        }
+    }
+
+    free( luma );
+    free( columnHits );
+    free( bandHits );
+    map->width = width;
+    map->height = height;
+    map->bandsX = bandsX;
+    map->bandsY = bandsY;
+    map->verticalPrefix = verticalPrefix;
+    map->horizontalPrefix = horizontalPrefix;
+    return 1;
+}
+
+
+static void releaseEdgeMap( struct EdgeMap* map ) {
+    free( map->verticalPrefix );
+    free( map->horizontalPrefix );
+    memset( map, 0, sizeof( *map ) );
+}
+
+
+// Find the strongest edge within `radius` of `pos`, along a segment covering [from, to) on the other axis. `prefix`,
+// `length` and `bands` describe one of the two projections. Returns `pos` unchanged if there is no strong edge.
+static int snapToEdge( uint32_t const* prefix, int length, int bands, int span, int pos, int from, int to,
+    int radius ) {
+
+    if( from > to ) {
+        int t = from;
+        from = to;
+        to = t;
+    }
+    if( from < 0 ) {
+        from = 0;
+    }
+    if( to >= span ) {
+        to = span - 1;
+    }
+    if( from > to ) {
+        return pos;
+    }
+    // The segment is rounded out to whole bands
+    int b0 = from / EDGE_BAND;
+    int b1 = to / EDGE_BAND + 1;
+    if( b1 > bands ) {
+        b1 = bands;
+    }
+    int covered = ( b1 * EDGE_BAND < span ? b1 * EDGE_BAND : span ) - b0 * EDGE_BAND;
+    uint32_t const* lo = prefix + (size_t) b0 * length;
+    uint32_t const* hi = prefix + (size_t) b1 * length;
+
+    int best = pos;
+    uint32_t bestHits = (uint32_t)( covered * EDGE_SNAP_RATIO );
+    for( int d = 0; d <= radius; ++d ) {
+        // Check closest candidates first, so ties go to the one nearest the cursor
+        int candidates[ 2 ] = { pos - d, pos + d };
+        for( int i = 0; i < ( d ? 2 : 1 ); ++i ) {
+            int c = candidates[ i ];
+            if( c >= 0 && c < length && hi[ c ] - lo[ c ] > bestHits ) {
+                bestHits = hi[ c ] - lo[ c ];
+                best = c;
+            }
+        }
+    }
+    return best;
+}
+
+
+// Snap the x coordinate of a vertical selection edge spanning rows [y0, y1]
+static int snapEdgeX( struct EdgeMap const* map, int x, int y0, int y1, int radius ) {
+    if( !map->verticalPrefix ) {
+        return x;
+    }
+    return snapToEdge( map->verticalPrefix, map->width, map->bandsY, map->height, x, y0, y1, radius );
+}
+
+
+// Snap the y coordinate of a horizontal selection edge spanning columns [x0, x1]
+static int snapEdgeY( struct EdgeMap const* map, int y, int x0, int x1, int radius ) {
+    if( !map->horizontalPrefix ) {
+        return y;
+    }
+    return snapToEdge( map->horizontalPrefix, map->height, map->bandsX, map->width, y, x0, x1, radius );
+}
@@ -0,0 +1,211 @@
+// Index for an on-disk cache of encoded images, keyed by a hash of the content they were encoded from. The index only
+// tracks keys, sizes and recency - storing, copying and deleting the files themselves is left to the caller, so this
+// part stays portable. When the total size goes over the cap, the least recently used entries are evicted.
+
+
+int const ENCODE_CACHE_VERSION = 1;
+uint64_t const ENCODE_CACHE_SEED = 1; // Part of every key. Change it whenever the output for an image changes
+
+
+struct EncodeCacheEntry {
+    uint64_t key;
+    uint64_t size; // Size of the cached file, in bytes
+    uint64_t lastUsed; // Value of `EncodeCache::clock` when the entry was last stored or found
+};
+
+
+struct EncodeCache {
+    uint64_t maxSize; // Cap on the total size of all cached files
+    uint64_t totalSize;
+    uint64_t clock; // Ticks once per lookup or insert, for LRU ordering
+    int count;
+    int capacity;
+    struct EncodeCacheEntry* entries;
+    int slotCount; // Open addressing hash table from key to entry index + 1 (0 for empty). Always a power of two
+    int* slots;
+    uint64_t hits; // Lookup statistics since the index was created or loaded
+    uint64_t misses;
+};
+
+
+// Key of the entry for `pixels` encoded with the codec at `codecIndex`. The same pixels in another format, or with any
+// pixel changed, get another key
+static uint64_t encodeCacheKey( struct PixelBuffer const* pixels, int codecIndex ) {
+    return hashPixels( pixels, ENCODE_CACHE_SEED + (uint64_t) codecIndex );
+}
+
+
+// Slot holding `key`, or the empty slot where it would go
+static int findCacheSlot( struct EncodeCache const* cache, uint64_t key ) {
+    int mask = cache->slotCount - 1;
+    int slot = (int)( hashAvalanche( key ) & mask );
+    while( cache->slots[ slot ] && cache->entries[ cache->slots[ slot ] - 1 ].key != key ) {
+        slot = ( slot + 1 ) & mask;
+    }
+    return slot;
+}
+
+
+// Rebuild the hash table, with room for at least twice the number of entries
+static int rehashEncodeCache( struct EncodeCache* cache ) {
+    int slotCount = cache->slotCount ? cache->slotCount : 64;
+    while( slotCount < cache->capacity * 2 ) {
+        slotCount *= 2;
+    }
+    if( slotCount != cache->slotCount ) {
+        int* slots = (int*) realloc( cache->slots, sizeof( int ) * slotCount );
+        if( !slots ) {
+            return 0;
+        }
+        cache->slots = slots;
+        cache->slotCount = slotCount;
+    }
+    memset( cache->slots, 0, sizeof( int ) * cache->slotCount );
+    for( int i = 0; i < cache->count; ++i ) {
+        cache->slots[ findCacheSlot( cache, cache->entries[ i ].key ) ] = i + 1;
+    }
+    return 1;
+}
+
+
+static int initEncodeCache( struct EncodeCache* cache, uint64_t maxSize ) {
+    memset( cache, 0, sizeof( *cache ) );
+    cache->maxSize = maxSize;
+    return rehashEncodeCache( cache );
+}
+
+
+static void releaseEncodeCache( struct EncodeCache* cache ) {
+    free( cache->entries );
+    free( cache->slots );
+    memset( cache, 0, sizeof( *cache ) );
+}
+
+
+// Returns the entry for `key` and marks it as recently used, or NULL if it is not cached
+static struct EncodeCacheEntry* lookupEncodeCache( struct EncodeCache* cache, uint64_t key ) {
+    ++cache->clock;
+    int index = cache->slots[ findCacheSlot( cache, key ) ] - 1;
+    if( index < 0 ) {
+        ++cache->misses;
+        return NULL;
+    }
+    ++cache->hits;
+    cache->entries[ index ].lastUsed = cache->clock;
+    return &cache->entries[ index ];
+}
+
+
+// Drops the entry for `key`, if there is one. Used when the file has gone missing, and for eviction
+static void removeEncodeCacheEntry( struct EncodeCache* cache, uint64_t key ) {
+    int index = cache->slots[ findCacheSlot( cache, key ) ] - 1;
+    if( index < 0 ) {
+        return;
+    }
+    cache->totalSize -= cache->entries[ index ].size;
+    cache->entries[ index ] = cache->entries[ --cache->count ];
+    rehashEncodeCache( cache ); // Removals are rare, so simpler than deleting from the open addressing table
+}
+
+
+// Adds or updates the entry for `key`, then evicts least recently used entries until the total size is within the
+// cap. The keys of evicted entries are written to `evicted`, so the caller can delete their files. At most
+// `maxEvicted` entries go at once, so none is dropped without its key being reported; whatever is still over the cap
+// goes on later inserts. The new entry itself is never evicted, even if it is larger than the cap. Returns the number
+// of evicted entries, or -1 if out of memory.
+static int insertEncodeCache( struct EncodeCache* cache, uint64_t key, uint64_t size, uint64_t* evicted,
+    int maxEvicted ) {
+
+    ++cache->clock;
+    int slot = findCacheSlot( cache, key );
+    if( cache->slots[ slot ] ) {
+        struct EncodeCacheEntry* entry = &cache->entries[ cache->slots[ slot ] - 1 ];
+        cache->totalSize += size - entry->size;
+        entry->size = size;
+        entry->lastUsed = cache->clock;
+    } else {
+        if( cache->count >= cache->capacity ) {
+            int capacity = cache->capacity ? cache->capacity * 2 : 64;
+            struct EncodeCacheEntry* entries = (struct EncodeCacheEntry*) realloc( cache->entries,
+                sizeof( struct EncodeCacheEntry ) * capacity );
+            if( !entries ) {
+                return -1;
+            }
+            cache->entries = entries;
+            cache->capacity = capacity;
+            if( !rehashEncodeCache( cache ) ) {
+                return -1;
+            }
+            slot = findCacheSlot( cache, key );
+        }
+        struct EncodeCacheEntry entry = { key, size, cache->clock };
+        cache->entries[ cache->count++ ] = entry;
+        cache->slots[ slot ] = cache->count;
+        cache->totalSize += size;
+    }
+
+    // Evict in LRU order. A linear scan per eviction is fine, since only a few entries go at a time
+    int evictedCount = 0;
+    while( cache->totalSize > cache->maxSize && cache->count > 1 && evictedCount < maxEvicted ) {
+        int oldest = -1;
+        for( int i = 0; i < cache->count; ++i ) {
+            if( cache->entries[ i ].key != key && ( oldest < 0 ||
+                cache->entries[ i ].lastUsed < cache->entries[ oldest ].lastUsed ) ) {
+                oldest = i;
+            }
+        }
+        uint64_t oldestKey = cache->entries[ oldest ].key;
+        evicted[ evictedCount++ ] = oldestKey;
+        removeEncodeCacheEntry( cache, oldestKey );
+    }
+    return evictedCount;
+}
+
+
+// Index file: "SSEC", version byte, varint clock, varint entry count, then key (8 bytes little endian), varint size
+// and varint last use for each entry
+static void writeEncodeCacheIndex( struct EncodeCache const* cache, struct ByteBuffer* out ) {
+    appendBytes( out, "SSEC", 4 );
+    appendByte( out, (uint8_t) ENCODE_CACHE_VERSION );
+    appendVarint( out, cache->clock );
+    appendVarint( out, (uint64_t) cache->count );
+    for( int i = 0; i < cache->count; ++i ) {
+        appendUint32( out, (uint32_t) cache->entries[ i ].key );
+        appendUint32( out, (uint32_t)( cache->entries[ i ].key >> 32 ) );
+        appendVarint( out, cache->entries[ i ].size );
+        appendVarint( out, cache->entries[ i ].lastUsed );
+    }
+}
+
+
+// Loads an index written by `writeEncodeCacheIndex` into an empty cache. A missing or damaged index just means an
+// empty cache, so it returns zero and leaves the cache empty rather than failing. Nothing is evicted while loading,
+// even if the cap has been lowered since - that happens on the next inserts, which report the keys to delete
+static int readEncodeCacheIndex( uint8_t const* data, size_t size, struct EncodeCache* cache ) {
+    struct ByteReader reader = { data, size, 0, 0 };
+    uint8_t const* magic = readBytes( &reader, 4 );
+    if( !magic || memcmp( magic, "SSEC", 4 ) != 0 || readByte( &reader ) != ENCODE_CACHE_VERSION ) {
+        return 0;
+    }
+    uint64_t maxSize = cache->maxSize;
+    cache->maxSize = UINT64_MAX;
+    uint64_t clock = readVarint( &reader );
+    uint64_t count = readVarint( &reader );
+    for( uint64_t i = 0; i < count && !reader.failed; ++i ) {
+        uint64_t key = readUint32( &reader );
+        key |= (uint64_t) readUint32( &reader ) << 32;
+        uint64_t entrySize = readVarint( &reader );
+        uint64_t lastUsed = readVarint( &reader );
+        if( !reader.failed && insertEncodeCache( cache, key, entrySize, NULL, 0 ) >= 0 ) {
+            cache->entries[ cache->slots[ findCacheSlot( cache, key ) ] - 1 ].lastUsed = lastUsed;
+        }
+    }
+    cache->maxSize = maxSize;
+    if( reader.failed ) {
+        releaseEncodeCache( cache );
+        initEncodeCache( cache, maxSize );
+        return 0;
+    }
+    cache->clock = clock > cache->clock ? clock : cache->clock;
+    return 1;
+}
@@ -0,0 +1,89 @@
+// Paces repaints to the display refresh. Changes only mark the scheduler dirty; a frame is rendered when something is
+// dirty, at most once per refresh interval, and never when nothing changed. Refreshes happen at `phase` plus whole
+// multiples of `interval`, and a frame is due at the first refresh after it begins. A frame begins as soon as it is
+// requested if it is expected to finish in time, and otherwise waits for the start of the next interval. The current
+// time is always passed in, so the scheduler can be driven by any clock. Nothing in here depends on windows.h.
+
+
+struct FrameScheduler {
+    double interval; // Time between display refreshes, in milliseconds
+    double phase; // Time of any past refresh
+    int dirty; // Set if anything changed since the last frame began
+    double nextFrame; // The next frame may not begin before this refresh
+    double started; // When the frame being rendered began
+    double deadline; // Refresh the frame being rendered is due at
+    double renderTime; // Running average of the time a frame takes to render
+    uint64_t requests; // Number of changes made. Without pacing, each could have caused a repaint
+    uint64_t frames; // Number of frames rendered
+    uint64_t missed; // Number of frames which finished after their deadline
+};
+
+
+static void initFrameScheduler( struct FrameScheduler* scheduler, double interval, double phase ) {
+    memset( scheduler, 0, sizeof( *scheduler ) );
+    scheduler->interval = interval;
+    scheduler->phase = phase;
+    scheduler->nextFrame = phase;
+}
+
+
+// Updates the refresh clock, if the display (or the measurement of it) changed
+static void setFrameClock( struct FrameScheduler* scheduler, double interval, double phase ) {
+    if( interval > 0.0 ) {
+        scheduler->interval = interval;
+        scheduler->phase = phase;
+    }
+}
+
+
+static void markFrameDirty( struct FrameScheduler* scheduler ) {
+    scheduler->dirty = 1;
+    ++scheduler->requests;
+}
+
+
+// Start of the refresh interval containing `time`. Times within a hair of a refresh count as after it, so rounding
+// can't put a frame beginning right on a refresh into the interval before
+static double frameIntervalStart( struct FrameScheduler const* scheduler, double time ) {
+    return scheduler->phase + floor( ( time - scheduler->phase ) / scheduler->interval + 1e-6 ) * scheduler->interval;
+}
+
+
+// Milliseconds until a frame should begin: zero to render right away, or negative if nothing needs rendering
+static double frameDelay( struct FrameScheduler const* scheduler, double now ) {
+    if( !scheduler->dirty ) {
+        return -1.0;
+    }
+    double begin = now > scheduler->nextFrame ? now : scheduler->nextFrame;
+    double start = frameIntervalStart( scheduler, begin );
+    if( begin - start > 1e-3 && begin - start + scheduler->renderTime > scheduler->interval ) {
+        begin = start + scheduler->interval;
+    }
+    return begin - now > 1e-3 ? begin - now : 0.0;
+}
+
+
+// Returns non-zero if a frame should be rendered now, in which case call `endFrame` when it is done
+static int beginFrame( struct FrameScheduler* scheduler, double now ) {
+    if( frameDelay( scheduler, now ) != 0.0 ) {
+        return 0;
+    }
+    scheduler->dirty = 0;
+    scheduler->started = now;
+    scheduler->deadline = frameIntervalStart( scheduler, now ) + scheduler->interval;
+    scheduler->nextFrame = scheduler->deadline;
+    ++scheduler->frames;
+    return 1;
+}
+
+
+// Returns non-zero if the frame was done in time
+static int endFrame( struct FrameScheduler* scheduler, double now ) {
+    double duration = now - scheduler->started;
+    scheduler->renderTime = scheduler->frames > 1 ? scheduler->renderTime * 0.75 + duration * 0.25 : duration;
+    if( now > scheduler->deadline ) {
+        ++scheduler->missed;
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,159 @@
+// Fast 64-bit non-cryptographic hash for content addressing, in the style of XXH3: eight 64-bit accumulators are fed
+// 64-byte stripes, each lane mixed with a 32x32->64 bit multiply of the data xor'ed with a key, and scrambled every
+// 1 KB. The SSE2 and scalar versions give identical results. It is not compatible with XXH3 itself. Nothing in here
+// depends on windows.h.
+
+
+int const HASH_STRIPE = 64; // Bytes consumed per accumulation step
+int const HASH_STRIPES_PER_BLOCK = 16; // Accumulators are scrambled after this many stripes
+
+uint64_t const HASH_PRIME32_1 = 0x9e3779b1ull;
+uint64_t const HASH_PRIME64_1 = 0x9e3779b185ebca87ull;
+uint64_t const HASH_PRIME64_2 = 0xc2b2ae3d27d4eb4full;
+uint64_t const HASH_PRIME64_3 = 0x165667b19e3779f9ull;
+
+
+struct HashState {
+    uint64_t acc[ 8 ];
+    uint64_t keys[ 16 ]; // Stripe `s` uses keys `s % 8` to `s % 8 + 7`, and the scramble uses keys 8 to 15
+    uint8_t buffer[ 64 ]; // Input not yet making up a full stripe
+    size_t buffered;
+    uint64_t length; // Total number of bytes hashed
+    int stripe; // Stripe number within the current block
+};
+
+
+static uint64_t hashRead64( uint8_t const* p ) {
+    uint64_t value;
+    memcpy( &value, p, sizeof( value ) ); // Little endian on every platform we build for
+    return value;
+}
+
+
+static uint64_t hashAvalanche( uint64_t h ) {
+    h ^= h >> 37;
+    h *= 0x165667919e3779f9ull;
+    h ^= h >> 32;
+    return h;
+}
+
+
+// Low 64 bits xor high 64 bits, of the 128-bit product of `a` and `b`
+static uint64_t hashFoldMultiply( uint64_t a, uint64_t b ) {
+    uint64_t lo = ( a & 0xffffffff ) * ( b & 0xffffffff );
+    uint64_t mid1 = ( a >> 32 ) * ( b & 0xffffffff );
+    uint64_t mid2 = ( a & 0xffffffff ) * ( b >> 32 );
+    uint64_t hi = ( a >> 32 ) * ( b >> 32 );
+    uint64_t cross = ( lo >> 32 ) + ( mid1 & 0xffffffff ) + ( mid2 & 0xffffffff );
+    uint64_t low = ( cross << 32 ) | ( lo & 0xffffffff );
+    uint64_t high = hi + ( mid1 >> 32 ) + ( mid2 >> 32 ) + ( cross >> 32 );
+    return low ^ high;
+}
+
+
+static void hashInit( struct HashState* state, uint64_t seed ) {
+    memset( state, 0, sizeof( *state ) );
+    uint64_t const initial[ 8 ] = { HASH_PRIME32_1, HASH_PRIME64_1, HASH_PRIME64_2, HASH_PRIME64_3,
+        HASH_PRIME64_1 ^ HASH_PRIME64_2, HASH_PRIME64_2 ^ HASH_PRIME64_3, HASH_PRIME64_3 ^ HASH_PRIME32_1,
+        HASH_PRIME64_1 + HASH_PRIME64_3 };
+    memcpy( state->acc, initial, sizeof( initial ) );
+    // Derive the keys from the seed with a simple generator
+    uint64_t k = seed ^ HASH_PRIME64_3;
+    for( int i = 0; i < 16; ++i ) {
+        k = hashAvalanche( k + HASH_PRIME64_1 );
+        state->keys[ i ] = k;
+    }
+}
+
+
+// One 64-byte stripe: each lane gets the product of the low and high halves of (data ^ key), plus the data of its
+// neighboring lane
+static void hashStripe( struct HashState* state, uint8_t const* data ) {
+    uint64_t const* keys = state->keys + ( state->stripe & 7 );
+    #ifdef PIXELS_SSE2
+        for( int i = 0; i < 8; i += 2 ) {
+            __m128i d = _mm_loadu_si128( (__m128i const*)( data + i * 8 ) );
+            __m128i k = _mm_loadu_si128( (__m128i const*)( keys + i ) );
+            __m128i dk = _mm_xor_si128( d, k );
+            __m128i product = _mm_mul_epu32( dk, _mm_shuffle_epi32( dk, _MM_SHUFFLE( 0, 3, 0, 1 ) ) );
+            __m128i swapped = _mm_shuffle_epi32( d, _MM_SHUFFLE( 1, 0, 3, 2 ) );
+            __m128i acc = _mm_loadu_si128( (__m128i const*)( state->acc + i ) );
+            acc = _mm_add_epi64( acc, _mm_add_epi64( product, swapped ) );
+            _mm_storeu_si128( (__m128i*)( state->acc + i ), acc );
+        }
+    #else
+        for( int i = 0; i < 8; ++i ) {
+            uint64_t dk = hashRead64( data + i * 8 ) ^ keys[ i ];
+            state->acc[ i ] += ( dk & 0xffffffff ) * ( dk >> 32 ) + hashRead64( data + ( i ^ 1 ) * 8 );
+        }
+    #endif
+    if( ++state->stripe == HASH_STRIPES_PER_BLOCK ) {
+        // Scramble, so high bits of the accumulators feed back into the low bits
+        for( int i = 0; i < 8; ++i ) {
+            uint64_t acc = state->acc[ i ];
+            acc ^= acc >> 47;
+            acc ^= state->keys[ 8 + i ];
+            state->acc[ i ] = acc * HASH_PRIME32_1;
+        }
+        state->stripe = 0;
+    }
+}
+
+
+static void hashUpdate( struct HashState* state, void const* data, size_t size ) {
+    uint8_t const* bytes = (uint8_t const*) data;
+    state->length += size;
+    if( state->buffered > 0 ) {
+        size_t count = HASH_STRIPE - state->buffered < size ? HASH_STRIPE - state->buffered : size;
+        memcpy( state->buffer + state->buffered, bytes, count );
+        state->buffered += count;
+        bytes += count;
+        size -= count;
+        if( state->buffered < (size_t) HASH_STRIPE ) {
+            return;
+        }
+        hashStripe( state, state->buffer );
+        state->buffered = 0;
+    }
+    for( ; size >= (size_t) HASH_STRIPE; size -= HASH_STRIPE, bytes += HASH_STRIPE ) {
+        hashStripe( state, bytes );
+    }
+    memcpy( state->buffer, bytes, size );
+    state->buffered = size;
+}
+
+
+// The hash of everything passed to `hashUpdate` so far. The state is left as it is, so more data can still be added
+static uint64_t hashDigest( struct HashState const* state ) {
+    struct HashState tail = *state;
+    if( tail.buffered > 0 ) {
+        memset( tail.buffer + tail.buffered, 0, HASH_STRIPE - tail.buffered );
+        hashStripe( &tail, tail.buffer );
+    }
+    uint64_t h = tail.length * HASH_PRIME64_1;
+    for( int i = 0; i < 8; i += 2 ) {
+        h += hashFoldMultiply( tail.acc[ i ] ^ tail.keys[ i ], tail.acc[ i + 1 ] ^ tail.keys[ i + 1 ] );
+    }
+    return hashAvalanche( h );
+}
+
+
+static uint64_t hashBytes( void const* data, size_t size, uint64_t seed ) {
+    struct HashState state;
+    hashInit( &state, seed );
+    hashUpdate( &state, data, size );
+    return hashDigest( &state );
+}
+
+
+// Hash of the pixels of `buffer`, along with its size. Padding beyond each row is not included
+static uint64_t hashPixels( struct PixelBuffer const* buffer, uint64_t seed ) {
+    struct HashState state;
+    hashInit( &state, seed );
+    int32_t size[ 2 ] = { buffer->width, buffer->height };
+    hashUpdate( &state, size, sizeof( size ) );
+    for( int y = 0; y < buffer->height; ++y ) {
+        hashUpdate( &state, pixelRow( buffer, y ), sizeof( uint32_t ) * buffer->width );
+    }
+    return hashDigest( &state );
+}
@@ -0,0 +1,306 @@
+// Output formats for saved snippets, and a registry to pick one by name or file extension. Besides PNG there are two
+// formats for handing the image to a process on the same machine, where deflate is wasted time: QOI (a simple
+// lossless format which still gets screenshots down to a fraction of their size) and raw BGRA pixels behind a small
+// header. Both write straight from the pixel rows, and come with decoders. Nothing in here depends on windows.h.
+#include <wchar.h>
+#include <wctype.h>
+
+
+int const QOI_HEADER_SIZE = 14;
+int const QOI_END_SIZE = 8;
+int const RAW_HEADER_SIZE = 12;
+
+
+// QOI, as specified at qoiformat.org. Written with 3 channels, as screen captures have no meaningful alpha
+static int encodeQoi( struct PixelBuffer const* pixels, double budgetMs, struct ByteBuffer* out ) {
+    (void) budgetMs;
+    size_t maxSize = (size_t) QOI_HEADER_SIZE + (size_t) pixels->width * pixels->height * 4 + QOI_END_SIZE;
+    if( !reserveBytes( out, maxSize ) ) {
+        return 0;
+    }
+    uint8_t* p = out->data + out->size;
+    uint8_t const header[ QOI_HEADER_SIZE ] = { 'q', 'o', 'i', 'f', (uint8_t)( pixels->width >> 24 ),
+        (uint8_t)( pixels->width >> 16 ), (uint8_t)( pixels->width >> 8 ), (uint8_t) pixels->width,
+        (uint8_t)( pixels->height >> 24 ), (uint8_t)( pixels->height >> 16 ), (uint8_t)( pixels->height >> 8 ),
+        (uint8_t) pixels->height, 3, 0 }; // 3 channels, sRGB
+    memcpy( p, header, QOI_HEADER_SIZE );
+    p += QOI_HEADER_SIZE;
+
+    uint32_t index[ 64 ] = { 0 };
+    uint32_t previous = 0xff000000; // BGRA, opaque black
+    int run = 0;
+    for( int y = 0; y < pixels->height; ++y ) {
+        uint32_t const* row = pixelRow( pixels, y );
+        for( int x = 0; x < pixels->width; ++x ) {
+            uint32_t pixel = row[ x ] | 0xff000000;
+            if( pixel == previous ) {
+                if( ++run == 62 ) {
+                    *p++ = (uint8_t)( 0xc0 | ( run - 1 ) ); // QOI_OP_RUN
+                    run = 0;
+                }
+                continue;
+            }
+            if( run > 0 ) {
+                *p++ = (uint8_t)( 0xc0 | ( run - 1 ) );
+                run = 0;
+            }
+            int r = (int)( ( pixel >> 16 ) & 0xff );
+            int g = (int)( ( pixel >> 8 ) & 0xff );
+            int b = (int)( pixel & 0xff );
+            int slot = ( r * 3 + g * 5 + b * 7 + 255 * 11 ) & 63;
+            if( index[ slot ] == pixel ) {
+                *p++ = (uint8_t) slot; // QOI_OP_INDEX
+            } else {
+                index[ slot ] = pixel;
+                int dr = (int8_t)( r - (int)( ( previous >> 16 ) & 0xff ) );
+                int dg = (int8_t)( g - (int)( ( previous >> 8 ) & 0xff ) );
+                int db = (int8_t)( b - (int)( previous & 0xff ) );
+                int drg = dr - dg;
+                int dbg = db - dg;
+                if( dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1 ) {
+                    *p++ = (uint8_t)( 0x40 | ( ( dr + 2 ) << 4 ) | ( ( dg + 2 ) << 2 ) | ( db + 2 ) ); // QOI_OP_DIFF
+                } else if( dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7 ) {
+                    *p++ = (uint8_t)( 0x80 | ( dg + 32 ) ); // QOI_OP_LUMA
+                    *p++ = (uint8_t)( ( ( drg + 8 ) << 4 ) | ( dbg + 8 ) );
+                } else {
+                    *p++ = 0xfe; // QOI_OP_RGB
+                    *p++ = (uint8_t) r;
+                    *p++ = (uint8_t) g;
+                    *p++ = (uint8_t) b;
+                }
+            }
+            previous = pixel;
+        }
+    }
+    if( run > 0 ) {
+        *p++ = (uint8_t)( 0xc0 | ( run - 1 ) );
+    }
+    uint8_t const end[ QOI_END_SIZE ] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    memcpy( p, end, QOI_END_SIZE );
+    p += QOI_END_SIZE;
+    out->size = (size_t)( p - out->data );
+    return 1;
+}
+
+
+// Decodes a QOI image (3 or 4 channels) into a newly allocated top-down BGRA buffer, which the caller must free.
+// Returns zero for anything malformed or truncated
+static int decodeQoi( uint8_t const* data, size_t size, struct PixelBuffer* pixels ) {
+    pixels->pixels = NULL;
+    if( size < (size_t)( QOI_HEADER_SIZE + QOI_END_SIZE ) || memcmp( data, "qoif", 4 ) != 0 ) {
+        return 0;
+    }
+    uint32_t width = ( (uint32_t) data[ 4 ] << 24 ) | ( (uint32_t) data[ 5 ] << 16 ) | ( (uint32_t) data[ 6 ] << 8 ) |
+        data[ 7 ];
+    uint32_t height = ( (uint32_t) data[ 8 ] << 24 ) | ( (uint32_t) data[ 9 ] << 16 ) | ( (uint32_t) data[ 10 ] << 8 ) |
+        data[ 11 ];
+    if( width == 0 || height == 0 || width > 65536 || height > 65536 || ( data[ 12 ] != 3 && data[ 12 ] != 4 ) ) {
+        return 0;
+    }
+    size_t count = (size_t) width * height;
+    uint32_t* out = (uint32_t*) malloc( sizeof( uint32_t ) * count );
+    if( !out ) {
+        return 0;
+    }
+
+    uint32_t index[ 64 ] = { 0 };
+    uint32_t pixel = 0xff000000;
+    size_t position = QOI_HEADER_SIZE;
+    size_t end = size - QOI_END_SIZE;
+    size_t i = 0;
+    while( i < count ) {
+        if( position >= end ) {
+            free( out );
+            return 0;
+        }
+        int op = data[ position++ ];
+        int run = 1;
+        if( op == 0xfe || op == 0xff ) {
+            if( position + ( op == 0xff ? 4 : 3 ) > end ) {
+                free( out );
+                return 0;
+            }
+            pixel = ( pixel & 0xff000000 ) | ( (uint32_t) data[ position ] << 16 ) |
+                ( (uint32_t) data[ position + 1 ] << 8 ) | data[ position + 2 ];
+            position += 3;
+            if( op == 0xff ) {
+                pixel = ( pixel & 0xffffff ) | ( (uint32_t) data[ position++ ] << 24 );
+            }
+        } else if( ( op & 0xc0 ) == 0x00 ) {
+            pixel = index[ op ];
+        } else if( ( op & 0xc0 ) == 0x40 ) {
+            int r = (int)( ( pixel >> 16 ) & 0xff ) + ( ( op >> 4 ) & 3 ) - 2;
+            int g = (int)( ( pixel >> 8 ) & 0xff ) + ( ( op >> 2 ) & 3 ) - 2;
+            int b = (int)( pixel & 0xff ) + ( op & 3 ) - 2;
+            pixel = ( pixel & 0xff000000 ) | ( (uint32_t)( r & 0xff ) << 16 ) | ( (uint32_t)( g & 0xff ) << 8 ) |
+                (uint32_t)( b & 0xff );
+        } else if( ( op & 0xc0 ) == 0x80 ) {
+            if( position >= end ) {
+                free( out );
+                return 0;
+            }
+            int next = data[ position++ ];
+            int dg = ( op & 0x3f ) - 32;
+            int r = (int)( ( pixel >> 16 ) & 0xff ) + dg + ( next >> 4 ) - 8;
+            int g = (int)( ( pixel >> 8 ) & 0xff ) + dg;
+            int b = (int)( pixel & 0xff ) + dg + ( next & 15 ) - 8;
+            pixel = ( pixel & 0xff000000 ) | ( (uint32_t)( r & 0xff ) << 16 ) | ( (uint32_t)( g & 0xff ) << 8 ) |
+                (uint32_t)( b & 0xff );
+        } else {
+            run = ( op & 0x3f ) + 1;
+        }
+        int slot = ( (int)( ( pixel >> 16 ) & 0xff ) * 3 + (int)( ( pixel >> 8 ) & 0xff ) * 5 +
+            (int)( pixel & 0xff ) * 7 + (int)( pixel >> 24 ) * 11 ) & 63;
+        index[ slot ] = pixel;
+        for( ; run > 0 && i < count; --run ) {
+            out[ i++ ] = pixel;
+        }
+    }
+    pixels->pixels = out;
+    pixels->width = (int) width;
+    pixels->height = (int) height;
+    pixels->stride = (int) width;
+    return 1;
+}
+
+
+// Copies `count` pixels with their alpha set to opaque. `out` may be `in`
+static void opaqueRowScalar( uint32_t* out, uint32_t const* in, int count ) {
+    for( int x = 0; x < count; ++x ) {
+        out[ x ] = in[ x ] | 0xff000000;
+    }
+}
+
+
+#ifdef PIXELS_SSE2
+    static void opaqueRowSse2( uint32_t* out, uint32_t const* in, int count ) {
+        __m128i const opaque = _mm_set1_epi32( (int) 0xff000000 );
+        int x = 0;
+        for( ; x + 4 <= count; x += 4 ) {
+            __m128i v = _mm_loadu_si128( (__m128i const*)( in + x ) );
+            _mm_storeu_si128( (__m128i*)( out + x ), _mm_or_si128( v, opaque ) );
+        }
+        opaqueRowScalar( out + x, in + x, count - x );
+    }
+#endif
+
+
+#ifdef PIXELS_AVX2
+    CPU_TARGET( "avx2" ) static void opaqueRowAvx2( uint32_t* out, uint32_t const* in, int count ) {
+        __m256i const opaque = _mm256_set1_epi32( (int) 0xff000000 );
+        int x = 0;
+        for( ; x + 8 <= count; x += 8 ) {
+            __m256i v = _mm256_loadu_si256( (__m256i const*)( in + x ) );
+            _mm256_storeu_si256( (__m256i*)( out + x ), _mm256_or_si256( v, opaque ) );
+        }
+        opaqueRowScalar( out + x, in + x, count - x );
+    }
+#endif
+
+
+static void opaqueRow( uint32_t* out, uint32_t const* in, int count ) {
+    cpuKernels.opaqueRow( out, in, count );
+}
+
+
+// Raw format: "BGRA", width and height as 32-bit little endian, then the rows top-down as 32-bit BGRA pixels with
+// opaque alpha
+static int encodeRaw( struct PixelBuffer const* pixels, double budgetMs, struct ByteBuffer* out ) {
+    (void) budgetMs;
+    if( !reserveBytes( out, RAW_HEADER_SIZE + sizeof( uint32_t ) * (size_t) pixels->width * pixels->height ) ) {
+        return 0;
+    }
+    appendBytes( out, "BGRA", 4 );
+    appendUint32( out, (uint32_t) pixels->width );
+    appendUint32( out, (uint32_t) pixels->height );
+    for( int y = 0; y < pixels->height; ++y ) {
+        uint32_t const* row = pixelRow( pixels, y );
+        opaqueRow( (uint32_t*)( out->data + out->size ), row, pixels->width );
+        out->size += sizeof( uint32_t ) * pixels->width;
+    }
+    return 1;
+}
+
+
+static int decodeRaw( uint8_t const* data, size_t size, struct PixelBuffer* pixels ) {
+    pixels->pixels = NULL;
+    struct ByteReader reader = { data, size, 0, 0 };
+    uint8_t const* magic = readBytes( &reader, 4 );
+    uint32_t width = readUint32( &reader );
+    uint32_t height = readUint32( &reader );
+    if( !magic || memcmp( magic, "BGRA", 4 ) != 0 || width > 65536 || height > 65536 ) {
+        return 0;
+    }
+    size_t bytes = sizeof( uint32_t ) * (size_t) width * height;
+    uint8_t const* source = readBytes( &reader, bytes );
+    if( !source ) {
+        return 0;
+    }
+    pixels->pixels = (uint32_t*) malloc( bytes ? bytes : 1 );
+    if( !pixels->pixels ) {
+        return 0;
+    }
+    memcpy( pixels->pixels, source, bytes );
+    pixels->width = (int) width;
+    pixels->height = (int) height;
+    pixels->stride = (int) width;
+    return 1;
+}
+
+
+// PNG goes through our own encoder: to a time budget if one is given, otherwise at a level which is a good balance
+// for screenshots. There is no decoder
+static int encodePngCodec( struct PixelBuffer const* pixels, double budgetMs, struct ByteBuffer* out ) {
+    if( budgetMs > 0.0 ) {
+        return encodePngBudgeted( pixels, budgetMs, out ) >= 0;
+    }
+    return encodePng( pixels, 2, 0, out );
+}
+
+
+struct ImageCodec {
+    wchar_t const* name; // As given to --format
+    wchar_t const* extension; // Lower case, including the dot
+    int (*encode)( struct PixelBuffer const* pixels, double budgetMs, struct ByteBuffer* out );
+    int (*decode)( uint8_t const* data, size_t size, struct PixelBuffer* pixels ); // NULL if there is no decoder
+};
+
+
+// The first entry is the default
+static struct ImageCodec const imageCodecs[] = {
+    { L"png", L".png", encodePngCodec, NULL },
+    { L"qoi", L".qoi", encodeQoi, decodeQoi },
+    { L"raw", L".bgra", encodeRaw, decodeRaw },
+};
+
+
+static struct ImageCodec const* findImageCodec( wchar_t const* name ) {
+    for( int i = 0; i < (int)( sizeof( imageCodecs ) / sizeof( *imageCodecs ) ); ++i ) {
+        if( wcscmp( imageCodecs[ i ].name, name ) == 0 ) {
+            return &imageCodecs[ i ];
+        }
+    }
+    return NULL;
+}
+
+
+// The codec for the extension of `filename` (compared ignoring case), or NULL if it is not one we know
+static struct ImageCodec const* findImageCodecForFilename( wchar_t const* filename ) {
+    size_t length = wcslen( filename );
+    for( int i = 0; i < (int)( sizeof( imageCodecs ) / sizeof( *imageCodecs ) ); ++i ) {
+        wchar_t const* extension = imageCodecs[ i ].extension;
+        size_t extensionLength = wcslen( extension );
+        if( length < extensionLength ) {
+            continue;
+        }
+        wchar_t const* tail = filename + length - extensionLength;
+        size_t j = 0;
+        while( j < extensionLength && (wchar_t) towlower( tail[ j ] ) == extension[ j ] ) {
+            ++j;
+        }
+        if( j == extensionLength ) {
+            return &imageCodecs[ i ];
+        }
+    }
+    return NULL;
+}
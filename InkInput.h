@@ -0,0 +1,186 @@
+// Pointer input for freehand strokes. Mouse samples are queued as they arrive and committed to the stroke in one pass
+// per frame, rather than one repaint per sample. To hide the time between a sample arriving and the frame showing it,
+// the tip of the stroke is extrapolated a few milliseconds ahead, from a least squares fit over the last few samples.
+// The same samples give the width of the pen as it moves, from the pressure when the pointer is a pen that reports it,
+// or from the speed otherwise. Nothing in here depends on windows.h.
+
+
+int const INK_QUEUE_SIZE = 256; // Samples held between frames. When full, the newest sample replaces the last one
+int const INK_HISTORY_SIZE = 16; // Recent samples kept for prediction
+float const INK_PREDICT_WINDOW_MS = 40.0f; // Only samples this recent are used to fit the motion
+float const INK_MAX_PREDICT_MS = 24.0f; // Never extrapolate further than this past the newest sample
+float const INK_STALE_MS = 50.0f; // If no sample arrived for this long, the pointer has stopped: don't extrapolate
+float const INK_MAX_PREDICT_DISTANCE = 48.0f; // Cap on the distance from the newest sample to the predicted point
+float const INK_THINNEST = 0.4f; // Narrowest a pen gets, as a fraction of its full width
+float const INK_SLOW_SPEED = 0.2f; // Speed, in pixels per millisecond, up to which a pen is full width...
+float const INK_FAST_SPEED = 2.5f; // ...and from which it is at its narrowest, when there is no pressure
+float const INK_WIDTH_SMOOTHING = 0.5f; // How far the width moves towards the width at a new point
+
+
+struct InkSample {
+    float x;
+    float y;
+    double time; // In milliseconds, from any fixed starting point
+    float pressure; // From 0 to 1, or exactly 0 if the pointer doesn't report pressure
+};
+
+
+// Samples received since the last frame
+struct InkQueue {
+    int count;
+    struct InkSample samples[ INK_QUEUE_SIZE ];
+};
+
+
+// The most recent samples of the stroke, as a ring buffer
+struct InkPredictor {
+    int count;
+    int next; // Where the next sample goes
+    struct InkSample history[ INK_HISTORY_SIZE ];
+};
+
+
+static void queueInkSample( struct InkQueue* queue, float x, float y, double time, float pressure ) {
+    struct InkSample sample = { x, y, time, pressure };
+    if( queue->count < INK_QUEUE_SIZE ) {
+        queue->samples[ queue->count++ ] = sample;
+    } else {
+        queue->samples[ INK_QUEUE_SIZE - 1 ] = sample;
+    }
+}
+
+
+static void resetInkPredictor( struct InkPredictor* predictor ) {
+    predictor->count = 0;
+    predictor->next = 0;
+}
+
+
+static void addInkSample( struct InkPredictor* predictor, struct InkSample sample ) {
+    predictor->history[ predictor->next ] = sample;
+    predictor->next = ( predictor->next + 1 ) % INK_HISTORY_SIZE;
+    if( predictor->count < INK_HISTORY_SIZE ) {
+        ++predictor->count;
+    }
+}
+
+
+// The most recent sample, which must exist
+static struct InkSample const* newestInkSample( struct InkPredictor const* predictor ) {
+    return &predictor->history[ ( predictor->next + INK_HISTORY_SIZE - 1 ) % INK_HISTORY_SIZE ];
+}
+
+
+// Predicts where the pointer will be at `time`. Returns zero if there is nothing to extrapolate from, or the pointer
+// has stopped; otherwise `x` and `y` are set. Each axis is fitted with a quadratic in time by least squares over the
+// samples of the last INK_PREDICT_WINDOW_MS, which follows curves better than a straight line through the last two
+// samples, and averages out the jitter of integer mouse positions. With fewer than four samples, or when the samples
+// are too close together in time to fit a curve, it falls back to a straight line
+static int predictInk( struct InkPredictor const* predictor, double time, float* x, float* y ) {
+    if( predictor->count < 2 ) {
+        return 0;
+    }
+    struct InkSample const* newest = newestInkSample( predictor );
+    double ahead = time - newest->time;
+    if( ahead <= 0.0 || ahead > INK_STALE_MS ) {
+        return 0;
+    }
+    ahead = ahead < INK_MAX_PREDICT_MS ? ahead : INK_MAX_PREDICT_MS;
+
+    // Sums of powers of t (relative to the newest sample, so they stay small), and of x and y weighted by them
+    double s[ 5 ] = { 0.0 };
+    double sx[ 3 ] = { 0.0 };
+    double sy[ 3 ] = { 0.0 };
+    for( int i = 0; i < predictor->count; ++i ) {
+        struct InkSample const* sample = &predictor->history[ ( predictor->next + INK_HISTORY_SIZE - 1 - i ) %
+            INK_HISTORY_SIZE ];
+        double t = sample->time - newest->time;
+        if( t < -INK_PREDICT_WINDOW_MS ) {
+            break;
+        }
+        double dx = sample->x - newest->x;
+        double dy = sample->y - newest->y;
+        double p = 1.0;
+        for( int k = 0; k < 5; ++k ) {
+            if( k < 3 ) {
+                sx[ k ] += dx * p;
+                sy[ k ] += dy * p;
+            }
+            s[ k ] += p;
+            p *= t;
+        }
+    }
+
+    // Solve the normal equations by Cramer's rule. Positions are relative to the newest sample too, so only the
+    // velocity and acceleration terms matter for the extrapolation, and the constant term absorbs the jitter
+    double vx = 0.0;
+    double vy = 0.0;
+    double ax = 0.0;
+    double ay = 0.0;
+    double det3 = s[ 0 ] * ( s[ 2 ] * s[ 4 ] - s[ 3 ] * s[ 3 ] ) - s[ 1 ] * ( s[ 1 ] * s[ 4 ] - s[ 3 ] * s[ 2 ] ) +
+        s[ 2 ] * ( s[ 1 ] * s[ 3 ] - s[ 2 ] * s[ 2 ] );
+    double det2 = s[ 0 ] * s[ 2 ] - s[ 1 ] * s[ 1 ];
+    if( s[ 0 ] >= 4.0 && fabs( det3 ) > 1e-6 * s[ 0 ] * s[ 2 ] * s[ 4 ] ) {
+        double const* r[ 2 ] = { sx, sy };
+        double* v[ 2 ] = { &vx, &vy };
+        double* a[ 2 ] = { &ax, &ay };
+        for( int axis = 0; axis < 2; ++axis ) {
+            double const* b = r[ axis ];
+            *v[ axis ] = ( s[ 0 ] * ( b[ 1 ] * s[ 4 ] - s[ 3 ] * b[ 2 ] ) - b[ 0 ] * ( s[ 1 ] * s[ 4 ] - s[ 3 ] * s[ 2 ] ) +
+                s[ 2 ] * ( s[ 1 ] * b[ 2 ] - b[ 1 ] * s[ 2 ] ) ) / det3;
+            *a[ axis ] = ( s[ 0 ] * ( s[ 2 ] * b[ 2 ] - b[ 1 ] * s[ 3 ] ) - s[ 1 ] * ( s[ 1 ] * b[ 2 ] - b[ 1 ] * s[ 2 ] ) +
+                b[ 0 ] * ( s[ 1 ] * s[ 3 ] - s[ 2 ] * s[ 2 ] ) ) / det3;
+        }
+    } else if( fabs( det2 ) > 1e-6 * s[ 2 ] ) {
+        vx = ( s[ 0 ] * sx[ 1 ] - s[ 1 ] * sx[ 0 ] ) / det2;
+        vy = ( s[ 0 ] * sy[ 1 ] - s[ 1 ] * sy[ 0 ] ) / det2;
+    } else {
+        return 0;
+    }
+
+    double px = vx * ahead + ax * ahead * ahead;
+    double py = vy * ahead + ay * ahead * ahead;
+    double distance = sqrt( px * px + py * py );
+    if( distance > INK_MAX_PREDICT_DISTANCE ) {
+        px *= INK_MAX_PREDICT_DISTANCE / distance;
+        py *= INK_MAX_PREDICT_DISTANCE / distance;
+    }
+    *x = newest->x + (float) px;
+    *y = newest->y + (float) py;
+    return 1;
+}
+
+
+// Width of a pen of full `width` at the newest sample. With pressure, the width follows it; without, the pen gets
+// thinner the faster it moves, like a felt tip. `previous` is the width at the last point of the stroke, or zero at
+// the first point, and the result only moves part of the way from it, so the width doesn't jump with noisy input
+static float inkWidth( struct InkPredictor const* predictor, float width, float previous ) {
+    if( predictor->count < 1 ) {
+        return previous > 0.0f ? previous : width;
+    }
+    struct InkSample const* newest = newestInkSample( predictor );
+    float fraction;
+    if( newest->pressure > 0.0f ) {
+        fraction = INK_THINNEST + ( 1.0f - INK_THINNEST ) * ( newest->pressure < 1.0f ? newest->pressure : 1.0f );
+    } else {
+        // Average speed over the same window as prediction uses
+        struct InkSample const* oldest = newest;
+        for( int i = 1; i < predictor->count; ++i ) {
+            struct InkSample const* sample = &predictor->history[ ( predictor->next + INK_HISTORY_SIZE - 1 - i ) %
+                INK_HISTORY_SIZE ];
+            if( newest->time - sample->time > INK_PREDICT_WINDOW_MS ) {
+                break;
+            }
+            oldest = sample;
+        }
+        double elapsed = newest->time - oldest->time;
+        float dx = newest->x - oldest->x;
+        float dy = newest->y - oldest->y;
+        float speed = elapsed > 0.0 ? (float)( sqrt( dx * dx + dy * dy ) / elapsed ) : 0.0f;
+        float u = ( speed - INK_SLOW_SPEED ) / ( INK_FAST_SPEED - INK_SLOW_SPEED );
+        u = u < 0.0f ? 0.0f : ( u > 1.0f ? 1.0f : u );
+        fraction = 1.0f - ( 1.0f - INK_THINNEST ) * u;
+    }
+    float target = width * fraction;
+    return previous > 0.0f ? previous + ( target - previous ) * INK_WIDTH_SMOOTHING : target;
+}
@@ -1,14 +1,25 @@
 ﻿
 static struct {
 	wchar_t const* language;
+	wchar_t const* arrow;
+	wchar_t const* blur;
+	wchar_t const* crop;
 	wchar_t const* done;
+	wchar_t const* ellipse;
 	wchar_t const* erase;
 	wchar_t const* highlight;
 	wchar_t const* pen;
+	wchar_t const* pixelate;
+	wchar_t const* rectangle;
+	wchar_t const* redact;
+	wchar_t const* resetCrop;
+	wchar_t const* shapes;
+	wchar_t const* text;
 	wchar_t const* title;
+	wchar_t const* trim;
 } localization[] {
-	{ L"en-US", L"Done", L"Erase", L"Highlight", L"Pen", L"Snipping Tool", },
-	{ L"fr-FR", L"Terminé", L"Effacer", L"Surligner", L"Stylo", L"Outil Capture", },
-	{ L"ja-JP", L"完了", L"消去する", L"ハイライト", L"ペン", L"タイトル", },
+	{ L"en-US", L"Arrow", L"Blur", L"Crop", L"Done", L"Ellipse", L"Erase", L"Highlight", L"Pen", L"Pixelate", L"Rectangle", L"Redact", L"Reset crop", L"Shapes", L"Text", L"Snipping Tool", L"Trim borders", },
+	{ L"fr-FR", L"Flèche", L"Flou", L"Rogner", L"Terminé", L"Ellipse", L"Effacer", L"Surligner", L"Stylo", L"Pixeliser", L"Rectangle", L"Masquer", L"Annuler le rognage", L"Formes", L"Texte", L"Outil Capture", L"Rogner les bords", },
+	{ L"ja-JP", L"矢印", L"ぼかし", L"トリミング", L"完了", L"楕円", L"消去する", L"ハイライト", L"ペン", L"モザイク", L"四角形", L"墨消し", L"トリミングを解除", L"図形", L"テキスト", L"タイトル", L"余白を削除", },
 };
 
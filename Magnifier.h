@@ -0,0 +1,80 @@
+// Nearest-neighbor zoom used for the loupe shown next to the cursor during region selection. Only the pixels of the
+// destination loupe are touched, so the cost is independent of the size of the desktop being sampled.
+
+
+// Expands the source pixels covering zoomed columns [zx, zx + width) of a single row into `out`. `in` is the source
+// row, `inWidth` its length, and anything outside it is filled with `border`.
+static void magnifyRow( uint32_t const* in, int inWidth, int zx, int zoom, uint32_t border, uint32_t* out, int width ) {
+    int x = 0;
+    while( x < width ) {
+        // Floor division, as zx can be negative when the cursor is near the left edge
+        int z = zx + x;
+        int sx = z >= 0 ? z / zoom : -( ( -z + zoom - 1 ) / zoom );
+        int run = ( sx + 1 ) * zoom - z; // Number of output pixels left in the block of source pixel `sx`
+        if( run > width - x ) {
+            run = width - x;
+        }
+        uint32_t pixel = ( sx >= 0 && sx < inWidth ) ? in[ sx ] : border;
+        uint32_t* o = out + x;
+        int i = 0;
+        #ifdef PIXELS_SSE2
+            __m128i v = _mm_set1_epi32( (int) pixel );
+            for( ; i + 4 <= run; i += 4 ) {
+                _mm_storeu_si128( (__m128i*)( o + i ), v );
+            }
+        #endif
+        for( ; i < run; ++i ) {
+            o[ i ] = pixel;
+        }
+        x += run;
+    }
+}
+
+
+// Fill all of `dst` with a `zoom` times magnification of `src`, centered on the source pixel (cx, cy). Each distinct
+// source row is only expanded once; the remaining rows of its block are plain copies of the first.
+static void magnifyNearest( struct PixelBuffer const* src, int cx, int cy, int zoom, uint32_t border,
+    struct PixelBuffer* dst ) {
+
+    // Top-left of the destination, in zoomed source space
+    int zx = cx * zoom + zoom / 2 - dst->width / 2;
+    int zy = cy * zoom + zoom / 2 - dst->height / 2;
+
+    int prevSy = 0;
+    uint32_t* prevRow = NULL;
+    for( int y = 0; y < dst->height; ++y ) {
+        int z = zy + y;
+        int sy = z >= 0 ? z / zoom : -( ( -z + zoom - 1 ) / zoom );
+        uint32_t* out = pixelRow( dst, y );
+        if( prevRow && sy == prevSy ) {
+            memcpy( out, prevRow, sizeof( uint32_t ) * dst->width );
+        } else if( sy < 0 || sy >= src->height ) {
+            magnifyRow( NULL, 0, zx, zoom, border, out, dst->width );
+        } else {
+            magnifyRow( pixelRow( src, sy ), src->width, zx, zoom, border, out, dst->width );
+        }
+        prevRow = out;
+        prevSy = sy;
+    }
+}
+
+
+// Draws a one pixel outline around the magnified pixel under the cursor, so it is clear which pixel the coordinates
+// refer to. Assumes `dst` was filled by `magnifyNearest` with the same `zoom`.
+static void magnifierMarkCenter( struct PixelBuffer* dst, int zoom, uint32_t color ) {
+    int left = dst->width / 2 - zoom / 2 - 1;
+    int top = dst->height / 2 - zoom / 2 - 1;
+    int right = left + zoom + 1;
+    int bottom = top + zoom + 1;
+    for( int y = top; y <= bottom; ++y ) {
+        if( y < 0 || y >= dst->height ) {
+            continue;
+        }
+        uint32_t* row = pixelRow( dst, y );
+        for( int x = left; x <= right; ++x ) {
+            if( x >= 0 && x < dst->width && ( y == top || y == bottom || x == left || x == right ) ) {
+                row[ x ] = color;
+            }
+        }
+    }
+}
@@ -1,11 +1,31 @@
 
-// A list of line segments making up a single stroke
-struct Stroke {
-    BOOL highlighter; // A stroke can be done with pen or highlighter
-    int penIndex; // The index (color) of the pen or highlighter used
-    int capacity; // `points` array is dynamically grown (by doubling). `capacity` holds current max capacity
-    int count; // Current number of points
-    Gdiplus::Point* points; // The points making up the stroke
+int const strokeMargin = 16; // Half the width of the widest pen, plus a little extra for anti-aliasing
+int const finalSupersampling = 2; // Samples per pixel along each axis, when rendering strokes for the saved image
+int const inkLatencyMs = 8; // How far past the time of painting to predict the tip of a stroke, until it's on screen
+
+
+// A rectangle of the snippet which will be blurred or pixelated
+struct Redaction {
+    struct PixelRect rect;
+    enum RedactMode mode;
+};
+
+
+int const redactStrength = 12; // Block size used for redaction, in snippet pixels
+
+
+// Edges of the crop rect, as bits, so one edge or the two meeting at a corner can be dragged at once
+int const cropLeft = 1;
+int const cropTop = 2;
+int const cropRight = 4;
+int const cropBottom = 8;
+int const cropHandleSize = 8; // Size of the handles on the crop rect, and how close to an edge grabs it, in view pixels
+
+
+// Optional extra results from `makeAnnotations`: the snippet without the annotations, and the annotations as vectors
+struct AnnotationOutput {
+    HBITMAP base; // The snippet with redactions applied (they are never left to the vector layer), but nothing else
+    struct VectorLayer vectors;
 };
 
 
@@ -25,8 +45,7 @@ struct MakeAnnotationsData {
     int highlightIndex; // Index of the currently selected highlighter
     BOOL eraser; // Will be TRUE when in `erase` mode`
     BOOL penDown; // Will be TRUE, while holding down the left mouse button, with pen or highlighter selected
-    int strokeCount; // Number of strokes (a single stroke can have any length)
-    struct Stroke strokes[ 256 ]; // Hardcoded limit of 256 strokes. Could be made dynamic if necessary.    
+    struct StrokeStore strokeStore; // All strokes, including erased ones, and the edits made to them for undo/redo
     HWND penButton; // Handles to the buttons
     HWND highlightButton;
     HWND eraseButton;
@@ -38,38 +57,120 @@ struct MakeAnnotationsData {
     HCURSOR penCursor;
     HCURSOR eraserCursor;
     int buttonHeight; // Last calculated scaled height of the buttons
-    HBITMAP* menuIcons;
     int penCount;
     int highlightCount;
     int menuMarginH;
     int menuMarginV;
+    struct PixelBuffer backbufferPixels; // Direct access to the pixels of the backbuffer, for redaction
+    HWND redactButton;
+    HMENU redactMenu;
+    HCURSOR crossCursor;
+    BOOL redact; // Will be TRUE when in `redact` mode
+    enum RedactMode redactMode; // Whether new redactions blur or pixelate
+    BOOL redacting; // Will be TRUE while dragging out a new redaction rect
+    POINT redactStart; // Point where the current redaction drag started
+    int redactionCount; // Number of redactions
+    struct Redaction redactions[ 256 ]; // Hardcoded limit of 256 redactions, like for strokes
+    float zoom; // Zoom level chosen by the user, applied on top of `scale`
+    struct Viewport view; // Maps between the visible area of the window and snippet coordinates
+    BOOL viewInitialized;
+    HDC viewDC; // Device context for the surface the visible part of the snippet is resampled into
+    HBITMAP viewBitmap;
+    struct PixelBuffer viewPixels;
+    int* viewColumns; // Scratch space for `renderViewport`
+    BOOL panning; // Will be TRUE while dragging the view with the middle mouse button
+    POINT panFrom; // Last mouse position while panning, in client coordinates
+    struct Scene scene; // Arrows, rectangles, ellipses and text labels
+    HWND shapeButton;
+    HMENU shapeMenu;
+    BOOL shapes; // Will be TRUE when in `shapes` mode
+    enum ShapeType shapeType; // Type of shape created in `shapes` mode
+    int activeShape; // Index of the shape being dragged out, or -1
+    HWND textEdit; // Edit control for typing the text of a new label, while it is open
+    WNDPROC textEditProc; // Original window procedure of `textEdit`, which we subclass to catch Enter and Esc
+    POINT textAnchor; // Position of the label being typed, in snippet coordinates
+    Gdiplus::Font* font; // Font for text labels
+    struct AnnotationOutput* output; // Where to put the unannotated snippet and vector layer, or NULL if not needed
+    struct InkQueue ink; // Mouse samples for the current stroke which arrived since the last paint
+    struct InkPredictor inkPredictor; // Recent samples of the current stroke, to extrapolate its tip from
+    DWORD inkStart; // Message time when the current stroke started. Sample times are relative to it
+    struct FrameScheduler scheduler; // Decides when to repaint. Changes mark it dirty instead of invalidating the window
+    float penPressure; // Pressure of the pen on a tablet, from 0 to 1, or 0 when drawing with something else
+    struct ResourceCache resources; // Fonts, brushes and bitmaps for the buttons and menus, reused between repaints
+    struct Telemetry* telemetry; // Counts the memory of the bitmaps made for annotating, or NULL
+    HWND cropButton;
+    HMENU cropMenu;
+    BOOL cropMode; // Will be TRUE when in `crop` mode
+    struct PixelRect crop; // Part of the snippet which is saved. Only the rect is kept, the snippet is left as it is
+    int cropDrag; // Edges of `crop` being dragged, as `cropLeft`, `cropTop`... bits, or 0 when not dragging
+    struct PixelRect* cropOutput; // Where to put the crop rect when done
+    struct StrokeJournal* journal; // Where every edit of the strokes is recorded as it is made, or NULL
 };
 
 
-// Creates a new stroke, and allocates memory for its points. If maximum strokes have been reached, it will do nothing
-void newStroke( struct MakeAnnotationsData* data, BOOL highlighter, int penIndex ) {
-    if( data->strokeCount < sizeof( data->strokes ) / sizeof( *data->strokes ) ) {
-        struct Stroke* stroke = &data->strokes[ data->strokeCount ];
-        stroke->highlighter = highlighter;
-        stroke->penIndex = penIndex;
-        stroke->capacity = 256;
-        stroke->count = 0;
-        stroke->points = (Gdiplus::Point*) malloc( sizeof( Gdiplus::Point ) * stroke->capacity );
-        ++data->strokeCount;
+// Starts a new redaction rect at `p`. If maximum redactions have been reached, it will do nothing
+void beginRedaction( struct MakeAnnotationsData* data, POINT p ) {
+    if( data->redactionCount < sizeof( data->redactions ) / sizeof( *data->redactions ) ) {
+        struct Redaction* redaction = &data->redactions[ data->redactionCount++ ];
+        struct PixelRect rect = { p.x, p.y, p.x, p.y };
+        redaction->rect = rect;
+        redaction->mode = data->redactMode;
+        data->redactStart = p;
+        data->redacting = TRUE;
     }
 }
 
 
+// Updates the redaction being dragged out, so it spans from where the drag started to `p`
+void updateRedaction( struct MakeAnnotationsData* data, POINT p ) {
+    if( data->redacting ) {
+        POINT a = data->redactStart;
+        struct PixelRect rect = { min( a.x, p.x ), min( a.y, p.y ), max( a.x, p.x ), max( a.y, p.y ) };
+        struct PixelRect bounds = { data->bounds.left, data->bounds.top, data->bounds.right, data->bounds.bottom };
+        data->redactions[ data->redactionCount - 1 ].rect = intersectPixelRect( rect, bounds );
+    }
+}
+
+
+// Completes the redaction being dragged out. Redactions with no area are discarded
+void endRedaction( struct MakeAnnotationsData* data, POINT p ) {
+    if( data->redacting ) {
+        updateRedaction( data, p );
+        data->redacting = FALSE;
+        if( pixelRectEmpty( data->redactions[ data->redactionCount - 1 ].rect ) ) {
+            --data->redactionCount;
+        }
+    }
+}
+
+
+// Index of the topmost stroke which is within `tolerance` of (x, y), not counting erased strokes, or -1 if none is.
+// Only looks at highlighter strokes if `highlighter` is TRUE, and otherwise at pen strokes
+int hitStroke( struct MakeAnnotationsData* data, float x, float y, BOOL highlighter, float tolerance ) {
+    for( int i = data->strokeStore.count - 1; i >= 0; --i ) {
+        struct Stroke* stroke = &data->strokeStore.strokes[ i ];
+        if( !stroke->erased && !stroke->highlighter == !highlighter && stroke->path.pointCount > 1 && 
+            strokeOutlineHit( &stroke->outline, x, y, tolerance ) ) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+
 // Adds a point/segment to a stroke, but only if the distance is far enough from the previous added point
-// The distance needed is determined by whether a pen or highlighter is used, and whether `force` is TRUE
+// The distance needed is determined by whether a pen or highlighter is used, and whether `force` is TRUE. Pens change
+// width with the pressure or speed of the recent samples, while highlighters always have the full width. Without pen
+// input (win7), pens keep their full width too, and the mouse draws strokes of constant width
 void addStrokePoint( struct MakeAnnotationsData* data, POINT* p, BOOL force ) {
     // Filter out points which are too close to the previous point. We do this to better leverage the curve
     // renderer and get smoother, more natural looking strokes even though using a mouse to draw
-    if( data->strokeCount > 0 ) {
-        struct Stroke* stroke = &data->strokes[ data->strokeCount - 1 ];
-        if( stroke->count > 0 ) {
-            int dx = stroke->points[ stroke->count - 1 ].X - p->x;
-            int dy = stroke->points[ stroke->count - 1 ].Y - p->y;
+    if( data->strokeStore.count > 0 ) {
+        struct Stroke* stroke = &data->strokeStore.strokes[ data->strokeStore.count - 1 ];
+        struct StrokePath* path = &stroke->path;
+        if( path->pointCount > 0 ) {
+            int dx = (int) path->points[ path->pointCount * 2 - 2 ] - p->x;
+            int dy = (int) path->points[ path->pointCount * 2 - 1 ] - p->y;
             int dist = (int)sqrtf( (float)( dx * dx + dy * dy ) );
             int const thresholdForce = 5;
             int const thresholdPen = 15;
@@ -79,15 +180,471 @@ void addStrokePoint( struct MakeAnnotationsData* data, POINT* p, BOOL force ) {
             }
         }
 
-        // Resize array if needed
-        if( stroke->count >= stroke->capacity ) {
-            stroke->capacity *= 2;
-            stroke->points = (Gdiplus::Point*) realloc( stroke->points, sizeof( Gdiplus::Point) * stroke->capacity );
+        // Add the point. Only the end of the polyline is flattened again and offset to the outline, and the bounds 
+        // grow to include it
+        Gdiplus::Pen* pen = stroke->highlighter ? 
+            data->highlighters[ stroke->penIndex ] :  data->pens[ stroke->penIndex ];
+        float width = pen->GetWidth();
+        if( !stroke->highlighter && GetPointerPenInfoPtr ) {
+            width = inkWidth( &data->inkPredictor, width, 
+                path->pointCount > 0 ? path->widths[ path->pointCount - 1 ] : 0.0f );
+        }
+        addPathPoint( path, (float) p->x, (float) p->y, width, strokeMargin );
+        updateStrokeOutline( &stroke->outline, path );
+        journalStrokePoint( data->journal, (float) p->x, (float) p->y, width );
+    }
+}
+
+
+// Queue a mouse sample for the current stroke, from a mouse message with the position in client coordinates. Samples
+// are only added to the stroke on the next paint, so however many arrive in between, the stroke is updated once
+void queueStrokeSample( struct MakeAnnotationsData* data, int x, int y, int spaceForButtons ) {
+    float ix;
+    float iy;
+    viewToImage( &data->view, (float) x, (float)( y - spaceForButtons ), &ix, &iy );
+    queueInkSample( &data->ink, ix, iy, (double)(DWORD)( GetMessageTime() - data->inkStart ), data->penPressure );
+}
+
+
+// Add the queued samples to the current stroke
+void commitStrokeSamples( struct MakeAnnotationsData* data ) {
+    for( int i = 0; i < data->ink.count; ++i ) {
+        struct InkSample sample = data->ink.samples[ i ];
+        addInkSample( &data->inkPredictor, sample );
+        POINT p = { (LONG) floorf( sample.x ), (LONG) floorf( sample.y ) };
+        addStrokePoint( data, &p, FALSE );
+    }
+    data->ink.count = 0;
+}
+
+
+// Edges of the crop rect near `p`, as `cropLeft`, `cropTop`... bits. Near a corner, that is both edges meeting there
+int hitCropEdges( struct MakeAnnotationsData* data, POINT p ) {
+    float reach = cropHandleSize / data->view.zoom;
+    struct PixelRect c = data->crop;
+    BOOL alongX = p.x > c.left - reach && p.x < c.right + reach;
+    BOOL alongY = p.y > c.top - reach && p.y < c.bottom + reach;
+    int edges = 0;
+    if( alongY && fabsf( (float)( p.x - c.left ) ) <= reach ) {
+        edges |= cropLeft;
+    } else if( alongY && fabsf( (float)( p.x - c.right ) ) <= reach ) {
+        edges |= cropRight;
+    }
+    if( alongX && fabsf( (float)( p.y - c.top ) ) <= reach ) {
+        edges |= cropTop;
+    } else if( alongX && fabsf( (float)( p.y - c.bottom ) ) <= reach ) {
+        edges |= cropBottom;
+    }
+    return edges;
+}
+
+
+// Moves the edges of the crop rect being dragged to `p`. Dragging an edge past the opposite one swaps them, so the
+// rect never turns inside out
+void dragCrop( struct MakeAnnotationsData* data, POINT p ) {
+    struct PixelRect* c = &data->crop;
+    int x = max( data->bounds.left, min( data->bounds.right, p.x ) );
+    int y = max( data->bounds.top, min( data->bounds.bottom, p.y ) );
+    if( data->cropDrag & cropLeft ) {
+        c->left = x;
+    } else if( data->cropDrag & cropRight ) {
+        c->right = x;
+    }
+    if( data->cropDrag & cropTop ) {
+        c->top = y;
+    } else if( data->cropDrag & cropBottom ) {
+        c->bottom = y;
+    }
+    if( c->right < c->left ) {
+        int t = c->left;
+        c->left = c->right;
+        c->right = t;
+        data->cropDrag ^= ( data->cropDrag & ( cropLeft | cropRight ) ) ? cropLeft | cropRight : 0;
+    }
+    if( c->bottom < c->top ) {
+        int t = c->top;
+        c->top = c->bottom;
+        c->bottom = t;
+        data->cropDrag ^= ( data->cropDrag & ( cropTop | cropBottom ) ) ? cropTop | cropBottom : 0;
+    }
+}
+
+
+// Returns TRUE if `msg` is an undo or redo shortcut meant for the strokes: not while drawing one, and not while typing
+// a text label, where the edit control has its own undo
+BOOL isUndoKey( struct MakeAnnotationsData* data, MSG const* msg ) {
+    return msg->message == WM_KEYDOWN && ( msg->wParam == 'Z' || msg->wParam == 'Y' ) && 
+        ( GetKeyState( VK_CONTROL ) & 0x8000 ) && !data->penDown && msg->hwnd != data->textEdit;
+}
+
+
+// Current time for the frame scheduler, in milliseconds
+double frameClock() {
+    LARGE_INTEGER counter;
+    LARGE_INTEGER frequency;
+    QueryPerformanceCounter( &counter );
+    QueryPerformanceFrequency( &frequency );
+    return counter.QuadPart * 1000.0 / frequency.QuadPart;
+}
+
+
+// Align the frame scheduler with the refresh period and last vblank of the desktop compositor. If it can't tell us
+// (composition is off), the scheduler keeps its current clock
+void syncFrameClock( struct FrameScheduler* scheduler ) {
+    DWM_TIMING_INFO timing;
+    memset( &timing, 0, sizeof( timing ) );
+    timing.cbSize = sizeof( timing );
+    if( SUCCEEDED( DwmGetCompositionTimingInfo( NULL, &timing ) ) && timing.qpcRefreshPeriod > 0 ) {
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency( &frequency );
+        setFrameClock( scheduler, timing.qpcRefreshPeriod * 1000.0 / frequency.QuadPart, 
+            timing.qpcVBlank * 1000.0 / frequency.QuadPart );
+    }
+}
+
+
+// Map a point in client coordinates to snippet coordinates, through the current view
+POINT clientToSnippet( struct MakeAnnotationsData* data, int x, int y, int spaceForButtons ) {
+    float ix;
+    float iy;
+    viewToImage( &data->view, (float) x, (float)( y - spaceForButtons ), &ix, &iy );
+    POINT p = { (LONG) floorf( ix ), (LONG) floorf( iy ) };
+    return p;
+}
+
+
+// Make sure the view surface matches the area of the window below the buttons. The first time around, the zoom is
+// set so the whole snippet fits
+void updateViewSurface( struct MakeAnnotationsData* data, HWND hwnd, int spaceForButtons ) {
+    RECT client;
+    GetClientRect( hwnd, &client );
+    int w = max( 1, client.right - client.left );
+    int h = max( 1, client.bottom - client.top - spaceForButtons );
+    if( !data->viewBitmap || data->viewPixels.width != w || data->viewPixels.height != h ) {
+        if( data->viewBitmap ) {
+            trackBitmap( data->telemetry, data->viewBitmap, -1 );
+            DeleteDC( data->viewDC );
+            DeleteObject( data->viewBitmap );
         }
+        HDC dc = GetDC( hwnd );
+        data->viewBitmap = createPixelBitmap( dc, w, h, &data->viewDC, &data->viewPixels );
+        trackBitmap( data->telemetry, data->viewBitmap, 1 );
+        ReleaseDC( hwnd, dc );
+        data->viewColumns = (int*) realloc( data->viewColumns, sizeof( int ) * w );
+    }
+
+    data->view.viewWidth = w;
+    data->view.viewHeight = h;
+    if( !data->viewInitialized ) {
+        float fit = min( w / (float) data->view.imageWidth, h / (float) data->view.imageHeight );
+        data->zoom = fit < data->scale ? fit / data->scale : 1.0f;
+        data->view.zoom = data->scale * data->zoom;
+        data->viewInitialized = TRUE;
+    }
+    clampViewport( &data->view );
+}
+
+
+// Render all strokes into the backbuffer with the tiled compositor, which is slower than GDI+ when just a few strokes
+// have changed, but uses all cores and supersamples. Used for the final image
+void compositeAllStrokes( struct MakeAnnotationsData* data ) {
+    struct CompositeStroke* strokes = (struct CompositeStroke*) malloc( sizeof( struct CompositeStroke ) * 
+        ( data->strokeStore.count > 0 ? data->strokeStore.count : 1 ) );
+    if( !strokes ) {
+        return;
+    }
+    int count = 0;
+    for( int i = 0; i < data->strokeStore.count; ++i ) {
+        struct Stroke* stroke = &data->strokeStore.strokes[ i ];
+        if( !stroke->erased && stroke->path.pointCount > 1 ) {
+            Gdiplus::Pen* pen = stroke->highlighter ? 
+                data->highlighters[ stroke->penIndex ] :  data->pens[ stroke->penIndex ];
+            Gdiplus::Color color;
+            pen->GetColor( &color );
+            struct CompositeStroke s = { stroke->path.vertices, stroke->path.vertexCount, stroke->path.maxWidth, 
+                (uint32_t) color.GetValue(), // ARGB value has the same layout as a BGRA pixel
+                stroke->path.vertexWidths };
+            strokes[ count++ ] = s;
+        }
+    }
+    GdiFlush(); // Make sure GDI is done with the backbuffer before we modify the pixels
+    compositeStrokes( &data->backbufferPixels, strokes, count, finalSupersampling, 0 );
+    free( strokes );
+}
+
+
+// Composite the snippet and redactions into the backbuffer, for the part of it covered by `area`
+void renderBackground( struct MakeAnnotationsData* data, struct PixelRect area ) {
+    HDC backbuffer = data->backbuffer;
+
+    // A redaction depends on all the pixels it covers, so any that are partially inside are composited in full
+    struct PixelRect paint = area;
+    for( int i = 0; i < data->redactionCount; ++i ) {
+        if( pixelRectsIntersect( data->redactions[ i ].rect, area ) ) {
+            paint = unionPixelRect( paint, data->redactions[ i ].rect );
+        }
+    }
+
+    // Draw the snippet as a background - the lines will be drawn on top. 
+    BitBlt( backbuffer, paint.left, paint.top, paint.right - paint.left, paint.bottom - paint.top, 
+        data->snippet, paint.left, paint.top, SRCCOPY );
+
+    // Redactions are applied directly to the backbuffer pixels, underneath the strokes
+    if( data->redactionCount > 0 ) {
+        GdiFlush(); // Make sure the BitBlt have completed before we modify the pixels
+        for( int i = 0; i < data->redactionCount; ++i ) {
+            if( pixelRectsIntersect( data->redactions[ i ].rect, area ) ) {
+                redactRect( &data->backbufferPixels, data->redactions[ i ].rect, data->redactions[ i ].mode, 
+                    redactStrength );
+            }
+        }
+    }
+}
+
+
+// Draws a single shape with the pen it was created with
+void drawShape( struct MakeAnnotationsData* data, Gdiplus::Graphics* graphics, struct Shape const* shape ) {
+    Gdiplus::Pen* pen = data->pens[ shape->penIndex ];
+    float x0 = min( shape->x0, shape->x1 );
+    float y0 = min( shape->y0, shape->y1 );
+    float x1 = max( shape->x0, shape->x1 );
+    float y1 = max( shape->y0, shape->y1 );
+    switch( shape->type ) {
+        case SHAPE_ARROW: {
+            float barbs[ 4 ];
+            shapeArrowHead( shape, barbs );
+            Gdiplus::PointF head[] = { Gdiplus::PointF( barbs[ 0 ], barbs[ 1 ] ), 
+                Gdiplus::PointF( shape->x1, shape->y1 ), Gdiplus::PointF( barbs[ 2 ], barbs[ 3 ] ) };
+            graphics->DrawLine( pen, shape->x0, shape->y0, shape->x1, shape->y1 );
+            graphics->DrawLines( pen, head, 3 );
+        } break;
+        case SHAPE_RECTANGLE: {
+            graphics->DrawRectangle( pen, x0, y0, x1 - x0, y1 - y0 );
+        } break;
+        case SHAPE_ELLIPSE: {
+            graphics->DrawEllipse( pen, x0, y0, x1 - x0, y1 - y0 );
+        } break;
+        case SHAPE_TEXT: {
+            if( shape->text ) {
+                Gdiplus::Color color;
+                pen->GetColor( &color );
+                Gdiplus::SolidBrush brush( color );
+                graphics->DrawString( shape->text, -1, data->font, Gdiplus::PointF( shape->x0, shape->y0 ), &brush );
+            }
+        } break;
+    }
+}
+
+
+// Composite the snippet, redactions and strokes into the backbuffer, but only for the part of it covered by `area`.
+// Strokes entirely outside of `area` are skipped. When `saving`, strokes are drawn by the tiled compositor
+void renderAnnotations( struct MakeAnnotationsData* data, struct PixelRect area, BOOL saving ) {
+    HDC backbuffer = data->backbuffer;
+    renderBackground( data, area );
+
+    if( saving ) {
+        compositeAllStrokes( data );
+    }
+
+    // Set up the GDI+ rendering. GDI+ is tjhe only way to get semitransparent and antialiased rendering
+    Gdiplus::Graphics graphics( backbuffer );
+    graphics.SetSmoothingMode( Gdiplus::SmoothingModeHighQuality );
+    graphics.SetClip( Gdiplus::Rect( area.left, area.top, area.right - area.left, area.bottom - area.top ) );
+
+    // Draw all the strokes
+    for( int i = 0; i < data->strokeStore.count && !saving; ++i ) {
+        struct Stroke* stroke = &data->strokeStore.strokes[ i ];
+        // Only draw strokes with at least one segment (two points or more), which are at least partially visible
+        if( !stroke->erased && stroke->path.pointCount > 1 && pixelRectsIntersect( stroke->path.bounds, area ) ) {
+            // Select the right pen or highlighter
+            Gdiplus::Pen* pen = stroke->highlighter ? 
+                data->highlighters[ stroke->penIndex ] :  data->pens[ stroke->penIndex ];
+            Gdiplus::Color color;
+            pen->GetColor( &color );
+            Gdiplus::SolidBrush brush( color );
+            // The cached outline has the same layout as an array of `PointF`, so it is filled as it is. The winding 
+            // fill mode covers the parts where the stroke crosses itself only once
+            graphics.FillPolygon( &brush, (Gdiplus::PointF const*) stroke->outline.points, stroke->outline.pointCount, 
+                Gdiplus::FillModeWinding );
+        }
+    }
+
+    // Draw the shapes, visiting only those which intersect the area
+    int* shapes;
+    int shapeCount = queryScene( &data->scene, area, &shapes );
+    for( int i = 0; i < shapeCount; ++i ) {
+        drawShape( data, &graphics, &data->scene.shapes[ shapes[ i ] ] );
+    }
+}
+
+
+// Shrinks the crop rect to leave out the uniform borders of the snippet, but not any strokes or shapes drawn on them
+void trimCrop( struct MakeAnnotationsData* data ) {
+    struct PixelRect all = { data->bounds.left, data->bounds.top, data->bounds.right, data->bounds.bottom };
+    renderBackground( data, all ); // Redactions count as content too
+    GdiFlush();
+    struct PixelBuffer view = cropPixelBuffer( &data->backbufferPixels, data->crop );
+    struct PixelRect trim = findTrimRect( &view, TRIM_TOLERANCE );
+    trim.left += data->crop.left;
+    trim.top += data->crop.top;
+    trim.right += data->crop.left;
+    trim.bottom += data->crop.top;
+    for( int i = 0; i < data->strokeStore.count; ++i ) {
+        struct Stroke* stroke = &data->strokeStore.strokes[ i ];
+        if( !stroke->erased && stroke->path.pointCount > 1 ) {
+            trim = unionPixelRect( trim, stroke->outline.bounds );
+        }
+    }
+    for( int i = 0; i < data->scene.count; ++i ) {
+        trim = unionPixelRect( trim, data->scene.shapes[ i ].bounds );
+    }
+    data->crop = intersectPixelRect( trim, data->crop );
+}
+
+
+// Shades the parts of the snippet outside the crop rect. In `crop` mode, also outlines the rect and draws its handles
+void drawCropFrame( struct MakeAnnotationsData* data, struct PixelRect visible ) {
+    struct PixelRect c = data->crop;
+    Gdiplus::Graphics graphics( data->backbuffer );
+    graphics.SetClip( Gdiplus::Rect( visible.left, visible.top, visible.right - visible.left, 
+        visible.bottom - visible.top ) );
+    Gdiplus::Region outside( Gdiplus::Rect( data->bounds.left, data->bounds.top, 
+        data->bounds.right - data->bounds.left, data->bounds.bottom - data->bounds.top ) );
+    outside.Exclude( Gdiplus::Rect( c.left, c.top, c.right - c.left, c.bottom - c.top ) );
+    Gdiplus::SolidBrush shade( Gdiplus::Color( 128, 0, 0, 0 ) );
+    graphics.FillRegion( &shade, &outside );
+    if( data->cropMode ) {
+        // Sizes are in view pixels, so the frame looks the same at any zoom
+        float pixel = 1.0f / data->view.zoom;
+        float size = cropHandleSize * pixel;
+        Gdiplus::Pen frame( Gdiplus::Color( 255, 255, 255, 255 ), pixel );
+        graphics.DrawRectangle( &frame, (float) c.left, (float) c.top, (float)( c.right - c.left ), 
+            (float)( c.bottom - c.top ) );
+        Gdiplus::SolidBrush handle( Gdiplus::Color( 255, 255, 255, 255 ) );
+        float xs[ 3 ] = { (float) c.left, ( c.left + c.right ) * 0.5f, (float) c.right };
+        float ys[ 3 ] = { (float) c.top, ( c.top + c.bottom ) * 0.5f, (float) c.bottom };
+        for( int i = 0; i < 9; ++i ) {
+            if( i != 4 ) {
+                graphics.FillRectangle( &handle, xs[ i % 3 ] - size * 0.5f, ys[ i / 3 ] - size * 0.5f, size, size );
+            }
+        }
+    }
+}
+
+
+// Turns the text typed into the label edit control into a text shape, and closes the edit control
+void commitTextLabel( struct MakeAnnotationsData* data ) {
+    HWND edit = data->textEdit;
+    if( !edit ) {
+        return;
+    }
+    data->textEdit = NULL; // Cleared first, as destroying the control will send another EN_KILLFOCUS
+
+    int length = GetWindowTextLengthW( edit );
+    wchar_t* text = (wchar_t*) malloc( sizeof( wchar_t ) * ( length + 1 ) );
+    if( length > 0 && text ) {
+        GetWindowTextW( edit, text, length + 1 );
+        // Measure the label, so the scene knows its bounds
+        Gdiplus::RectF box;
+        HDC dc = GetDC( edit );
+        {
+            Gdiplus::Graphics graphics( dc );
+            graphics.MeasureString( text, -1, data->font, Gdiplus::PointF( 0.0f, 0.0f ), &box );
+        }
+        ReleaseDC( edit, dc );
+        float x = (float) data->textAnchor.x;
+        float y = (float) data->textAnchor.y;
+        addShape( &data->scene, SHAPE_TEXT, data->penIndex, 0.0f, x, y, x + box.Width, y + box.Height, text );
+    }
+    free( text );
+    DestroyWindow( edit );
+}
+
+
+// Subclassed window procedure for the label edit control. Enter commits the label and Esc cancels it
+static LRESULT CALLBACK textEditWndProc( HWND hwnd, UINT message, WPARAM wparam, LPARAM lparam ) {
+    struct MakeAnnotationsData* data = (struct MakeAnnotationsData*) GetWindowLongPtrA( GetParent( hwnd ), GWLP_USERDATA );
+    if( wparam == VK_RETURN || wparam == VK_ESCAPE ) {
+        if( message == WM_KEYDOWN ) {
+            if( wparam == VK_ESCAPE ) {
+                SetWindowTextW( hwnd, L"" );
+            }
+            SetFocus( GetParent( hwnd ) ); // Losing focus commits the label
+            return 0;
+        }
+        if( message == WM_CHAR ) {
+            return 0; // Single-line edit controls beep on Enter and Esc otherwise
+        }
+    }
+    return CallWindowProcW( data->textEditProc, hwnd, message, wparam, lparam );
+}
+
+
+// Opens an edit control at client position (x, y), for typing a label which will be placed at `p` on the snippet
+void openTextLabel( struct MakeAnnotationsData* data, HWND hwnd, POINT p, int x, int y ) {
+    data->textAnchor = p;
+    int height = max( 20, (int)( data->font->GetHeight( 96.0f ) * data->view.zoom ) + 6 );
+    data->textEdit = CreateWindowW( L"EDIT", L"", WS_CHILD | WS_VISIBLE | WS_BORDER | ES_AUTOHSCROLL, 
+        x, y, 300, height, hwnd, NULL, GetModuleHandleW( NULL ), NULL );
+    if( data->textEdit ) {
+        SendMessage( data->textEdit, WM_SETFONT, (WPARAM) GetStockObject( DEFAULT_GUI_FONT ), TRUE );
+        data->textEditProc = (WNDPROC) SetWindowLongPtrW( data->textEdit, GWLP_WNDPROC, (LONG_PTR) textEditWndProc );
+        SetFocus( data->textEdit );
+    }
+}
+
+
+// Copy of the backbuffer as a new bitmap
+HBITMAP copyBackbuffer( struct MakeAnnotationsData* data ) {
+    int width = data->bounds.right - data->bounds.left;
+    int height = data->bounds.bottom - data->bounds.top;
+    HDC screen = GetDC( NULL );
+    HDC dc = CreateCompatibleDC( screen );
+    HBITMAP copy = CreateCompatibleBitmap( screen, width, height );
+    HGDIOBJ oldObject = SelectObject( dc, copy );
+    BitBlt( dc, 0, 0, width, height, data->backbuffer, 0, 0, SRCCOPY );
+    SelectObject( dc, oldObject );
+    DeleteDC( dc );
+    ReleaseDC( NULL, screen );
+    return copy;
+}
+
 
-        // Add the point
-        stroke->points[ stroke->count++ ] = Gdiplus::Point( p->x, p->y );
+// Store all strokes and shapes as vectors, in the order they are painted, relative to the crop rect
+void collectVectorLayer( struct MakeAnnotationsData* data, struct VectorLayer* layer ) {
+    layer->width = data->bounds.right - data->bounds.left;
+    layer->height = data->bounds.bottom - data->bounds.top;
+    for( int i = 0; i < data->strokeStore.count; ++i ) {
+        struct Stroke* stroke = &data->strokeStore.strokes[ i ];
+        if( !stroke->erased && stroke->path.pointCount > 1 ) {
+            Gdiplus::Pen* pen = stroke->highlighter ? 
+                data->highlighters[ stroke->penIndex ] :  data->pens[ stroke->penIndex ];
+            Gdiplus::Color color;
+            pen->GetColor( &color );
+            addVectorItem( layer, stroke->highlighter ? VECTOR_HIGHLIGHTER : VECTOR_PEN, stroke->penIndex, 
+                (uint32_t) color.GetValue(), pen->GetWidth(), stroke->path.points, stroke->path.pointCount, NULL );
+        }
     }
+    for( int i = 0; i < data->scene.count; ++i ) {
+        struct Shape* shape = &data->scene.shapes[ i ];
+        Gdiplus::Color color;
+        data->pens[ shape->penIndex ]->GetColor( &color );
+        float points[ 4 ] = { shape->x0, shape->y0, shape->x1, shape->y1 };
+        char* text = NULL;
+        if( shape->text ) {
+            int size = WideCharToMultiByte( CP_UTF8, 0, shape->text, -1, NULL, 0, NULL, NULL );
+            text = (char*) malloc( size > 0 ? size : 1 );
+            if( text ) {
+                text[ 0 ] = '\0';
+                WideCharToMultiByte( CP_UTF8, 0, shape->text, -1, text, size, NULL, NULL );
+            }
+        }
+        enum VectorKind kind = shape->type == SHAPE_ARROW ? VECTOR_ARROW : shape->type == SHAPE_RECTANGLE ? 
+            VECTOR_RECTANGLE : shape->type == SHAPE_ELLIPSE ? VECTOR_ELLIPSE : VECTOR_TEXT;
+        addVectorItem( layer, kind, shape->penIndex, (uint32_t) color.GetValue(), shape->width, points, 2, text );
+        free( text );
+    }
+    cropVectorLayer( layer, data->crop );
 }
 
 
@@ -122,7 +679,88 @@ void resizeWindow( HWND hwnd, float prevScale, float newScale ) {
 }
 
 
-int resizeButton( HWND button, float prevScale, float newScale ) {
+int const menuItemWidth = 120;
+int const menuItemHeight = 20; 
+int const menuIconsBitmap = 0; // Variant of the RESOURCE_BITMAP holding the icons of all pens and highlighters
+
+
+// Creates the GDI objects of the resource cache. Fonts are the caption font at the height of the key, and the icon
+// bitmap is an atlas with a line drawn with each pen, and then each highlighter, in cells of the height of the key, on
+// the background color of the key
+static void* createGdiResource( void* context, struct ResourceKey const* key ) {
+    struct MakeAnnotationsData* data = (struct MakeAnnotationsData*) context;
+    switch( key->kind ) {
+        case RESOURCE_DC: {
+            return CreateCompatibleDC( NULL );
+        }
+        case RESOURCE_FONT: {
+            NONCLIENTMETRICSA metrics = {};
+            metrics.cbSize = sizeof( metrics );
+            SystemParametersInfoA( SPI_GETNONCLIENTMETRICS, metrics.cbSize, &metrics, 0 );
+            metrics.lfCaptionFont.lfHeight = (LONG) key->size;
+            return CreateFontIndirectA( &metrics.lfCaptionFont );
+        }
+        case RESOURCE_BRUSH: {
+            return CreateSolidBrush( (COLORREF) key->color );
+        }
+        case RESOURCE_BITMAP: {
+            int cellWidth = key->size * menuItemWidth / menuItemHeight;
+            int cells = data->penCount + data->highlightCount;
+            if( key->variant != menuIconsBitmap || key->size <= 0 || cells <= 0 ) {
+                return NULL;
+            }
+            HDC screen = GetDC( NULL );
+            HBITMAP atlas = CreateCompatibleBitmap( screen, cellWidth, key->size * cells );
+            ReleaseDC( NULL, screen );
+            if( !atlas ) {
+                return NULL;
+            }
+            HDC dc = CreateCompatibleDC( NULL );
+            HGDIOBJ oldBitmap = SelectObject( dc, atlas );
+            HBRUSH background = CreateSolidBrush( (COLORREF) key->color );
+            RECT r = { 0, 0, cellWidth, key->size * cells };
+            FillRect( dc, &r, background );
+            DeleteObject( background );
+            {
+                Gdiplus::Graphics graphics( dc );
+                graphics.SetSmoothingMode( Gdiplus::SmoothingModeHighQuality );
+                float scale = key->size / (float) menuItemHeight;
+                for( int i = 0; i < cells; ++i ) {
+                    Gdiplus::Pen* pen = i < data->penCount ? data->pens[ i ] : data->highlighters[ i - data->penCount ];
+                    graphics.ResetTransform();
+                    graphics.SetClip( Gdiplus::Rect( 0, i * key->size, cellWidth, key->size ) );
+                    graphics.TranslateTransform( 0.0f, (float)( i * key->size ) );
+                    graphics.ScaleTransform( scale, scale );
+                    graphics.DrawLine( pen, Gdiplus::Point( 0, menuItemHeight / 2 ), 
+                        Gdiplus::Point( menuItemWidth, menuItemHeight / 2 ) );
+                }
+            }
+            SelectObject( dc, oldBitmap );
+            DeleteDC( dc );
+            trackBitmap( data->telemetry, atlas, 1 );
+            return atlas;
+        }
+        default: {
+            return NULL;
+        }
+    }
+}
+
+
+static void destroyGdiResource( void* context, struct ResourceKey const* key, void* handle ) {
+    struct MakeAnnotationsData* data = (struct MakeAnnotationsData*) context;
+    if( key->kind == RESOURCE_DC ) {
+        DeleteDC( (HDC) handle );
+    } else {
+        if( key->kind == RESOURCE_BITMAP ) {
+            trackBitmap( data->telemetry, (HBITMAP) handle, -1 );
+        }
+        DeleteObject( (HGDIOBJ) handle );
+    }
+}
+
+
+int resizeButton( struct ResourceCache* resources, HWND button, float prevScale, float newScale ) {
     RECT rect;
     GetWindowRect( button, &rect );
     MapWindowPoints( HWND_DESKTOP, GetParent( button ), (LPPOINT) &rect, 2 );
@@ -140,11 +778,7 @@ int resizeButton( HWND button, float prevScale, float newScale ) {
     h = (int)( h * newScale );  
     SetWindowPos( button, 0, x, y, w, h, SWP_NOZORDER | SWP_NOREPOSITION );
 
-    NONCLIENTMETRICSA metrics = {};
-    metrics.cbSize = sizeof( metrics );
-    SystemParametersInfoA( SPI_GETNONCLIENTMETRICS, metrics.cbSize, &metrics, 0 );
-    metrics.lfCaptionFont.lfHeight = (LONG)( h * 0.8f );
-    HFONT font = CreateFontIndirectA( &metrics.lfCaptionFont );
+    HFONT font = (HFONT) getResource( resources, resourceKey( RESOURCE_FONT, (int)( h * 0.8f ), 0, 0 ) );
     SendMessage( button, WM_SETFONT, (LPARAM) font, TRUE );
     return h;
 }
@@ -175,12 +809,16 @@ static LRESULT CALLBACK makeAnnotationsWndProc( HWND hwnd, UINT message, WPARAM
                 // Rescale window if necessary
                 if( data->scale != scale ) {
                     resizeWindow( hwnd, data->scale, scale );
-                    resizeButton( data->penButton, data->scale, scale );
-                    resizeButton( data->highlightButton, data->scale, scale );
-                    resizeButton( data->eraseButton, data->scale, scale );
-                    data->buttonHeight = resizeButton( data->doneButton, data->scale, scale );
+                    resizeButton( &data->resources, data->penButton, data->scale, scale );
+                    resizeButton( &data->resources, data->highlightButton, data->scale, scale );
+                    resizeButton( &data->resources, data->eraseButton, data->scale, scale );
+                    resizeButton( &data->resources, data->redactButton, data->scale, scale );
+                    resizeButton( &data->resources, data->shapeButton, data->scale, scale );
+                    resizeButton( &data->resources, data->cropButton, data->scale, scale );
+                    data->buttonHeight = resizeButton( &data->resources, data->doneButton, data->scale, scale );
 
                     data->scale = scale;
+                    zoomViewport( &data->view, data->scale * data->zoom, 0.0f, 0.0f );
 
                     // Clear background
                     HDC dc = GetDC( hwnd );
@@ -193,15 +831,31 @@ static LRESULT CALLBACK makeAnnotationsWndProc( HWND hwnd, UINT message, WPARAM
         } break;
 
         case WM_COMMAND: {
+            // Clicking outside of the label edit control commits the label
+            if( HIWORD( wparam ) == EN_KILLFOCUS && data->textEdit && (HWND) lparam == data->textEdit ) {
+                commitTextLabel( data );
+                markFrameDirty( &data->scheduler );
+            }
             // Handle button clicks
             if( HIWORD( wparam ) == BN_CLICKED ) {
                 if( (HWND) lparam == data->doneButton ) {
                     data->completed = TRUE;
-                    // As the backbuffer already contains the complete annotated image, copy it over 
-                    // the snippet bitmap
+                    commitTextLabel( data );
+                    // The backbuffer only has the visible part composited, so composite all of it at full quality,
+                    // then copy it over the snippet bitmap
                     RECT bounds = data->bounds;
+                    struct PixelRect all = { bounds.left, bounds.top, bounds.right, bounds.bottom };
+                    if( data->output ) {
+                        renderBackground( data, all );
+                        GdiFlush();
+                        data->output->base = copyBackbuffer( data );
+                        trackBitmap( data->telemetry, data->output->base, 1 ); // Deleted by the caller
+                        collectVectorLayer( data, &data->output->vectors );
+                    }
+                    renderAnnotations( data, all, TRUE );
                     BitBlt( data->snippet, bounds.left, bounds.top, bounds.right - bounds.left, 
                         bounds.bottom - bounds.top, data->backbuffer, 0, 0, SRCCOPY );
+                    *data->cropOutput = data->crop;
                     PostQuitMessage( 0 ); // Exit the annotation part of the program
                 }
                 // Show the pen selection submenu and let the user select an item
@@ -216,6 +870,9 @@ static LRESULT CALLBACK makeAnnotationsWndProc( HWND hwnd, UINT message, WPARAM
                     // Switch to `pen` mode whether the user selected a menu item or not (use last selected pen index)
                     data->highlighter = FALSE;
                     data->eraser = FALSE;
+                    data->redact = FALSE;
+                    data->shapes = FALSE;
+                    data->cropMode = FALSE;
                 }
                 // Show the highlighter selection submenu and let the user select an item
                 if( (HWND) lparam == data->highlightButton ) {
@@ -229,11 +886,68 @@ static LRESULT CALLBACK makeAnnotationsWndProc( HWND hwnd, UINT message, WPARAM
                     // Switch to `highlighter` mode whether the user selected a menu item or not (use last index)
                     data->highlighter = TRUE;
                     data->eraser = FALSE;
+                    data->redact = FALSE;
+                    data->shapes = FALSE;
+                    data->cropMode = FALSE;
+                }
+                // Show the redaction selection submenu and enter `redact` mode
+                if( (HWND) lparam == data->redactButton ) {
+                    RECT bounds;
+                    GetWindowRect( data->redactButton, &bounds );
+                    POINT p = { bounds.left, bounds.bottom };
+                    DWORD item = TrackPopupMenu( data->redactMenu, TPM_RETURNCMD, p.x, p.y, 0, hwnd, NULL );
+                    if( item > 0 ) {
+                        data->redactMode = item == 1 ? REDACT_BLUR : REDACT_PIXELATE;
+                    }
+                    data->penDown = FALSE;
+                    data->eraser = FALSE;
+                    data->redact = TRUE;
+                    data->shapes = FALSE;
+                    data->cropMode = FALSE;
+                }
+                // Show the shape selection submenu and enter `shapes` mode. Shapes use the current pen color
+                if( (HWND) lparam == data->shapeButton ) {
+                    RECT bounds;
+                    GetWindowRect( data->shapeButton, &bounds );
+                    POINT p = { bounds.left, bounds.bottom };
+                    DWORD item = TrackPopupMenu( data->shapeMenu, TPM_RETURNCMD, p.x, p.y, 0, hwnd, NULL );
+                    if( item > 0 ) {
+                        data->shapeType = (enum ShapeType)( item - 1 );
+                    }
+                    data->penDown = FALSE;
+                    data->eraser = FALSE;
+                    data->redact = FALSE;
+                    data->shapes = TRUE;
+                    data->cropMode = FALSE;
+                }
+                // Show the crop submenu and enter `crop` mode. Trimming and resetting only change the crop rect, which
+                // can then be adjusted with the handles
+                if( (HWND) lparam == data->cropButton ) {
+                    RECT bounds;
+                    GetWindowRect( data->cropButton, &bounds );
+                    POINT p = { bounds.left, bounds.bottom };
+                    DWORD item = TrackPopupMenu( data->cropMenu, TPM_RETURNCMD, p.x, p.y, 0, hwnd, NULL );
+                    if( item == 2 ) {
+                        trimCrop( data );
+                    } else if( item == 3 ) {
+                        struct PixelRect all = { data->bounds.left, data->bounds.top, data->bounds.right, 
+                            data->bounds.bottom };
+                        data->crop = all;
+                    }
+                    data->penDown = FALSE;
+                    data->eraser = FALSE;
+                    data->redact = FALSE;
+                    data->shapes = FALSE;
+                    data->cropMode = TRUE;
+                    markFrameDirty( &data->scheduler );
                 }
                 // Enter `erase` mode
                 if( (HWND) lparam == data->eraseButton ) {
                     data->penDown = FALSE;
                     data->eraser = TRUE;
+                    data->redact = FALSE;
+                    data->shapes = FALSE;
+                    data->cropMode = FALSE;
                 }
             }
         } break;
@@ -245,6 +959,8 @@ static LRESULT CALLBACK makeAnnotationsWndProc( HWND hwnd, UINT message, WPARAM
             if( ScreenToClient( hwnd, &pos ) ) {
                 if( pos.y < spaceForButtons ) {
                     SetCursor( data->arrowCursor );
+                } else if( data->redact || data->shapes || data->cropMode ) {
+                    SetCursor( data->crossCursor );
                 } else if( data->eraser ) {
                     SetCursor( data->eraserCursor );
                 } else {
@@ -283,182 +999,334 @@ static LRESULT CALLBACK makeAnnotationsWndProc( HWND hwnd, UINT message, WPARAM
             ReleaseDC( hwnd, dc );
         } break;
 
-        // Redraw the window - mostly happens in response to us calling `InvalidateRect`
+        // Redraw the window - mostly happens when the frame scheduler calls for it, from the message loop in
+        // `makeAnnotations`
         case WM_PAINT: {
-            // All drawing happens on the off-screen backbuffer surface, to eliminate flickering
-
-            // Draw the snippet as a background - the lines will be drawn on top. 
-            RECT bounds = data->bounds;
-            HDC backbuffer = data->backbuffer;
-
-            BitBlt( backbuffer, bounds.left, bounds.top, bounds.right - bounds.left, bounds.bottom - bounds.top, 
-                data->snippet, 0, 0, SRCCOPY );
-
-            // Set up the GDI+ rendering. GDI+ is tjhe only way to get semitransparent and antialiased rendering
-            Gdiplus::Graphics graphics( backbuffer );
-            graphics.SetSmoothingMode( Gdiplus::SmoothingModeHighQuality );
-
-            // Draw all the strokes
-            for( int i = 0; i < data->strokeCount; ++i ) {
-                struct Stroke* stroke = &data->strokes[ i ];
+            // All drawing happens on the off-screen backbuffer surface, to eliminate flickering. Only the part of the
+            // snippet visible through the view is composited, and only that part is resampled into the window
+            updateViewSurface( data, hwnd, spaceForButtons );
+            if( !data->viewBitmap ) {
+                ValidateRect( hwnd, NULL );
+                break;
+            }
+            if( data->penDown ) {
+                commitStrokeSamples( data );
+            }
+            struct PixelRect visible = visibleImageRect( &data->view );
+            renderAnnotations( data, visible, FALSE );
+
+            // To make the pen feel more snappy, draw a temporary tail from the end of the current stroke, through the
+            // newest mouse sample (which may have been too close to the last point to be added), to where the mouse is
+            // predicted to be by the time this frame is on screen. The tail is a single polyline, so it doesn't
+            // overlap itself, which lets highlighters have one too. It has the width of the end of the stroke
+            if( data->penDown && data->strokeStore.count > 0 ) {
+                struct Stroke* stroke = &data->strokeStore.strokes[ data->strokeStore.count - 1 ];
                 // Select the right pen or highlighter
                 Gdiplus::Pen* pen = stroke->highlighter ? 
                     data->highlighters[ stroke->penIndex ] :  data->pens[ stroke->penIndex ];
-                // Only draw strokes with at least one segment (two points or more)
-                if( stroke->count > 1 ) {           
-                    graphics.DrawCurve( pen, stroke->points, stroke->count );
+                if( stroke->path.pointCount > 0 && data->inkPredictor.count > 0 ) {
+                    Gdiplus::Graphics graphics( data->backbuffer );
+                    graphics.SetSmoothingMode( Gdiplus::SmoothingModeHighQuality );
+                    graphics.SetClip( Gdiplus::Rect( visible.left, visible.top, visible.right - visible.left, 
+                        visible.bottom - visible.top ) );
+                    float const* p = stroke->path.points + stroke->path.pointCount * 2 - 2;
+                    struct InkSample const* newest = newestInkSample( &data->inkPredictor );
+                    Gdiplus::PointF tail[ 3 ] = { Gdiplus::PointF( p[ 0 ], p[ 1 ] ), 
+                        Gdiplus::PointF( newest->x, newest->y ) };
+                    int count = 2;
+                    float x;
+                    float y;
+                    double now = (double)(DWORD)( GetTickCount() - data->inkStart );
+                    if( predictInk( &data->inkPredictor, now + inkLatencyMs, &x, &y ) ) {
+                        tail[ count++ ] = Gdiplus::PointF( x, y );
+                    }
+                    Gdiplus::Color color;
+                    pen->GetColor( &color );
+                    Gdiplus::Pen tailPen( color, stroke->path.widths[ stroke->path.pointCount - 1 ] );
+                    tailPen.SetEndCap( Gdiplus::LineCapRound );
+                    graphics.DrawLines( &tailPen, tail, count );
                 }
             }
 
-            // To make the pen feel a bit more snappy, draw a straight line from the end of the current stroke
-            // to the position of the mouse cursor. This line is just temporary and will be replaced by a point
-            // in the stroke point list when the mouse button is released
-            if( data->penDown && data->strokeCount > 0 ) {
-                struct Stroke* stroke = &data->strokes[ data->strokeCount - 1 ];
-                // Select the right pen or highlighter
-                Gdiplus::Pen* pen = stroke->highlighter ? 
-                    data->highlighters[ stroke->penIndex ] :  data->pens[ stroke->penIndex ];
-                if( stroke->count > 0 && !stroke->highlighter ) {
-                    POINT mouse;
-                    GetCursorPos( &mouse );
-                    ScreenToClient( hwnd, &mouse );
-                    Gdiplus::Point p = stroke->points[ stroke->count - 1 ];
-                    graphics.DrawLine( pen, p.X, p.Y, (INT)( mouse.x / data->scale ), (INT)( ( mouse.y - spaceForButtons ) / data->scale ) );
-                }
+            // Show what will be cropped away. Only the crop rect is kept, the saved image is composited without this
+            struct PixelRect all = { data->bounds.left, data->bounds.top, data->bounds.right, data->bounds.bottom };
+            if( data->cropMode || memcmp( &data->crop, &all, sizeof( all ) ) != 0 ) {
+                drawCropFrame( data, visible );
             }
 
-            // Copy the backbuffer to the window so it can be seen
+            // Resample the visible part of the backbuffer to the view surface, and copy that to the window
+            GdiFlush();
+            renderViewport( &data->view, &data->backbufferPixels, &data->viewPixels, 0x00c0c0c0, data->viewColumns );
             PAINTSTRUCT ps; 
             HDC dc = BeginPaint( hwnd, &ps );
+            BitBlt( dc, 0, spaceForButtons, data->viewPixels.width, data->viewPixels.height, data->viewDC, 0, 0, SRCCOPY );
+            EndPaint( hwnd, &ps );
+        } break;
 
-            if( data->scale == 1.0f ) {
-                BitBlt( dc, 0, spaceForButtons, bounds.right - bounds.left, bounds.bottom - bounds.top, 
-                    backbuffer, 0, 0, SRCCOPY );
+        // Mouse wheel zooms around the cursor when holding Ctrl, and otherwise scrolls (horizontally if holding Shift)
+        case WM_MOUSEWHEEL: {
+            float steps = GET_WHEEL_DELTA_WPARAM( wparam ) / (float) WHEEL_DELTA;
+            POINT pos = { GET_X_LPARAM( lparam ), GET_Y_LPARAM( lparam ) }; // Wheel messages use screen coordinates
+            ScreenToClient( hwnd, &pos );
+            if( GET_KEYSTATE_WPARAM( wparam ) & MK_CONTROL ) {
+                zoomViewport( &data->view, data->view.zoom * powf( 1.25f, steps ), (float) pos.x, 
+                    (float)( pos.y - spaceForButtons ) );
+                data->zoom = data->view.zoom / data->scale;
+            } else if( GET_KEYSTATE_WPARAM( wparam ) & MK_SHIFT ) {
+                panViewport( &data->view, -steps * 100.0f, 0.0f );
             } else {
-                int w = (int)( ( bounds.right - bounds.left ) * data->scale );
-                int h = (int)( ( bounds.bottom - bounds.top ) * data->scale );
-                SetStretchBltMode( backbuffer, COLORONCOLOR );
-                StretchBlt( dc, 0, spaceForButtons, w, h, 
-                    backbuffer, 0, 0, bounds.right - bounds.left, bounds.bottom - bounds.top, SRCCOPY );
+                panViewport( &data->view, 0.0f, -steps * 100.0f );
             }
+            markFrameDirty( &data->scheduler );
+            return 0;
+        }
 
-            
-            EndPaint( hwnd, &ps );
+        // Dragging with the middle mouse button pans the view
+        case WM_MBUTTONDOWN: {
+            data->panning = TRUE;
+            data->panFrom.x = GET_X_LPARAM( lparam );
+            data->panFrom.y = GET_Y_LPARAM( lparam );
+            SetCapture( hwnd );
+        } break;
+
+        case WM_MBUTTONUP: {
+            if( data->panning ) {
+                data->panning = FALSE;
+                ReleaseCapture();
+            }
         } break;
 
         case WM_LBUTTONDOWN: {
-            // Start a new stroke
+            commitTextLabel( data );
+            // Start dragging out a new shape, or open the edit control for a new text label
+            if( data->shapes ) {
+                POINT p = clientToSnippet( data, GET_X_LPARAM( lparam ), GET_Y_LPARAM( lparam ), spaceForButtons );
+                if( data->shapeType == SHAPE_TEXT ) {
+                    openTextLabel( data, hwnd, p, GET_X_LPARAM( lparam ), GET_Y_LPARAM( lparam ) );
+                } else {
+                    data->activeShape = addShape( &data->scene, data->shapeType, data->penIndex, 
+                        data->pens[ data->penIndex ]->GetWidth(), (float) p.x, (float) p.y, (float) p.x, (float) p.y, 
+                        NULL );
+                }
+                markFrameDirty( &data->scheduler );
+                break;
+            }
+            // Drag the edges of the crop rect near the cursor, or if there are none, drag out a new crop rect
+            if( data->cropMode ) {
+                POINT p = clientToSnippet( data, GET_X_LPARAM( lparam ), GET_Y_LPARAM( lparam ), spaceForButtons );
+                data->cropDrag = hitCropEdges( data, p );
+                if( !data->cropDrag ) {
+                    p.x = max( data->bounds.left, min( data->bounds.right, p.x ) );
+                    p.y = max( data->bounds.top, min( data->bounds.bottom, p.y ) );
+                    struct PixelRect start = { p.x, p.y, p.x, p.y };
+                    data->crop = start;
+                    data->cropDrag = cropRight | cropBottom;
+                }
+                SetCapture( hwnd );
+                markFrameDirty( &data->scheduler );
+                break;
+            }
+            // Start dragging out a new redaction rect
+            if( data->redact ) {
+                POINT p = clientToSnippet( data, GET_X_LPARAM( lparam ), GET_Y_LPARAM( lparam ), spaceForButtons );
+                beginRedaction( data, p );
+                break;
+            }
+            // Clicking a stroke while holding Ctrl gives it the color of the current pen or highlighter. Otherwise, start 
+            // a new stroke
             if( !data->eraser ) {
+                POINT p = clientToSnippet( data, GET_X_LPARAM( lparam ), GET_Y_LPARAM( lparam ), spaceForButtons );
+                int penIndex = data->highlighter ? data->highlightIndex : data->penIndex;
+                if( wparam & MK_CONTROL ) {
+                    int hit = hitStroke( data, (float) p.x, (float) p.y, data->highlighter, 5.0f );
+                    if( hit >= 0 ) {
+                        recolorStroke( &data->strokeStore, hit, penIndex );
+                        journalStrokeEdit( data->journal, JOURNAL_RECOLOR, hit, penIndex );
+                        markFrameDirty( &data->scheduler );
+                    }
+                    break;
+                }
+                if( !addStroke( &data->strokeStore, data->highlighter, penIndex ) ) {
+                    break;
+                }
+                journalAddStroke( data->journal, data->highlighter, penIndex );
                 data->penDown = TRUE;
-                newStroke( data, data->highlighter, 
-                    data->highlighter ? data->highlightIndex : data->penIndex );
-                POINT p = { (int)( GET_X_LPARAM( lparam ) / data->scale ), (int)( ( GET_Y_LPARAM( lparam ) - spaceForButtons ) / data->scale ) };
+                data->inkStart = (DWORD) GetMessageTime();
+                data->ink.count = 0;
+                resetInkPredictor( &data->inkPredictor );
+                struct InkSample first = { (float) p.x, (float) p.y, 0.0, data->penPressure };
+                addInkSample( &data->inkPredictor, first );
                 addStrokePoint( data, &p, TRUE );
-                InvalidateRect( hwnd, NULL, FALSE );
+                markFrameDirty( &data->scheduler );
                 break; // If we are in 'eraser' mode, fall through into the "RBUTTONDOWN" eraser code below
             }
         } // Intentionally no `break;` statement here
 
         case WM_RBUTTONDOWN: {
             // Remove strokes when the user press the right button or if `erase` mode is enabled and pressing left button
-            Gdiplus::Point p = { (int)( GET_X_LPARAM( lparam ) / data->scale ), (int)( ( GET_Y_LPARAM( lparam ) - spaceForButtons ) / data->scale ) };
-            HDC backbuffer = data->backbuffer;
-            Gdiplus::Graphics graphics( backbuffer );
-            graphics.SetSmoothingMode( Gdiplus::SmoothingModeHighQuality );
-            if( data->strokeCount > 0 ) {
-                // Check all strokes in reverse order (not strictly necessary now as we don't break after deleting a
-                // stroke, but will be helpful if we would do that, as strokes drawn on top have higher priority)
-                for( int i = data->strokeCount - 1; i >= 0 ; --i ) {
-                    struct Stroke* stroke = &data->strokes[ i ];
-                    if( stroke->count > 1 ) {           
-                        Gdiplus::Pen* pen = stroke->highlighter ? data->highlightEraser : data->penEraser;
-                        // Check if the cursor is on this stroke by building a path from it and calling `IsOutlineVisible`
-                        Gdiplus::GraphicsPath path;
-                        path.AddCurve( stroke->points, stroke->count );
-                        if( path.IsOutlineVisible( p, pen, &graphics ) ) {
-                            stroke->count = 0;
-                            InvalidateRect( hwnd, NULL, TRUE );
-                        }
+            POINT c = clientToSnippet( data, GET_X_LPARAM( lparam ), GET_Y_LPARAM( lparam ), spaceForButtons );
+            Gdiplus::Point p( c.x, c.y );
+            // Erased strokes keep their points, so the erasing can be undone
+            for( int i = data->strokeStore.count - 1; i >= 0 ; --i ) {
+                struct Stroke* stroke = &data->strokeStore.strokes[ i ];
+                if( !stroke->erased && stroke->path.pointCount > 1 ) {           
+                    Gdiplus::Pen* pen = stroke->highlighter ? data->highlightEraser : data->penEraser;
+                    // Check if the cursor is within half the eraser width of the cached outline
+                    if( strokeOutlineHit( &stroke->outline, (float) p.X, (float) p.Y, pen->GetWidth() * 0.5f ) ) {
+                        eraseStroke( &data->strokeStore, i );
+                        journalStrokeEdit( data->journal, JOURNAL_ERASE, i, 0 );
+                        markFrameDirty( &data->scheduler );
                     }
                 }
             }
+            // Remove any shapes under the cursor
+            for( int hit = hitTestScene( &data->scene, (float) p.X, (float) p.Y, 10.0f ); hit >= 0; 
+                hit = hitTestScene( &data->scene, (float) p.X, (float) p.Y, 10.0f ) ) {
+                removeShape( &data->scene, hit );
+                markFrameDirty( &data->scheduler );
+            }
+            // Remove any redactions under the cursor
+            for( int i = data->redactionCount - 1; i >= 0; --i ) {
+                struct PixelRect r = data->redactions[ i ].rect;
+                if( p.X >= r.left && p.X < r.right && p.Y >= r.top && p.Y < r.bottom ) {
+                    memmove( &data->redactions[ i ], &data->redactions[ i + 1 ], 
+                        sizeof( *data->redactions ) * ( data->redactionCount - i - 1 ) );
+                    --data->redactionCount;
+                    markFrameDirty( &data->scheduler );
+                }
+            }
         } break;
 
         // When releasing the mouse button, stop drawing
         case WM_LBUTTONUP: {
+            // Complete the shape being dragged out. Shapes too small to be seen are discarded
+            if( data->activeShape >= 0 ) {
+                POINT p = clientToSnippet( data, GET_X_LPARAM( lparam ), GET_Y_LPARAM( lparam ), spaceForButtons );
+                struct Shape* shape = &data->scene.shapes[ data->activeShape ];
+                shape->x1 = (float) p.x;
+                shape->y1 = (float) p.y;
+                updateShape( &data->scene, data->activeShape );
+                if( fabsf( shape->x1 - shape->x0 ) < 3.0f && fabsf( shape->y1 - shape->y0 ) < 3.0f ) {
+                    removeShape( &data->scene, data->activeShape );
+                }
+                data->activeShape = -1;
+                markFrameDirty( &data->scheduler );
+            }
+            if( data->redacting ) {
+                POINT p = clientToSnippet( data, GET_X_LPARAM( lparam ), GET_Y_LPARAM( lparam ), spaceForButtons );
+                endRedaction( data, p );
+                markFrameDirty( &data->scheduler );
+            }
+            // Complete the crop. A rect too small to be meant goes back to the whole snippet
+            if( data->cropDrag ) {
+                POINT p = clientToSnippet( data, GET_X_LPARAM( lparam ), GET_Y_LPARAM( lparam ), spaceForButtons );
+                dragCrop( data, p );
+                data->cropDrag = 0;
+                ReleaseCapture();
+                if( data->crop.right - data->crop.left < 4 || data->crop.bottom - data->crop.top < 4 ) {
+                    struct PixelRect all = { data->bounds.left, data->bounds.top, data->bounds.right, 
+                        data->bounds.bottom };
+                    data->crop = all;
+                }
+                markFrameDirty( &data->scheduler );
+            }
             if( data->penDown ) {
+                commitStrokeSamples( data );
                 data->penDown = FALSE;
-                POINT p = { (int)( GET_X_LPARAM( lparam ) / data->scale ), (int)( ( GET_Y_LPARAM( lparam ) - spaceForButtons ) / data->scale ) };
+                POINT p = clientToSnippet( data, GET_X_LPARAM( lparam ), GET_Y_LPARAM( lparam ), spaceForButtons );
                 addStrokePoint( data, &p, TRUE );
-                InvalidateRect( hwnd, NULL, FALSE );
+                struct StrokeStore* store = &data->strokeStore;
+                if( store->strokes[ store->count - 1 ].path.pointCount < 2 ) {
+                    discardLastStroke( store ); // Nothing was drawn, so there is nothing to undo either
+                    journalStrokeEdit( data->journal, JOURNAL_DISCARD, 0, 0 );
+                }
+                flushStrokeJournal( data->journal );
+                markFrameDirty( &data->scheduler );
+            }
+        } break;
+
+        // Keep track of the pressure of a pen on a tablet. The message is passed on, so the pen still gets turned into
+        // the mouse messages below
+        case WM_POINTERDOWN:
+        case WM_POINTERUPDATE: {
+            POINTER_INPUT_TYPE type;
+            POINTER_PEN_INFO pen;
+            data->penPressure = 0.0f;
+            if( GetPointerTypePtr && GetPointerPenInfoPtr && 
+                GetPointerTypePtr( GET_POINTERID_WPARAM( wparam ), &type ) && type == PT_PEN && 
+                GetPointerPenInfoPtr( GET_POINTERID_WPARAM( wparam ), &pen ) && ( pen.penMask & PEN_MASK_PRESSURE ) ) {
+                data->penPressure = max( 1u, (UINT32) pen.pressure ) / 1024.0f; // Zero would mean no pressure at all
             }
         } break;
 
-        // When the mouse moves and the left button is being held, add a point to the current stroke
+        // When the mouse moves and the left button is being held, queue a point for the current stroke
         case WM_MOUSEMOVE: {
+            if( data->activeShape >= 0 ) {
+                POINT p = clientToSnippet( data, GET_X_LPARAM( lparam ), GET_Y_LPARAM( lparam ), spaceForButtons );
+                data->scene.shapes[ data->activeShape ].x1 = (float) p.x;
+                data->scene.shapes[ data->activeShape ].y1 = (float) p.y;
+                updateShape( &data->scene, data->activeShape );
+                markFrameDirty( &data->scheduler );
+            }
+            if( data->panning ) {
+                panViewport( &data->view, (float)( data->panFrom.x - GET_X_LPARAM( lparam ) ), 
+                    (float)( data->panFrom.y - GET_Y_LPARAM( lparam ) ) );
+                data->panFrom.x = GET_X_LPARAM( lparam );
+                data->panFrom.y = GET_Y_LPARAM( lparam );
+                markFrameDirty( &data->scheduler );
+            }
+            if( data->redacting ) {
+                POINT p = clientToSnippet( data, GET_X_LPARAM( lparam ), GET_Y_LPARAM( lparam ), spaceForButtons );
+                updateRedaction( data, p );
+                markFrameDirty( &data->scheduler );
+            }
+            if( data->cropDrag ) {
+                POINT p = clientToSnippet( data, GET_X_LPARAM( lparam ), GET_Y_LPARAM( lparam ), spaceForButtons );
+                dragCrop( data, p );
+                markFrameDirty( &data->scheduler );
+            }
             if( data->penDown ) {
-                POINT p = { (int)( GET_X_LPARAM( lparam ) / data->scale ), (int)( ( GET_Y_LPARAM( lparam ) - spaceForButtons ) / data->scale ) };
-                addStrokePoint( data, &p, FALSE );
-                InvalidateRect( hwnd, NULL, FALSE );
+                queueStrokeSample( data, GET_X_LPARAM( lparam ), GET_Y_LPARAM( lparam ), spaceForButtons );
+                markFrameDirty( &data->scheduler );
             }
         } break;
 
         case WM_DRAWITEM: {
             DRAWITEMSTRUCT* item = (DRAWITEMSTRUCT*) lparam;
-            HBRUSH brush; 
-            int offset = 0;
-            if( ( item->itemState & ODS_HOTLIGHT ) || (item->itemState & ODS_SELECTED ) ) {
-                brush = (HBRUSH) CreateSolidBrush( GetSysColor( COLOR_MENUHILIGHT ) );
-                offset = data->penCount + data->highlightCount;
-            } else {
-                brush = (HBRUSH) CreateSolidBrush( GetSysColor( COLOR_MENU ) );
-            }
-            FillRect( item->hDC, &item->rcItem, brush );
-            HDC dc = CreateCompatibleDC( item->hDC );
-            SelectObject( dc, data->menuIcons[ item->itemID + offset - 1 ] );
-            BitBlt( item->hDC, item->rcItem.left + data->menuMarginH, item->rcItem.top + data->menuMarginV, 
-                item->rcItem.right - item->rcItem.left - data->menuMarginH * 2, 
-                item->rcItem.bottom - item->rcItem.top - data->menuMarginV * 2, 
-                dc, 0, 0, SRCCOPY );
-            DeleteObject( dc );
+            BOOL hot = ( item->itemState & ODS_HOTLIGHT ) || ( item->itemState & ODS_SELECTED );
+            COLORREF color = GetSysColor( hot ? COLOR_MENUHILIGHT : COLOR_MENU );
+            HBRUSH brush = (HBRUSH) getResource( &data->resources, resourceKey( RESOURCE_BRUSH, 0, color, 0 ) );
+            if( brush ) {
+                FillRect( item->hDC, &item->rcItem, brush );
+            }
+
+            // The icons come from an atlas made for the size of the item, so they are only drawn once per scale
+            int w = item->rcItem.right - item->rcItem.left - data->menuMarginH * 2;
+            int h = item->rcItem.bottom - item->rcItem.top - data->menuMarginV * 2;
+            HBITMAP atlas = (HBITMAP) getResource( &data->resources, 
+                resourceKey( RESOURCE_BITMAP, h, color, menuIconsBitmap ) );
+            HDC dc = (HDC) getResource( &data->resources, resourceKey( RESOURCE_DC, 0, 0, 0 ) );
+            if( atlas && dc ) {
+                HGDIOBJ oldBitmap = SelectObject( dc, atlas );
+                BitBlt( item->hDC, item->rcItem.left + data->menuMarginH, item->rcItem.top + data->menuMarginV, 
+                    min( w, h * menuItemWidth / menuItemHeight ), h, dc, 0, ( item->itemID - 1 ) * h, SRCCOPY );
+                SelectObject( dc, oldBitmap );
+            }
         }
     }
 
     return DefWindowProc( hwnd, message, wparam, lparam);
 }
 
-int const menuItemWidth = 120;
-int const menuItemHeight = 20; 
-
-// Create an icon representing a pen, for use in the dropdown menus to select pen or highlighter
-HBITMAP WINAPI penIcon( Gdiplus::Pen* pen, BOOL highlight = FALSE ) { 
-    HWND hwndDesktop = GetDesktopWindow(); 
-    HDC hdcDesktop = GetDC( hwndDesktop ); 
-    HDC hdcMem = CreateCompatibleDC( hdcDesktop ); 
-    COLORREF clrMenu = highlight ? GetSysColor( COLOR_MENUHILIGHT ): GetSysColor( COLOR_MENU ); 
-
-    HBRUSH hbrOld = (HBRUSH) SelectObject( hdcMem, CreateSolidBrush( clrMenu ) ); 
-
-
-    HBITMAP paHbm = CreateCompatibleBitmap( hdcDesktop, menuItemWidth, menuItemHeight ); 
-    HBITMAP hbmOld = (HBITMAP) SelectObject( hdcMem, paHbm ); 
- 
-    PatBlt( hdcMem, 0, 0, menuItemWidth, menuItemHeight, PATCOPY ); 
-    Gdiplus::Graphics graphics( hdcMem );
-    graphics.SetSmoothingMode( Gdiplus::SmoothingModeHighQuality );
-    graphics.DrawLine( pen, Gdiplus::Point( 0, menuItemHeight / 2 ), 
-        Gdiplus::Point( menuItemWidth, menuItemHeight / 2 ) );
-
-    SelectObject( hdcMem, hbmOld ); 
- 
-    DeleteObject( SelectObject( hdcMem, hbrOld ) ); 
-    DeleteDC( hdcMem ); 
-    ReleaseDC( hwndDesktop, hdcDesktop ); 
-    return paHbm;
-}
-
-
-int makeAnnotations( HMONITOR monitor, HBITMAP snippet, float snippetScale, int lang ) {
+// Let the user annotate `snippet`, which is updated with the result. The part of it to save is put in `crop`: the user
+// can crop it without the pixels being copied, and with `autoTrim`, it starts out with the uniform borders left out. If
+// `output` is not NULL, it also receives the snippet without annotations and the annotations as vectors (relative to
+// `crop`), which the caller must release. If `journal` is not NULL, the strokes recorded in it are redone, and every
+// edit of the strokes is recorded in it. Shapes and redactions are not. The bitmaps made while annotating are counted
+// in `telemetry`, unless it is NULL
+int makeAnnotations( HMONITOR monitor, HBITMAP snippet, float snippetScale, int lang, BOOL autoTrim, 
+    struct PixelRect* crop, struct AnnotationOutput* output, struct StrokeJournal* journal, 
+    struct Telemetry* telemetry ) {
     RECT bounds = { 0, 0, 0, 0 };
     
     BITMAP bmp;  
@@ -492,6 +1360,10 @@ int makeAnnotations( HMONITOR monitor, HBITMAP snippet, float snippetScale, int
     MONITORINFO info;
     info.cbSize = sizeof( info );
     GetMonitorInfo( monitor, &info );
+
+    // Snippets larger than the monitor are zoomed out to fit, rather than letting the window spill off screen
+    width = min( width, info.rcWork.right - info.rcWork.left );
+    height = min( height, info.rcWork.bottom - info.rcWork.top );
     int x = info.rcWork.left + max( 0, ( ( info.rcWork.right - info.rcWork.left ) - width ) / 2 );
     int y = info.rcWork.top + max( 0, ( ( info.rcWork.bottom - info.rcWork.top ) - height ) / 2 );
     
@@ -534,12 +1406,28 @@ int makeAnnotations( HMONITOR monitor, HBITMAP snippet, float snippetScale, int
     makeAnnotationsData.arrowCursor = LoadCursor( NULL, IDC_ARROW );
     makeAnnotationsData.penCursor = (HCURSOR) LoadCursorA( GetModuleHandleA( NULL ), MAKEINTRESOURCEA( IDR_PEN ) );
     makeAnnotationsData.eraserCursor = (HCURSOR) LoadCursorA( GetModuleHandleA( NULL ), MAKEINTRESOURCEA( IDR_ERASER ) );
+    makeAnnotationsData.crossCursor = LoadCursor( NULL, IDC_CROSS );
+    makeAnnotationsData.output = output;
+    makeAnnotationsData.telemetry = telemetry;
+    makeAnnotationsData.journal = journal;
+    makeAnnotationsData.zoom = 1.0f;
+    makeAnnotationsData.view.zoom = 1.0f;
+    makeAnnotationsData.view.imageWidth = bounds.right - bounds.left;
+    makeAnnotationsData.view.imageHeight = bounds.bottom - bounds.top;
+    struct PixelRect all = { bounds.left, bounds.top, bounds.right, bounds.bottom };
+    makeAnnotationsData.crop = all;
+    makeAnnotationsData.cropOutput = crop;
+    *crop = all;
+    struct ResourceBackend gdiBackend = { &makeAnnotationsData, createGdiResource, destroyGdiResource };
+    initResourceCache( &makeAnnotationsData.resources, &gdiBackend );
 
     makeAnnotationsData.menuMarginH = 20;
     makeAnnotationsData.menuMarginV = 5;
-    HBITMAP menuItemSpace = CreateCompatibleBitmap( GetDC( hwnd ), 
+    HDC screen = GetDC( NULL );
+    HBITMAP menuItemSpace = CreateCompatibleBitmap( screen, 
         menuItemWidth + makeAnnotationsData.menuMarginH * 2, 
         menuItemHeight + makeAnnotationsData.menuMarginV * 2 ); 
+    ReleaseDC( NULL, screen );
 
     // Create the `pen` menu and add all items to it
     HMENU penMenu = CreatePopupMenu();
@@ -571,16 +1459,29 @@ int makeAnnotations( HMONITOR monitor, HBITMAP snippet, float snippetScale, int
     makeAnnotationsData.highlightMenu = highlightMenu;
     makeAnnotationsData.highlightCount = highlightCount;
 
-    HBITMAP menuIcons[ 2 * ( penCount + highlightCount ) ];
-    for( int i = 0; i < penCount; ++i ) {
-        menuIcons[ i ] = penIcon( pens[ i ] );
-        menuIcons[ i + penCount + highlightCount ] = penIcon( pens[ i ], TRUE );
-    }
-    for( int i = 0; i < highlightCount; ++i ) {
-        menuIcons[ penCount + i ] = penIcon( highlights[ i ] );
-        menuIcons[ penCount + i + penCount + highlightCount ] = penIcon( highlights[ i ], TRUE );
-    }
-    makeAnnotationsData.menuIcons = menuIcons;
+    // Create the `redact` menu
+    HMENU redactMenu = CreatePopupMenu();
+    AppendMenuW( redactMenu, MF_STRING, 1, localization[ lang ].blur );
+    AppendMenuW( redactMenu, MF_STRING, 2, localization[ lang ].pixelate );
+    makeAnnotationsData.redactMenu = redactMenu;
+    makeAnnotationsData.redactMode = REDACT_BLUR;
+
+    // Create the `shapes` menu, with items in the same order as `ShapeType`
+    HMENU shapeMenu = CreatePopupMenu();
+    AppendMenuW( shapeMenu, MF_STRING, 1 + SHAPE_ARROW, localization[ lang ].arrow );
+    AppendMenuW( shapeMenu, MF_STRING, 1 + SHAPE_RECTANGLE, localization[ lang ].rectangle );
+    AppendMenuW( shapeMenu, MF_STRING, 1 + SHAPE_ELLIPSE, localization[ lang ].ellipse );
+    AppendMenuW( shapeMenu, MF_STRING, 1 + SHAPE_TEXT, localization[ lang ].text );
+    makeAnnotationsData.shapeMenu = shapeMenu;
+    makeAnnotationsData.shapeType = SHAPE_ARROW;
+    makeAnnotationsData.activeShape = -1;
+    // Create the `crop` menu
+    HMENU cropMenu = CreatePopupMenu();
+    AppendMenuW( cropMenu, MF_STRING, 1, localization[ lang ].crop );
+    AppendMenuW( cropMenu, MF_STRING, 2, localization[ lang ].trim );
+    AppendMenuW( cropMenu, MF_STRING, 3, localization[ lang ].resetCrop );
+    makeAnnotationsData.cropMenu = cropMenu;
+    makeAnnotationsData.font = new Gdiplus::Font( L"Segoe UI", 20.0f, Gdiplus::FontStyleRegular, Gdiplus::UnitPixel );
 
     // Create buttons
     makeAnnotationsData.penButton = CreateWindowW( L"BUTTON", localization[ lang ].pen,
@@ -595,42 +1496,103 @@ int makeAnnotations( HMONITOR monitor, HBITMAP snippet, float snippetScale, int
         WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON | BS_FLAT,
         5 + 80 * 2, 7, 75, 20, hwnd, NULL, GetModuleHandleW( NULL ), NULL );
     
+    makeAnnotationsData.redactButton = CreateWindowW( L"BUTTON", localization[ lang ].redact,
+        WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON | BS_FLAT,
+        5 + 80 * 3, 7, 75, 20, hwnd, NULL, GetModuleHandleW( NULL ), NULL );
+    
+    makeAnnotationsData.shapeButton = CreateWindowW( L"BUTTON", localization[ lang ].shapes,
+        WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON | BS_FLAT,
+        5 + 80 * 4, 7, 75, 20, hwnd, NULL, GetModuleHandleW( NULL ), NULL );
+    
+    makeAnnotationsData.cropButton = CreateWindowW( L"BUTTON", localization[ lang ].crop,
+        WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON | BS_FLAT,
+        5 + 80 * 5, 7, 75, 20, hwnd, NULL, GetModuleHandleW( NULL ), NULL );
+    
     makeAnnotationsData.doneButton = CreateWindowW( L"BUTTON", localization[ lang ].done,
         WS_TABSTOP | WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON | BS_FLAT,
-        5 + 10 + 80 * 3, 7, 75, 20, hwnd, NULL, GetModuleHandleW( NULL ), NULL );
+        5 + 10 + 80 * 6, 7, 75, 20, hwnd, NULL, GetModuleHandleW( NULL ), NULL );
 
     float scale = getDisplayScaling( hwnd );
     if( scale == 0.0f ) {
         scale = 1.0f;
     }
-    resizeButton( makeAnnotationsData.penButton, 1.0f, scale );
-    resizeButton( makeAnnotationsData.highlightButton, 1.0f, scale );
-    resizeButton( makeAnnotationsData.eraseButton, 1.0f, scale );
-    makeAnnotationsData.buttonHeight = resizeButton( makeAnnotationsData.doneButton, 1.0f, scale );
+    resizeButton( &makeAnnotationsData.resources, makeAnnotationsData.penButton, 1.0f, scale );
+    resizeButton( &makeAnnotationsData.resources, makeAnnotationsData.highlightButton, 1.0f, scale );
+    resizeButton( &makeAnnotationsData.resources, makeAnnotationsData.eraseButton, 1.0f, scale );
+    resizeButton( &makeAnnotationsData.resources, makeAnnotationsData.redactButton, 1.0f, scale );
+    resizeButton( &makeAnnotationsData.resources, makeAnnotationsData.shapeButton, 1.0f, scale );
+    resizeButton( &makeAnnotationsData.resources, makeAnnotationsData.cropButton, 1.0f, scale );
+    makeAnnotationsData.buttonHeight = resizeButton( &makeAnnotationsData.resources, makeAnnotationsData.doneButton, 
+        1.0f, scale );
 
     // Attach state data to window instance
     SetWindowLongPtrA( hwnd, GWLP_USERDATA, (LONG_PTR)&makeAnnotationsData );
     ShowWindow( hwnd, SW_SHOW );
     UpdateWindow( hwnd );
 
-    // Create off-screen drawing surface for window
+    // Create off-screen drawing surface for window. It is a DIB section, so redactions can work on the pixels directly
     HDC dc = GetDC( hwnd );
-    HBITMAP backbuffer = CreateCompatibleBitmap( dc, bounds.right - bounds.left, bounds.bottom - bounds.top );
-    makeAnnotationsData.backbuffer = CreateCompatibleDC( dc );
-    SelectObject( makeAnnotationsData.backbuffer, backbuffer );
+    HBITMAP backbuffer = createPixelBitmap( dc, bounds.right - bounds.left, bounds.bottom - bounds.top, 
+        &makeAnnotationsData.backbuffer, &makeAnnotationsData.backbufferPixels );
+    trackBitmap( telemetry, backbuffer, 1 );
 
     // Create device context for screen snippet
     makeAnnotationsData.snippet = CreateCompatibleDC( dc );
     SelectObject( makeAnnotationsData.snippet, snippet );
     ReleaseDC( hwnd, dc );
+
+    // When resuming from a journal, redo the strokes already recorded in it
+    if( journal ) {
+        resumeStrokeJournal( journal, &makeAnnotationsData.strokeStore, strokeMargin, penCount, highlightCount );
+    }
+    if( autoTrim ) {
+        trimCrop( &makeAnnotationsData );
+    }
     InvalidateRect( hwnd, NULL, TRUE );
     
-    // Standard windows message pump
+    // Message pump. Handlers only mark the frame scheduler dirty, and once all pending messages are handled, the
+    // window is repainted if the scheduler says it's time. So a burst of input causes one repaint per display refresh
+    // at most, and none at all while nothing changes
+    struct FrameScheduler* scheduler = &makeAnnotationsData.scheduler;
+    initFrameScheduler( scheduler, 1000.0 / 60.0, frameClock() );
+    syncFrameClock( scheduler );
     MSG msg = { NULL };
-    while( GetMessage( &msg, NULL, 0, 0 ) ) {
-        TranslateMessage(&msg);
-        DispatchMessage(&msg);
+    BOOL quit = FALSE;
+    while( !quit ) {
+        double delay = frameDelay( scheduler, frameClock() );
+        if( delay != 0.0 ) {
+            MsgWaitForMultipleObjectsEx( 0, NULL, delay < 0.0 ? INFINITE : (DWORD) ceil( delay ), QS_ALLINPUT, 
+                MWMO_INPUTAVAILABLE );
+        }
+        while( !quit && PeekMessage( &msg, NULL, 0, 0, PM_REMOVE ) ) {
+            if( msg.message == WM_QUIT ) {
+                quit = TRUE;
+            } else if( isUndoKey( &makeAnnotationsData, &msg ) ) {
+                // Ctrl+Z undoes the last edit of the strokes, Ctrl+Y or Ctrl+Shift+Z redoes it. Whichever button has
+                // the focus, so they are caught here rather than in the window procedure
+                BOOL redo = msg.wParam == 'Y' || ( GetKeyState( VK_SHIFT ) & 0x8000 );
+                struct StrokeStore* store = &makeAnnotationsData.strokeStore;
+                if( ( redo ? redoStrokeEdit( store ) : undoStrokeEdit( store ) ) >= 0 ) {
+                    journalStrokeEdit( makeAnnotationsData.journal, redo ? JOURNAL_REDO : JOURNAL_UNDO, 0, 0 );
+                    markFrameDirty( scheduler );
+                }
+            } else {
+                TranslateMessage( &msg );
+                DispatchMessage( &msg );
+            }
+        }
+        if( !quit && beginFrame( scheduler, frameClock() ) ) {
+            RedrawWindow( hwnd, NULL, NULL, RDW_INVALIDATE | RDW_UPDATENOW );
+            endFrame( scheduler, frameClock() );
+            syncFrameClock( scheduler );
+        }
     }
+    struct ResourceCache* resources = &makeAnnotationsData.resources;
+    setTelemetryCounter( telemetry, "annotation_frames", scheduler->frames );
+    setTelemetryCounter( telemetry, "annotation_changes", scheduler->requests );
+    setTelemetryCounter( telemetry, "annotation_frames_late", scheduler->missed );
+    setTelemetryCounter( telemetry, "annotation_gdi_resources_created", resources->created );
+    sampleTelemetry( telemetry );
 
     // CLeanup
     delete penEraser;
@@ -644,9 +1606,21 @@ int makeAnnotations( HMONITOR monitor, HBITMAP snippet, float snippetScale, int
     }
 
     DestroyWindow( hwnd );
-    DeleteObject( makeAnnotationsData.snippet );
-    DeleteObject( makeAnnotationsData.backbuffer );
+    releaseResourceCache( &makeAnnotationsData.resources ); // The buttons used the fonts until they were destroyed
+    DeleteObject( menuItemSpace );
+    DeleteDC( makeAnnotationsData.snippet );
+    DeleteDC( makeAnnotationsData.backbuffer );
+    trackBitmap( telemetry, backbuffer, -1 );
     DeleteObject( backbuffer );
+    if( makeAnnotationsData.viewBitmap ) {
+        trackBitmap( telemetry, makeAnnotationsData.viewBitmap, -1 );
+        DeleteDC( makeAnnotationsData.viewDC );
+        DeleteObject( makeAnnotationsData.viewBitmap );
+    }
+    free( makeAnnotationsData.viewColumns );
+    releaseScene( &makeAnnotationsData.scene );
+    releaseStrokeStore( &makeAnnotationsData.strokeStore );
+    delete makeAnnotationsData.font;
 
     UnregisterClassW( wc.lpszClassName, GetModuleHandleW( NULL ) );
 
@@ -0,0 +1,102 @@
+// Portable pixel types shared by the capture, annotation and encoding code. Nothing in here depends on windows.h,
+// so the kernels built on top of it can be compiled and benchmarked on any platform.
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined( _M_X64 ) || defined( _M_IX86 ) || defined( __SSE2__ )
+    #include <emmintrin.h>
+    #define PIXELS_SSE2 1
+#endif
+
+
+// A view of 32-bit BGRA pixels (the memory layout of a 32bpp top-down DIB). `stride` is measured in pixels, not
+// bytes, and is negative for a view of bottom-up rows. The view does not own `pixels`, so a sub-rectangle of a larger
+// buffer is just a pointer offset.
+struct PixelBuffer {
+    uint32_t* pixels;
+    int width;
+    int height;
+    int stride;
+};
+
+
+// A view of 16-bit RGBA pixels, four channels in that order, for captures with more than 8 bits per channel. `stride`
+// is measured in pixels, like for `PixelBuffer`
+struct WidePixelBuffer {
+    uint16_t* pixels;
+    int width;
+    int height;
+    int stride;
+};
+
+
+// Rectangle in pixel coordinates, same conventions as a win32 RECT (right and bottom are exclusive)
+struct PixelRect {
+    int left;
+    int top;
+    int right;
+    int bottom;
+};
+
+
+static uint32_t* pixelRow( struct PixelBuffer const* buffer, int y ) {
+    return buffer->pixels + (ptrdiff_t) y * buffer->stride;
+}
+
+
+static uint16_t* widePixelRow( struct WidePixelBuffer const* buffer, int y ) {
+    return buffer->pixels + (ptrdiff_t) y * buffer->stride * 4;
+}
+
+
+static struct PixelRect intersectPixelRect( struct PixelRect a, struct PixelRect b ) {
+    struct PixelRect r = { a.left > b.left ? a.left : b.left, a.top > b.top ? a.top : b.top,
+        a.right < b.right ? a.right : b.right, a.bottom < b.bottom ? a.bottom : b.bottom };
+    if( r.right < r.left ) {
+        r.right = r.left;
+    }
+    if( r.bottom < r.top ) {
+        r.bottom = r.top;
+    }
+    return r;
+}
+
+
+static int pixelRectEmpty( struct PixelRect r ) {
+    return r.right <= r.left || r.bottom <= r.top;
+}
+
+
+static int pixelRectsIntersect( struct PixelRect a, struct PixelRect b ) {
+    return a.left < b.right && b.left < a.right && a.top < b.bottom && b.top < a.bottom;
+}
+
+
+static struct PixelRect unionPixelRect( struct PixelRect a, struct PixelRect b ) {
+    struct PixelRect r = { a.left < b.left ? a.left : b.left, a.top < b.top ? a.top : b.top,
+        a.right > b.right ? a.right : b.right, a.bottom > b.bottom ? a.bottom : b.bottom };
+    return r;
+}
+
+
+// View of the part of `buffer` inside `rect`, clamped to the buffer. The pixels are not copied: the view points into
+// `buffer` and keeps its stride, so encoders reading it row by row only see the rectangle
+static struct PixelBuffer cropPixelBuffer( struct PixelBuffer const* buffer, struct PixelRect rect ) {
+    struct PixelRect all = { 0, 0, buffer->width, buffer->height };
+    rect = intersectPixelRect( rect, all );
+    struct PixelBuffer view = { pixelRow( buffer, rect.top ) + rect.left, rect.right - rect.left, 
+        rect.bottom - rect.top, buffer->stride };
+    return view;
+}
+
+
+static struct WidePixelBuffer cropWidePixelBuffer( struct WidePixelBuffer const* buffer, struct PixelRect rect ) {
+    struct PixelRect all = { 0, 0, buffer->width, buffer->height };
+    rect = intersectPixelRect( rect, all );
+    struct WidePixelBuffer view = { widePixelRow( buffer, rect.top ) + rect.left * 4, rect.right - rect.left, 
+        rect.bottom - rect.top, buffer->stride };
+    return view;
+}
@@ -0,0 +1,1208 @@
+// PNG encoder with its own deflate, built so the time spent can be traded against file size. Rows are filtered with a
+// fixed or per-row adaptive PNG filter, then compressed as independent strips in parallel (each strip is a run of
+// deflate blocks ending on a byte boundary, so they simply concatenate into one zlib stream). Levels go from stored
+// (no compression) to lazy matching with long hash chains. Nothing in here depends on windows.h.
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+
+int const PNG_LEVEL_COUNT = 4;
+int const PNG_STRIP_ROWS = 64; // Rows per independently compressed strip, at least
+int const PNG_MAX_THREADS = 64;
+int const DEFLATE_WINDOW = 32768;
+int const DEFLATE_HASH_BITS = 15;
+int const DEFLATE_MIN_MATCH = 3;
+int const DEFLATE_MAX_MATCH = 258;
+int const DEFLATE_BLOCK_SYMBOLS = 32768; // Symbols collected before a block is written with its own Huffman codes
+
+
+// Settings for one compression level
+struct PngLevel {
+    int adaptiveFilter; // Pick the best filter per row (like libpng), or always use the `up` filter
+    int chainLength; // Max number of earlier positions tried when looking for a match. Zero means stored blocks
+    int lazy; // Check if the next position has a longer match before taking one
+    int niceLength; // Stop looking once a match is this long
+};
+
+
+static struct PngLevel const pngLevels[ PNG_LEVEL_COUNT ] = {
+    { 0, 0, 0, 0 }, // Stored, just the framing around the raw rows
+    { 0, 4, 0, 32 },
+    { 1, 16, 0, 64 },
+    { 1, 128, 1, 258 },
+};
+
+
+static uint32_t pngCrcTable[ 4 ][ 256 ]; // Slicing-by-4 tables: [ k ][ n ] is the CRC of byte n followed by k zeros
+static uint16_t deflateLengthCode[ DEFLATE_MAX_MATCH + 1 ]; // Index (0-28) of the length code for each length
+static uint8_t deflateDistanceCode[ 512 ]; // Distance code for distances 1-256 and (via `>> 7`) for larger ones
+
+static uint16_t const deflateLengthBase[ 29 ] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43,
+    51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static uint8_t const deflateLengthExtra[ 29 ] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4,
+    4, 4, 5, 5, 5, 5, 0 };
+static uint16_t const deflateDistanceBase[ 30 ] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257,
+    385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static uint8_t const deflateDistanceExtra[ 30 ] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9,
+    10, 10, 11, 11, 12, 12, 13, 13 };
+static uint8_t const deflateCodeLengthOrder[ 19 ] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1,
+    15 };
+
+
+static std::atomic<int> pngTablesReady;
+
+
+// Fills the lookup tables, the first time it is called. The first call must be made before any encoding threads start
+static void initPngTables( void ) {
+    if( pngTablesReady.load() ) {
+        return;
+    }
+    for( uint32_t n = 0; n < 256; ++n ) {
+        uint32_t c = n;
+        for( int k = 0; k < 8; ++k ) {
+            c = ( c & 1 ) ? 0xedb88320u ^ ( c >> 1 ) : c >> 1;
+        }
+        pngCrcTable[ 0 ][ n ] = c;
+    }
+    for( int n = 0; n < 256; ++n ) {
+        for( int k = 1; k < 4; ++k ) {
+            uint32_t c = pngCrcTable[ k - 1 ][ n ];
+            pngCrcTable[ k ][ n ] = pngCrcTable[ 0 ][ c & 0xff ] ^ ( c >> 8 );
+        }
+    }
+    for( int code = 0; code < 29; ++code ) {
+        int end = code < 28 ? deflateLengthBase[ code ] + ( 1 << deflateLengthExtra[ code ] ) : DEFLATE_MAX_MATCH + 1;
+        for( int length = deflateLengthBase[ code ]; length < end && length <= DEFLATE_MAX_MATCH; ++length ) {
+            deflateLengthCode[ length ] = (uint16_t) code;
+        }
+    }
+    for( int code = 0; code < 30; ++code ) {
+        int end = deflateDistanceBase[ code ] + ( 1 << deflateDistanceExtra[ code ] );
+        for( int distance = deflateDistanceBase[ code ]; distance < end; ++distance ) {
+            if( distance <= 256 ) {
+                deflateDistanceCode[ distance - 1 ] = (uint8_t) code;
+            } else {
+                deflateDistanceCode[ 256 + ( ( distance - 1 ) >> 7 ) ] = (uint8_t) code;
+            }
+        }
+    }
+    pngTablesReady.store( 1 );
+}
+
+
+static int deflateDistanceSymbol( int distance ) {
+    return distance <= 256 ? deflateDistanceCode[ distance - 1 ] : deflateDistanceCode[ 256 + ( ( distance - 1 ) >> 7 ) ];
+}
+
+
+static uint32_t pngCrc( uint32_t crc, uint8_t const* data, size_t size ) {
+    crc = ~crc;
+    size_t i = 0;
+    for( ; i + 4 <= size; i += 4 ) {
+        crc ^= (uint32_t) data[ i ] | ( (uint32_t) data[ i + 1 ] << 8 ) | ( (uint32_t) data[ i + 2 ] << 16 ) |
+            ( (uint32_t) data[ i + 3 ] << 24 );
+        crc = pngCrcTable[ 3 ][ crc & 0xff ] ^ pngCrcTable[ 2 ][ ( crc >> 8 ) & 0xff ] ^
+            pngCrcTable[ 1 ][ ( crc >> 16 ) & 0xff ] ^ pngCrcTable[ 0 ][ crc >> 24 ];
+    }
+    for( ; i < size; ++i ) {
+        crc = pngCrcTable[ 0 ][ ( crc ^ data[ i ] ) & 0xff ] ^ ( crc >> 8 );
+    }
+    return ~crc;
+}
+
+
+static uint32_t adler32( uint32_t adler, uint8_t const* data, size_t size ) {
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+    while( size > 0 ) {
+        size_t count = size < 5552 ? size : 5552; // Largest run which can't overflow before the modulo
+        for( size_t i = 0; i < count; ++i ) {
+            a += data[ i ];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+        data += count;
+        size -= count;
+    }
+    return ( b << 16 ) | a;
+}
+
+
+// Adler-32 of two concatenated runs of data, from the checksums of each run and the length of the second
+static uint32_t adler32Combine( uint32_t first, uint32_t second, size_t secondLength ) {
+    uint32_t const base = 65521;
+    uint32_t remainder = (uint32_t)( secondLength % base );
+    uint32_t a1 = first & 0xffff, b1 = first >> 16;
+    uint32_t a2 = second & 0xffff, b2 = second >> 16;
+    uint64_t a = (uint64_t) a1 + a2 + base - 1;
+    uint64_t b = (uint64_t) b1 + b2 + ( (uint64_t) remainder * a1 ) % base + base - remainder;
+    return (uint32_t)( ( b % base ) << 16 | ( a % base ) );
+}
+
+
+// LSB-first bit writer on top of a byte buffer
+struct BitWriter {
+    struct ByteBuffer* out;
+    uint64_t bits;
+    int count;
+};
+
+
+// Adds up to 16 bits. Whole 32-bit words are written out as they fill up
+static void putBits( struct BitWriter* writer, uint32_t value, int count ) {
+    writer->bits |= (uint64_t) value << writer->count;
+    writer->count += count;
+    if( writer->count >= 32 ) {
+        uint8_t bytes[ 4 ] = { (uint8_t) writer->bits, (uint8_t)( writer->bits >> 8 ), (uint8_t)( writer->bits >> 16 ),
+            (uint8_t)( writer->bits >> 24 ) };
+        appendBytes( writer->out, bytes, 4 );
+        writer->bits >>= 32;
+        writer->count -= 32;
+    }
+}
+
+
+// Pads with zero bits to a byte boundary, and writes out everything pending
+static void alignBits( struct BitWriter* writer ) {
+    writer->count = ( writer->count + 7 ) & ~7;
+    for( ; writer->count > 0; writer->count -= 8 ) {
+        appendByte( writer->out, (uint8_t) writer->bits );
+        writer->bits >>= 8;
+    }
+    writer->bits = 0;
+}
+
+
+// Code lengths for a Huffman code over `count` symbols, limited to `maxBits`. Symbols with a frequency of zero get no
+// code, but at least two symbols always get one, so the code is complete
+static void buildHuffmanLengths( uint32_t const* freqs, int count, int maxBits, uint8_t* lengths ) {
+    int symbols[ 288 ];
+    uint32_t weights[ 2 * 288 ];
+    int parents[ 2 * 288 ];
+    int used = 0;
+    for( int i = 0; i < count; ++i ) {
+        lengths[ i ] = 0;
+        if( freqs[ i ] ) {
+            symbols[ used++ ] = i;
+        }
+    }
+    for( int i = 0; used < 2 && i < count; ++i ) {
+        if( !freqs[ i ] ) {
+            symbols[ used++ ] = i; // Pad with unused symbols, which will get a code they never use
+        }
+    }
+    // Sort by ascending frequency (insertion sort, there are at most 288)
+    for( int i = 1; i < used; ++i ) {
+        int s = symbols[ i ];
+        int j = i;
+        while( j > 0 && freqs[ symbols[ j - 1 ] ] > freqs[ s ] ) {
+            symbols[ j ] = symbols[ j - 1 ];
+            --j;
+        }
+        symbols[ j ] = s;
+    }
+
+    // Two-queue Huffman construction: leaves in sorted order, and internal nodes as they are created (which are
+    // created in ascending weight order too)
+    for( int i = 0; i < used; ++i ) {
+        weights[ i ] = freqs[ symbols[ i ] ] ? freqs[ symbols[ i ] ] : 1;
+    }
+    int leaf = 0;
+    int node = used;
+    int next = used;
+    for( int created = 0; created < used - 1; ++created ) {
+        int pick[ 2 ];
+        for( int k = 0; k < 2; ++k ) {
+            if( leaf < used && ( node >= next || weights[ leaf ] <= weights[ node ] ) ) {
+                pick[ k ] = leaf++;
+            } else {
+                pick[ k ] = node++;
+            }
+        }
+        weights[ next ] = weights[ pick[ 0 ] ] + weights[ pick[ 1 ] ];
+        parents[ pick[ 0 ] ] = next;
+        parents[ pick[ 1 ] ] = next;
+        ++next;
+    }
+
+    // Depth of each leaf, counted per length. The root is `next - 1`
+    int lengthCounts[ 64 ] = { 0 };
+    int depths[ 2 * 288 ];
+    depths[ next - 1 ] = 0;
+    for( int i = next - 2; i >= 0; --i ) {
+        depths[ i ] = depths[ parents[ i ] ] + 1;
+    }
+    // Clamp lengths to the limit, which over-subscribes the code, measured in units of 2^-maxBits
+    int64_t kraft = 0;
+    for( int i = 0; i < used; ++i ) {
+        int depth = depths[ i ] > maxBits ? maxBits : depths[ i ];
+        ++lengthCounts[ depth ];
+        kraft += (int64_t) 1 << ( maxBits - depth );
+    }
+
+    // Fix that up the way zlib does: push a leaf one level down, where it makes room for a leaf from the bottom level.
+    // Each step takes off exactly one unit, so the code ends up complete
+    for( ; kraft > ( (int64_t) 1 << maxBits ); --kraft ) {
+        int bits = maxBits - 1;
+        while( lengthCounts[ bits ] == 0 ) {
+            --bits;
+        }
+        --lengthCounts[ bits ];
+        lengthCounts[ bits + 1 ] += 2;
+        --lengthCounts[ maxBits ];
+    }
+
+    // Hand out the lengths, longest to the least frequent symbols
+    int i = 0;
+    for( int bits = maxBits; bits > 0; --bits ) {
+        for( int n = lengthCounts[ bits ]; n > 0; --n ) {
+            lengths[ symbols[ i++ ] ] = (uint8_t) bits;
+        }
+    }
+}
+
+
+// Canonical codes from code lengths, bit reversed so they can be written LSB-first
+static void buildHuffmanCodes( uint8_t const* lengths, int count, uint16_t* codes ) {
+    int lengthCounts[ 16 ] = { 0 };
+    for( int i = 0; i < count; ++i ) {
+        ++lengthCounts[ lengths[ i ] ];
+    }
+    lengthCounts[ 0 ] = 0;
+    int nextCode[ 16 ];
+    int code = 0;
+    for( int bits = 1; bits < 16; ++bits ) {
+        code = ( code + lengthCounts[ bits - 1 ] ) << 1;
+        nextCode[ bits ] = code;
+    }
+    for( int i = 0; i < count; ++i ) {
+        int length = lengths[ i ];
+        if( length ) {
+            int c = nextCode[ length ]++;
+            int reversed = 0;
+            for( int b = 0; b < length; ++b ) {
+                reversed |= ( ( c >> b ) & 1 ) << ( length - 1 - b );
+            }
+            codes[ i ] = (uint16_t) reversed;
+        }
+    }
+}
+
+
+// A run of LZ77 output waiting to be written as a block. `distances[ i ]` is zero for a literal, in which case
+// `lengths[ i ]` holds the byte
+struct DeflateBlock {
+    uint16_t lengths[ DEFLATE_BLOCK_SYMBOLS ];
+    uint16_t distances[ DEFLATE_BLOCK_SYMBOLS ];
+    int count;
+    uint8_t const* start; // The input covered by the block, in case it is cheaper to store it
+    size_t size;
+};
+
+
+// Run-length code a pair of code length arrays with the code length alphabet (16 = repeat previous, 17/18 = zeros)
+static int encodeCodeLengths( uint8_t const* lengths, int count, uint8_t* symbols, uint8_t* extras ) {
+    int n = 0;
+    for( int i = 0; i < count; ) {
+        int run = 1;
+        while( i + run < count && lengths[ i + run ] == lengths[ i ] ) {
+            ++run;
+        }
+        if( lengths[ i ] == 0 && run >= 3 ) {
+            run = run > 138 ? 138 : run;
+            symbols[ n ] = run >= 11 ? 18 : 17;
+            extras[ n++ ] = (uint8_t)( run >= 11 ? run - 11 : run - 3 );
+        } else if( lengths[ i ] != 0 && run >= 4 ) {
+            symbols[ n ] = lengths[ i ];
+            extras[ n++ ] = 0;
+            run = run - 1 > 6 ? 7 : run;
+            symbols[ n ] = 16;
+            extras[ n++ ] = (uint8_t)( run - 1 - 3 );
+        } else {
+            run = 1;
+            symbols[ n ] = lengths[ i ];
+            extras[ n++ ] = 0;
+        }
+        i += run;
+    }
+    return n;
+}
+
+
+// Write a block with whichever of dynamic Huffman, fixed Huffman or stored comes out smallest
+static void writeDeflateBlock( struct BitWriter* writer, struct DeflateBlock const* block, int last ) {
+    uint32_t litFreqs[ 286 ] = { 0 };
+    uint32_t distFreqs[ 30 ] = { 0 };
+    for( int i = 0; i < block->count; ++i ) {
+        if( block->distances[ i ] ) {
+            ++litFreqs[ 257 + deflateLengthCode[ block->lengths[ i ] ] ];
+            ++distFreqs[ deflateDistanceSymbol( block->distances[ i ] ) ];
+        } else {
+            ++litFreqs[ block->lengths[ i ] ];
+        }
+    }
+    litFreqs[ 256 ] = 1;
+
+    uint8_t litLengths[ 286 ];
+    uint8_t distLengths[ 30 ];
+    buildHuffmanLengths( litFreqs, 286, 15, litLengths );
+    buildHuffmanLengths( distFreqs, 30, 15, distLengths );
+    int litCount = 286;
+    while( litCount > 257 && !litLengths[ litCount - 1 ] ) {
+        --litCount;
+    }
+    int distCount = 30;
+    while( distCount > 1 && !distLengths[ distCount - 1 ] ) {
+        --distCount;
+    }
+
+    // Code length codes for the header
+    uint8_t allLengths[ 286 + 30 ];
+    memcpy( allLengths, litLengths, litCount );
+    memcpy( allLengths + litCount, distLengths, distCount );
+    uint8_t clSymbols[ 286 + 30 ];
+    uint8_t clExtras[ 286 + 30 ];
+    int clCount = encodeCodeLengths( allLengths, litCount + distCount, clSymbols, clExtras );
+    uint32_t clFreqs[ 19 ] = { 0 };
+    for( int i = 0; i < clCount; ++i ) {
+        ++clFreqs[ clSymbols[ i ] ];
+    }
+    uint8_t clLengths[ 19 ];
+    buildHuffmanLengths( clFreqs, 19, 7, clLengths );
+    int clOrderCount = 19;
+    while( clOrderCount > 4 && !clLengths[ deflateCodeLengthOrder[ clOrderCount - 1 ] ] ) {
+        --clOrderCount;
+    }
+
+    // Sizes in bits of each way of writing the block
+    uint8_t fixedLit[ 288 ];
+    uint8_t fixedDist[ 30 ];
+    for( int i = 0; i < 288; ++i ) {
+        fixedLit[ i ] = i < 144 ? 8 : ( i < 256 ? 9 : ( i < 280 ? 7 : 8 ) );
+    }
+    memset( fixedDist, 5, sizeof( fixedDist ) );
+    uint64_t dynamicBits = 3 + 5 + 5 + 4 + 3 * clOrderCount;
+    for( int i = 0; i < clCount; ++i ) {
+        int s = clSymbols[ i ];
+        dynamicBits += clLengths[ s ] + ( s == 16 ? 2 : s == 17 ? 3 : s == 18 ? 7 : 0 );
+    }
+    uint64_t fixedBits = 3;
+    for( int i = 0; i < 286; ++i ) {
+        dynamicBits += (uint64_t) litFreqs[ i ] * litLengths[ i ];
+        fixedBits += (uint64_t) litFreqs[ i ] * fixedLit[ i ];
+        if( i >= 257 ) {
+            dynamicBits += (uint64_t) litFreqs[ i ] * deflateLengthExtra[ i - 257 ];
+            fixedBits += (uint64_t) litFreqs[ i ] * deflateLengthExtra[ i - 257 ];
+        }
+    }
+    for( int i = 0; i < 30; ++i ) {
+        dynamicBits += (uint64_t) distFreqs[ i ] * ( distLengths[ i ] + deflateDistanceExtra[ i ] );
+        fixedBits += (uint64_t) distFreqs[ i ] * ( 5 + deflateDistanceExtra[ i ] );
+    }
+    uint64_t storedBits = 3 + 7 + ( block->size / 65535 + 1 ) * 40 + (uint64_t) block->size * 8;
+
+    if( storedBits <= dynamicBits && storedBits <= fixedBits ) {
+        size_t offset = 0;
+        do {
+            size_t size = block->size - offset < 65535 ? block->size - offset : 65535;
+            int final = last && offset + size == block->size;
+            putBits( writer, final ? 1 : 0, 3 ); // BFINAL, BTYPE = 00
+            alignBits( writer );
+            putBits( writer, (uint32_t) size, 16 );
+            putBits( writer, (uint32_t) size ^ 0xffff, 16 );
+            appendBytes( writer->out, block->start + offset, size );
+            offset += size;
+        } while( offset < block->size );
+        return;
+    }
+
+    uint16_t litCodes[ 288 ];
+    uint16_t distCodes[ 30 ];
+    uint8_t const* lit = litLengths;
+    uint8_t const* dist = distLengths;
+    if( fixedBits < dynamicBits ) {
+        putBits( writer, ( last ? 1 : 0 ) | ( 1 << 1 ), 3 );
+        lit = fixedLit;
+        dist = fixedDist;
+        buildHuffmanCodes( fixedLit, 288, litCodes );
+        buildHuffmanCodes( fixedDist, 30, distCodes );
+    } else {
+        putBits( writer, ( last ? 1 : 0 ) | ( 2 << 1 ), 3 );
+        putBits( writer, litCount - 257, 5 );
+        putBits( writer, distCount - 1, 5 );
+        putBits( writer, clOrderCount - 4, 4 );
+        for( int i = 0; i < clOrderCount; ++i ) {
+            putBits( writer, clLengths[ deflateCodeLengthOrder[ i ] ], 3 );
+        }
+        uint16_t clCodes[ 19 ];
+        buildHuffmanCodes( clLengths, 19, clCodes );
+        for( int i = 0; i < clCount; ++i ) {
+            int s = clSymbols[ i ];
+            putBits( writer, clCodes[ s ], clLengths[ s ] );
+            if( s >= 16 ) {
+                putBits( writer, clExtras[ i ], s == 16 ? 2 : s == 17 ? 3 : 7 );
+            }
+        }
+        buildHuffmanCodes( litLengths, 286, litCodes );
+        buildHuffmanCodes( distLengths, 30, distCodes );
+    }
+
+    for( int i = 0; i < block->count; ++i ) {
+        int length = block->lengths[ i ];
+        int distance = block->distances[ i ];
+        if( !distance ) {
+            putBits( writer, litCodes[ length ], lit[ length ] );
+            continue;
+        }
+        int code = deflateLengthCode[ length ];
+        putBits( writer, litCodes[ 257 + code ], lit[ 257 + code ] );
+        putBits( writer, length - deflateLengthBase[ code ], deflateLengthExtra[ code ] );
+        int d = deflateDistanceSymbol( distance );
+        putBits( writer, distCodes[ d ], dist[ d ] );
+        putBits( writer, distance - deflateDistanceBase[ d ], deflateDistanceExtra[ d ] );
+    }
+    putBits( writer, litCodes[ 256 ], lit[ 256 ] );
+}
+
+
+static uint32_t deflateHash( uint8_t const* p ) {
+    uint32_t v = (uint32_t) p[ 0 ] | ( (uint32_t) p[ 1 ] << 8 ) | ( (uint32_t) p[ 2 ] << 16 );
+    return ( v * 2654435761u ) >> ( 32 - DEFLATE_HASH_BITS );
+}
+
+
+// Scratch memory for compressing one strip
+struct DeflateState {
+    int* head; // Most recent position for each hash
+    int* prev; // Previous position with the same hash, for each position in the window
+    struct DeflateBlock block;
+};
+
+
+static int initDeflateState( struct DeflateState* state ) {
+    state->head = (int*) malloc( sizeof( int ) * ( 1 << DEFLATE_HASH_BITS ) );
+    state->prev = (int*) malloc( sizeof( int ) * DEFLATE_WINDOW );
+    return state->head && state->prev;
+}
+
+
+static void releaseDeflateState( struct DeflateState* state ) {
+    free( state->head );
+    free( state->prev );
+}
+
+
+// Longest match for position `pos` among earlier positions with the same hash
+static int findMatch( struct DeflateState const* state, uint8_t const* data, int pos, int end, int chain, int nice,
+    int minLength, int* distance ) {
+
+    int best = minLength - 1;
+    int limit = end - pos < DEFLATE_MAX_MATCH ? end - pos : DEFLATE_MAX_MATCH;
+    nice = nice < limit ? nice : limit;
+    uint8_t const* current = data + pos;
+    for( int candidate = state->head[ deflateHash( current ) ]; candidate >= 0 && pos - candidate <= DEFLATE_WINDOW &&
+        chain-- > 0; candidate = state->prev[ candidate & ( DEFLATE_WINDOW - 1 ) ] ) {
+
+        uint8_t const* match = data + candidate;
+        if( best >= limit || match[ best ] != current[ best ] || match[ 0 ] != current[ 0 ] ) {
+            continue;
+        }
+        int length = 0;
+        while( length + 8 <= limit ) {
+            uint64_t a, b;
+            memcpy( &a, match + length, 8 );
+            memcpy( &b, current + length, 8 );
+            if( a != b ) {
+                break;
+            }
+            length += 8;
+        }
+        while( length < limit && match[ length ] == current[ length ] ) {
+            ++length;
+        }
+        if( length > best ) {
+            best = length;
+            *distance = pos - candidate;
+            if( length >= nice ) {
+                break;
+            }
+        }
+    }
+    return best >= DEFLATE_MIN_MATCH ? best : 0;
+}
+
+
+static void insertHash( struct DeflateState* state, uint8_t const* data, int pos ) {
+    uint32_t h = deflateHash( data + pos );
+    state->prev[ pos & ( DEFLATE_WINDOW - 1 ) ] = state->head[ h ];
+    state->head[ h ] = pos;
+}
+
+
+static void flushDeflateBlock( struct BitWriter* writer, struct DeflateState* state, uint8_t const* end, int last ) {
+    struct DeflateBlock* block = &state->block;
+    block->size = (size_t)( end - block->start );
+    writeDeflateBlock( writer, block, last );
+    block->count = 0;
+    block->start = end;
+}
+
+
+// Compress `size` bytes as a run of deflate blocks. Unless `last`, the run ends with an empty stored block, which
+// leaves it byte aligned so the next run can follow directly
+static void deflateRun( struct DeflateState* state, struct PngLevel const* level, uint8_t const* data, int size,
+    int last, struct ByteBuffer* out ) {
+
+    struct BitWriter writer = { out, 0, 0 };
+    struct DeflateBlock* block = &state->block;
+    block->count = 0;
+    block->start = data;
+    if( level->chainLength == 0 ) {
+        size_t offset = 0;
+        do {
+            size_t count = size - offset < 65535 ? size - offset : 65535;
+            putBits( &writer, last && offset + count == (size_t) size ? 1 : 0, 3 );
+            alignBits( &writer );
+            putBits( &writer, (uint32_t) count, 16 );
+            putBits( &writer, (uint32_t) count ^ 0xffff, 16 );
+            appendBytes( out, data + offset, count );
+            offset += count;
+        } while( offset < (size_t) size );
+    } else {
+        for( int i = 0; i < ( 1 << DEFLATE_HASH_BITS ); ++i ) {
+            state->head[ i ] = -1;
+        }
+        int pos = 0;
+        int pendingLength = 0; // With lazy matching, a match found at `pos - 1` which is not yet emitted
+        int pendingDistance = 0;
+        while( pos < size ) {
+            int length = 0;
+            int distance = 0;
+            if( pos + DEFLATE_MIN_MATCH <= size ) {
+                length = findMatch( state, data, pos, size, level->chainLength, level->niceLength,
+                    pendingLength > 0 ? pendingLength + 1 : DEFLATE_MIN_MATCH, &distance );
+                insertHash( state, data, pos );
+            }
+            if( pendingLength > 0 ) {
+                if( length > pendingLength ) {
+                    // The match one step later is better: the previous position becomes a literal
+                    block->lengths[ block->count ] = data[ pos - 1 ];
+                    block->distances[ block->count++ ] = 0;
+                    pendingLength = 0;
+                } else {
+                    block->lengths[ block->count ] = (uint16_t) pendingLength;
+                    block->distances[ block->count++ ] = (uint16_t) pendingDistance;
+                    for( int i = pos + 1; i < pos - 1 + pendingLength && i + DEFLATE_MIN_MATCH <= size; ++i ) {
+                        insertHash( state, data, i );
+                    }
+                    pos = pos - 1 + pendingLength;
+                    pendingLength = 0;
+                    length = 0;
+                    if( block->count >= DEFLATE_BLOCK_SYMBOLS - 2 ) {
+                        flushDeflateBlock( &writer, state, data + pos, 0 );
+                    }
+                    continue;
+                }
+            }
+            if( length > 0 && level->lazy && length < level->niceLength ) {
+                pendingLength = length;
+                pendingDistance = distance;
+                ++pos;
+                continue;
+            }
+            if( length > 0 ) {
+                block->lengths[ block->count ] = (uint16_t) length;
+                block->distances[ block->count++ ] = (uint16_t) distance;
+                for( int i = pos + 1; i < pos + length && i + DEFLATE_MIN_MATCH <= size; ++i ) {
+                    insertHash( state, data, i );
+                }
+                pos += length;
+            } else {
+                block->lengths[ block->count ] = data[ pos ];
+                block->distances[ block->count++ ] = 0;
+                ++pos;
+            }
+            if( block->count >= DEFLATE_BLOCK_SYMBOLS - 2 ) {
+                flushDeflateBlock( &writer, state, data + pos, 0 );
+            }
+        }
+        if( pendingLength > 0 ) {
+            block->lengths[ block->count ] = (uint16_t) pendingLength;
+            block->distances[ block->count++ ] = (uint16_t) pendingDistance;
+        }
+        flushDeflateBlock( &writer, state, data + size, last );
+    }
+    if( !last ) {
+        putBits( &writer, 0, 3 ); // Empty stored block, to get back to a byte boundary
+        alignBits( &writer );
+        putBits( &writer, 0, 16 );
+        putBits( &writer, 0xffff, 16 );
+    }
+    alignBits( &writer );
+}
+
+
+// Sum of the absolute values of the filtered bytes, taken as signed. The usual heuristic for picking a filter
+static uint32_t filterCostScalar( uint8_t const* filtered, int size ) {
+    uint32_t sum = 0;
+    for( int i = 0; i < size; ++i ) {
+        sum += filtered[ i ] < 128 ? filtered[ i ] : 256 - filtered[ i ];
+    }
+    return sum;
+}
+
+
+#ifdef PIXELS_SSE2
+    static uint32_t filterCostSse2( uint8_t const* filtered, int size ) {
+        __m128i const zero = _mm_setzero_si128();
+        __m128i acc = zero;
+        int i = 0;
+        for( ; i + 16 <= size; i += 16 ) {
+            __m128i v = _mm_loadu_si128( (__m128i const*)( filtered + i ) );
+            __m128i magnitude = _mm_min_epu8( v, _mm_sub_epi8( zero, v ) );
+            acc = _mm_add_epi64( acc, _mm_sad_epu8( magnitude, zero ) );
+        }
+        uint32_t sum = (uint32_t)( _mm_cvtsi128_si32( acc ) + _mm_cvtsi128_si32( _mm_srli_si128( acc, 8 ) ) );
+        return sum + filterCostScalar( filtered + i, size - i );
+    }
+#endif
+
+
+#ifdef PIXELS_AVX2
+    CPU_TARGET( "avx2" ) static uint32_t filterCostAvx2( uint8_t const* filtered, int size ) {
+        __m256i const zero = _mm256_setzero_si256();
+        __m256i acc = zero;
+        int i = 0;
+        for( ; i + 32 <= size; i += 32 ) {
+            __m256i v = _mm256_loadu_si256( (__m256i const*)( filtered + i ) );
+            __m256i magnitude = _mm256_min_epu8( v, _mm256_sub_epi8( zero, v ) );
+            acc = _mm256_add_epi64( acc, _mm256_sad_epu8( magnitude, zero ) );
+        }
+        __m128i half = _mm_add_epi64( _mm256_castsi256_si128( acc ), _mm256_extracti128_si256( acc, 1 ) );
+        uint32_t sum = (uint32_t)( _mm_cvtsi128_si32( half ) + _mm_cvtsi128_si32( _mm_srli_si128( half, 8 ) ) );
+        return sum + filterCostScalar( filtered + i, size - i );
+    }
+#endif
+
+
+static uint32_t filterCost( uint8_t const* filtered, int size ) {
+    return cpuKernels.filterCost( filtered, size );
+}
+
+
+// Filters the bytes of a row from `first` on, one at a time. The vector variants finish their rows with it
+static void filterRowFrom( int type, uint8_t const* row, uint8_t const* prior, int first, int size, int bpp,
+    uint8_t* out ) {
+
+    for( int i = first; i < size; ++i ) {
+        int a = row[ i - bpp ];
+        int b = prior[ i ];
+        int c = prior[ i - bpp ];
+        int predicted;
+        if( type == 1 ) {
+            predicted = a;
+        } else if( type == 2 ) {
+            predicted = b;
+        } else if( type == 3 ) {
+            predicted = ( a + b ) >> 1;
+        } else {
+            int pa = abs( b - c );
+            int pb = abs( a - c );
+            int pc = abs( a + b - 2 * c );
+            predicted = ( pa <= pb && pa <= pc ) ? a : ( pb <= pc ? b : c );
+        }
+        out[ i ] = (uint8_t)( row[ i ] - predicted );
+    }
+}
+
+
+// Apply PNG filter `type` (1-4) to a row. `row` and `prior` must have `bpp` readable zero bytes before them
+static void filterRowScalar( int type, uint8_t const* row, uint8_t const* prior, int size, int bpp, uint8_t* out ) {
+    filterRowFrom( type, row, prior, 0, size, bpp, out );
+}
+
+
+#ifdef PIXELS_SSE2
+    static void filterRowSse2( int type, uint8_t const* row, uint8_t const* prior, int size, int bpp, uint8_t* out ) {
+        __m128i const zero = _mm_setzero_si128();
+        __m128i const one = _mm_set1_epi8( 1 );
+        int i = 0;
+        for( ; i + 16 <= size; i += 16 ) {
+            __m128i x = _mm_loadu_si128( (__m128i const*)( row + i ) );
+            __m128i a = _mm_loadu_si128( (__m128i const*)( row + i - bpp ) );
+            __m128i b = _mm_loadu_si128( (__m128i const*)( prior + i ) );
+            __m128i predicted;
+            if( type == 1 ) {
+                predicted = a;
+            } else if( type == 2 ) {
+                predicted = b;
+            } else if( type == 3 ) {
+                predicted = _mm_sub_epi8( _mm_avg_epu8( a, b ), _mm_and_si128( _mm_xor_si128( a, b ), one ) );
+            } else {
+                // Paeth, in 16 bits: pa = |b - c|, pb = |a - c|, pc = |a + b - 2c|
+                __m128i c = _mm_loadu_si128( (__m128i const*)( prior + i - bpp ) );
+                __m128i halves[ 2 ];
+                for( int h = 0; h < 2; ++h ) {
+                    __m128i a16 = h ? _mm_unpackhi_epi8( a, zero ) : _mm_unpacklo_epi8( a, zero );
+                    __m128i b16 = h ? _mm_unpackhi_epi8( b, zero ) : _mm_unpacklo_epi8( b, zero );
+                    __m128i c16 = h ? _mm_unpackhi_epi8( c, zero ) : _mm_unpacklo_epi8( c, zero );
+                    __m128i pa = _mm_sub_epi16( b16, c16 );
+                    __m128i pb = _mm_sub_epi16( a16, c16 );
+                    __m128i pc = _mm_add_epi16( pa, pb );
+                    pa = _mm_max_epi16( pa, _mm_sub_epi16( _mm_setzero_si128(), pa ) );
+                    pb = _mm_max_epi16( pb, _mm_sub_epi16( _mm_setzero_si128(), pb ) );
+                    pc = _mm_max_epi16( pc, _mm_sub_epi16( _mm_setzero_si128(), pc ) );
+                    __m128i useA = _mm_and_si128( _mm_cmplt_epi16( pa, _mm_add_epi16( pb, _mm_set1_epi16( 1 ) ) ),
+                        _mm_cmplt_epi16( pa, _mm_add_epi16( pc, _mm_set1_epi16( 1 ) ) ) );
+                    __m128i useB = _mm_cmplt_epi16( pb, _mm_add_epi16( pc, _mm_set1_epi16( 1 ) ) );
+                    __m128i bc = _mm_or_si128( _mm_and_si128( useB, b16 ), _mm_andnot_si128( useB, c16 ) );
+                    halves[ h ] = _mm_or_si128( _mm_and_si128( useA, a16 ), _mm_andnot_si128( useA, bc ) );
+                }
+                predicted = _mm_packus_epi16( halves[ 0 ], halves[ 1 ] );
+            }
+            _mm_storeu_si128( (__m128i*)( out + i ), _mm_sub_epi8( x, predicted ) );
+        }
+        filterRowFrom( type, row, prior, i, size, bpp, out );
+    }
+
+
+    // Paeth picks with absolute values and blends instead of masks. The other filters are the same as with SSE2
+    CPU_TARGET( "sse4.1" ) static void filterRowSse41( int type, uint8_t const* row, uint8_t const* prior, int size,
+        int bpp, uint8_t* out ) {
+
+        if( type != 4 ) {
+            filterRowSse2( type, row, prior, size, bpp, out );
+            return;
+        }
+        __m128i const zero = _mm_setzero_si128();
+        int i = 0;
+        for( ; i + 16 <= size; i += 16 ) {
+            __m128i x = _mm_loadu_si128( (__m128i const*)( row + i ) );
+            __m128i a = _mm_loadu_si128( (__m128i const*)( row + i - bpp ) );
+            __m128i b = _mm_loadu_si128( (__m128i const*)( prior + i ) );
+            __m128i c = _mm_loadu_si128( (__m128i const*)( prior + i - bpp ) );
+            __m128i halves[ 2 ];
+            for( int h = 0; h < 2; ++h ) {
+                __m128i a16 = h ? _mm_unpackhi_epi8( a, zero ) : _mm_unpacklo_epi8( a, zero );
+                __m128i b16 = h ? _mm_unpackhi_epi8( b, zero ) : _mm_unpacklo_epi8( b, zero );
+                __m128i c16 = h ? _mm_unpackhi_epi8( c, zero ) : _mm_unpacklo_epi8( c, zero );
+                __m128i pa = _mm_sub_epi16( b16, c16 );
+                __m128i pb = _mm_sub_epi16( a16, c16 );
+                __m128i pc = _mm_abs_epi16( _mm_add_epi16( pa, pb ) );
+                pa = _mm_abs_epi16( pa );
+                pb = _mm_abs_epi16( pb );
+                __m128i notA = _mm_or_si128( _mm_cmpgt_epi16( pa, pb ), _mm_cmpgt_epi16( pa, pc ) );
+                __m128i bc = _mm_blendv_epi8( b16, c16, _mm_cmpgt_epi16( pb, pc ) );
+                halves[ h ] = _mm_blendv_epi8( a16, bc, notA );
+            }
+            _mm_storeu_si128( (__m128i*)( out + i ), _mm_sub_epi8( x, _mm_packus_epi16( halves[ 0 ], halves[ 1 ] ) ) );
+        }
+        filterRowFrom( type, row, prior, i, size, bpp, out );
+    }
+#endif
+
+
+#ifdef PIXELS_AVX2
+    // Like SSE4.1, 32 bytes at a time. Unpacking and packing work within each 16-byte lane, so they cancel out
+    CPU_TARGET( "avx2" ) static void filterRowAvx2( int type, uint8_t const* row, uint8_t const* prior, int size,
+        int bpp, uint8_t* out ) {
+
+        __m256i const zero = _mm256_setzero_si256();
+        __m256i const one = _mm256_set1_epi8( 1 );
+        int i = 0;
+        for( ; i + 32 <= size; i += 32 ) {
+            __m256i x = _mm256_loadu_si256( (__m256i const*)( row + i ) );
+            __m256i a = _mm256_loadu_si256( (__m256i const*)( row + i - bpp ) );
+            __m256i b = _mm256_loadu_si256( (__m256i const*)( prior + i ) );
+            __m256i predicted;
+            if( type == 1 ) {
+                predicted = a;
+            } else if( type == 2 ) {
+                predicted = b;
+            } else if( type == 3 ) {
+                predicted = _mm256_sub_epi8( _mm256_avg_epu8( a, b ),
+                    _mm256_and_si256( _mm256_xor_si256( a, b ), one ) );
+            } else {
+                __m256i c = _mm256_loadu_si256( (__m256i const*)( prior + i - bpp ) );
+                __m256i halves[ 2 ];
+                for( int h = 0; h < 2; ++h ) {
+                    __m256i a16 = h ? _mm256_unpackhi_epi8( a, zero ) : _mm256_unpacklo_epi8( a, zero );
+                    __m256i b16 = h ? _mm256_unpackhi_epi8( b, zero ) : _mm256_unpacklo_epi8( b, zero );
+                    __m256i c16 = h ? _mm256_unpackhi_epi8( c, zero ) : _mm256_unpacklo_epi8( c, zero );
+                    __m256i pa = _mm256_sub_epi16( b16, c16 );
+                    __m256i pb = _mm256_sub_epi16( a16, c16 );
+                    __m256i pc = _mm256_abs_epi16( _mm256_add_epi16( pa, pb ) );
+                    pa = _mm256_abs_epi16( pa );
+                    pb = _mm256_abs_epi16( pb );
+                    __m256i notA = _mm256_or_si256( _mm256_cmpgt_epi16( pa, pb ), _mm256_cmpgt_epi16( pa, pc ) );
+                    __m256i bc = _mm256_blendv_epi8( b16, c16, _mm256_cmpgt_epi16( pb, pc ) );
+                    halves[ h ] = _mm256_blendv_epi8( a16, bc, notA );
+                }
+                predicted = _mm256_packus_epi16( halves[ 0 ], halves[ 1 ] );
+            }
+            _mm256_storeu_si256( (__m256i*)( out + i ), _mm256_sub_epi8( x, predicted ) );
+        }
+        filterRowFrom( type, row, prior, i, size, bpp, out );
+    }
+#endif
+
+
+static void filterRow( int type, uint8_t const* row, uint8_t const* prior, int size, int bpp, uint8_t* out ) {
+    cpuKernels.filterRow( type, row, prior, size, bpp, out );
+}
+
+
+// Converts a row of BGRA pixels to RGB bytes
+static void pixelsToRgb( uint32_t const* pixels, int width, uint8_t* out ) {
+    for( int x = 0; x < width; ++x ) {
+        uint32_t p = pixels[ x ];
+        out[ x * 3 + 0 ] = (uint8_t)( p >> 16 );
+        out[ x * 3 + 1 ] = (uint8_t)( p >> 8 );
+        out[ x * 3 + 2 ] = (uint8_t) p;
+    }
+}
+
+
+// Converts a row of 16-bit RGBA pixels to big endian 16-bit RGB
+static void widePixelsToRgb16( uint16_t const* pixels, int width, uint8_t* out ) {
+    for( int x = 0; x < width; ++x ) {
+        for( int i = 0; i < 3; ++i ) {
+            out[ x * 6 + i * 2 + 0 ] = (uint8_t)( pixels[ x * 4 + i ] >> 8 );
+            out[ x * 6 + i * 2 + 1 ] = (uint8_t) pixels[ x * 4 + i ];
+        }
+    }
+}
+
+
+// The image to encode: either 8-bit pixels, or 16-bit ones (`wide`)
+struct PngSource {
+    struct PixelBuffer const* pixels;
+    struct WidePixelBuffer const* wide;
+    int width;
+    int height;
+    int bytesPerPixel; // 3, or 6 for 16 bits per channel
+};
+
+
+static void pngSourceRow( struct PngSource const* source, int y, uint8_t* out ) {
+    if( source->wide ) {
+        widePixelsToRgb16( widePixelRow( source->wide, y ), source->width, out );
+    } else {
+        pixelsToRgb( pixelRow( source->pixels, y ), source->width, out );
+    }
+}
+
+
+// Filters rows `first` to `end` of the image into `out`, each row prefixed by its filter type byte. `scratch` must
+// hold four padded rows of `16 + width * bytesPerPixel` bytes
+static void filterRows( struct PngSource const* source, int first, int end, int adaptive, uint8_t* scratch,
+    uint8_t* out ) {
+
+    int const bpp = source->bytesPerPixel;
+    int rowSize = source->width * bpp;
+    int padded = 16 + rowSize;
+    uint8_t* prior = scratch + 16;
+    uint8_t* row = scratch + padded + 16;
+    uint8_t* candidate = scratch + padded * 2;
+    uint8_t* best = scratch + padded * 3;
+    memset( scratch, 0, (size_t) padded * 2 );
+    if( first > 0 ) {
+        pngSourceRow( source, first - 1, prior );
+    }
+    for( int y = first; y < end; ++y ) {
+        pngSourceRow( source, y, row );
+        uint8_t* line = out + (size_t)( y - first ) * ( rowSize + 1 );
+        if( !adaptive ) {
+            line[ 0 ] = 2; // `up` works well on the large flat areas of typical screenshots
+            filterRow( 2, row, prior, rowSize, bpp, line + 1 );
+        } else {
+            uint32_t bestCost = filterCost( row, rowSize );
+            int bestType = 0;
+            memcpy( best, row, rowSize );
+            for( int type = 1; type <= 4; ++type ) {
+                filterRow( type, row, prior, rowSize, bpp, candidate );
+                uint32_t cost = filterCost( candidate, rowSize );
+                if( cost < bestCost ) {
+                    bestCost = cost;
+                    bestType = type;
+                    uint8_t* swap = best;
+                    best = candidate;
+                    candidate = swap;
+                }
+            }
+            line[ 0 ] = (uint8_t) bestType;
+            memcpy( line + 1, best, rowSize );
+        }
+        uint8_t* swap = prior;
+        prior = row;
+        row = swap;
+    }
+}
+
+
+// Work shared by the threads compressing strips
+struct PngJob {
+    struct PngSource const* source;
+    struct PngLevel const* level;
+    int stripRows;
+    int stripCount;
+    struct ByteBuffer* strips; // Compressed output per strip
+    uint32_t* adlers; // Adler-32 of the filtered data of each strip
+    std::atomic<int> next; // Next strip to take
+    std::atomic<int> failed;
+};
+
+
+static void pngWorker( struct PngJob* job ) {
+    int rowSize = job->source->width * job->source->bytesPerPixel + 1;
+    uint8_t* scratch = (uint8_t*) malloc( (size_t)( 16 + rowSize ) * 4 );
+    uint8_t* filtered = (uint8_t*) malloc( (size_t) rowSize * job->stripRows );
+    struct DeflateState* state = (struct DeflateState*) calloc( 1, sizeof( struct DeflateState ) );
+    if( !scratch || !filtered || !state || !initDeflateState( state ) ) {
+        job->failed = 1;
+    }
+    for( int strip = job->next++; strip < job->stripCount && !job->failed; strip = job->next++ ) {
+        int first = strip * job->stripRows;
+        int end = first + job->stripRows < job->source->height ? first + job->stripRows : job->source->height;
+        filterRows( job->source, first, end, job->level->adaptiveFilter, scratch, filtered );
+        int size = rowSize * ( end - first );
+        job->adlers[ strip ] = adler32( 1, filtered, size );
+        if( strip == 0 ) {
+            uint8_t const zlibHeader[ 2 ] = { 0x78, 0x01 }; // Deflate with a 32 KB window, no dictionary
+            appendBytes( &job->strips[ 0 ], zlibHeader, 2 );
+        }
+        deflateRun( state, job->level, filtered, size, strip == job->stripCount - 1, &job->strips[ strip ] );
+        if( job->strips[ strip ].failed ) {
+            job->failed = 1;
+        }
+    }
+    if( state ) {
+        releaseDeflateState( state );
+    }
+    free( state );
+    free( scratch );
+    free( filtered );
+}
+
+
+static void appendPngChunk( struct ByteBuffer* out, char const* type, uint8_t const* data, size_t size ) {
+    uint8_t header[ 8 ] = { (uint8_t)( size >> 24 ), (uint8_t)( size >> 16 ), (uint8_t)( size >> 8 ), (uint8_t) size,
+        (uint8_t) type[ 0 ], (uint8_t) type[ 1 ], (uint8_t) type[ 2 ], (uint8_t) type[ 3 ] };
+    appendBytes( out, header, 8 );
+    if( size > 0 ) {
+        appendBytes( out, data, size );
+    }
+    uint32_t crc = pngCrc( pngCrc( 0, header + 4, 4 ), data, size );
+    uint8_t trailer[ 4 ] = { (uint8_t)( crc >> 24 ), (uint8_t)( crc >> 16 ), (uint8_t)( crc >> 8 ), (uint8_t) crc };
+    appendBytes( out, trailer, 4 );
+}
+
+
+// Encode `image` as an RGB PNG, 8 or 16 bits per channel, at compression `level`, using up to `threads` threads (0 for
+// one per core). Returns zero if out of memory
+static int encodePngSource( struct PngSource const* image, int level, int threads, struct ByteBuffer* out ) {
+    initPngTables();
+    struct PngJob* job = new struct PngJob();
+    job->source = image;
+    job->level = &pngLevels[ level < 0 ? 0 : ( level >= PNG_LEVEL_COUNT ? PNG_LEVEL_COUNT - 1 : level ) ];
+    if( threads <= 0 ) {
+        threads = (int) std::thread::hardware_concurrency();
+    }
+    threads = threads < 1 ? 1 : ( threads > PNG_MAX_THREADS ? PNG_MAX_THREADS : threads );
+    // Enough strips to keep every thread busy, but not so small that compression suffers from the restarts
+    job->stripRows = ( image->height + threads * 2 - 1 ) / ( threads * 2 );
+    job->stripRows = job->stripRows < PNG_STRIP_ROWS ? PNG_STRIP_ROWS : job->stripRows;
+    job->stripCount = ( image->height + job->stripRows - 1 ) / job->stripRows;
+    job->stripCount = job->stripCount < 1 ? 1 : job->stripCount;
+    job->strips = (struct ByteBuffer*) calloc( job->stripCount, sizeof( struct ByteBuffer ) );
+    job->adlers = (uint32_t*) calloc( job->stripCount, sizeof( uint32_t ) );
+    if( !job->strips || !job->adlers ) {
+        free( job->strips );
+        free( job->adlers );
+        delete job;
+        return 0;
+    }
+
+    threads = threads > job->stripCount ? job->stripCount : threads;
+    std::thread* workers[ PNG_MAX_THREADS ] = {};
+    for( int i = 1; i < threads; ++i ) {
+        workers[ i ] = new std::thread( pngWorker, job );
+    }
+    pngWorker( job );
+    for( int i = 1; i < threads; ++i ) {
+        workers[ i ]->join();
+        delete workers[ i ];
+    }
+
+    int result = !job->failed;
+    if( result ) {
+        static uint8_t const signature[ 8 ] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+        appendBytes( out, signature, 8 );
+        uint8_t header[ 13 ] = { (uint8_t)( image->width >> 24 ), (uint8_t)( image->width >> 16 ),
+            (uint8_t)( image->width >> 8 ), (uint8_t) image->width, (uint8_t)( image->height >> 24 ),
+            (uint8_t)( image->height >> 16 ), (uint8_t)( image->height >> 8 ), (uint8_t) image->height,
+            (uint8_t)( image->bytesPerPixel * 8 / 3 ), 2, 0, 0, 0 }; // RGB, deflate, standard filters, no interlace
+        appendPngChunk( out, "IHDR", header, 13 );
+
+        // The zlib stream goes in one IDAT chunk per strip, since chunk boundaries can fall anywhere in it
+        uint32_t adler = job->adlers[ 0 ];
+        size_t rowSize = (size_t) image->width * image->bytesPerPixel + 1;
+        for( int i = 1; i < job->stripCount; ++i ) {
+            int rows = i < job->stripCount - 1 ? job->stripRows : image->height - job->stripRows * i;
+            adler = adler32Combine( adler, job->adlers[ i ], rowSize * rows );
+        }
+        struct ByteBuffer* last = &job->strips[ job->stripCount - 1 ];
+        uint8_t trailer[ 4 ] = { (uint8_t)( adler >> 24 ), (uint8_t)( adler >> 16 ), (uint8_t)( adler >> 8 ),
+            (uint8_t) adler };
+        appendBytes( last, trailer, 4 );
+        for( int i = 0; i < job->stripCount; ++i ) {
+            appendPngChunk( out, "IDAT", job->strips[ i ].data, job->strips[ i ].size );
+        }
+        appendPngChunk( out, "IEND", NULL, 0 );
+        result = !out->failed && !last->failed;
+    }
+
+    for( int i = 0; i < job->stripCount; ++i ) {
+        releaseByteBuffer( &job->strips[ i ] );
+    }
+    free( job->strips );
+    free( job->adlers );
+    delete job;
+    return result;
+}
+
+
+// Encode `image` as an 8-bit RGB PNG (alpha is dropped, as screen captures have none)
+static int encodePng( struct PixelBuffer const* image, int level, int threads, struct ByteBuffer* out ) {
+    struct PngSource source = { image, NULL, image->width, image->height, 3 };
+    return encodePngSource( &source, level, threads, out );
+}
+
+
+// Encode `image` as a 16-bit RGB PNG
+static int encodePng16( struct WidePixelBuffer const* image, int level, int threads, struct ByteBuffer* out ) {
+    struct PngSource source = { NULL, image, image->width, image->height, 6 };
+    return encodePngSource( &source, level, threads, out );
+}
+
+
+// Entropy in bits per byte of the `paeth` filtered bytes of a sample of up to `sampleRows` rows, as a quick guess of
+// how well the image will compress (and how hard the matcher has to work on it)
+static float samplePngEntropy( struct PixelBuffer const* image, int sampleRows ) {
+    int rowSize = image->width * 3;
+    uint8_t* scratch = (uint8_t*) calloc( (size_t)( 16 + rowSize ) * 3, 1 );
+    if( !scratch || image->height < 2 || rowSize == 0 ) {
+        free( scratch );
+        return 8.0f;
+    }
+    uint8_t* prior = scratch + 16;
+    uint8_t* row = scratch + 16 + rowSize + 16;
+    uint8_t* filtered = scratch + ( 16 + rowSize ) * 2;
+    uint32_t histogram[ 256 ] = { 0 };
+    sampleRows = sampleRows < image->height - 1 ? sampleRows : image->height - 1;
+    for( int i = 0; i < sampleRows; ++i ) {
+        int y = 1 + (int)( (int64_t) i * ( image->height - 1 ) / sampleRows );
+        pixelsToRgb( pixelRow( image, y - 1 ), image->width, prior );
+        pixelsToRgb( pixelRow( image, y ), image->width, row );
+        filterRow( 4, row, prior, rowSize, 3, filtered );
+        for( int x = 0; x < rowSize; ++x ) {
+            ++histogram[ filtered[ x ] ];
+        }
+    }
+    free( scratch );
+    double total = (double) sampleRows * rowSize;
+    double entropy = 0.0;
+    for( int i = 0; i < 256; ++i ) {
+        if( histogram[ i ] ) {
+            double p = histogram[ i ] / total;
+            entropy -= p * log2( p );
+        }
+    }
+    return (float) entropy;
+}
+
+
+// Rough single-threaded cost of each level in nanoseconds per input byte, at zero and at full (8 bits) entropy, in
+// between it is linear. Measured on synthetic screenshots on a modest machine; the refinement step corrects for the
+// actual one
+static float const pngCostPerByte[ PNG_LEVEL_COUNT ][ 2 ] = {
+    { 4.5f, 4.5f },
+    { 4.0f, 40.0f },
+    { 6.0f, 64.0f },
+    { 10.0f, 260.0f },
+};
+
+
+static double estimatePngMilliseconds( struct PixelBuffer const* image, float entropy, int level, int threads ) {
+    double bytes = (double) image->width * image->height * 3;
+    double t = entropy / 8.0;
+    double nanoseconds = pngCostPerByte[ level ][ 0 ] * ( 1.0 - t ) + pngCostPerByte[ level ][ 1 ] * t;
+    int strips = ( image->height + PNG_STRIP_ROWS - 1 ) / PNG_STRIP_ROWS;
+    threads = threads < strips ? threads : ( strips < 1 ? 1 : strips );
+    return bytes * nanoseconds / threads / 1e6;
+}
+
+
+struct PngEncodePlan {
+    float entropy;
+    int level; // Level and thread count for the first pass
+    int threads;
+    int maxThreads;
+};
+
+
+// Picks the first pass: the best level that is expected to take no more than half the budget, using as few threads
+// as will do it. That leaves room to refine, or to absorb a bad estimate. The lowest level is used if nothing fits
+static struct PngEncodePlan planPngEncode( struct PixelBuffer const* image, double budgetMs ) {
+    struct PngEncodePlan plan;
+    plan.entropy = samplePngEntropy( image, 32 );
+    plan.maxThreads = (int) std::thread::hardware_concurrency();
+    plan.maxThreads = plan.maxThreads < 1 ? 1 : ( plan.maxThreads > PNG_MAX_THREADS ? PNG_MAX_THREADS : plan.maxThreads );
+    plan.level = 0;
+    plan.threads = 1;
+    for( int level = PNG_LEVEL_COUNT - 1; level > 0; --level ) {
+        for( int threads = 1; threads <= plan.maxThreads; threads *= 2 ) {
+            if( estimatePngMilliseconds( image, plan.entropy, level, threads ) <= budgetMs * 0.5 ) {
+                plan.level = level;
+                plan.threads = threads;
+                return plan;
+            }
+        }
+    }
+    return plan;
+}
+
+
+// Encodes `image` as a PNG, aiming to finish within `budgetMs`. A first pass is planned from the sampled entropy; if
+// the time it took leaves room for a higher level (judged by how far off its own estimate was), that is tried as
+// well, and the smaller result is kept. Returns the level of the result, or -1 if out of memory
+static int encodePngBudgeted( struct PixelBuffer const* image, double budgetMs, struct ByteBuffer* out ) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    struct PngEncodePlan plan = planPngEncode( image, budgetMs );
+    if( !encodePng( image, plan.level, plan.threads, out ) ) {
+        return -1;
+    }
+    double elapsed = std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count();
+    double correction = elapsed / estimatePngMilliseconds( image, plan.entropy, plan.level, plan.threads );
+    int best = plan.level;
+    for( int level = plan.level + 1; level < PNG_LEVEL_COUNT; ++level ) {
+        double expected = estimatePngMilliseconds( image, plan.entropy, level, plan.maxThreads ) * correction;
+        if( elapsed + expected > budgetMs ) {
+            break;
+        }
+        struct ByteBuffer refined = {};
+        if( encodePng( image, level, plan.maxThreads, &refined ) && refined.size < out->size ) {
+            struct ByteBuffer swap = *out;
+            *out = refined;
+            refined = swap;
+            best = level;
+        }
+        releaseByteBuffer( &refined );
+        double now = std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now() - start ).count();
+        correction = ( now - elapsed ) / estimatePngMilliseconds( image, plan.entropy, level, plan.maxThreads );
+        elapsed = now;
+    }
+    return best;
+}
@@ -0,0 +1,325 @@
+// Smaller copies of the snippet, saved alongside it: a version at 96 DPI, for recipients whose displays aren't scaled,
+// and a thumbnail for previews. They come from a pyramid of images, each half the size of the one before, made with
+// a 2x2 box filter. Each size is resampled from the smallest level of the pyramid that is still at least as big, which
+// is less than twice as big where the sides keep halving evenly, so the whole snippet is only read once, and the
+// pyramid levels each take a quarter of the work of the one before. All the sizes are then encoded in parallel.
+// Nothing in here depends on windows.h.
+#include <thread>
+
+
+int const PYRAMID_MAX_LEVELS = 16;
+int const THUMBNAIL_SIZE = 256; // Longest side of a thumbnail, in pixels
+int const RESOLUTION_MAX_OUTPUTS = 8;
+
+
+// `levels[ 0 ]` is the image the pyramid was built from, which is not owned by the pyramid
+struct Pyramid {
+    int count;
+    struct PixelBuffer levels[ PYRAMID_MAX_LEVELS ];
+};
+
+
+// Halves `src` into `dst`, which must be ( width + 1 ) / 2 by ( height + 1 ) / 2. Each pixel of `dst` is the rounded
+// average of a 2x2 block of `src`. With an odd size, the last column or row of `src` is used twice
+static void halvePixels( struct PixelBuffer const* src, struct PixelBuffer* dst ) {
+    for( int y = 0; y < dst->height; ++y ) {
+        uint32_t const* row0 = pixelRow( src, y * 2 );
+        uint32_t const* row1 = pixelRow( src, y * 2 + 1 < src->height ? y * 2 + 1 : y * 2 );
+        uint32_t* out = pixelRow( dst, y );
+        int x = 0;
+        #ifdef PIXELS_SSE2
+            // Four pixels at a time: eight from each row, added up as 16 bit channels, then each pair across
+            __m128i const zero = _mm_setzero_si128();
+            __m128i const two = _mm_set1_epi16( 2 );
+            for( ; x * 2 + 8 <= src->width; x += 4 ) {
+                __m128i sums[ 2 ];
+                for( int half = 0; half < 2; ++half ) {
+                    __m128i a = _mm_loadu_si128( (__m128i const*)( row0 + x * 2 + half * 4 ) );
+                    __m128i b = _mm_loadu_si128( (__m128i const*)( row1 + x * 2 + half * 4 ) );
+                    __m128i lo = _mm_add_epi16( _mm_unpacklo_epi8( a, zero ), _mm_unpacklo_epi8( b, zero ) );
+                    __m128i hi = _mm_add_epi16( _mm_unpackhi_epi8( a, zero ), _mm_unpackhi_epi8( b, zero ) );
+                    lo = _mm_add_epi16( lo, _mm_srli_si128( lo, 8 ) );
+                    hi = _mm_add_epi16( hi, _mm_srli_si128( hi, 8 ) );
+                    sums[ half ] = _mm_srli_epi16( _mm_add_epi16( _mm_unpacklo_epi64( lo, hi ), two ), 2 );
+                }
+                _mm_storeu_si128( (__m128i*)( out + x ), _mm_packus_epi16( sums[ 0 ], sums[ 1 ] ) );
+            }
+        #endif
+        for( ; x < dst->width; ++x ) {
+            int x1 = x * 2 + 1 < src->width ? x * 2 + 1 : x * 2;
+            uint32_t p[ 4 ] = { row0[ x * 2 ], row0[ x1 ], row1[ x * 2 ], row1[ x1 ] };
+            uint32_t result = 0;
+            for( int shift = 0; shift < 32; shift += 8 ) {
+                uint32_t sum = ( ( p[ 0 ] >> shift ) & 0xff ) + ( ( p[ 1 ] >> shift ) & 0xff ) +
+                    ( ( p[ 2 ] >> shift ) & 0xff ) + ( ( p[ 3 ] >> shift ) & 0xff );
+                result |= ( ( sum + 2 ) >> 2 ) << shift;
+            }
+            out[ x ] = result;
+        }
+    }
+}
+
+
+// Builds the pyramid for `source`, halving it for as long as the result is at least `minWidth` by `minHeight`, and the
+// level above has even sides. Halving an odd side uses the last column or row twice, which would shift that level by
+// up to half a pixel from the image it stands for, so sizes below it are resampled from there instead. Returns zero
+// if out of memory, in which case the pyramid has the levels made so far
+static int buildPyramid( struct Pyramid* pyramid, struct PixelBuffer const* source, int minWidth, int minHeight ) {
+    pyramid->levels[ 0 ] = *source;
+    pyramid->count = 1;
+    while( pyramid->count < PYRAMID_MAX_LEVELS ) {
+        struct PixelBuffer const* above = &pyramid->levels[ pyramid->count - 1 ];
+        int width = ( above->width + 1 ) / 2;
+        int height = ( above->height + 1 ) / 2;
+        if( above->width % 2 || above->height % 2 || width < minWidth || height < minHeight ) {
+            break;
+        }
+        struct PixelBuffer level = { (uint32_t*) malloc( sizeof( uint32_t ) * width * height ), width, height, width };
+        if( !level.pixels ) {
+            return 0;
+        }
+        halvePixels( above, &level );
+        pyramid->levels[ pyramid->count++ ] = level;
+    }
+    return 1;
+}
+
+
+static void releasePyramid( struct Pyramid* pyramid ) {
+    for( int i = 1; i < pyramid->count; ++i ) {
+        free( pyramid->levels[ i ].pixels );
+    }
+    pyramid->count = 0;
+}
+
+
+// Weights of the source pixels making up each destination pixel, along one axis, for a box filter scaling `srcSize`
+// down to `dstSize`. Destination pixel i is made of `taps` source pixels starting at `starts[ i ]`, with weights
+// `weights[ i * taps ]` onward, adding up to one
+static void boxFilterWeights( int srcSize, int dstSize, int taps, int* starts, float* weights ) {
+    double scale = (double) srcSize / dstSize;
+    for( int i = 0; i < dstSize; ++i ) {
+        double from = i * scale;
+        double to = ( i + 1 ) * scale;
+        int start = (int) from;
+        start = start + taps > srcSize ? srcSize - taps : start;
+        starts[ i ] = start;
+        for( int k = 0; k < taps; ++k ) {
+            double overlap = ( to < start + k + 1 ? to : start + k + 1 ) - ( from > start + k ? from : start + k );
+            weights[ i * taps + k ] = overlap > 0.0 ? (float)( overlap / scale ) : 0.0f;
+        }
+    }
+}
+
+
+// One row of `src` scaled horizontally with a box filter, as four floats per pixel
+static void resampleRow( uint32_t const* src, int width, int taps, int const* starts, float const* weights,
+    float* out ) {
+
+    for( int x = 0; x < width; ++x ) {
+        uint32_t const* p = src + starts[ x ];
+        float const* w = weights + x * taps;
+        #ifdef PIXELS_SSE2
+            __m128i const zero = _mm_setzero_si128();
+            __m128 sum = _mm_setzero_ps();
+            for( int k = 0; k < taps; ++k ) {
+                __m128i c = _mm_unpacklo_epi16( _mm_unpacklo_epi8( _mm_cvtsi32_si128( (int) p[ k ] ), zero ), zero );
+                sum = _mm_add_ps( sum, _mm_mul_ps( _mm_cvtepi32_ps( c ), _mm_set1_ps( w[ k ] ) ) );
+            }
+            _mm_storeu_ps( out + x * 4, sum );
+        #else
+            float sum[ 4 ] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            for( int k = 0; k < taps; ++k ) {
+                for( int c = 0; c < 4; ++c ) {
+                    sum[ c ] += ( ( p[ k ] >> ( c * 8 ) ) & 0xff ) * w[ k ];
+                }
+            }
+            memcpy( out + x * 4, sum, sizeof( sum ) );
+        #endif
+    }
+}
+
+
+// Scales `src` down to the size of `dst` with a box filter, so each pixel of `dst` is the average of the area of `src`
+// it covers. Works for any amount of scaling, but is meant for less than 2x, with the pyramid doing the rest. Returns
+// zero if out of memory
+static int resamplePixels( struct PixelBuffer const* src, struct PixelBuffer* dst ) {
+    int tapsX = (int) ceil( (double) src->width / dst->width ) + 1;
+    int tapsY = (int) ceil( (double) src->height / dst->height ) + 1;
+    tapsX = tapsX > src->width ? src->width : tapsX;
+    tapsY = tapsY > src->height ? src->height : tapsY;
+    int* startsX = (int*) malloc( sizeof( int ) * ( dst->width + dst->height ) );
+    float* weightsX = (float*) malloc( sizeof( float ) * ( dst->width * tapsX + dst->height * tapsY ) );
+    // Rows of `src` scaled horizontally, kept in a ring so those shared by consecutive rows of `dst` are made once
+    int ringSize = tapsY + 1;
+    float* ring = (float*) malloc( sizeof( float ) * 4 * dst->width * ringSize );
+    int* ringRows = (int*) malloc( sizeof( int ) * ringSize );
+    float const** rows = (float const**) malloc( sizeof( float* ) * tapsY );
+    if( !startsX || !weightsX || !ring || !ringRows || !rows ) {
+        free( startsX );
+        free( weightsX );
+        free( ring );
+        free( ringRows );
+        free( rows );
+        return 0;
+    }
+    int* startsY = startsX + dst->width;
+    float* weightsY = weightsX + dst->width * tapsX;
+    boxFilterWeights( src->width, dst->width, tapsX, startsX, weightsX );
+    boxFilterWeights( src->height, dst->height, tapsY, startsY, weightsY );
+    for( int i = 0; i < ringSize; ++i ) {
+        ringRows[ i ] = -1;
+    }
+
+    for( int y = 0; y < dst->height; ++y ) {
+        for( int k = 0; k < tapsY; ++k ) {
+            int row = startsY[ y ] + k;
+            float* slot = ring + ( row % ringSize ) * dst->width * 4;
+            if( ringRows[ row % ringSize ] != row ) {
+                resampleRow( pixelRow( src, row ), dst->width, tapsX, startsX, weightsX, slot );
+                ringRows[ row % ringSize ] = row;
+            }
+            rows[ k ] = slot;
+        }
+        float const* w = weightsY + y * tapsY;
+        uint32_t* out = pixelRow( dst, y );
+        int x = 0;
+        #ifdef PIXELS_SSE2
+            for( ; x < dst->width; ++x ) {
+                __m128 sum = _mm_set1_ps( 0.5f );
+                for( int k = 0; k < tapsY; ++k ) {
+                    sum = _mm_add_ps( sum, _mm_mul_ps( _mm_loadu_ps( rows[ k ] + x * 4 ), _mm_set1_ps( w[ k ] ) ) );
+                }
+                __m128i c = _mm_cvttps_epi32( sum );
+                c = _mm_packs_epi32( c, c );
+                out[ x ] = (uint32_t) _mm_cvtsi128_si32( _mm_packus_epi16( c, c ) );
+            }
+        #endif
+        for( ; x < dst->width; ++x ) {
+            uint32_t result = 0;
+            for( int c = 0; c < 4; ++c ) {
+                float sum = 0.5f;
+                for( int k = 0; k < tapsY; ++k ) {
+                    sum += rows[ k ][ x * 4 + c ] * w[ k ];
+                }
+                int value = (int) sum;
+                result |= (uint32_t)( value < 0 ? 0 : ( value > 255 ? 255 : value ) ) << ( c * 8 );
+            }
+            out[ x ] = result;
+        }
+    }
+    free( startsX );
+    free( weightsX );
+    free( ring );
+    free( ringRows );
+    free( rows );
+    return 1;
+}
+
+
+// Makes a `width` by `height` copy of the image the pyramid was built from, resampled from the smallest level that is
+// at least that big. `out` is allocated, and must be freed by the caller. Returns zero if out of memory
+static int resizeFromPyramid( struct Pyramid const* pyramid, int width, int height, struct PixelBuffer* out ) {
+    int level = 0;
+    while( level + 1 < pyramid->count && pyramid->levels[ level + 1 ].width >= width &&
+        pyramid->levels[ level + 1 ].height >= height ) {
+        ++level;
+    }
+    struct PixelBuffer const* src = &pyramid->levels[ level ];
+    out->width = width;
+    out->height = height;
+    out->stride = width;
+    out->pixels = (uint32_t*) malloc( sizeof( uint32_t ) * width * height );
+    if( !out->pixels ) {
+        return 0;
+    }
+    if( src->width == width && src->height == height ) {
+        for( int y = 0; y < height; ++y ) {
+            memcpy( pixelRow( out, y ), pixelRow( src, y ), sizeof( uint32_t ) * width );
+        }
+        return 1;
+    }
+    if( !resamplePixels( src, out ) ) {
+        free( out->pixels );
+        out->pixels = NULL;
+        return 0;
+    }
+    return 1;
+}
+
+
+// Size of a thumbnail of a `width` by `height` image: THUMBNAIL_SIZE on the longest side, or the size of the image if
+// that is smaller already
+static void thumbnailSize( int width, int height, int* thumbWidth, int* thumbHeight ) {
+    int longest = width > height ? width : height;
+    if( longest <= THUMBNAIL_SIZE ) {
+        *thumbWidth = width;
+        *thumbHeight = height;
+        return;
+    }
+    *thumbWidth = (int)( (int64_t) width * THUMBNAIL_SIZE / longest );
+    *thumbHeight = (int)( (int64_t) height * THUMBNAIL_SIZE / longest );
+    *thumbWidth = *thumbWidth < 1 ? 1 : *thumbWidth;
+    *thumbHeight = *thumbHeight < 1 ? 1 : *thumbHeight;
+}
+
+
+// One of the sizes to save. `width`, `height` and `codec` are set by the caller, the rest by `encodeResolutions`
+struct ResolutionOutput {
+    int width;
+    int height;
+    struct ImageCodec const* codec;
+    struct ByteBuffer encoded;
+    int result; // Non-zero if `encoded` holds the image
+};
+
+
+static void encodeResolution( struct Pyramid const* pyramid, struct ResolutionOutput* output, double budgetMs ) {
+    struct PixelBuffer const* native = &pyramid->levels[ 0 ];
+    if( output->width == native->width && output->height == native->height ) {
+        output->result = output->codec->encode( native, budgetMs, &output->encoded );
+        return;
+    }
+    struct PixelBuffer pixels;
+    output->result = resizeFromPyramid( pyramid, output->width, output->height, &pixels ) &&
+        output->codec->encode( &pixels, budgetMs, &output->encoded );
+    free( pixels.pixels );
+}
+
+
+// Makes and encodes each of `outputs` from `source`. The pyramid is built once, down to the smallest size asked for,
+// and then each size is resampled and encoded on its own thread, the first on the calling thread. Returns non-zero if
+// all of them were encoded
+static int encodeResolutions( struct PixelBuffer const* source, struct ResolutionOutput* outputs, int count,
+    double budgetMs ) {
+
+    count = count < RESOLUTION_MAX_OUTPUTS ? count : RESOLUTION_MAX_OUTPUTS;
+    int minWidth = source->width;
+    int minHeight = source->height;
+    for( int i = 0; i < count; ++i ) {
+        minWidth = outputs[ i ].width < minWidth ? outputs[ i ].width : minWidth;
+        minHeight = outputs[ i ].height < minHeight ? outputs[ i ].height : minHeight;
+        outputs[ i ].result = 0;
+    }
+    struct Pyramid pyramid;
+    buildPyramid( &pyramid, source, minWidth, minHeight ); // If it runs out of memory, the levels made will do
+    initPngTables(); // Before any of the threads can start encoding a PNG
+
+    std::thread* threads[ RESOLUTION_MAX_OUTPUTS ] = {};
+    for( int i = 1; i < count; ++i ) {
+        threads[ i ] = new std::thread( encodeResolution, &pyramid, &outputs[ i ], budgetMs );
+    }
+    if( count > 0 ) {
+        encodeResolution( &pyramid, &outputs[ 0 ], budgetMs );
+    }
+    int result = 1;
+    for( int i = 0; i < count; ++i ) {
+        if( threads[ i ] ) {
+            threads[ i ]->join();
+            delete threads[ i ];
+        }
+        result = result && outputs[ i ].result;
+    }
+    releasePyramid( &pyramid );
+    return result;
+}
@@ -0,0 +1,360 @@
+// Redaction kernels: block-average pixelation and a separable running-sum box blur, both applied in place to a
+// rectangle of a pixel buffer. Only pixels inside the rectangle are ever sampled, so nothing from outside bleeds in.
+// Summing pixels and turning sums back into pixels are called through `cpuKernels`, and every variant rounds the same
+// way, so a redaction gives the same pixels whichever instruction set runs it.
+
+
+enum RedactMode {
+    REDACT_BLUR,
+    REDACT_PIXELATE,
+};
+
+
+// Adds the channels of `count` pixels to `sums` (four of them: B, G, R and A)
+static void sumPixelsScalar( uint32_t const* row, int count, uint32_t* sums ) {
+    for( int x = 0; x < count; ++x ) {
+        uint32_t p = row[ x ];
+        sums[ 0 ] += p & 0xff;
+        sums[ 1 ] += ( p >> 8 ) & 0xff;
+        sums[ 2 ] += ( p >> 16 ) & 0xff;
+        sums[ 3 ] += p >> 24;
+    }
+}
+
+
+#ifdef PIXELS_SSE2
+    // Four pixels at a time, widened to 16 bits and added in pairs, then to 32 bits and added again
+    static void sumPixelsSse2( uint32_t const* row, int count, uint32_t* sums ) {
+        __m128i const zero = _mm_setzero_si128();
+        __m128i acc = _mm_loadu_si128( (__m128i const*) sums );
+        int x = 0;
+        for( ; x + 4 <= count; x += 4 ) {
+            __m128i v = _mm_loadu_si128( (__m128i const*)( row + x ) );
+            __m128i pairs = _mm_add_epi16( _mm_unpacklo_epi8( v, zero ), _mm_unpackhi_epi8( v, zero ) );
+            acc = _mm_add_epi32( acc, _mm_add_epi32( _mm_unpacklo_epi16( pairs, zero ),
+                _mm_unpackhi_epi16( pairs, zero ) ) );
+        }
+        _mm_storeu_si128( (__m128i*) sums, acc );
+        sumPixelsScalar( row + x, count - x, sums );
+    }
+#endif
+
+
+#ifdef PIXELS_AVX2
+    CPU_TARGET( "avx2" ) static void sumPixelsAvx2( uint32_t const* row, int count, uint32_t* sums ) {
+        __m256i const zero = _mm256_setzero_si256();
+        __m256i acc = zero;
+        int x = 0;
+        for( ; x + 8 <= count; x += 8 ) {
+            __m256i v = _mm256_loadu_si256( (__m256i const*)( row + x ) );
+            __m256i pairs = _mm256_add_epi16( _mm256_unpacklo_epi8( v, zero ), _mm256_unpackhi_epi8( v, zero ) );
+            acc = _mm256_add_epi32( acc, _mm256_add_epi32( _mm256_unpacklo_epi16( pairs, zero ),
+                _mm256_unpackhi_epi16( pairs, zero ) ) );
+        }
+        __m128i total = _mm_add_epi32( _mm256_castsi256_si128( acc ), _mm256_extracti128_si256( acc, 1 ) );
+        _mm_storeu_si128( (__m128i*) sums, _mm_add_epi32( _mm_loadu_si128( (__m128i const*) sums ), total ) );
+        _mm256_zeroupper(); // The SSE2 variant isn't VEX encoded, and would stall on the upper halves otherwise
+        sumPixelsSse2( row + x, count - x, sums );
+    }
+#endif
+
+
+// Averaging by `n` pixels, rounded: `( sum + n / 2 ) / n` for each channel. The vector variants multiply
+// `sum + n / 2 + 0.5` by `reciprocal` in single precision and truncate. The sums are below 256 * n, so that is exact
+// as a float, and the product is at least 0.5 / n away from the next integer either way while its error is below
+// 2^-15, so for `n` up to REDACT_MAX_DIVISOR it truncates to exactly the integer quotient. The reciprocal is zero for
+// larger `n`, and only the scalar division is used
+struct RedactDivisor {
+    uint32_t n;
+    float reciprocal;
+};
+
+uint32_t const REDACT_MAX_DIVISOR = 4096;
+
+
+static struct RedactDivisor redactDivisor( uint32_t n ) {
+    struct RedactDivisor divisor = { n, n > 0 && n <= REDACT_MAX_DIVISOR ? 1.0f / n : 0.0f };
+    return divisor;
+}
+
+
+// Turns `count` pixels worth of channel sums (four per pixel, as `sumPixels` makes them) into the average pixels
+static void averageSumsScalar( uint32_t const* sums, uint32_t* out, int count, struct RedactDivisor const* divisor ) {
+    uint32_t const n = divisor->n;
+    for( int x = 0; x < count; ++x ) {
+        uint32_t const* s = sums + x * 4;
+        out[ x ] = ( ( s[ 0 ] + n / 2 ) / n ) | ( ( ( s[ 1 ] + n / 2 ) / n ) << 8 ) |
+            ( ( ( s[ 2 ] + n / 2 ) / n ) << 16 ) | ( ( ( s[ 3 ] + n / 2 ) / n ) << 24 );
+    }
+}
+
+
+#ifdef PIXELS_SSE2
+    // Four pixels at a time
+    static void averageSumsSse2( uint32_t const* sums, uint32_t* out, int count,
+        struct RedactDivisor const* divisor ) {
+
+        int x = 0;
+        if( divisor->reciprocal != 0.0f ) {
+            __m128 const half = _mm_set1_ps( divisor->n / 2 + 0.5f );
+            __m128 const reciprocal = _mm_set1_ps( divisor->reciprocal );
+            for( ; x + 4 <= count; x += 4 ) {
+                __m128i q[ 4 ];
+                for( int i = 0; i < 4; ++i ) {
+                    __m128 sum = _mm_cvtepi32_ps( _mm_loadu_si128( (__m128i const*)( sums + ( x + i ) * 4 ) ) );
+                    q[ i ] = _mm_cvttps_epi32( _mm_mul_ps( _mm_add_ps( sum, half ), reciprocal ) );
+                }
+                __m128i low = _mm_packs_epi32( q[ 0 ], q[ 1 ] );
+                __m128i high = _mm_packs_epi32( q[ 2 ], q[ 3 ] );
+                _mm_storeu_si128( (__m128i*)( out + x ), _mm_packus_epi16( low, high ) );
+            }
+        }
+        averageSumsScalar( sums + x * 4, out + x, count - x, divisor );
+    }
+#endif
+
+
+#ifdef PIXELS_AVX2
+    // Eight pixels at a time. Packing works within each 16-byte lane, which leaves the even pixels in the low lane and
+    // the odd ones in the high lane, so they are put back in order at the end
+    CPU_TARGET( "avx2" ) static void averageSumsAvx2( uint32_t const* sums, uint32_t* out, int count,
+        struct RedactDivisor const* divisor ) {
+
+        int x = 0;
+        if( divisor->reciprocal != 0.0f ) {
+            __m256 const half = _mm256_set1_ps( divisor->n / 2 + 0.5f );
+            __m256 const reciprocal = _mm256_set1_ps( divisor->reciprocal );
+            __m256i const order = _mm256_setr_epi32( 0, 4, 1, 5, 2, 6, 3, 7 );
+            for( ; x + 8 <= count; x += 8 ) {
+                __m256i q[ 4 ];
+                for( int i = 0; i < 4; ++i ) {
+                    __m256i sum = _mm256_loadu_si256( (__m256i const*)( sums + ( x + i * 2 ) * 4 ) );
+                    __m256 rounded = _mm256_add_ps( _mm256_cvtepi32_ps( sum ), half );
+                    q[ i ] = _mm256_cvttps_epi32( _mm256_mul_ps( rounded, reciprocal ) );
+                }
+                __m256i pixels = _mm256_packus_epi16( _mm256_packs_epi32( q[ 0 ], q[ 1 ] ),
+                    _mm256_packs_epi32( q[ 2 ], q[ 3 ] ) );
+                _mm256_storeu_si256( (__m256i*)( out + x ), _mm256_permutevar8x32_epi32( pixels, order ) );
+            }
+        }
+        _mm256_zeroupper();
+        averageSumsSse2( sums + x * 4, out + x, count - x, divisor );
+    }
+#endif
+
+
+// Replace every `block` x `block` cell of `rect` (aligned to its top-left corner) with the average color of the cell
+static void pixelateRect( struct PixelBuffer* buffer, struct PixelRect rect, int block ) {
+    int width = rect.right - rect.left;
+    int cells = ( width + block - 1 ) / block;
+    uint32_t* sums = (uint32_t*) malloc( sizeof( uint32_t ) * 4 * cells );
+    if( !sums ) {
+        return;
+    }
+
+    for( int y0 = rect.top; y0 < rect.bottom; y0 += block ) {
+        int y1 = y0 + block < rect.bottom ? y0 + block : rect.bottom;
+        memset( sums, 0, sizeof( uint32_t ) * 4 * cells );
+
+        // Sum each cell, one channel per 32-bit lane
+        for( int y = y0; y < y1; ++y ) {
+            uint32_t const* row = pixelRow( buffer, y ) + rect.left;
+            for( int c = 0; c < cells; ++c ) {
+                int x0 = c * block;
+                int x1 = x0 + block < width ? x0 + block : width;
+                cpuKernels.sumPixels( row + x0, x1 - x0, sums + c * 4 );
+            }
+        }
+
+        // Fill each cell with its average. The cells at the right and bottom edges may be smaller, so each has its own
+        // divisor, but there is only one division per channel of a cell
+        for( int c = 0; c < cells; ++c ) {
+            int x0 = c * block;
+            int x1 = x0 + block < width ? x0 + block : width;
+            struct RedactDivisor divisor = { (uint32_t)( ( x1 - x0 ) * ( y1 - y0 ) ), 0.0f };
+            uint32_t color;
+            averageSumsScalar( sums + c * 4, &color, 1, &divisor );
+            for( int y = y0; y < y1; ++y ) {
+                uint32_t* row = pixelRow( buffer, y ) + rect.left;
+                for( int x = x0; x < x1; ++x ) {
+                    row[ x ] = color;
+                }
+            }
+        }
+    }
+
+    free( sums );
+}
+
+
+#ifdef PIXELS_SSE2
+    // The channels of four pixels of `add` less those of `sub`, as signed 32-bit lanes, one register per pixel
+    static void pixelDifferencesSse2( __m128i add, __m128i sub, __m128i differences[ 4 ] ) {
+        __m128i const zero = _mm_setzero_si128();
+        __m128i low = _mm_sub_epi16( _mm_unpacklo_epi8( add, zero ), _mm_unpacklo_epi8( sub, zero ) );
+        __m128i high = _mm_sub_epi16( _mm_unpackhi_epi8( add, zero ), _mm_unpackhi_epi8( sub, zero ) );
+        differences[ 0 ] = _mm_srai_epi32( _mm_unpacklo_epi16( low, low ), 16 );
+        differences[ 1 ] = _mm_srai_epi32( _mm_unpackhi_epi16( low, low ), 16 );
+        differences[ 2 ] = _mm_srai_epi32( _mm_unpacklo_epi16( high, high ), 16 );
+        differences[ 3 ] = _mm_srai_epi32( _mm_unpackhi_epi16( high, high ), 16 );
+    }
+#endif
+
+
+// Stores the running sum `acc` of the window around pixel `x` of a row, then moves the window on by a pixel
+static void boxBlurStep( uint32_t const* in, int count, int radius, int x, uint32_t* acc, uint32_t* sums ) {
+    uint32_t add = in[ x + radius + 1 < count ? x + radius + 1 : count - 1 ];
+    uint32_t sub = in[ x - radius > 0 ? x - radius : 0 ];
+    for( int c = 0; c < 4; ++c ) {
+        sums[ x * 4 + c ] = acc[ c ];
+        acc[ c ] += ( ( add >> ( c * 8 ) ) & 0xff ) - ( ( sub >> ( c * 8 ) ) & 0xff );
+    }
+}
+
+
+// One horizontal box blur pass over a row of `count` pixels. The window is clamped to the ends of the row. Each
+// window's sum follows from the one before, so the sums are made a pixel at a time into `sums` (four per pixel), then
+// averaged into pixels several at a time
+static void boxBlurRow( uint32_t const* in, uint32_t* out, int count, int radius, uint32_t* sums,
+    struct RedactDivisor const* divisor ) {
+
+    // Prime the running sum with the window around the first pixel, repeating the edge pixel as needed
+    uint32_t acc[ 4 ] = { 0, 0, 0, 0 };
+    for( int i = -radius; i <= radius; ++i ) {
+        sumPixelsScalar( in + ( i < 0 ? 0 : ( i >= count ? count - 1 : i ) ), 1, acc );
+    }
+
+    int x = 0;
+    #ifdef PIXELS_SSE2
+        // Away from the ends of the row the window needs no clamping, and what four pixels add to the running sum
+        // is worked out at once
+        for( ; x < radius && x < count; ++x ) {
+            boxBlurStep( in, count, radius, x, acc, sums );
+        }
+        __m128i sum = _mm_loadu_si128( (__m128i const*) acc );
+        for( ; x + radius + 4 < count; x += 4 ) {
+            __m128i differences[ 4 ];
+            pixelDifferencesSse2( _mm_loadu_si128( (__m128i const*)( in + x + radius + 1 ) ),
+                _mm_loadu_si128( (__m128i const*)( in + x - radius ) ), differences );
+            for( int i = 0; i < 4; ++i ) {
+                _mm_storeu_si128( (__m128i*)( sums + ( x + i ) * 4 ), sum );
+                sum = _mm_add_epi32( sum, differences[ i ] );
+            }
+        }
+        _mm_storeu_si128( (__m128i*) acc, sum );
+    #endif
+    for( ; x < count; ++x ) {
+        boxBlurStep( in, count, radius, x, acc, sums );
+    }
+    cpuKernels.averageSums( sums, out, count, divisor );
+}
+
+
+// Adds each pixel of `row` to the per-column, per-channel running sums in `sums`
+static void accumulateRow( uint32_t const* row, uint32_t* sums, int width ) {
+    int x = 0;
+    #ifdef PIXELS_SSE2
+        __m128i const zero = _mm_setzero_si128();
+        for( ; x + 4 <= width; x += 4 ) {
+            __m128i px = _mm_loadu_si128( (__m128i const*)( row + x ) );
+            __m128i low = _mm_unpacklo_epi8( px, zero );
+            __m128i high = _mm_unpackhi_epi8( px, zero );
+            __m128i channels[ 4 ] = { _mm_unpacklo_epi16( low, zero ), _mm_unpackhi_epi16( low, zero ),
+                _mm_unpacklo_epi16( high, zero ), _mm_unpackhi_epi16( high, zero ) };
+            for( int i = 0; i < 4; ++i ) {
+                __m128i* s = (__m128i*)( sums + ( x + i ) * 4 );
+                _mm_storeu_si128( s, _mm_add_epi32( _mm_loadu_si128( s ), channels[ i ] ) );
+            }
+        }
+    #endif
+    for( ; x < width; ++x ) {
+        sumPixelsScalar( row + x, 1, sums + x * 4 );
+    }
+}
+
+
+// Moves the per-column running sums in `sums` down a row: adds each pixel of `add` and removes each of `sub`
+static void slideColumns( uint32_t const* add, uint32_t const* sub, uint32_t* sums, int width ) {
+    int x = 0;
+    #ifdef PIXELS_SSE2
+        for( ; x + 4 <= width; x += 4 ) {
+            __m128i differences[ 4 ];
+            pixelDifferencesSse2( _mm_loadu_si128( (__m128i const*)( add + x ) ),
+                _mm_loadu_si128( (__m128i const*)( sub + x ) ), differences );
+            for( int i = 0; i < 4; ++i ) {
+                __m128i* s = (__m128i*)( sums + ( x + i ) * 4 );
+                _mm_storeu_si128( s, _mm_add_epi32( _mm_loadu_si128( s ), differences[ i ] ) );
+            }
+        }
+    #endif
+    for( ; x < width; ++x ) {
+        for( int c = 0; c < 4; ++c ) {
+            sums[ x * 4 + c ] += ( ( add[ x ] >> ( c * 8 ) ) & 0xff ) - ( ( sub[ x ] >> ( c * 8 ) ) & 0xff );
+        }
+    }
+}
+
+
+// Vertical box blur pass over a whole rectangle. Rather than walking down each column, a running sum is kept for all
+// columns at once and updated a row at a time, so memory is always read in row order.
+static void boxBlurColumns( struct PixelBuffer const* in, struct PixelBuffer* out, int radius, uint32_t* sums,
+    struct RedactDivisor const* divisor ) {
+
+    int width = in->width;
+    int height = in->height;
+    memset( sums, 0, sizeof( uint32_t ) * 4 * width );
+    for( int i = -radius; i <= radius; ++i ) {
+        int j = i < 0 ? 0 : ( i >= height ? height - 1 : i );
+        accumulateRow( pixelRow( in, j ), sums, width );
+    }
+
+    for( int y = 0; y < height; ++y ) {
+        cpuKernels.averageSums( sums, pixelRow( out, y ), width, divisor );
+        int add = y + radius + 1 < height ? y + radius + 1 : height - 1;
+        int sub = y - radius > 0 ? y - radius : 0;
+        slideColumns( pixelRow( in, add ), pixelRow( in, sub ), sums, width );
+    }
+}
+
+
+// Three passes of separable box blur over `rect`, which approximates a gaussian with a standard deviation of about
+// `radius`. Each pass is done as rows into a scratch buffer, then columns back into the image.
+static void boxBlurRect( struct PixelBuffer* buffer, struct PixelRect rect, int radius ) {
+    int width = rect.right - rect.left;
+    int height = rect.bottom - rect.top;
+    uint32_t* scratch = (uint32_t*) malloc( sizeof( uint32_t ) * (size_t) width * height );
+    uint32_t* sums = (uint32_t*) malloc( sizeof( uint32_t ) * 4 * width );
+    if( !scratch || !sums ) {
+        free( scratch );
+        free( sums );
+        return;
+    }
+
+    struct PixelBuffer area = { pixelRow( buffer, rect.top ) + rect.left, width, height, buffer->stride };
+    struct PixelBuffer temp = { scratch, width, height, width };
+    struct RedactDivisor divisor = redactDivisor( (uint32_t)( radius * 2 + 1 ) );
+    for( int pass = 0; pass < 3; ++pass ) {
+        for( int y = 0; y < height; ++y ) {
+            boxBlurRow( pixelRow( &area, y ), pixelRow( &temp, y ), width, radius, sums, &divisor );
+        }
+        boxBlurColumns( &temp, &area, radius, sums, &divisor );
+    }
+
+    free( scratch );
+    free( sums );
+}
+
+
+// Irreversibly obscure `rect` of `buffer`. Blurring alone can to some extent be undone by deconvolution, so the blur
+// mode pixelates first - what remains is only block averages, which are then smoothed to look like a blur.
+static void redactRect( struct PixelBuffer* buffer, struct PixelRect rect, enum RedactMode mode, int strength ) {
+    struct PixelRect bounds = { 0, 0, buffer->width, buffer->height };
+    rect = intersectPixelRect( rect, bounds );
+    if( pixelRectEmpty( rect ) || strength < 1 ) {
+        return;
+    }
+    pixelateRect( buffer, rect, strength );
+    if( mode == REDACT_BLUR ) {
+        boxBlurRect( buffer, rect, strength / 2 > 1 ? strength / 2 : 1 );
+    }
+}
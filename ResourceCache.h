@@ -0,0 +1,128 @@
+// Cache of the GDI objects the annotation window draws its controls with: fonts, brushes, memory device contexts and
+// bitmaps such as the atlas of menu icons. A resource is asked for by a key saying what it is, its size and its color,
+// is created the first time it is asked for, and is then handed out again on later repaints, or when the window moves
+// back to a display with the same scaling. Each kind keeps at most RESOURCE_CACHE_LIMIT resources, destroying the one
+// that went unused the longest to make room. The cache only sees opaque handles: creating and destroying them is left
+// to a backend, so the policy can be exercised without a display. Nothing in here depends on windows.h.
+
+
+// Resources are destroyed in this order, so no DC still has a bitmap or brush of the cache selected into it
+enum ResourceKind {
+    RESOURCE_DC,
+    RESOURCE_FONT,
+    RESOURCE_BRUSH,
+    RESOURCE_BITMAP,
+    RESOURCE_KIND_COUNT,
+};
+
+int const RESOURCE_CACHE_LIMIT = 8; // Per kind. Must be more than the number of resources of a kind in use at once
+
+
+struct ResourceKey {
+    enum ResourceKind kind;
+    int size; // Height in pixels for fonts and bitmaps, unused for the rest
+    uint32_t color;
+    int variant; // Tells apart resources of the same kind, size and color, like different bitmaps
+};
+
+
+// Creates the resource for a key, returning NULL if it couldn't, and destroys it again
+struct ResourceBackend {
+    void* context;
+    void* (*create)( void* context, struct ResourceKey const* key );
+    void (*destroy)( void* context, struct ResourceKey const* key, void* handle );
+};
+
+
+struct ResourceEntry {
+    struct ResourceKey key;
+    void* handle;
+    uint64_t lastUse;
+};
+
+
+struct ResourceCache {
+    struct ResourceBackend backend;
+    int count;
+    struct ResourceEntry entries[ RESOURCE_KIND_COUNT * RESOURCE_CACHE_LIMIT ];
+    int live[ RESOURCE_KIND_COUNT ]; // Number of resources of each kind currently held
+    uint64_t clock; // Counts lookups, to tell which resource went unused the longest
+    uint64_t created; // Number of resources created, and destroyed, since the cache was initialized
+    uint64_t destroyed;
+};
+
+
+static void initResourceCache( struct ResourceCache* cache, struct ResourceBackend const* backend ) {
+    memset( cache, 0, sizeof( *cache ) );
+    cache->backend = *backend;
+}
+
+
+static struct ResourceKey resourceKey( enum ResourceKind kind, int size, uint32_t color, int variant ) {
+    struct ResourceKey key = { kind, size, color, variant };
+    return key;
+}
+
+
+static int sameResourceKey( struct ResourceKey const* a, struct ResourceKey const* b ) {
+    return a->kind == b->kind && a->size == b->size && a->color == b->color && a->variant == b->variant;
+}
+
+
+static void destroyResourceEntry( struct ResourceCache* cache, int index ) {
+    struct ResourceEntry* entry = &cache->entries[ index ];
+    cache->backend.destroy( cache->backend.context, &entry->key, entry->handle );
+    --cache->live[ entry->key.kind ];
+    ++cache->destroyed;
+    cache->entries[ index ] = cache->entries[ --cache->count ];
+}
+
+
+// Returns the resource for `key`, creating it if it isn't in the cache yet, or NULL if it couldn't be created. The
+// handle stays valid until RESOURCE_CACHE_LIMIT other resources of the same kind have been asked for since it was
+// last returned, or the cache is released
+static void* getResource( struct ResourceCache* cache, struct ResourceKey key ) {
+    ++cache->clock;
+    int oldest = -1;
+    for( int i = 0; i < cache->count; ++i ) {
+        struct ResourceEntry* entry = &cache->entries[ i ];
+        if( sameResourceKey( &entry->key, &key ) ) {
+            entry->lastUse = cache->clock;
+            return entry->handle;
+        }
+        if( entry->key.kind == key.kind && ( oldest < 0 || entry->lastUse < cache->entries[ oldest ].lastUse ) ) {
+            oldest = i;
+        }
+    }
+
+    void* handle = cache->backend.create( cache->backend.context, &key );
+    if( !handle ) {
+        return NULL;
+    }
+    if( cache->live[ key.kind ] >= RESOURCE_CACHE_LIMIT ) {
+        destroyResourceEntry( cache, oldest );
+    }
+    struct ResourceEntry entry = { key, handle, cache->clock };
+    cache->entries[ cache->count++ ] = entry;
+    ++cache->live[ key.kind ];
+    ++cache->created;
+    return handle;
+}
+
+
+// Destroys all resources of `kind`, for when what they were made from changed in a way their keys don't capture
+static void flushResources( struct ResourceCache* cache, enum ResourceKind kind ) {
+    for( int i = cache->count - 1; i >= 0; --i ) {
+        if( cache->entries[ i ].key.kind == kind ) {
+            destroyResourceEntry( cache, i );
+        }
+    }
+}
+
+
+// Destroys every resource in the cache
+static void releaseResourceCache( struct ResourceCache* cache ) {
+    for( int kind = 0; kind < RESOURCE_KIND_COUNT; ++kind ) {
+        flushResources( cache, (enum ResourceKind) kind );
+    }
+}
@@ -0,0 +1,407 @@
+// Retained scene of typed annotation shapes (arrows, rectangles, ellipses and text labels). Each shape caches its
+// bounds, and the shapes are organized in a bounding volume hierarchy, so repainting a dirty rect or hit-testing a
+// point only visits the shapes which can actually intersect it.
+#include <wchar.h>
+
+
+enum ShapeType {
+    SHAPE_ARROW,
+    SHAPE_RECTANGLE,
+    SHAPE_ELLIPSE,
+    SHAPE_TEXT,
+};
+
+
+struct Shape {
+    enum ShapeType type;
+    int penIndex; // The index (color) of the pen used
+    float width; // Width of the outline
+    float x0; // Arrow tail, or first corner of the rectangle/ellipse/text box
+    float y0;
+    float x1; // Arrow head, or opposite corner
+    float y1;
+    wchar_t* text; // Label for SHAPE_TEXT, owned by the scene
+    struct PixelRect bounds; // Everything the shape touches when rendered
+};
+
+
+// Node in the bounding volume hierarchy. Inner nodes have two children, leaves refer to a range of `Scene::order`
+struct SceneNode {
+    struct PixelRect bounds;
+    int left; // Indices of the children, or -1 for leaves
+    int right;
+    int first; // For leaves, the range in `order` of the shapes it holds
+    int count;
+};
+
+
+int const SCENE_LEAF_SIZE = 4; // Max number of shapes in a leaf
+int const SCENE_MAX_PENDING = 32; // Shapes added since the last build are tested linearly, up to this many
+
+
+struct Scene {
+    int count; // Number of shapes
+    int capacity;
+    struct Shape* shapes; // Shapes in paint order
+
+    int built; // Number of shapes (from the start of `shapes`) covered by the hierarchy
+    int dirty; // Set if a shape covered by the hierarchy was changed or removed
+    int nodeCount;
+    int nodeCapacity;
+    struct SceneNode* nodes;
+    int* order; // Shape indices, grouped by leaf
+
+    int resultCount; // Result of the last query
+    int resultCapacity;
+    int* results;
+};
+
+
+// Arrowhead barbs for an arrow, as two points (x, y, x, y)
+static void shapeArrowHead( struct Shape const* shape, float* barbs ) {
+    float dx = shape->x1 - shape->x0;
+    float dy = shape->y1 - shape->y0;
+    float length = sqrtf( dx * dx + dy * dy );
+    if( length < 1.0f ) {
+        barbs[ 0 ] = barbs[ 2 ] = shape->x1;
+        barbs[ 1 ] = barbs[ 3 ] = shape->y1;
+        return;
+    }
+    float head = shape->width * 4.0f > 12.0f ? shape->width * 4.0f : 12.0f;
+    if( head > length / 3.0f ) {
+        head = length / 3.0f;
+    }
+    // Barbs at +-30 degrees from the shaft (cos 30 = 0.866, sin 30 = 0.5)
+    float ux = dx / length;
+    float uy = dy / length;
+    barbs[ 0 ] = shape->x1 - head * ( ux * 0.866f - uy * 0.5f );
+    barbs[ 1 ] = shape->y1 - head * ( uy * 0.866f + ux * 0.5f );
+    barbs[ 2 ] = shape->x1 - head * ( ux * 0.866f + uy * 0.5f );
+    barbs[ 3 ] = shape->y1 - head * ( uy * 0.866f - ux * 0.5f );
+}
+
+
+static void updateShapeBounds( struct Shape* shape ) {
+    float x0 = shape->x0 < shape->x1 ? shape->x0 : shape->x1;
+    float x1 = shape->x0 < shape->x1 ? shape->x1 : shape->x0;
+    float y0 = shape->y0 < shape->y1 ? shape->y0 : shape->y1;
+    float y1 = shape->y0 < shape->y1 ? shape->y1 : shape->y0;
+    if( shape->type == SHAPE_ARROW ) {
+        float barbs[ 4 ];
+        shapeArrowHead( shape, barbs );
+        for( int i = 0; i < 4; i += 2 ) {
+            x0 = barbs[ i ] < x0 ? barbs[ i ] : x0;
+            x1 = barbs[ i ] > x1 ? barbs[ i ] : x1;
+            y0 = barbs[ i + 1 ] < y0 ? barbs[ i + 1 ] : y0;
+            y1 = barbs[ i + 1 ] > y1 ? barbs[ i + 1 ] : y1;
+        }
+    }
+    float margin = shape->width * 0.5f + 2.0f; // Half the outline width, and some slack for anti-aliasing
+    struct PixelRect bounds = { (int) floorf( x0 - margin ), (int) floorf( y0 - margin ),
+        (int) ceilf( x1 + margin ), (int) ceilf( y1 + margin ) };
+    shape->bounds = bounds;
+}
+
+
+static float distanceToSegment( float px, float py, float x0, float y0, float x1, float y1 ) {
+    float dx = x1 - x0;
+    float dy = y1 - y0;
+    float len2 = dx * dx + dy * dy;
+    float t = len2 > 0.0f ? ( ( px - x0 ) * dx + ( py - y0 ) * dy ) / len2 : 0.0f;
+    t = t < 0.0f ? 0.0f : ( t > 1.0f ? 1.0f : t );
+    float ex = x0 + t * dx - px;
+    float ey = y0 + t * dy - py;
+    return sqrtf( ex * ex + ey * ey );
+}
+
+
+// Distance from (px, py) to the outline of a shape (or 0 if inside a text label)
+static float shapeDistance( struct Shape const* shape, float px, float py ) {
+    float x0 = shape->x0 < shape->x1 ? shape->x0 : shape->x1;
+    float x1 = shape->x0 < shape->x1 ? shape->x1 : shape->x0;
+    float y0 = shape->y0 < shape->y1 ? shape->y0 : shape->y1;
+    float y1 = shape->y0 < shape->y1 ? shape->y1 : shape->y0;
+    switch( shape->type ) {
+        case SHAPE_ARROW: {
+            float barbs[ 4 ];
+            shapeArrowHead( shape, barbs );
+            float d = distanceToSegment( px, py, shape->x0, shape->y0, shape->x1, shape->y1 );
+            float a = distanceToSegment( px, py, barbs[ 0 ], barbs[ 1 ], shape->x1, shape->y1 );
+            float b = distanceToSegment( px, py, barbs[ 2 ], barbs[ 3 ], shape->x1, shape->y1 );
+            d = a < d ? a : d;
+            return b < d ? b : d;
+        }
+        case SHAPE_RECTANGLE: {
+            float d = distanceToSegment( px, py, x0, y0, x1, y0 );
+            float e = distanceToSegment( px, py, x1, y0, x1, y1 );
+            d = e < d ? e : d;
+            e = distanceToSegment( px, py, x1, y1, x0, y1 );
+            d = e < d ? e : d;
+            e = distanceToSegment( px, py, x0, y1, x0, y0 );
+            return e < d ? e : d;
+        }
+        case SHAPE_ELLIPSE: {
+            // Approximation: radial distance from the outline in normalized space, scaled back by the smaller radius
+            float rx = ( x1 - x0 ) * 0.5f;
+            float ry = ( y1 - y0 ) * 0.5f;
+            if( rx < 0.5f || ry < 0.5f ) {
+                return distanceToSegment( px, py, x0, y0, x1, y1 );
+            }
+            float nx = ( px - ( x0 + rx ) ) / rx;
+            float ny = ( py - ( y0 + ry ) ) / ry;
+            return fabsf( sqrtf( nx * nx + ny * ny ) - 1.0f ) * ( rx < ry ? rx : ry );
+        }
+        case SHAPE_TEXT: {
+            float dx = px < x0 ? x0 - px : ( px > x1 ? px - x1 : 0.0f );
+            float dy = py < y0 ? y0 - py : ( py > y1 ? py - y1 : 0.0f );
+            return sqrtf( dx * dx + dy * dy );
+        }
+    }
+    return 1e30f;
+}
+
+
+// Appends a shape to the scene and returns its index, or -1 if out of memory. `text` is copied.
+static int addShape( struct Scene* scene, enum ShapeType type, int penIndex, float width, float x0, float y0,
+    float x1, float y1, wchar_t const* text ) {
+
+    if( scene->count >= scene->capacity ) {
+        int capacity = scene->capacity ? scene->capacity * 2 : 64;
+        struct Shape* shapes = (struct Shape*) realloc( scene->shapes, sizeof( struct Shape ) * capacity );
+        if( !shapes ) {
+            return -1;
+        }
+        scene->shapes = shapes;
+        scene->capacity = capacity;
+    }
+    struct Shape* shape = &scene->shapes[ scene->count ];
+    shape->type = type;
+    shape->penIndex = penIndex;
+    shape->width = width;
+    shape->x0 = x0;
+    shape->y0 = y0;
+    shape->x1 = x1;
+    shape->y1 = y1;
+    shape->text = NULL;
+    if( text ) {
+        size_t length = wcslen( text ) + 1;
+        shape->text = (wchar_t*) malloc( sizeof( wchar_t ) * length );
+        if( shape->text ) {
+            memcpy( shape->text, text, sizeof( wchar_t ) * length );
+        }
+    }
+    updateShapeBounds( shape );
+    return scene->count++;
+}
+
+
+// Must be called after changing the coordinates of a shape, to update its cached bounds
+static void updateShape( struct Scene* scene, int index ) {
+    updateShapeBounds( &scene->shapes[ index ] );
+    if( index < scene->built ) {
+        scene->dirty = 1;
+    }
+}
+
+
+static void removeShape( struct Scene* scene, int index ) {
+    free( scene->shapes[ index ].text );
+    memmove( &scene->shapes[ index ], &scene->shapes[ index + 1 ],
+        sizeof( struct Shape ) * ( scene->count - index - 1 ) );
+    --scene->count;
+    if( index < scene->built ) {
+        scene->dirty = 1;
+    }
+}
+
+
+static void releaseScene( struct Scene* scene ) {
+    for( int i = 0; i < scene->count; ++i ) {
+        free( scene->shapes[ i ].text );
+    }
+    free( scene->shapes );
+    free( scene->nodes );
+    free( scene->order );
+    free( scene->results );
+    memset( scene, 0, sizeof( *scene ) );
+}
+
+
+// Twice the center of the bounds of a shape, along the x or y axis
+static int shapeCenter( struct Scene const* scene, int index, int axisX ) {
+    struct PixelRect const* b = &scene->shapes[ index ].bounds;
+    return axisX ? b->left + b->right : b->top + b->bottom;
+}
+
+
+// Recursively builds the hierarchy over order[ first, first + count ), splitting at the median of the shape centers
+// along the longest axis. Returns the index of the new node.
+static int buildSceneNode( struct Scene* scene, int first, int count ) {
+    int index = scene->nodeCount++;
+    struct SceneNode* node = &scene->nodes[ index ];
+    struct PixelRect bounds = scene->shapes[ scene->order[ first ] ].bounds;
+    for( int i = 1; i < count; ++i ) {
+        bounds = unionPixelRect( bounds, scene->shapes[ scene->order[ first + i ] ].bounds );
+    }
+    node->bounds = bounds;
+    node->first = first;
+    node->count = count;
+    node->left = -1;
+    node->right = -1;
+    if( count <= SCENE_LEAF_SIZE ) {
+        return index;
+    }
+
+    // Quickselect around the median of the shape centers, along the longest axis
+    int axisX = bounds.right - bounds.left >= bounds.bottom - bounds.top;
+    int* order = scene->order + first;
+    int mid = count / 2;
+    int lo = 0;
+    int hi = count - 1;
+    while( lo < hi ) {
+        int pivot = shapeCenter( scene, order[ ( lo + hi ) / 2 ], axisX );
+        int i = lo;
+        int j = hi;
+        while( i <= j ) {
+            while( shapeCenter( scene, order[ i ], axisX ) < pivot ) {
+                ++i;
+            }
+            while( shapeCenter( scene, order[ j ], axisX ) > pivot ) {
+                --j;
+            }
+            if( i <= j ) {
+                int t = order[ i ];
+                order[ i ] = order[ j ];
+                order[ j ] = t;
+                ++i;
+                --j;
+            }
+        }
+        if( mid <= j ) {
+            hi = j;
+        } else if( mid >= i ) {
+            lo = i;
+        } else {
+            break;
+        }
+    }
+
+    int left = buildSceneNode( scene, first, mid );
+    int right = buildSceneNode( scene, first + mid, count - mid );
+    scene->nodes[ index ].left = left;
+    scene->nodes[ index ].right = right;
+    return index;
+}
+
+
+// Rebuilds the hierarchy to cover all shapes. Returns FALSE if out of memory (queries then fall back to linear tests)
+static int buildScene( struct Scene* scene ) {
+    scene->built = 0;
+    scene->dirty = 0;
+    scene->nodeCount = 0;
+    if( scene->count == 0 ) {
+        return 1;
+    }
+    int maxNodes = 2 * scene->count;
+    if( maxNodes > scene->nodeCapacity ) {
+        struct SceneNode* nodes = (struct SceneNode*) realloc( scene->nodes, sizeof( struct SceneNode ) * maxNodes );
+        int* order = (int*) realloc( scene->order, sizeof( int ) * maxNodes );
+        if( nodes ) {
+            scene->nodes = nodes;
+        }
+        if( order ) {
+            scene->order = order;
+        }
+        if( !nodes || !order ) {
+            return 0;
+        }
+        scene->nodeCapacity = maxNodes;
+    }
+    for( int i = 0; i < scene->count; ++i ) {
+        scene->order[ i ] = i;
+    }
+    buildSceneNode( scene, 0, scene->count );
+    scene->built = scene->count;
+    return 1;
+}
+
+
+static void addQueryResult( struct Scene* scene, int index ) {
+    if( scene->resultCount >= scene->resultCapacity ) {
+        int capacity = scene->resultCapacity ? scene->resultCapacity * 2 : 64;
+        int* results = (int*) realloc( scene->results, sizeof( int ) * capacity );
+        if( !results ) {
+            return;
+        }
+        scene->results = results;
+        scene->resultCapacity = capacity;
+    }
+    scene->results[ scene->resultCount++ ] = index;
+}
+
+
+static int compareInts( void const* a, void const* b ) {
+    return *(int const*) a - *(int const*) b;
+}
+
+
+// Finds all shapes whose bounds intersect `rect`. Returns the number of shapes found, and points `results` at their
+// indices, in paint order. The results stay valid until the next query or change to the scene.
+static int queryScene( struct Scene* scene, struct PixelRect rect, int** results ) {
+    if( scene->dirty || scene->count - scene->built > SCENE_MAX_PENDING ) {
+        buildScene( scene );
+    }
+    scene->resultCount = 0;
+
+    // Walk the hierarchy with an explicit stack. Depth is at most log2 of the shape count, so 64 entries is plenty
+    int stack[ 64 ];
+    int top = 0;
+    if( scene->built > 0 ) {
+        stack[ top++ ] = 0;
+    }
+    while( top > 0 ) {
+        struct SceneNode const* node = &scene->nodes[ stack[ --top ] ];
+        if( !pixelRectsIntersect( node->bounds, rect ) ) {
+            continue;
+        }
+        if( node->left < 0 ) {
+            for( int i = 0; i < node->count; ++i ) {
+                int index = scene->order[ node->first + i ];
+                if( pixelRectsIntersect( scene->shapes[ index ].bounds, rect ) ) {
+                    addQueryResult( scene, index );
+                }
+            }
+        } else {
+            stack[ top++ ] = node->right;
+            stack[ top++ ] = node->left;
+        }
+    }
+    qsort( scene->results, scene->resultCount, sizeof( int ), compareInts );
+
+    // Shapes added since the last build are already in paint order, after everything in the hierarchy
+    for( int i = scene->built; i < scene->count; ++i ) {
+        if( pixelRectsIntersect( scene->shapes[ i ].bounds, rect ) ) {
+            addQueryResult( scene, i );
+        }
+    }
+
+    *results = scene->results;
+    return scene->resultCount;
+}
+
+
+// Returns the index of the topmost shape whose outline is within `tolerance` of (x, y), or -1 if there is none
+static int hitTestScene( struct Scene* scene, float x, float y, float tolerance ) {
+    int r = (int) ceilf( tolerance ) + 1;
+    struct PixelRect rect = { (int) floorf( x ) - r, (int) floorf( y ) - r, (int) floorf( x ) + r + 1,
+        (int) floorf( y ) + r + 1 };
+    int* results;
+    int count = queryScene( scene, rect, &results );
+    for( int i = count - 1; i >= 0; --i ) {
+        struct Shape const* shape = &scene->shapes[ results[ i ] ];
+        if( shapeDistance( shape, x, y ) <= tolerance + shape->width * 0.5f ) {
+            return results[ i ];
+        }
+    }
+    return -1;
+}
@@ -5,22 +5,33 @@
 #include <windowsx.h>
 #include <gdiplus.h>
 #include <shellscalingapi.h>
+#include <dwmapi.h>
+#include <d3d11.h>
+#include <dxgi1_6.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <inttypes.h>
 #include <math.h>
+#include <limits.h>
 
 #pragma comment( lib, "user32.lib" )
 #pragma comment( lib, "gdi32.lib" )
 #pragma comment( lib, "gdiplus.lib" )
 #pragma comment( lib, "shell32.lib" )
+#pragma comment( lib, "dwmapi.lib" )
+#pragma comment( lib, "d3d11.lib" )
+#pragma comment( lib, "dxgi.lib" )
+#pragma comment( lib, "psapi.lib" )
 
 #define WINDOW_CLASS_NAME L"SymphonyScreenSnippetTool"
 
 BOOL (WINAPI *EnableNonClientDpiScalingPtr)( HWND ) = NULL; // Dynamic bound function which does not exist on win7
 HRESULT (STDAPICALLTYPE* GetDpiForMonitorPtr)(HMONITOR, MONITOR_DPI_TYPE, UINT*, UINT* ) = NULL;
+BOOL (WINAPI *GetPointerTypePtr)( UINT32, POINTER_INPUT_TYPE* ) = NULL; // Pen input, which does not exist on win7
+BOOL (WINAPI *GetPointerPenInfoPtr)( UINT32, POINTER_PEN_INFO* ) = NULL;
 
 #include "resources.h"
+#include "SnippetCore.h"
 #include "SelectRegion.h"
 #include "Localization.h"
 #include "MakeAnnotations.h"
@@ -81,36 +92,625 @@ static HBITMAP grabSnippet( POINT topLeft, POINT bottomRight ) {
 }
 
 
+// SDR white level of the display attached to GDI device `deviceName`, as an scRGB value, or zero if it can't be found
+static float getSdrWhiteLevel( wchar_t const* deviceName ) {
+    UINT32 pathCount = 0;
+    UINT32 modeCount = 0;
+    if( GetDisplayConfigBufferSizes( QDC_ONLY_ACTIVE_PATHS, &pathCount, &modeCount ) != ERROR_SUCCESS ) {
+        return 0.0f;
+    }
+    DISPLAYCONFIG_PATH_INFO* paths = (DISPLAYCONFIG_PATH_INFO*) malloc( sizeof( *paths ) * pathCount );
+    DISPLAYCONFIG_MODE_INFO* modes = (DISPLAYCONFIG_MODE_INFO*) malloc( sizeof( *modes ) * modeCount );
+    float white = 0.0f;
+    if( paths && modes && 
+        QueryDisplayConfig( QDC_ONLY_ACTIVE_PATHS, &pathCount, paths, &modeCount, modes, NULL ) == ERROR_SUCCESS ) {
+        for( UINT32 i = 0; i < pathCount && white == 0.0f; ++i ) {
+            DISPLAYCONFIG_SOURCE_DEVICE_NAME source = {};
+            source.header.type = DISPLAYCONFIG_DEVICE_INFO_GET_SOURCE_NAME;
+            source.header.size = sizeof( source );
+            source.header.adapterId = paths[ i ].sourceInfo.adapterId;
+            source.header.id = paths[ i ].sourceInfo.id;
+            if( DisplayConfigGetDeviceInfo( &source.header ) != ERROR_SUCCESS || 
+                wcscmp( source.viewGdiDeviceName, deviceName ) != 0 ) {
+                continue;
+            }
+            DISPLAYCONFIG_SDR_WHITE_LEVEL level = {};
+            level.header.type = DISPLAYCONFIG_DEVICE_INFO_GET_SDR_WHITE_LEVEL;
+            level.header.size = sizeof( level );
+            level.header.adapterId = paths[ i ].targetInfo.adapterId;
+            level.header.id = paths[ i ].targetInfo.id;
+            if( DisplayConfigGetDeviceInfo( &level.header ) == ERROR_SUCCESS ) {
+                white = level.SDRWhiteLevel / 1000.0f; // 1000 means 80 nits, which is 1.0 in scRGB
+            }
+        }
+    }
+    free( paths );
+    free( modes );
+    return white;
+}
 
-// Utility function used to get an encoder for PNG image format
-static int GetEncoderClsid( const WCHAR* format, CLSID* pClsid ) {
-    UINT num = 0; // number of image encoders
-    UINT size = 0; // size of the image encoder array in bytes
 
-    Gdiplus::ImageCodecInfo* pImageCodecInfo = NULL;
+// Find the output (and its adapter) showing all of a section of the screen, if it is in HDR mode
+static IDXGIOutput6* findHdrOutput( POINT topLeft, POINT bottomRight, IDXGIAdapter1** adapter, 
+    DXGI_OUTPUT_DESC1* desc ) {
 
-    Gdiplus::GetImageEncodersSize( &num, &size );
-    if( size == 0 ) {
-        return -1;
+    IDXGIFactory1* factory = NULL;
+    if( FAILED( CreateDXGIFactory1( __uuidof( IDXGIFactory1 ), (void**) &factory ) ) ) {
+        return NULL;
+    }
+    IDXGIOutput6* found = NULL;
+    for( UINT a = 0; !found && factory->EnumAdapters1( a, adapter ) == S_OK; ++a ) {
+        IDXGIOutput* output = NULL;
+        for( UINT o = 0; !found && ( *adapter )->EnumOutputs( o, &output ) == S_OK; ++o ) {
+            IDXGIOutput6* output6 = NULL;
+            if( SUCCEEDED( output->QueryInterface( __uuidof( IDXGIOutput6 ), (void**) &output6 ) ) ) {
+                RECT* r = &desc->DesktopCoordinates;
+                if( SUCCEEDED( output6->GetDesc1( desc ) ) && topLeft.x >= r->left && topLeft.y >= r->top && 
+                    bottomRight.x <= r->right && bottomRight.y <= r->bottom ) {
+                    found = output6;
+                } else {
+                    output6->Release();
+                }
+            }
+            output->Release();
+        }
+        if( !found ) {
+            ( *adapter )->Release();
+            *adapter = NULL;
+        }
     }
+    factory->Release();
 
-    pImageCodecInfo = (Gdiplus::ImageCodecInfo*) malloc( size );
-    if( pImageCodecInfo == NULL ) {
-        return -1;
+    // Rotated outputs are duplicated unrotated, which we don't bother with
+    if( found && ( desc->ColorSpace != DXGI_COLOR_SPACE_RGB_FULL_G2084_NONE_P2020 || 
+        ( desc->Rotation != DXGI_MODE_ROTATION_IDENTITY && desc->Rotation != DXGI_MODE_ROTATION_UNSPECIFIED ) ) ) {
+        found->Release();
+        found = NULL;
+        ( *adapter )->Release();
+        *adapter = NULL;
     }
+    return found;
+}
 
-    GetImageEncoders( num, size, pImageCodecInfo );
 
-    for( UINT j = 0; j < num; ++j ) {
-        if( wcscmp( pImageCodecInfo[ j ].MimeType, format ) == 0 ) {
-            *pClsid = pImageCodecInfo[ j ].Clsid;
-            free( pImageCodecInfo );
-            return j;
+// Grab a section of the screen through desktop duplication, as an FP16 scRGB image tone mapped to sRGB. On an HDR
+// display, BitBlt gives washed out colors instead. Returns NULL if the section isn't all on one HDR display, or it
+// couldn't be grabbed, so the caller can fall back to `grabSnippet`. If `wide` is given, it also gets the snippet at 16
+// bits per channel, which the caller must free
+static HBITMAP grabHdrSnippet( POINT topLeft, POINT bottomRight, struct WidePixelBuffer* wide ) {
+    IDXGIAdapter1* adapter = NULL;
+    DXGI_OUTPUT_DESC1 desc;
+    IDXGIOutput6* output = findHdrOutput( topLeft, bottomRight, &adapter, &desc );
+    if( !output ) {
+        return NULL;
+    }
+    int width = bottomRight.x - topLeft.x;
+    int height = bottomRight.y - topLeft.y;
+    HBITMAP snippet = NULL;
+    ID3D11Device* device = NULL;
+    ID3D11DeviceContext* context = NULL;
+    IDXGIOutputDuplication* duplication = NULL;
+    IDXGIResource* frame = NULL;
+    ID3D11Texture2D* texture = NULL;
+    ID3D11Texture2D* staging = NULL;
+    DXGI_FORMAT const formats[] = { DXGI_FORMAT_R16G16B16A16_FLOAT };
+    if( SUCCEEDED( D3D11CreateDevice( adapter, D3D_DRIVER_TYPE_UNKNOWN, NULL, 0, NULL, 0, D3D11_SDK_VERSION, &device,
+            NULL, &context ) ) &&
+        SUCCEEDED( output->DuplicateOutput1( device, 0, 1, formats, &duplication ) ) ) {
+        // The first frame after duplication starts has the whole desktop, but may take a moment to arrive
+        DXGI_OUTDUPL_FRAME_INFO info;
+        for( int attempt = 0; attempt < 10 && !frame; ++attempt ) {
+            if( FAILED( duplication->AcquireNextFrame( 100, &info, &frame ) ) ) {
+                frame = NULL;
+            }
         }
     }
+    D3D11_TEXTURE2D_DESC stagingDesc = {};
+    stagingDesc.Width = width;
+    stagingDesc.Height = height;
+    stagingDesc.MipLevels = 1;
+    stagingDesc.ArraySize = 1;
+    stagingDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+    stagingDesc.SampleDesc.Count = 1;
+    stagingDesc.Usage = D3D11_USAGE_STAGING;
+    stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    if( frame && SUCCEEDED( frame->QueryInterface( __uuidof( ID3D11Texture2D ), (void**) &texture ) ) &&
+        SUCCEEDED( device->CreateTexture2D( &stagingDesc, NULL, &staging ) ) ) {
+        RECT r = desc.DesktopCoordinates;
+        D3D11_BOX box = { (UINT)( topLeft.x - r.left ), (UINT)( topLeft.y - r.top ), 0, 
+            (UINT)( bottomRight.x - r.left ), (UINT)( bottomRight.y - r.top ), 1 };
+        context->CopySubresourceRegion( staging, 0, 0, 0, 0, texture, 0, &box );
+        D3D11_MAPPED_SUBRESOURCE mapped;
+        if( SUCCEEDED( context->Map( staging, 0, D3D11_MAP_READ, 0, &mapped ) ) ) {
+            struct HdrBuffer hdr = { mapped.pData, width, height, (int) mapped.RowPitch, HDR_FORMAT_RGBA16F };
+            float white = getSdrWhiteLevel( desc.DeviceName );
+            white = white > 0.0f ? white : 2.5f; // 200 nits, a typical setting
+            HDC screen = GetDC( NULL );
+            HDC dc;
+            struct PixelBuffer pixels;
+            snippet = createPixelBitmap( screen, width, height, &dc, &pixels );
+            ReleaseDC( NULL, screen );
+            if( snippet ) {
+                toneMapToPixels( &hdr, white, &pixels );
+                DeleteDC( dc );
+            }
+            if( snippet && wide ) {
+                wide->pixels = (uint16_t*) malloc( sizeof( uint16_t ) * 4 * (size_t) width * height );
+                wide->width = width;
+                wide->height = height;
+                wide->stride = width;
+                if( wide->pixels ) {
+                    toneMapToWidePixels( &hdr, white, wide );
+                }
+            }
+            context->Unmap( staging, 0 );
+        }
+    }
+
+    if( staging ) {
+        staging->Release();
+    }
+    if( texture ) {
+        texture->Release();
+    }
+    if( frame ) {
+        frame->Release();
+        duplication->ReleaseFrame();
+    }
+    if( duplication ) {
+        duplication->Release();
+    }
+    if( context ) {
+        context->Release();
+    }
+    if( device ) {
+        device->Release();
+    }
+    output->Release();
+    adapter->Release();
+    return snippet;
+}
+
+
+// Replace a file with the contents of `buffer`, atomically, as the caller may be polling for it
+static BOOL writeFile( wchar_t const* filename, struct ByteBuffer const* buffer ) {
+    if( buffer->failed ) {
+        return FALSE;
+    }
+    return writeFileAtomic( filename, buffer->data, buffer->size );
+}
 
-    free( pImageCodecInfo );
-    return -1;
+
+// Read a whole file into `buffer`
+static BOOL readFile( wchar_t const* filename, struct ByteBuffer* buffer ) {
+    FILE* fp = _wfopen( filename, L"rb" );
+    if( !fp ) {
+        return FALSE;
+    }
+    uint8_t chunk[ 4096 ];
+    size_t count;
+    while( ( count = fread( chunk, 1, sizeof( chunk ), fp ) ) > 0 ) {
+        appendBytes( buffer, chunk, count );
+    }
+    BOOL result = !ferror( fp ) && !buffer->failed;
+    fclose( fp );
+    return result;
+}
+
+
+// Copy the pixels of a bitmap into a newly allocated top-down 32-bit buffer, which the caller must free
+static BOOL readBitmapPixels( HBITMAP bitmap, struct PixelBuffer* pixels ) {
+    BITMAP bmp;
+    GetObject( bitmap, sizeof( BITMAP ), &bmp );
+    BITMAPINFO info = {};
+    info.bmiHeader.biSize = sizeof( info.bmiHeader );
+    info.bmiHeader.biWidth = bmp.bmWidth;
+    info.bmiHeader.biHeight = -bmp.bmHeight; // Negative height makes it top-down
+    info.bmiHeader.biPlanes = 1;
+    info.bmiHeader.biBitCount = 32;
+    info.bmiHeader.biCompression = BI_RGB;
+    pixels->width = bmp.bmWidth;
+    pixels->height = bmp.bmHeight;
+    pixels->stride = bmp.bmWidth;
+    pixels->pixels = (uint32_t*) malloc( sizeof( uint32_t ) * (size_t) bmp.bmWidth * bmp.bmHeight );
+    if( !pixels->pixels ) {
+        return FALSE;
+    }
+    HDC screen = GetDC( NULL );
+    int lines = GetDIBits( screen, bitmap, 0, bmp.bmHeight, pixels->pixels, &info, DIB_RGB_COLORS );
+    ReleaseDC( NULL, screen );
+    if( lines != bmp.bmHeight ) {
+        free( pixels->pixels );
+        pixels->pixels = NULL;
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
+// The snippet the SnippingTool put on the clipboard, as a packed DIB, locked in clipboard memory
+struct ClipboardDib {
+    HGLOBAL data;
+    uint8_t const* bits;
+    size_t size;
+};
+
+
+// Open the clipboard and lock the snippet on it, so it can be read in place rather than copied. It is asked for as
+// CF_DIBV5 or CF_DIB, which is what the SnippingTool provides, rather than as CF_BITMAP, which Windows would first have
+// to convert to a device dependent bitmap. The clipboard stays open until `releaseClipboardDib`, so hold on to it only
+// as long as the bits are needed
+static BOOL lockClipboardDib( struct ClipboardDib* dib ) {
+    memset( dib, 0, sizeof( *dib ) );
+    if( !OpenClipboard( NULL ) ) {
+        return FALSE;
+    }
+    UINT format = IsClipboardFormatAvailable( CF_DIBV5 ) ? CF_DIBV5 : CF_DIB;
+    dib->data = GetClipboardData( format );
+    dib->bits = dib->data ? (uint8_t const*) GlobalLock( dib->data ) : NULL;
+    if( !dib->bits ) {
+        CloseClipboard();
+        return FALSE;
+    }
+    dib->size = GlobalSize( dib->data );
+    return TRUE;
+}
+
+
+static void releaseClipboardDib( struct ClipboardDib* dib ) {
+    if( dib->bits ) {
+        GlobalUnlock( dib->data );
+        CloseClipboard();
+    }
+    memset( dib, 0, sizeof( *dib ) );
+}
+
+
+// New bitmap with a copy of `pixels`, for the annotation window to draw on
+static HBITMAP createSnippetBitmap( struct PixelBuffer const* pixels ) {
+    HDC screen = GetDC( NULL );
+    HDC dc;
+    struct PixelBuffer target;
+    HBITMAP bitmap = createPixelBitmap( screen, pixels->width, pixels->height, &dc, &target );
+    ReleaseDC( NULL, screen );
+    if( bitmap ) {
+        for( int y = 0; y < pixels->height; ++y ) {
+            memcpy( pixelRow( &target, y ), pixelRow( pixels, y ), sizeof( uint32_t ) * pixels->width );
+        }
+        DeleteDC( dc );
+    }
+    return bitmap;
+}
+
+
+// The snippet a journal refers to, being saved in the background
+struct JournalBase {
+    struct PixelBuffer pixels;
+    wchar_t const* path;
+    HANDLE thread;
+};
+
+
+static DWORD WINAPI journalBaseThreadProc( LPVOID param ) {
+    struct JournalBase* base = (struct JournalBase*) param;
+    struct ByteBuffer qoi = {};
+    if( encodeQoi( &base->pixels, 0.0, &qoi ) ) {
+        writeFile( base->path, &qoi );
+    }
+    releaseByteBuffer( &qoi );
+    free( base->pixels.pixels );
+    base->pixels.pixels = NULL;
+    return 0;
+}
+
+
+// Start recording the annotation of `snippet` in a journal at `path`. The journal refers to the snippet by hash, so it
+// can be checked when resuming. Its pixels are saved to `pixelsPath` as QOI by a thread started in `base`, so encoding
+// and writing them doesn't hold up the annotation window: until they are on disk, there is nothing to resume, as if
+// there were no journal. Call `finishJournalBase` before touching `pixelsPath`
+static BOOL beginJournal( struct StrokeJournal* journal, wchar_t const* path, wchar_t const* pixelsPath, 
+    HBITMAP snippet, float snippetScale, struct JournalBase* base ) {
+
+    // A copy, as the annotation window draws on the snippet while the thread encodes it
+    struct PixelBuffer pixels;
+    if( !readBitmapPixels( snippet, &pixels ) ) {
+        return FALSE;
+    }
+    // Hashed the way they will be read back, as QOI leaves out alpha
+    opaqueRow( pixels.pixels, pixels.pixels, pixels.width * pixels.height );
+    struct JournalHeader header = {};
+    header.width = (uint32_t) pixels.width;
+    header.height = (uint32_t) pixels.height;
+    header.pixelHash = hashPixels( &pixels, JOURNAL_PIXEL_SEED );
+    header.snippetScale = snippetScale;
+    if( !openStrokeJournal( journal, path, &header, NULL, 0 ) ) {
+        free( pixels.pixels );
+        return FALSE;
+    }
+    base->pixels = pixels;
+    base->path = pixelsPath;
+    base->thread = CreateThread( NULL, 0, journalBaseThreadProc, base, 0, NULL );
+    if( base->thread ) {
+        SetThreadPriority( base->thread, THREAD_PRIORITY_BELOW_NORMAL ); // Leave the first frames to the window
+    } else {
+        journalBaseThreadProc( base );
+    }
+    return TRUE;
+}
+
+
+// Waits for the snippet of the journal to be saved
+static void finishJournalBase( struct JournalBase* base ) {
+    if( base->thread ) {
+        WaitForSingleObject( base->thread, INFINITE );
+        CloseHandle( base->thread );
+        base->thread = NULL;
+    }
+}
+
+
+// Read the journal at `path` left by an annotation window which never closed, and the snippet it refers to from
+// `pixelsPath`, into a newly allocated buffer which the caller must free. The records are appended to `records`.
+// Returns FALSE if there is no journal, or the snippet is missing or doesn't match
+static BOOL readJournal( wchar_t const* path, wchar_t const* pixelsPath, struct JournalHeader* header, 
+    struct ByteBuffer* records, struct PixelBuffer* pixels ) {
+
+    struct ByteBuffer journal = {};
+    struct ByteBuffer qoi = {};
+    pixels->pixels = NULL;
+    BOOL found = readFile( path, &journal ) && readJournalHeader( journal.data, journal.size, header ) && 
+        readFile( pixelsPath, &qoi ) && decodeQoi( qoi.data, qoi.size, pixels );
+    if( found && ( (uint32_t) pixels->width != header->width || (uint32_t) pixels->height != header->height ||
+        hashPixels( pixels, JOURNAL_PIXEL_SEED ) != header->pixelHash ) ) {
+        found = FALSE;
+    }
+    if( found ) {
+        appendBytes( records, journal.data + JOURNAL_HEADER_SIZE, journalRecordsSize( journal.data, journal.size ) );
+        found = !records->failed;
+    }
+    if( !found ) {
+        free( pixels->pixels );
+        pixels->pixels = NULL;
+    }
+    releaseByteBuffer( &qoi );
+    releaseByteBuffer( &journal );
+    return found;
+}
+
+
+// Save the part of `pixels` inside `crop` (see `croppedPixels`) with `codec`. For PNG, a `budgetMs` above zero makes
+// the encoder pick how hard to compress to finish in about that much time
+static BOOL saveImage( struct PixelBuffer const* pixels, struct PixelRect crop, BOOL trim, wchar_t const* filename, 
+    struct ImageCodec const* codec, double budgetMs ) {
+
+    struct PixelBuffer view = croppedPixels( pixels, crop, trim );
+    struct ByteBuffer encoded = {};
+    BOOL saved = codec->encode( &view, budgetMs, &encoded ) && writeFile( filename, &encoded );
+    releaseByteBuffer( &encoded );
+    return saved;
+}
+
+
+// Save the part of `pixels` inside `crop` with `codec` through a content-addressed cache in `directory`. An image
+// identical to one saved before in the same format is copied from the cache rather than encoded again. Cached files
+// are named by their key alone, the hash of the pixels and the format, so an entry can be deleted whatever format it
+// was saved in. An index file keeps track of their sizes and last use, so the least recently used are deleted to stay
+// within `maxSize`
+static BOOL saveImageCached( struct PixelBuffer const* pixels, struct PixelRect crop, BOOL trim, 
+    wchar_t const* filename, struct ImageCodec const* codec, wchar_t const* directory, uint64_t maxSize, 
+    double budgetMs ) {
+
+    struct PixelBuffer view = croppedPixels( pixels, crop, trim );
+    uint64_t key = encodeCacheKey( &view, (int)( codec - imageCodecs ) );
+
+    CreateDirectoryW( directory, NULL );
+    wchar_t indexPath[ 1024 ];
+    wchar_t entryPath[ 1024 ];
+    swprintf( indexPath, 1024, L"%ls\\index.bin", directory );
+    swprintf( entryPath, 1024, L"%ls\\%016llx", directory, (unsigned long long) key );
+
+    struct EncodeCache cache;
+    if( !initEncodeCache( &cache, maxSize ) ) {
+        return saveImage( pixels, crop, trim, filename, codec, budgetMs );
+    }
+    struct ByteBuffer index = {};
+    if( readFile( indexPath, &index ) ) {
+        readEncodeCacheIndex( index.data, index.size, &cache );
+    }
+    releaseByteBuffer( &index );
+
+    BOOL saved = FALSE;
+    if( lookupEncodeCache( &cache, key ) ) {
+        struct ByteBuffer cached = {};
+        saved = readFile( entryPath, &cached ) && writeFile( filename, &cached ); // Not CopyFileW, which isn't atomic
+        releaseByteBuffer( &cached );
+        if( !saved ) {
+            removeEncodeCacheEntry( &cache, key ); // The cached file has gone missing
+        }
+    }
+    if( !saved ) {
+        // Encoded once, and written to the output and the cache each through `writeFile`, so a crash can't leave a
+        // truncated entry behind for a later hit to serve
+        struct ByteBuffer encoded = {};
+        saved = codec->encode( &view, budgetMs, &encoded ) && writeFile( filename, &encoded );
+        if( saved && writeFile( entryPath, &encoded ) ) {
+            uint64_t evicted[ 64 ];
+            int evictedCount = insertEncodeCache( &cache, key, encoded.size, evicted, 64 );
+            for( int i = 0; i < evictedCount; ++i ) {
+                wchar_t evictedPath[ 1024 ];
+                swprintf( evictedPath, 1024, L"%ls\\%016llx", directory, (unsigned long long) evicted[ i ] );
+                DeleteFileW( evictedPath );
+            }
+        }
+        releaseByteBuffer( &encoded );
+    }
+
+    writeEncodeCacheIndex( &cache, &index );
+    writeFile( indexPath, &index );
+    releaseByteBuffer( &index );
+    releaseEncodeCache( &cache );
+    return saved;
+}
+
+
+// Name for a file saved alongside `filename`, made by replacing its extension with `extension`
+static BOOL sidecarFilename( wchar_t const* filename, wchar_t const* extension, wchar_t* out, size_t capacity ) {
+    wchar_t const* dot = wcsrchr( filename, L'.' );
+    if( dot && ( wcschr( dot, L'\\' ) || wcschr( dot, L'/' ) ) ) {
+        dot = NULL; // The dot is in a folder name, not the filename
+    }
+    size_t length = dot ? dot - filename : wcslen( filename );
+    size_t extensionLength = wcslen( extension );
+    if( length + extensionLength + 1 > capacity ) {
+        return FALSE;
+    }
+    memcpy( out, filename, sizeof( wchar_t ) * length );
+    memcpy( out + length, extension, sizeof( wchar_t ) * ( extensionLength + 1 ) );
+    return TRUE;
+}
+
+
+// Save the part of `pixels` inside `crop` at its native size to `filename`, and next to it at 96 DPI (scaled down by
+// `snippetScale`) and as a thumbnail, in files named like `filename` with ".1x" or ".thumb" before the extension. All
+// three are made in one pass and encoded in parallel
+static BOOL saveResolutions( struct PixelBuffer const* pixels, struct PixelRect crop, BOOL trim, 
+    wchar_t const* filename, struct ImageCodec const* codec, float snippetScale, double budgetMs ) {
+
+    struct PixelBuffer view = croppedPixels( pixels, crop, trim );
+    float scale = max( 1.0f, snippetScale );
+    int thumbWidth;
+    int thumbHeight;
+    thumbnailSize( view.width, view.height, &thumbWidth, &thumbHeight );
+    struct ResolutionOutput outputs[ 3 ] = {
+        { view.width, view.height, codec },
+        { max( 1, (int)( view.width / scale + 0.5f ) ), max( 1, (int)( view.height / scale + 0.5f ) ), codec },
+        { thumbWidth, thumbHeight, codec },
+    };
+    wchar_t const* suffixes[ 3 ] = { NULL, L".1x", L".thumb" };
+    encodeResolutions( &view, outputs, 3, budgetMs ); // Each output has a result of its own
+    // Every size that was encoded is written, even after another fails, and the results are combined at the end
+    BOOL saved = TRUE;
+    for( int i = 0; i < 3; ++i ) {
+        wchar_t extension[ 64 ];
+        wchar_t sidecar[ 1024 ];
+        BOOL written = outputs[ i ].result;
+        if( written && !suffixes[ i ] ) {
+            written = writeFile( filename, &outputs[ i ].encoded );
+        } else if( written && swprintf( extension, 64, L"%ls%ls", suffixes[ i ], codec->extension ) > 0 && 
+            sidecarFilename( filename, extension, sidecar, 1024 ) ) {
+            written = writeFile( sidecar, &outputs[ i ].encoded );
+        }
+        saved = saved && written;
+        releaseByteBuffer( &outputs[ i ].encoded );
+    }
+    return saved;
+}
+
+
+// Save the snippet without annotations (`base`), cropped like the snippet, and the annotations as SVG and in compact
+// binary form, next to `filename`
+static void saveVectorSidecars( wchar_t const* filename, struct PixelBuffer const* base, struct PixelRect crop, 
+    BOOL trim, struct VectorLayer const* vectors, double budgetMs ) {
+
+    wchar_t sidecar[ 1024 ];
+    if( sidecarFilename( filename, L".base.png", sidecar, 1024 ) ) {
+        saveImage( base, crop, trim, sidecar, &imageCodecs[ 0 ], budgetMs );
+    }
+    struct ByteBuffer svg = {};
+    writeVectorSvg( vectors, &svg );
+    if( sidecarFilename( filename, L".svg", sidecar, 1024 ) ) {
+        writeFile( sidecar, &svg );
+    }
+    releaseByteBuffer( &svg );
+    struct ByteBuffer binary = {};
+    writeVectorBinary( vectors, &binary );
+    if( sidecarFilename( filename, L".ssvl", sidecar, 1024 ) ) {
+        writeFile( sidecar, &binary );
+    }
+    releaseByteBuffer( &binary );
+}
+
+
+// Command line options. Usage: 
+// ScreenSnippet [--no-annotate] [--vectors] [--cache <folder>] [--cache-size <MB>] [--encode-budget-ms <ms>]
+//     [--format png|qoi|raw] [--png16] [--multi-res] [--telemetry <file>] [--auto-trim]
+//     [--force-isa scalar|sse2|sse4.1|avx2|avx512] <filename> [<language>]
+// ScreenSnippet --self-test
+struct Options {
+    bool annotate; // Let the user annotate the snippet before it is saved
+    bool vectors; // Also save the unannotated snippet and the annotations as vectors, alongside `filename`
+    wchar_t const* cacheDirectory; // Folder for the cache of encoded images, or NULL to always encode
+    uint64_t cacheSize; // Max total size of the cached images, in bytes
+    double encodeBudgetMs; // Time to aim for when encoding PNGs, or zero for a fixed compression level
+    struct ImageCodec const* codec; // Output format, or NULL to go by the extension of `filename` (PNG if unknown)
+    bool png16; // Save PNGs of HDR captures with 16 bits per channel. Only without annotations, which are 8-bit
+    bool multiRes; // Also save a 96 DPI version and a thumbnail, next to `filename`. Not with the encode cache
+    wchar_t const* telemetryFile; // File to write the memory and handles used in each phase to, as JSON, or NULL
+    bool autoTrim; // Leave out the uniform borders of the snippet. With annotations, the user can still adjust the crop
+    enum CpuIsa forceIsa; // Highest instruction set level for the kernels to use, or CPU_ISA_COUNT for any supported
+    bool selfTest; // Only check the kernel variants against the scalar ones, printing which matched, and exit
+    wchar_t const* filename;
+    int lang; // Index into `localization`, defaults to 'en-US'
+};
+
+
+static void parseOptions( int argc, wchar_t* argv[], struct Options* options ) {
+    options->annotate = true;
+    options->vectors = false;
+    options->cacheDirectory = NULL;
+    options->cacheSize = 256ull << 20;
+    options->encodeBudgetMs = 0.0;
+    options->codec = NULL;
+    options->png16 = false;
+    options->multiRes = false;
+    options->telemetryFile = NULL;
+    options->autoTrim = false;
+    options->forceIsa = CPU_ISA_COUNT;
+    options->selfTest = false;
+    options->filename = NULL;
+    options->lang = 0;
+    int positional = 0;
+    for( int i = 1; i < argc; ++i ) {
+        if( wcscmp( argv[ i ], L"--no-annotate" ) == 0 ) {
+            options->annotate = false;
+        } else if( wcscmp( argv[ i ], L"--vectors" ) == 0 ) {
+            options->vectors = true;
+        } else if( wcscmp( argv[ i ], L"--cache" ) == 0 && i + 1 < argc ) {
+            options->cacheDirectory = argv[ ++i ];
+        } else if( wcscmp( argv[ i ], L"--cache-size" ) == 0 && i + 1 < argc ) {
+            options->cacheSize = (uint64_t) _wtoi64( argv[ ++i ] ) << 20;
+        } else if( wcscmp( argv[ i ], L"--encode-budget-ms" ) == 0 && i + 1 < argc ) {
+            options->encodeBudgetMs = _wtof( argv[ ++i ] );
+        } else if( wcscmp( argv[ i ], L"--format" ) == 0 && i + 1 < argc ) {
+            options->codec = findImageCodec( argv[ ++i ] );
+        } else if( wcscmp( argv[ i ], L"--png16" ) == 0 ) {
+            options->png16 = true;
+        } else if( wcscmp( argv[ i ], L"--multi-res" ) == 0 ) {
+            options->multiRes = true;
+        } else if( wcscmp( argv[ i ], L"--telemetry" ) == 0 && i + 1 < argc ) {
+            options->telemetryFile = argv[ ++i ];
+        } else if( wcscmp( argv[ i ], L"--auto-trim" ) == 0 ) {
+            options->autoTrim = true;
+        } else if( wcscmp( argv[ i ], L"--force-isa" ) == 0 && i + 1 < argc ) {
+            char name[ 16 ] = "";
+            WideCharToMultiByte( CP_UTF8, 0, argv[ ++i ], -1, name, sizeof( name ) - 1, NULL, NULL );
+            options->forceIsa = findCpuIsa( name );
+        } else if( wcscmp( argv[ i ], L"--self-test" ) == 0 ) {
+            options->selfTest = true;
+        } else if( positional == 0 ) {
+            options->filename = argv[ i ];
+            ++positional;
+        } else if( positional == 1 ) {
+            // Find language matching command line arg
+            for( int j = 0; j < sizeof( localization ) / sizeof( *localization ); ++j ) {
+                if( wcsicmp( localization[ j ].language, argv[ i ] ) == 0 ) {
+                    options->lang = j;
+                    break;
+                }
+            }
+            ++positional;
+        }
+    }
 }
 
 
@@ -173,11 +773,32 @@ BOOL GetVersion(OSVERSIONINFOEX * os) {
 
 
 int wmain( int argc, wchar_t* argv[] ) {
+    struct Telemetry telemetry;
+    initTelemetry( &telemetry );
+    struct Options options;
+    parseOptions( argc, argv, &options );
+
+    // The kernels were bound for the processor when the program started, and are bound again here, before any other
+    // thread runs, if a lower level was asked for
+    cpuKernelsIsa = bindCpuKernels( options.forceIsa );
+    if( options.selfTest ) {
+        struct ByteBuffer report = {};
+        appendFormat( &report, "detected %s, using %s\n", cpuIsaNames[ cpuIsaDetected ], cpuIsaNames[ cpuKernelsIsa ] );
+        int failures = selfTestCpuKernels( &report );
+        if( !report.failed ) {
+            fwrite( report.data, 1, report.size, stdout );
+        }
+        releaseByteBuffer( &report );
+        return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
 
     // Dynamic binding of functions not available on win 7
     HMODULE user32lib = LoadLibraryA( "user32.dll" );
     if( user32lib ) {
         EnableNonClientDpiScalingPtr = (BOOL (WINAPI*)(HWND)) GetProcAddress( user32lib, "EnableNonClientDpiScaling" );
+        GetPointerTypePtr = (BOOL (WINAPI*)(UINT32, POINTER_INPUT_TYPE*)) GetProcAddress( user32lib, "GetPointerType" );
+        GetPointerPenInfoPtr = (BOOL (WINAPI*)(UINT32, POINTER_PEN_INFO*)) 
+            GetProcAddress( user32lib, "GetPointerPenInfo" );
 
         DPI_AWARENESS_CONTEXT (WINAPI *SetThreadDpiAwarenessContextPtr)( DPI_AWARENESS_CONTEXT ) = 
             (DPI_AWARENESS_CONTEXT (WINAPI*)(DPI_AWARENESS_CONTEXT)) 
@@ -216,35 +837,44 @@ int wmain( int argc, wchar_t* argv[] ) {
         return EXIT_SUCCESS;
     }
 
-    bool annotate = true;
-    // Check for --no-annotate switch
-    if( argc > 1 && wcscmp( argv[ 1 ], L"--no-annotate" ) == 0 ) {
-        annotate = false;
-        // Skip the --no-annotate argument in the remaining code
-        argv++; 
-        argc--;
-    }
-
-    // Find language matching command line arg
-    int lang = 0; // default to 'en-US'
-    if( argc == 3 ) {
-        wchar_t const* lang_str = argv[ 2 ];
-        for( int i = 0; i < sizeof( localization ) / sizeof( *localization ); ++i ) {
-            if( wcsicmp( localization[ i ].language, lang_str ) == 0 ) {
-                lang = i;
-                break;
-            }
-        }
+    wchar_t const* filename = options.filename ? options.filename : L"test_image.png";
+    struct ImageCodec const* codec = options.codec ? options.codec : findImageCodecForFilename( filename );
+    if( !codec ) {
+        codec = &imageCodecs[ 0 ];
     }
 
     // Start GDI+ (used for semi-transparent drawing and anti-aliased curve drawing)
     Gdiplus::GdiplusStartupInput gdiplusStartupInput;
     ULONG_PTR gdiplusToken;
     Gdiplus::GdiplusStartup( &gdiplusToken, &gdiplusStartupInput, NULL );
+    endTelemetryPhase( &telemetry, "startup" );
 
+    // An annotation window which never closed leaves a journal of its strokes next to the output file, along with the
+    // snippet. If there is one, the annotation picks up where it left off, instead of taking a new snippet. Only the
+    // strokes come back: shapes and redactions are not journaled
+    wchar_t journalPath[ 1024 ];
+    wchar_t journalPixelsPath[ 1024 ];
+    BOOL journalPaths = sidecarFilename( filename, L".journal", journalPath, 1024 ) &&
+        sidecarFilename( filename, L".journal.qoi", journalPixelsPath, 1024 );
+    BOOL journaling = options.annotate && journalPaths;
+    struct JournalHeader resumedHeader;
+    struct ByteBuffer resumedRecords = {};
+    struct PixelBuffer resumedPixels = {};
+    BOOL resuming = journaling && 
+        readJournal( journalPath, journalPixelsPath, &resumedHeader, &resumedRecords, &resumedPixels );
+    if( journalPaths && !resuming ) {
+        // The snippet of a journal is as it was before any redaction. Unless it is to be resumed, it is only a copy of
+        // pixels the user may have hidden, so it is deleted, along with a journal which can't be resumed without it
+        DeleteFileW( journalPixelsPath );
+        DeleteFileW( journalPath );
+    }
 
     HBITMAP snippet = NULL;
+    struct ClipboardDib clipboard = {}; // The snippet of the SnippingTool, as a DIB on the clipboard...
+    struct PixelBuffer clipboardPixels = {}; // ...and its pixels, either in `clipboard` or in `converted`
+    uint32_t* converted = NULL;
     float snippetScale = 1.0f;
+    struct WidePixelBuffer wide = {}; // The snippet at 16 bits per channel, if it is to be saved that way
     
     BOOL isOldWindows = FALSE;
     OSVERSIONINFOEX osvi;
@@ -263,15 +893,36 @@ int wmain( int argc, wchar_t* argv[] ) {
     info.lpFile = "SnippingTool";
     info.lpParameters = "/clip";
     info.nShow = SW_SHOWNORMAL ;    
-    if( !isOldWindows ) {
+    if( !isOldWindows && !resuming ) {
         OpenClipboard( NULL );
         EmptyClipboard();
         CloseClipboard();
     }
-    if( !isOldWindows && ShellExecuteExA( &info ) ) {
+    if( resuming ) {
+        snippet = createSnippetBitmap( &resumedPixels );
+        snippetScale = resumedHeader.snippetScale;
+        free( resumedPixels.pixels );
+    } else if( !isOldWindows && ShellExecuteExA( &info ) ) {
         WaitForSingleObject( info.hProcess, INFINITE );
-        if( IsClipboardFormatAvailable( CF_BITMAP ) ) {
-            if( OpenClipboard( NULL ) ) {
+        endTelemetryPhase( &telemetry, "select" );
+        // The DIB is saved straight from clipboard memory. Only the annotation window needs it as a bitmap
+        struct DibImage dib;
+        if( lockClipboardDib( &clipboard ) && parseDib( clipboard.bits, clipboard.size, &dib ) &&
+            dibPixels( &dib, &clipboardPixels, &converted ) ) {
+            if( options.annotate ) {
+                snippet = createSnippetBitmap( &clipboardPixels );
+            }
+            // The clipboard is kept open only while the pixels to save are still in its memory. Once they are in the
+            // bitmap to annotate, or were converted, it is let go right away
+            if( snippet || converted ) {
+                releaseClipboardDib( &clipboard );
+            }
+            if( snippet ) {
+                clipboardPixels.pixels = NULL; // What gets saved is read back from the bitmap
+            }
+        } else {
+            releaseClipboardDib( &clipboard );
+            if( IsClipboardFormatAvailable( CF_BITMAP ) && OpenClipboard( NULL ) ) {
                 snippet = (HBITMAP) GetClipboardData( CF_BITMAP );
                 CloseClipboard();
             }
@@ -279,7 +930,9 @@ int wmain( int argc, wchar_t* argv[] ) {
     } else { // Windows SnippingTool is not available, so use our custom implementation
         // Let the user select a region on the screen
         RECT region;
-        if( selectRegion( &region ) == EXIT_SUCCESS ) { 
+        int selected = selectRegion( &region, &telemetry );
+        endTelemetryPhase( &telemetry, "select" );
+        if( selected == EXIT_SUCCESS ) { 
             POINT topLeft = { region.left, region.top };
             POINT bottomRight = { region.right, region.bottom };
 
@@ -292,32 +945,117 @@ int wmain( int argc, wchar_t* argv[] ) {
             }
             
             // Grab a bitmap of the selected region
-            snippet = grabSnippet( topLeft, bottomRight );
+            BOOL keepWide = options.png16 && !options.annotate && codec == &imageCodecs[ 0 ];
+            snippet = grabHdrSnippet( topLeft, bottomRight, keepWide ? &wide : NULL );
+            if( !snippet ) {
+                snippet = grabSnippet( topLeft, bottomRight );
+            }
             snippetScale = getSnippetScaling( topLeft, bottomRight );
         }
     }
+    trackBitmap( &telemetry, snippet, 1 );
+    endTelemetryPhase( &telemetry, "grab" );
     
-    if( snippet ) {
+    if( snippet || clipboardPixels.pixels ) {
         // Let the user annotate the screen snippet with drawings
+        // Without the annotation window, the whole snippet is saved, trimmed as it is encoded if asked to. With it, the
+        // user decides on the crop, and any trimming is done up front so they can see it
         int result = EXIT_SUCCESS;
-        if( annotate ) {
-            result = makeAnnotations( monitor, snippet, snippetScale, lang );
+        struct AnnotationOutput output = {};
+        struct PixelRect crop = { 0, 0, INT_MAX, INT_MAX };
+        BOOL trim = options.autoTrim;
+        struct StrokeJournal journal;
+        struct JournalBase journalBase = {};
+        BOOL journaled = FALSE;
+        if( options.annotate && snippet && journaling ) {
+            journaled = resuming ? openStrokeJournal( &journal, journalPath, &resumedHeader, resumedRecords.data, 
+                resumedRecords.size ) : beginJournal( &journal, journalPath, journalPixelsPath, snippet, snippetScale, 
+                &journalBase );
+        }
+        if( options.annotate && snippet ) {
+            result = makeAnnotations( monitor, snippet, snippetScale, options.lang, options.autoTrim, &crop,
+                options.vectors ? &output : NULL, journaled ? &journal : NULL, &telemetry );
+            trim = FALSE;
+            endTelemetryPhase( &telemetry, "annotate" );
         }
         
+        // What gets saved is the pixels of the snippet bitmap, which has the annotations drawn on it, or else the DIB
+        struct PixelBuffer pixels = clipboardPixels;
+        if( result == EXIT_SUCCESS && snippet && !readBitmapPixels( snippet, &pixels ) ) {
+            result = EXIT_FAILURE;
+        }
         if( result == EXIT_SUCCESS ) {
             // Save bitmap
-            Gdiplus::Bitmap bmp( snippet, (HPALETTE)0 );
-            CLSID pngClsid;
-            if( GetEncoderClsid( L"image/png", &pngClsid ) >= 0 ) {
-                wchar_t* filename = argv[ 1 ];
-                bmp.Save( filename ? filename : L"test_image.png", &pngClsid, NULL );
+            if( wide.pixels ) {
+                // The borders are found on the 8-bit snippet, which has the same size
+                if( trim ) {
+                    crop = findTrimRect( &pixels, TRIM_TOLERANCE );
+                }
+                struct WidePixelBuffer view = cropWidePixelBuffer( &wide, crop );
+                struct ByteBuffer png = {};
+                encodePng16( &view, 2, 0, &png );
+                writeFile( filename, &png );
+                releaseByteBuffer( &png );
+            } else if( options.multiRes ) {
+                saveResolutions( &pixels, crop, trim, filename, codec, snippetScale, options.encodeBudgetMs );
+            } else if( options.cacheDirectory ) {
+                saveImageCached( &pixels, crop, trim, filename, codec, options.cacheDirectory, options.cacheSize,
+                    options.encodeBudgetMs );
+            } else {
+                saveImage( &pixels, crop, trim, filename, codec, options.encodeBudgetMs );
             }
+            if( options.vectors ) {
+                // Without the annotation window there are no annotations, and the snippet is its own base
+                struct PixelBuffer base = pixels;
+                if( !output.base || readBitmapPixels( output.base, &base ) ) {
+                    saveVectorSidecars( filename, &base, crop, trim, &output.vectors, options.encodeBudgetMs );
+                    if( output.base ) {
+                        free( base.pixels );
+                    }
+                }
+            }
+            endTelemetryPhase( &telemetry, "save" );
+        }
+        releaseClipboardDib( &clipboard );
+        if( snippet && pixels.pixels != clipboardPixels.pixels ) {
+            free( pixels.pixels );
+        }
+
+        // Saved, or cancelled by the user, so there is nothing left to resume
+        finishJournalBase( &journalBase );
+        if( journaled ) {
+            closeStrokeJournal( &journal, 0 );
+        }
+        if( journaling && snippet ) {
+            DeleteFileW( journalPixelsPath );
         }
 
-        DeleteObject( snippet );
+        if( output.base ) {
+            trackBitmap( &telemetry, output.base, -1 );
+            DeleteObject( output.base );
+        }
+        releaseVectorLayer( &output.vectors );
+
+        if( snippet ) {
+            trackBitmap( &telemetry, snippet, -1 );
+            DeleteObject( snippet );
+        }
     }
+    free( wide.pixels );
+    free( converted );
+    releaseClipboardDib( &clipboard );
+    releaseByteBuffer( &resumedRecords );
     
     Gdiplus::GdiplusShutdown( gdiplusToken );
+    endTelemetryPhase( &telemetry, "cleanup" );
+    if( options.telemetryFile ) {
+        struct ByteBuffer json = {};
+        writeTelemetryJson( &telemetry, &json );
+        if( !json.failed ) {
+            writeFile( options.telemetryFile, &json );
+        }
+        releaseByteBuffer( &json );
+    }
     if( foregroundWindow ) {
         SetForegroundWindow( foregroundWindow );
     }
@@ -14,6 +14,7 @@ struct Display {
     MONITORINFOEXA info;
     DEVMODEA mode;
     HDC backbuffer; // Device context for offscreen draw target for the display
+    HBITMAP backbufferBitmap;
     POINT topLeft; // Starting point of drag rect
     POINT bottomRight; // End point of drag rect
     POINT prevTopLeft;  // Stores previous rect coordinates for erasing
@@ -24,6 +25,32 @@ struct Display {
 int const MAX_DISPLAYS = 256; // Hard limit of 256 displays...
 
 
+// Copy of the whole virtual desktop, grabbed once before the selection windows are shown. Used as the source for the
+// loupe, so we never have to read back from the screen while the user is dragging
+struct DesktopFrame {
+    HDC dc;
+    HBITMAP bitmap;
+    POINT origin; // Top-left of the virtual desktop, in screen coordinates
+    struct PixelBuffer pixels; // Points into the DIB section memory of `bitmap`
+};
+
+
+int const LOUPE_ZOOM = 8; // Magnification factor
+int const LOUPE_PIXELS = 21; // Number of source pixels shown across the loupe (odd, so there is a center pixel)
+int const LOUPE_TEXT_HEIGHT = 20; // Space below the zoomed image for the coordinates
+
+
+// Small always-on-top window following the cursor, showing a magnified view of the pixels under it
+struct Loupe {
+    HWND hwnd;
+    HDC dc; // Device context for the DIB section the loupe is rendered into before being copied to the window
+    HBITMAP bitmap;
+    struct PixelBuffer pixels;
+    int width;
+    int height;
+};
+
+
 struct SelectRegionData {
     HPEN pen; // Pen to use for drawing the frame   
     HPEN eraser; // Pen to use to erase the frame (same color as background)
@@ -36,9 +63,160 @@ struct SelectRegionData {
     BOOL aborted; // Will be TRUE if the user press Esc to abort region selection
     int displayCount; // Number of displays
     Display displays[ MAX_DISPLAYS ]; // Current state for each display
+    struct DesktopFrame desktop; // Cached copy of the desktop, taken before selection starts
+    struct Loupe loupe;
+    POINT anchor; // The point where the user pressed the mouse button, before any snapping
+    struct EdgeMap edges; // Edge projections of `desktop`, built on a background thread
+    HANDLE edgeThread;
+    volatile LONG edgesReady; // Set to 1 by the background thread once `edges` can be used
+    struct Telemetry* telemetry; // Counts the memory of the bitmaps made for the selection, or NULL
 };
 
 
+int const SNAP_RADIUS = 8; // Max distance, in pixels, the selection edges will be moved to snap to an edge
+
+
+// Builds the edge map for the desktop frame. Runs on a background thread started when the selection starts
+static DWORD WINAPI edgeMapThreadProc( LPVOID param ) {
+    struct SelectRegionData* selectRegionData = (struct SelectRegionData*) param;
+    if( buildEdgeMap( &selectRegionData->desktop.pixels, &selectRegionData->edges ) ) {
+        InterlockedExchange( &selectRegionData->edgesReady, 1 );
+    }
+    return 0;
+}
+
+
+// Update the selection rect from the anchor and the current cursor position `p` (both in global coordinates), 
+// snapping its edges to nearby strong edges on the desktop. Holding Alt disables snapping
+static void snapSelection( struct SelectRegionData* selectRegionData, POINT p ) {
+    POINT a = selectRegionData->anchor;
+    selectRegionData->topLeft = a;
+    selectRegionData->bottomRight = p;
+    if( !selectRegionData->edgesReady || ( GetAsyncKeyState( VK_MENU ) & 0x8000 ) != 0 ) {
+        return;
+    }
+
+    // Each edge is only snapped along the extent the selection actually covers on the other axis
+    struct EdgeMap const* edges = &selectRegionData->edges;
+    POINT o = selectRegionData->desktop.origin;
+    int ax = snapEdgeX( edges, a.x - o.x, a.y - o.y, p.y - o.y, SNAP_RADIUS ) + o.x;
+    int px = snapEdgeX( edges, p.x - o.x, a.y - o.y, p.y - o.y, SNAP_RADIUS ) + o.x;
+    int ay = snapEdgeY( edges, a.y - o.y, a.x - o.x, p.x - o.x, SNAP_RADIUS ) + o.y;
+    int py = snapEdgeY( edges, p.y - o.y, a.x - o.x, p.x - o.x, SNAP_RADIUS ) + o.y;
+
+    // Don't let both edges snap to the same line, which would collapse the selection
+    if( ax != px ) {
+        selectRegionData->topLeft.x = ax;
+        selectRegionData->bottomRight.x = px;
+    }
+    if( ay != py ) {
+        selectRegionData->topLeft.y = ay;
+        selectRegionData->bottomRight.y = py;
+    }
+}
+
+
+// Creates a 32bpp top-down DIB section selected into a new memory DC, and points `pixels` at its memory
+static HBITMAP createPixelBitmap( HDC reference, int width, int height, HDC* dc, struct PixelBuffer* pixels ) {
+    BITMAPINFO bmi = { { sizeof( BITMAPINFOHEADER ), width, -height, 1, 32, BI_RGB } };
+    void* bits = NULL;
+    HBITMAP bitmap = CreateDIBSection( reference, &bmi, DIB_RGB_COLORS, &bits, NULL, 0 );
+    if( !bitmap ) {
+        return NULL;
+    }
+    *dc = CreateCompatibleDC( reference );
+    SelectObject( *dc, bitmap );
+    pixels->pixels = (uint32_t*) bits;
+    pixels->width = width;
+    pixels->height = height;
+    pixels->stride = width;
+    return bitmap;
+}
+
+
+// Counts the pixel memory of `bitmap` in the bitmap bytes of `telemetry`, or with `sign` -1 stops counting it
+static void trackBitmap( struct Telemetry* telemetry, HBITMAP bitmap, int sign ) {
+    BITMAP bmp;
+    if( telemetry && bitmap && GetObject( bitmap, sizeof( bmp ), &bmp ) ) {
+        trackBitmapBytes( telemetry, sign * (int64_t) bmp.bmWidthBytes * bmp.bmHeight );
+    }
+}
+
+
+// Grab the full virtual desktop into a DIB section we can read pixels from directly
+static BOOL captureDesktop( struct DesktopFrame* desktop ) {
+    desktop->origin.x = GetSystemMetrics( SM_XVIRTUALSCREEN );
+    desktop->origin.y = GetSystemMetrics( SM_YVIRTUALSCREEN );
+    int width = GetSystemMetrics( SM_CXVIRTUALSCREEN );
+    int height = GetSystemMetrics( SM_CYVIRTUALSCREEN );
+
+    HDC screen = GetDC( NULL );
+    desktop->bitmap = createPixelBitmap( screen, width, height, &desktop->dc, &desktop->pixels );
+    if( desktop->bitmap ) {
+        BitBlt( desktop->dc, 0, 0, width, height, screen, desktop->origin.x, desktop->origin.y, SRCCOPY );
+        GdiFlush(); // Make sure the blit has landed before we read the pixels from memory
+    }
+    ReleaseDC( NULL, screen );
+    return desktop->bitmap != NULL;
+}
+
+
+static void releaseDesktop( struct DesktopFrame* desktop ) {
+    if( desktop->bitmap ) {
+        DeleteDC( desktop->dc );
+        DeleteObject( desktop->bitmap );
+        desktop->bitmap = NULL;
+    }
+}
+
+
+// Render the loupe for the pixel at `p` (global coordinates) and move it next to the cursor at `cursor`
+static void updateLoupe( struct SelectRegionData* selectRegionData, POINT cursor, POINT p ) {
+    struct Loupe* loupe = &selectRegionData->loupe;
+    struct DesktopFrame* desktop = &selectRegionData->desktop;
+    if( !loupe->hwnd || !desktop->bitmap ) {
+        return;
+    }
+
+    // Zoom the cached desktop into the top part of the loupe
+    struct PixelBuffer zoomed = loupe->pixels;
+    zoomed.height = loupe->width;
+    magnifyNearest( &desktop->pixels, p.x - desktop->origin.x, p.y - desktop->origin.y, LOUPE_ZOOM, 0x00000000, 
+        &zoomed );
+    magnifierMarkCenter( &zoomed, LOUPE_ZOOM, 0x00ff0000 );
+
+    // Coordinates, and the size of the selection while dragging
+    RECT text = { 0, loupe->width, loupe->width, loupe->height };
+    FillRect( loupe->dc, &text, (HBRUSH) GetStockObject( BLACK_BRUSH ) );
+    wchar_t str[ 64 ];
+    if( selectRegionData->dragging ) {
+        swprintf( str, sizeof( str ) / sizeof( *str ), L"%d, %d  (%d x %d)", (int) p.x, (int) p.y,
+            (int) labs( selectRegionData->bottomRight.x - selectRegionData->topLeft.x ),
+            (int) labs( selectRegionData->bottomRight.y - selectRegionData->topLeft.y ) );
+    } else {
+        swprintf( str, sizeof( str ) / sizeof( *str ), L"%d, %d", (int) p.x, (int) p.y );
+    }
+    SetBkMode( loupe->dc, TRANSPARENT );
+    SetTextColor( loupe->dc, RGB( 255, 255, 255 ) );
+    DrawTextW( loupe->dc, str, -1, &text, DT_CENTER | DT_VCENTER | DT_SINGLELINE );
+
+    // Place the loupe below and to the right of the cursor, flipping it to the other side near the desktop edges
+    int x = cursor.x + 24;
+    int y = cursor.y + 24;
+    if( x + loupe->width > desktop->origin.x + desktop->pixels.width ) {
+        x = cursor.x - 24 - loupe->width;
+    }
+    if( y + loupe->height > desktop->origin.y + desktop->pixels.height ) {
+        y = cursor.y - 24 - loupe->height;
+    }
+    SetWindowPos( loupe->hwnd, HWND_TOPMOST, x, y, 0, 0, SWP_NOSIZE | SWP_NOACTIVATE | SWP_SHOWWINDOW );
+
+    HDC dc = GetDC( loupe->hwnd );
+    BitBlt( dc, 0, 0, loupe->width, loupe->height, loupe->dc, 0, 0, SRCCOPY );
+    ReleaseDC( loupe->hwnd, dc );
+}
+
+
 // Map from client coordinates to global, dpi-adjusted coordinates
 static void clientToGlobal( struct Display* display, POINT* p ) {
     RECT monRect = display->info.rcMonitor;
@@ -70,6 +248,7 @@ static void CALLBACK timerProc( HWND hwnd, UINT message, UINT_PTR id, DWORD ms )
     // Read current mouse pos in screen coordinates
     POINT p;
     GetCursorPos( &p );
+    POINT cursor = p;
 
     // Map cursor postion to global, dpi-adjusted coordinates (by finding the screen it is on)
     BOOL found = FALSE;
@@ -94,13 +273,14 @@ static void CALLBACK timerProc( HWND hwnd, UINT message, UINT_PTR id, DWORD ms )
     if( found ) {
         // Update dragging rect
         if( selectRegionData->dragging ) {
-            selectRegionData->bottomRight.x = p.x;
-            selectRegionData->bottomRight.y = p.y;
+            snapSelection( selectRegionData, p );
             // Invalidate each window to cause redraw of rect
             for( int i = 0; i < selectRegionData->displayCount; ++i ) {
                 InvalidateRect( selectRegionData->displays[ i ].hwnd, NULL, FALSE );
             }
         }
+
+        updateLoupe( selectRegionData, cursor, p );
     }
 
     // Check if user have let go of mouse button
@@ -233,6 +413,7 @@ static LRESULT CALLBACK selectRegionWndProc( HWND hwnd, UINT message, WPARAM wpa
             // Store the starting point of the drag rect, in global, dpi-adjusted coordinates
             POINT p = { GET_X_LPARAM( lparam ), GET_Y_LPARAM( lparam ) };
             clientToGlobal( display, &p );
+            selectRegionData->anchor = p;
             selectRegionData->topLeft.x = p.x;
             selectRegionData->topLeft.y = p.y; 
             selectRegionData->bottomRight.x = p.x;
@@ -273,7 +454,7 @@ static BOOL CALLBACK findScreens( HMONITOR monitor, HDC dc, LPRECT rect, LPARAM
 
 
 // Let the user select a region of the full virtual desktop. Selction may span multiple displays.
-static int selectRegion( RECT* region ) {
+static int selectRegion( RECT* region, struct Telemetry* telemetry ) {
     // Enumerate all displays
     struct FindScreensData findScreensData = { 0 };
     EnumDisplayMonitors( NULL, NULL, findScreens, (LPARAM) &findScreensData );
@@ -292,6 +473,7 @@ static int selectRegion( RECT* region ) {
         CreateSolidBrush( background ),
         CreateSolidBrush( transparent ),
     };
+    selectRegionData.telemetry = telemetry;
     
     // Register window class
     WNDCLASSW wc = { 
@@ -308,6 +490,28 @@ static int selectRegion( RECT* region ) {
     };
     RegisterClassW( &wc );
 
+    // Window class for the loupe. It never handles any messages itself, we just draw into it from the timer
+    WNDCLASSW loupeWc = { 
+        CS_OWNDC,                               // style
+        (WNDPROC) DefWindowProcW,               // lpfnWndProc
+        0,                                      // cbClsExtra
+        0,                                      // cbWndExtra
+        GetModuleHandleA( NULL ),               // hInstance
+        NULL,                                   // hIcon;
+        NULL,                                   // hCursor
+        NULL,                                   // hbrBackground
+        NULL,                                   // lpszMenuName
+        WINDOW_CLASS_NAME L"Loupe"              // lpszClassName
+    };
+    RegisterClassW( &loupeWc );
+
+    // Grab the desktop before any of our windows cover it, so the loupe shows the real pixels
+    // Build the edge map used for snapping in the background, it is only needed once the user starts dragging
+    if( captureDesktop( &selectRegionData.desktop ) ) {
+        trackBitmap( telemetry, selectRegionData.desktop.bitmap, 1 );
+        selectRegionData.edgeThread = CreateThread( NULL, 0, edgeMapThreadProc, &selectRegionData, 0, NULL );
+    }
+
 
     // Create a window for each display, covering it entirely as a semi-transparent overlay
     int count = findScreensData.count;
@@ -327,9 +531,11 @@ static int selectRegion( RECT* region ) {
         
         // Create off-screen drawing surface for window
         HDC dc = GetDC( display->hwnd );
-        HBITMAP backbuffer = CreateCompatibleBitmap( dc, bounds.right - bounds.left, bounds.bottom - bounds.top );
+        display->backbufferBitmap = CreateCompatibleBitmap( dc, bounds.right - bounds.left, 
+            bounds.bottom - bounds.top );
         display->backbuffer = CreateCompatibleDC( dc );
-        SelectObject( display->backbuffer, backbuffer );
+        SelectObject( display->backbuffer, display->backbufferBitmap );
+        trackBitmap( telemetry, display->backbufferBitmap, 1 );
         ReleaseDC( display->hwnd, dc );
 
         // Set window transparency
@@ -342,6 +548,26 @@ static int selectRegion( RECT* region ) {
         SetWindowPos( hwnd[ i ], NULL, bounds.left, bounds.top, 0, 0, SWP_NOSIZE | SWP_NOZORDER | SWP_FRAMECHANGED );
     }
 
+    // Create the loupe last, so it stays on top of the selection windows. It is transparent to mouse input, so clicks
+    // go through to the selection window underneath
+    struct Loupe* loupe = &selectRegionData.loupe;
+    loupe->width = LOUPE_PIXELS * LOUPE_ZOOM;
+    loupe->height = loupe->width + LOUPE_TEXT_HEIGHT;
+    if( selectRegionData.desktop.bitmap ) {
+        loupe->hwnd = CreateWindowExW( WS_EX_LAYERED | WS_EX_TRANSPARENT | WS_EX_TOOLWINDOW | WS_EX_TOPMOST | 
+            WS_EX_NOACTIVATE, loupeWc.lpszClassName, NULL, WS_POPUP, 0, 0, loupe->width, loupe->height, 
+            NULL, NULL, GetModuleHandleA( NULL ), 0 );
+        SetLayeredWindowAttributes( loupe->hwnd, 0, 255, LWA_ALPHA );
+        HDC dc = GetDC( loupe->hwnd );
+        loupe->bitmap = createPixelBitmap( dc, loupe->width, loupe->height, &loupe->dc, &loupe->pixels );
+        trackBitmap( telemetry, loupe->bitmap, 1 );
+        ReleaseDC( loupe->hwnd, dc );
+        if( !loupe->bitmap ) {
+            DestroyWindow( loupe->hwnd );
+            loupe->hwnd = NULL;
+        }
+    }
+
     // Call timer function directly - it will set up a timer based call to itself as the last thing it does
     timerProc( hwnd[ 0 ], 0, (UINT_PTR)&selectRegionData, 0 );
 
@@ -370,17 +596,36 @@ static int selectRegion( RECT* region ) {
         Sleep( 16 ); // Limit the update rate, as we use PeekMessage rather then GetMessage which would be blocking
     }
 
-    // Cleanup
+    // Cleanup. The selection is when the most memory and handles are in use, so sample them first
+    sampleTelemetry( telemetry );
     for( int i = 0; i < count; ++i ) {
         if( hwnd[ i ] ) {
             DestroyWindow( hwnd[ i ] );
         }
+        struct Display* display = &selectRegionData.displays[ i ];
+        trackBitmap( telemetry, display->backbufferBitmap, -1 );
+        DeleteDC( display->backbuffer );
+        DeleteObject( display->backbufferBitmap );
+    }
+    if( loupe->hwnd ) {
+        DestroyWindow( loupe->hwnd );
+        trackBitmap( telemetry, loupe->bitmap, -1 );
+        DeleteDC( loupe->dc );
+        DeleteObject( loupe->bitmap );
+    }
+    if( selectRegionData.edgeThread ) {
+        WaitForSingleObject( selectRegionData.edgeThread, INFINITE );
+        CloseHandle( selectRegionData.edgeThread );
     }
+    releaseEdgeMap( &selectRegionData.edges );
+    trackBitmap( telemetry, selectRegionData.desktop.bitmap, -1 );
+    releaseDesktop( &selectRegionData.desktop );
     DeleteObject( selectRegionData.pen );
     DeleteObject( selectRegionData.eraser );
     DeleteObject( selectRegionData.background );
     DeleteObject( selectRegionData.transparent );
     UnregisterClassW( wc.lpszClassName, GetModuleHandleW( NULL ) );
+    UnregisterClassW( loupeWc.lpszClassName, GetModuleHandleW( NULL ) );
     
     // If the user aborted, we don't return the region
     if( !selectRegionData.done ) {
@@ -0,0 +1,31 @@
+// The portable core of the snippet tool: pixel buffers, strokes and shapes, compositing, hashing and encoding. None of
+// these depend on windows.h, so they can also be built and benchmarked on other platforms (see CMakeLists.txt). The
+// headers have no include guards and rely on the ones before them, so this is the order to include them in.
+#include "Pixels.h"
+#include "CpuFeatures.h"
+#include "ToneMap.h"
+#include "Magnifier.h"
+#include "EdgeMap.h"
+#include "AutoTrim.h"
+#include "Redact.h"
+#include "Viewport.h"
+#include "Scene.h"
+#include "Strokes.h"
+#include "StrokeOutline.h"
+#include "StrokeStore.h"
+#include "InkInput.h"
+#include "FrameScheduler.h"
+#include "ResourceCache.h"
+#include "Compositor.h"
+#include "ByteBuffer.h"
+#include "Telemetry.h"
+#include "AtomicFile.h"
+#include "VectorLayer.h"
+#include "Hash.h"
+#include "EncodeCache.h"
+#include "StrokeJournal.h"
+#include "PngEncoder.h"
+#include "ImageCodecs.h"
+#include "DibParser.h"
+#include "Pyramid.h"
+#include "CpuDispatch.h"
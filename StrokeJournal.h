@@ -0,0 +1,344 @@
+// Journal of the edits made to the strokes of the annotation window, so the work isn't lost if the tool dies while
+// annotating. Every edit, down to each point added to a stroke, is appended as a fixed size record to a file mapped
+// into memory, next to the output file. Appending is a copy into the mapping: no locks, no system calls, and the
+// operating system writes the pages back even if the process is killed. Only when the mapping is full is it grown,
+// which doubles it. The header refers to the snippet being annotated by its size and hash; the pixels themselves are
+// saved next to the journal by the tool. Replaying the records through the same StrokeStore functions rebuilds the
+// strokes, and the undo log along with them. Records are in the byte order of the machine, as a journal is only ever
+// resumed where it was written. There is a Win32 and a POSIX version, like for AtomicFile.
+//
+// Only the strokes are journaled. Shapes, redactions and the crop are not, so a resumed annotation starts without
+// them, and anything the user had redacted has to be redacted again. As the saved snippet holds the pixels from before
+// any redaction, the tool deletes it whenever there is no journal for it to resume.
+#include <atomic>
+
+
+int const JOURNAL_VERSION = 1;
+int const JOURNAL_HEADER_SIZE = 32;
+int const JOURNAL_RECORD_SIZE = 20;
+size_t const JOURNAL_INITIAL_SIZE = 256 * 1024; // About 13000 points before the mapping first grows
+uint64_t const JOURNAL_PIXEL_SEED = 0x4a524e4c; // Seed of `hashPixels` for the snippet hash in the header
+
+
+enum JournalRecordType {
+    JOURNAL_END, // Zero, which is what follows the last record in the file
+    JOURNAL_ADD_STROKE,
+    JOURNAL_POINT, // A point added to the last stroke
+    JOURNAL_ERASE,
+    JOURNAL_RECOLOR,
+    JOURNAL_UNDO,
+    JOURNAL_REDO,
+    JOURNAL_DISCARD, // `discardLastStroke`
+    JOURNAL_RECORD_TYPE_COUNT,
+};
+
+
+struct JournalHeader {
+    char magic[ 4 ]; // "SSJR"
+    uint32_t version;
+    uint32_t width; // Size and hash of the pixels of the snippet
+    uint32_t height;
+    uint64_t pixelHash;
+    float snippetScale;
+    uint32_t reserved;
+};
+
+
+struct JournalRecord {
+    uint8_t type; // A `JournalRecordType`. Written last, so a record cut short by a crash reads as the end
+    uint8_t check; // Checksum of the rest of the record, so stale or damaged data also reads as the end
+    uint8_t highlighter; // For JOURNAL_ADD_STROKE
+    uint8_t penIndex; // For JOURNAL_ADD_STROKE and JOURNAL_RECOLOR
+    uint32_t stroke; // For JOURNAL_ERASE and JOURNAL_RECOLOR
+    float x; // For JOURNAL_POINT
+    float y;
+    float width;
+};
+
+
+struct StrokeJournal {
+    PathChar path[ ATOMIC_PATH_MAX ];
+    uint8_t* data; // The mapped file: the header, the records, and zeros up to `capacity`
+    size_t size; // Bytes used
+    size_t capacity;
+    int failed; // Set when the mapping couldn't be grown. Later edits are not journaled
+    #ifdef _WIN32
+        HANDLE file;
+        HANDLE mapping;
+    #else
+        int file;
+    #endif
+};
+
+
+static uint8_t journalRecordCheck( struct JournalRecord const* record ) {
+    uint8_t const* bytes = (uint8_t const*) record;
+    uint32_t sum = 0x5a ^ bytes[ 0 ];
+    for( int i = 2; i < JOURNAL_RECORD_SIZE; ++i ) {
+        sum = sum * 31 + bytes[ i ];
+    }
+    return (uint8_t)( sum ^ ( sum >> 8 ) ^ ( sum >> 16 ) );
+}
+
+
+static void unmapStrokeJournal( struct StrokeJournal* journal ) {
+    #ifdef _WIN32
+        if( journal->data ) {
+            UnmapViewOfFile( journal->data );
+        }
+        if( journal->mapping ) {
+            CloseHandle( journal->mapping );
+        }
+        journal->mapping = NULL;
+    #else
+        if( journal->data ) {
+            munmap( journal->data, journal->capacity );
+        }
+    #endif
+    journal->data = NULL;
+}
+
+
+// Maps the file at `capacity` bytes, extending it with zeros. Returns zero on failure, leaving nothing mapped
+static int mapStrokeJournal( struct StrokeJournal* journal, size_t capacity ) {
+    unmapStrokeJournal( journal );
+    #ifdef _WIN32
+        journal->mapping = CreateFileMappingW( journal->file, NULL, PAGE_READWRITE,
+            (DWORD)( (uint64_t) capacity >> 32 ), (DWORD) capacity, NULL );
+        journal->data = journal->mapping ?
+            (uint8_t*) MapViewOfFile( journal->mapping, FILE_MAP_WRITE, 0, 0, capacity ) : NULL;
+        if( !journal->data ) {
+            unmapStrokeJournal( journal );
+            return 0;
+        }
+    #else
+        void* data = MAP_FAILED;
+        if( ftruncate( journal->file, (off_t) capacity ) == 0 ) {
+            data = mmap( NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, journal->file, 0 );
+        }
+        if( data == MAP_FAILED ) {
+            return 0;
+        }
+        journal->data = (uint8_t*) data;
+    #endif
+    journal->capacity = capacity;
+    return 1;
+}
+
+
+// Closes the journal, and deletes its file unless `keep` is set. A journal that is never closed, because the process
+// died, is left for `replayStrokeJournal`
+static void closeStrokeJournal( struct StrokeJournal* journal, int keep ) {
+    unmapStrokeJournal( journal );
+    #ifdef _WIN32
+        if( journal->file != INVALID_HANDLE_VALUE ) {
+            CloseHandle( journal->file );
+            if( !keep ) {
+                DeleteFileW( journal->path );
+            }
+        }
+        journal->file = INVALID_HANDLE_VALUE;
+    #else
+        if( journal->file >= 0 ) {
+            close( journal->file );
+            if( !keep ) {
+                unlink( journal->path );
+            }
+        }
+        journal->file = -1;
+    #endif
+}
+
+
+// Creates the journal `filename` for the snippet described by `header`, replacing any journal there. `records` are
+// `size` bytes of records to start with, as returned by `replayStrokeJournal` when resuming. Returns zero on failure
+static int openStrokeJournal( struct StrokeJournal* journal, PathChar const* filename,
+    struct JournalHeader const* header, uint8_t const* records, size_t size ) {
+
+    memset( journal, 0, sizeof( *journal ) );
+    #ifdef _WIN32
+        journal->file = INVALID_HANDLE_VALUE;
+        if( swprintf( journal->path, ATOMIC_PATH_MAX, L"%ls", filename ) < 0 ) {
+            return 0;
+        }
+        journal->file = CreateFileW( filename, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+            FILE_ATTRIBUTE_NORMAL, NULL );
+        if( journal->file == INVALID_HANDLE_VALUE ) {
+            return 0;
+        }
+    #else
+        journal->file = -1;
+        if( snprintf( journal->path, ATOMIC_PATH_MAX, "%s", filename ) >= ATOMIC_PATH_MAX ) {
+            return 0;
+        }
+        journal->file = open( filename, O_RDWR | O_CREAT | O_TRUNC, 0666 );
+        if( journal->file < 0 ) {
+            return 0;
+        }
+    #endif
+    size_t capacity = JOURNAL_INITIAL_SIZE;
+    while( capacity < JOURNAL_HEADER_SIZE + size * 2 ) {
+        capacity *= 2;
+    }
+    if( !mapStrokeJournal( journal, capacity ) ) {
+        closeStrokeJournal( journal, 0 );
+        return 0;
+    }
+    struct JournalHeader written = *header;
+    memcpy( written.magic, "SSJR", 4 );
+    written.version = JOURNAL_VERSION;
+    memcpy( journal->data, &written, JOURNAL_HEADER_SIZE );
+    if( size > 0 ) {
+        memcpy( journal->data + JOURNAL_HEADER_SIZE, records, size );
+    }
+    journal->size = JOURNAL_HEADER_SIZE + size;
+    return 1;
+}
+
+
+// Appends a record. Takes a NULL `journal`, for annotating without one. The record goes in before its type, with a
+// compiler barrier in between, so whatever point the process dies at, the type is only set on a complete record
+static void appendJournalRecord( struct StrokeJournal* journal, struct JournalRecord record ) {
+    if( !journal || journal->failed ) {
+        return;
+    }
+    if( journal->size + JOURNAL_RECORD_SIZE > journal->capacity &&
+        !mapStrokeJournal( journal, journal->capacity * 2 ) ) {
+        journal->failed = 1;
+        return;
+    }
+    record.check = journalRecordCheck( &record );
+    uint8_t* out = journal->data + journal->size;
+    memcpy( out + 1, (uint8_t const*) &record + 1, JOURNAL_RECORD_SIZE - 1 );
+    std::atomic_signal_fence( std::memory_order_release );
+    out[ 0 ] = record.type;
+    journal->size += JOURNAL_RECORD_SIZE;
+}
+
+
+static void journalAddStroke( struct StrokeJournal* journal, int highlighter, int penIndex ) {
+    struct JournalRecord record = { JOURNAL_ADD_STROKE, 0, (uint8_t) !!highlighter, (uint8_t) penIndex };
+    appendJournalRecord( journal, record );
+}
+
+
+static void journalStrokePoint( struct StrokeJournal* journal, float x, float y, float width ) {
+    struct JournalRecord record = { JOURNAL_POINT, 0, 0, 0, 0, x, y, width };
+    appendJournalRecord( journal, record );
+}
+
+
+// For JOURNAL_ERASE, JOURNAL_RECOLOR (with `penIndex`), JOURNAL_UNDO, JOURNAL_REDO and JOURNAL_DISCARD
+static void journalStrokeEdit( struct StrokeJournal* journal, enum JournalRecordType type, int stroke, int penIndex ) {
+    struct JournalRecord record = { (uint8_t) type, 0, 0, (uint8_t) penIndex, (uint32_t) stroke };
+    appendJournalRecord( journal, record );
+}
+
+
+// Starts the pages written since the last call on their way to disk, without waiting for them. The mapping already
+// survives the process being killed; this is for the session or the machine going down. Call it when a stroke ends
+static void flushStrokeJournal( struct StrokeJournal* journal ) {
+    if( journal && journal->data ) {
+        #ifdef _WIN32
+            FlushViewOfFile( journal->data, journal->size );
+        #else
+            msync( journal->data, ( journal->size + 4095 ) & ~(size_t) 4095, MS_ASYNC );
+        #endif
+    }
+}
+
+
+// Reads the header of a journal of `size` bytes. Returns zero if it isn't a journal, or from another version
+static int readJournalHeader( uint8_t const* data, size_t size, struct JournalHeader* header ) {
+    if( size < (size_t) JOURNAL_HEADER_SIZE ) {
+        return 0;
+    }
+    memcpy( header, data, JOURNAL_HEADER_SIZE );
+    return memcmp( header->magic, "SSJR", 4 ) == 0 && header->version == (uint32_t) JOURNAL_VERSION;
+}
+
+
+static int validJournalRecord( struct JournalRecord const* record ) {
+    return record->type != JOURNAL_END && record->type < JOURNAL_RECORD_TYPE_COUNT &&
+        record->check == journalRecordCheck( record );
+}
+
+
+// Size of the records of a journal of `size` bytes, up to the first one which is cut short, damaged or past the end.
+// Doesn't check that they make sense for the strokes, which only `replayStrokeJournal` does
+static size_t journalRecordsSize( uint8_t const* data, size_t size ) {
+    size_t position = JOURNAL_HEADER_SIZE;
+    while( position + JOURNAL_RECORD_SIZE <= size ) {
+        struct JournalRecord record;
+        memcpy( &record, data + position, JOURNAL_RECORD_SIZE );
+        if( !validJournalRecord( &record ) ) {
+            break;
+        }
+        position += JOURNAL_RECORD_SIZE;
+    }
+    return position > size ? 0 : position - JOURNAL_HEADER_SIZE;
+}
+
+
+// Applies the records of a journal of `size` bytes to `store`, which should be empty, the way the annotation window
+// applied them: points go through `addPathPoint` with `margin`, and outlines are brought up to date. Pen indices must
+// be below `penCount`, or `highlightCount` for highlighters. Replay stops at the end of the journal, or at the first
+// record which is damaged, cut short or doesn't fit the strokes so far. Returns the size of the records applied
+static size_t replayStrokeJournal( uint8_t const* data, size_t size, struct StrokeStore* store, int margin,
+    int penCount, int highlightCount ) {
+
+    size_t position = JOURNAL_HEADER_SIZE;
+    while( position + JOURNAL_RECORD_SIZE <= size ) {
+        struct JournalRecord record;
+        memcpy( &record, data + position, JOURNAL_RECORD_SIZE );
+        if( !validJournalRecord( &record ) ) {
+            break;
+        }
+        struct Stroke* last = store->count > 0 ? &store->strokes[ store->count - 1 ] : NULL;
+        int target = record.stroke < (uint32_t) store->count ? (int) record.stroke : -1;
+        if( record.type == JOURNAL_ADD_STROKE ) {
+            if( record.penIndex >= ( record.highlighter ? highlightCount : penCount ) ||
+                !addStroke( store, record.highlighter, record.penIndex ) ) {
+                break;
+            }
+        } else if( record.type == JOURNAL_POINT ) {
+            if( !last || !( record.width >= 0.0f && record.width <= (float) margin * 2 ) ||
+                !( fabsf( record.x ) < 1e6f && fabsf( record.y ) < 1e6f ) ) {
+                break;
+            }
+            addPathPoint( &last->path, record.x, record.y, record.width, margin );
+            updateStrokeOutline( &last->outline, &last->path );
+        } else if( record.type == JOURNAL_ERASE ) {
+            if( target < 0 ) {
+                break;
+            }
+            eraseStroke( store, target );
+        } else if( record.type == JOURNAL_RECOLOR ) {
+            if( target < 0 || 
+                record.penIndex >= ( store->strokes[ target ].highlighter ? highlightCount : penCount ) ) {
+                break;
+            }
+            recolorStroke( store, target, record.penIndex );
+        } else if( record.type == JOURNAL_UNDO ) {
+            undoStrokeEdit( store );
+        } else if( record.type == JOURNAL_REDO ) {
+            redoStrokeEdit( store );
+        } else if( record.type == JOURNAL_DISCARD ) {
+            discardLastStroke( store );
+        }
+        position += JOURNAL_RECORD_SIZE;
+    }
+    return position - JOURNAL_HEADER_SIZE;
+}
+
+
+// Replays the records `journal` was opened with into `store`, like `replayStrokeJournal`, and drops any after the
+// first that couldn't be applied, so new records follow straight on from the strokes as they are
+static void resumeStrokeJournal( struct StrokeJournal* journal, struct StrokeStore* store, int margin, int penCount,
+    int highlightCount ) {
+
+    size_t size = JOURNAL_HEADER_SIZE + replayStrokeJournal( journal->data, journal->size, store, margin, penCount,
+        highlightCount );
+    memset( journal->data + size, 0, journal->size - size );
+    journal->size = size;
+}
@@ -0,0 +1,336 @@
+// Outlines of variable width strokes. Each vertex of the flattened polyline of a stroke is offset to either side by
+// half the pen width there, and the two sides are joined by round caps into a polygon, which is filled with the
+// nonzero winding rule so that parts of the stroke crossing over each other are only covered once. As a stroke grows,
+// only the vertices which changed are offset again, and the polygon is laid out so that both of its sides can grow
+// in place. Painting and hit testing use the same polygon until the stroke changes. Nothing in here depends on
+// windows.h.
+
+
+int const OUTLINE_CAP_STEPS = 8; // Line segments in each round cap
+float const OUTLINE_MAX_MITER = 2.0f; // At sharp corners the offset is lengthened to keep the width, up to this much
+
+
+// The polygon goes from the last vertex back to the first along the right side (going by the direction of the
+// stroke), around the start cap, along the left side to the last vertex, and around the end cap. In `buffer`, the
+// start cap is in the middle, with room for `sideCapacity` vertices on either side, so adding vertices to the stroke
+// adds points to both ends of the polygon without moving the rest. The end cap follows the left side, wherever it ends
+struct StrokeOutline {
+    int vertexCount; // Number of vertices of the polyline the polygon was made from
+    int sideCapacity;
+    float* buffer;
+    float* points; // The polygon, as x, y pairs, somewhere in `buffer`
+    int pointCount;
+    struct PixelRect bounds; // Bounds of the polygon. May be larger, if the end of the stroke changed shape
+};
+
+
+// Where the offset of vertex `index` to the left, and to the right, are kept
+static float* outlineLeft( struct StrokeOutline const* outline, int index ) {
+    return outline->buffer + ( outline->sideCapacity + OUTLINE_CAP_STEPS - 1 + index ) * 2;
+}
+
+
+static float* outlineRight( struct StrokeOutline const* outline, int index ) {
+    return outline->buffer + ( outline->sideCapacity - 1 - index ) * 2;
+}
+
+
+// Normalizes (x, y), leaving it as it is if it has no length. Returns non-zero if it had a length
+static int normalizeOutlineVector( float* x, float* y ) {
+    float length = sqrtf( *x * *x + *y * *y );
+    if( length <= 1e-6f ) {
+        return 0;
+    }
+    *x /= length;
+    *y /= length;
+    return 1;
+}
+
+
+// Offsets vertex `index` of `path` to the left and right. The offset is along the average of the normals of the
+// segments on either side of the vertex, lengthened at corners so the stroke doesn't get thinner around them
+static void offsetOutlineVertex( struct StrokeOutline* outline, struct StrokePath const* path, int index ) {
+    float const* v = path->vertices;
+    float x = v[ index * 2 ];
+    float y = v[ index * 2 + 1 ];
+    float ax = 0.0f, ay = 0.0f, bx = 0.0f, by = 0.0f;
+    if( index > 0 ) {
+        ax = x - v[ index * 2 - 2 ];
+        ay = y - v[ index * 2 - 1 ];
+    }
+    if( index + 1 < path->vertexCount ) {
+        bx = v[ index * 2 + 2 ] - x;
+        by = v[ index * 2 + 3 ] - y;
+    }
+    int hasA = normalizeOutlineVector( &ax, &ay );
+    int hasB = normalizeOutlineVector( &bx, &by );
+    if( !hasA && !hasB ) {
+        ax = bx = 1.0f; // A single point, or a run of points on top of each other: any direction will do
+    } else if( !hasA ) {
+        ax = bx;
+        ay = by;
+    } else if( !hasB ) {
+        bx = ax;
+        by = ay;
+    }
+
+    float tx = ax + bx;
+    float ty = ay + by;
+    float scale = 1.0f;
+    if( normalizeOutlineVector( &tx, &ty ) ) {
+        float cosine = tx * ax + ty * ay; // Cosine of half the turn at the vertex
+        scale = cosine > 1.0f / OUTLINE_MAX_MITER ? 1.0f / cosine : OUTLINE_MAX_MITER;
+    } else {
+        tx = ax; // The stroke turns right around, so either segment's direction is as good as the other
+        ty = ay;
+    }
+    float offset = path->vertexWidths[ index ] * 0.5f * scale;
+    float* left = outlineLeft( outline, index );
+    float* right = outlineRight( outline, index );
+    left[ 0 ] = x - ty * offset;
+    left[ 1 ] = y + tx * offset;
+    right[ 0 ] = x + ty * offset;
+    right[ 1 ] = y - tx * offset;
+}
+
+
+// Writes a round cap around (cx, cy) to `out`, from the side offset at `from` to the opposite side, turning away from
+// the stroke. Both ends of the cap are already in the polygon, so only the points in between are written
+static void writeOutlineCap( float* out, float cx, float cy, float const* from ) {
+    float const angle = 3.14159265f / OUTLINE_CAP_STEPS;
+    float c = cosf( angle );
+    float s = sinf( angle );
+    float rx = from[ 0 ] - cx;
+    float ry = from[ 1 ] - cy;
+    for( int i = 1; i < OUTLINE_CAP_STEPS; ++i ) {
+        float x = rx * c + ry * s;
+        ry = ry * c - rx * s;
+        rx = x;
+        out[ 0 ] = cx + rx;
+        out[ 1 ] = cy + ry;
+        out += 2;
+    }
+}
+
+
+static void growOutlineBounds( struct StrokeOutline* outline, float const* points, int count ) {
+    float x0 = (float) outline->bounds.left, y0 = (float) outline->bounds.top;
+    float x1 = (float)( outline->bounds.right - 1 ), y1 = (float)( outline->bounds.bottom - 1 );
+    for( int i = 0; i < count; ++i ) {
+        x0 = points[ i * 2 ] < x0 ? points[ i * 2 ] : x0;
+        y0 = points[ i * 2 + 1 ] < y0 ? points[ i * 2 + 1 ] : y0;
+        x1 = points[ i * 2 ] > x1 ? points[ i * 2 ] : x1;
+        y1 = points[ i * 2 + 1 ] > y1 ? points[ i * 2 + 1 ] : y1;
+    }
+    struct PixelRect bounds = { (int) floorf( x0 ), (int) floorf( y0 ), (int) ceilf( x1 ) + 1, (int) ceilf( y1 ) + 1 };
+    outline->bounds = bounds;
+}
+
+
+// Brings the outline up to date with `path`, offsetting only the vertices which changed since the last update (and
+// the one before them, whose direction depends on the next). Each path can only have one outline kept up to date
+// this way. Returns zero if out of memory, in which case the outline is empty
+static int updateStrokeOutline( struct StrokeOutline* outline, struct StrokePath* path ) {
+    int n = path->vertexCount;
+    int from = path->changedVertex < outline->vertexCount ? path->changedVertex : outline->vertexCount;
+    from = from > 0 ? from - 1 : 0;
+    if( n > outline->sideCapacity ) {
+        // Move the sides that are still valid to the middle of a bigger buffer
+        int capacity = outline->sideCapacity ? outline->sideCapacity * 2 : 256;
+        while( capacity < n ) {
+            capacity *= 2;
+        }
+        float* buffer = (float*) malloc( sizeof( float ) * 4 * ( capacity + OUTLINE_CAP_STEPS - 1 ) );
+        if( !buffer ) {
+            outline->vertexCount = outline->pointCount = 0;
+            return 0;
+        }
+        if( from > 0 ) {
+            memcpy( buffer + ( capacity - from ) * 2, outlineRight( outline, from - 1 ), sizeof( float ) * 2 * from );
+            memcpy( buffer + ( capacity + OUTLINE_CAP_STEPS - 1 ) * 2, outlineLeft( outline, 0 ), 
+                sizeof( float ) * 2 * from );
+        }
+        free( outline->buffer );
+        outline->buffer = buffer;
+        outline->sideCapacity = capacity;
+    }
+
+    outline->vertexCount = n;
+    path->changedVertex = n;
+    if( n < 1 ) {
+        struct PixelRect empty = { 0, 0, 0, 0 };
+        outline->bounds = empty;
+        outline->pointCount = 0;
+        return 1;
+    }
+    for( int i = from; i < n; ++i ) {
+        offsetOutlineVertex( outline, path, i );
+    }
+    float* startCap = outlineRight( outline, -1 );
+    float* endCap = outlineLeft( outline, n );
+    writeOutlineCap( startCap, path->vertices[ 0 ], path->vertices[ 1 ], outlineRight( outline, 0 ) );
+    writeOutlineCap( endCap, path->vertices[ n * 2 - 2 ], path->vertices[ n * 2 - 1 ], outlineLeft( outline, n - 1 ) );
+    outline->points = outlineRight( outline, n - 1 );
+    outline->pointCount = 2 * n + 2 * ( OUTLINE_CAP_STEPS - 1 );
+
+    // Grow the bounds by the points that changed. When the whole stroke changed, start over
+    if( from == 0 ) {
+        float const* p = outline->points;
+        struct PixelRect r = { (int) floorf( p[ 0 ] ), (int) floorf( p[ 1 ] ), (int) ceilf( p[ 0 ] ) + 1, 
+            (int) ceilf( p[ 1 ] ) + 1 };
+        outline->bounds = r;
+        growOutlineBounds( outline, startCap, OUTLINE_CAP_STEPS - 1 );
+    }
+    growOutlineBounds( outline, outlineRight( outline, n - 1 ), n - from );
+    growOutlineBounds( outline, outlineLeft( outline, from ), n - from );
+    growOutlineBounds( outline, endCap, OUTLINE_CAP_STEPS - 1 );
+    return 1;
+}
+
+
+static void releaseStrokeOutline( struct StrokeOutline* outline ) {
+    free( outline->buffer );
+    memset( outline, 0, sizeof( *outline ) );
+}
+
+
+// Goes through the edges of a polygon from point `first` on, adding up in `winding` those crossing the horizontal
+// line through (x, y) on its right, by direction. Returns non-zero as soon as one passes within the square root of
+// `limit` of the point
+static int outlineEdgesHit( float const* p, int first, int pointCount, float x, float y, float limit, int* winding ) {
+    for( int i = first; i < pointCount; ++i ) {
+        int j = i + 1 < pointCount ? i + 1 : 0;
+        float x0 = p[ i * 2 ], y0 = p[ i * 2 + 1 ];
+        float sx = p[ j * 2 ] - x0, sy = p[ j * 2 + 1 ] - y0;
+        float dx = x - x0, dy = y - y0;
+
+        float cross = sx * dy - dx * sy;
+        if( y0 <= y ) {
+            *winding += y0 + sy > y && cross > 0.0f;
+        } else {
+            *winding -= y0 + sy <= y && cross < 0.0f;
+        }
+
+        // Distance to the edge, clamping to its ends
+        float lengthSq = sx * sx + sy * sy;
+        float t = lengthSq > 0.0f ? ( dx * sx + dy * sy ) / lengthSq : 0.0f;
+        t = t < 0.0f ? 0.0f : ( t > 1.0f ? 1.0f : t );
+        dx -= sx * t;
+        dy -= sy * t;
+        if( dx * dx + dy * dy <= limit ) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+
+// Returns non-zero if (x, y) is inside the polygon by the nonzero winding rule, or within the square root of `limit`
+// of its edge
+static int outlineHitScalar( float const* points, int pointCount, float x, float y, float limit ) {
+    int winding = 0;
+    return outlineEdgesHit( points, 0, pointCount, x, y, limit, &winding ) || winding != 0;
+}
+
+
+// The vector variants take several edges at once, except the last few, and compute the same as the scalar version
+// for each. The edges of a vector are in no particular order, as all that matters is the sum of the crossings and
+// whether any edge is near
+#ifdef PIXELS_SSE2
+    static int outlineHitSse2( float const* points, int pointCount, float x, float y, float limit ) {
+        __m128 const px = _mm_set1_ps( x ), py = _mm_set1_ps( y ), zero = _mm_setzero_ps(), one = _mm_set1_ps( 1.0f );
+        __m128i windings = _mm_setzero_si128();
+        int i = 0;
+        for( ; i + 4 < pointCount; i += 4 ) {
+            __m128 first = _mm_loadu_ps( points + i * 2 ), second = _mm_loadu_ps( points + i * 2 + 4 );
+            __m128 nextFirst = _mm_loadu_ps( points + i * 2 + 2 ), nextSecond = _mm_loadu_ps( points + i * 2 + 6 );
+            __m128 x0 = _mm_shuffle_ps( first, second, _MM_SHUFFLE( 2, 0, 2, 0 ) );
+            __m128 y0 = _mm_shuffle_ps( first, second, _MM_SHUFFLE( 3, 1, 3, 1 ) );
+            __m128 sx = _mm_sub_ps( _mm_shuffle_ps( nextFirst, nextSecond, _MM_SHUFFLE( 2, 0, 2, 0 ) ), x0 );
+            __m128 sy = _mm_sub_ps( _mm_shuffle_ps( nextFirst, nextSecond, _MM_SHUFFLE( 3, 1, 3, 1 ) ), y0 );
+            __m128 dx = _mm_sub_ps( px, x0 ), dy = _mm_sub_ps( py, y0 );
+
+            __m128 cross = _mm_sub_ps( _mm_mul_ps( sx, dy ), _mm_mul_ps( dx, sy ) );
+            __m128 below = _mm_cmple_ps( y0, py );
+            __m128 end = _mm_add_ps( y0, sy );
+            __m128 up = _mm_and_ps( below, _mm_and_ps( _mm_cmpgt_ps( end, py ), _mm_cmpgt_ps( cross, zero ) ) );
+            __m128 down = _mm_andnot_ps( below, _mm_and_ps( _mm_cmple_ps( end, py ), _mm_cmplt_ps( cross, zero ) ) );
+            windings = _mm_add_epi32( _mm_sub_epi32( windings, _mm_castps_si128( up ) ), _mm_castps_si128( down ) );
+
+            __m128 lengthSq = _mm_add_ps( _mm_mul_ps( sx, sx ), _mm_mul_ps( sy, sy ) );
+            __m128 t = _mm_div_ps( _mm_add_ps( _mm_mul_ps( dx, sx ), _mm_mul_ps( dy, sy ) ), lengthSq );
+            t = _mm_and_ps( t, _mm_cmpgt_ps( lengthSq, zero ) );
+            t = _mm_min_ps( _mm_max_ps( t, zero ), one );
+            dx = _mm_sub_ps( dx, _mm_mul_ps( sx, t ) );
+            dy = _mm_sub_ps( dy, _mm_mul_ps( sy, t ) );
+            __m128 distanceSq = _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) );
+            if( _mm_movemask_ps( _mm_cmple_ps( distanceSq, _mm_set1_ps( limit ) ) ) ) {
+                return 1;
+            }
+        }
+        int lanes[ 4 ];
+        _mm_storeu_si128( (__m128i*) lanes, windings );
+        int winding = lanes[ 0 ] + lanes[ 1 ] + lanes[ 2 ] + lanes[ 3 ];
+        return outlineEdgesHit( points, i, pointCount, x, y, limit, &winding ) || winding != 0;
+    }
+#endif
+
+
+#ifdef PIXELS_AVX2
+    CPU_TARGET( "avx2" ) static int outlineHitAvx2( float const* points, int pointCount, float x, float y,
+        float limit ) {
+
+        __m256 const px = _mm256_set1_ps( x ), py = _mm256_set1_ps( y );
+        __m256 const zero = _mm256_setzero_ps(), one = _mm256_set1_ps( 1.0f );
+        __m256i windings = _mm256_setzero_si256();
+        int i = 0;
+        for( ; i + 8 < pointCount; i += 8 ) {
+            __m256 first = _mm256_loadu_ps( points + i * 2 ), second = _mm256_loadu_ps( points + i * 2 + 8 );
+            __m256 nextFirst = _mm256_loadu_ps( points + i * 2 + 2 );
+            __m256 nextSecond = _mm256_loadu_ps( points + i * 2 + 10 );
+            __m256 x0 = _mm256_shuffle_ps( first, second, _MM_SHUFFLE( 2, 0, 2, 0 ) );
+            __m256 y0 = _mm256_shuffle_ps( first, second, _MM_SHUFFLE( 3, 1, 3, 1 ) );
+            __m256 sx = _mm256_sub_ps( _mm256_shuffle_ps( nextFirst, nextSecond, _MM_SHUFFLE( 2, 0, 2, 0 ) ), x0 );
+            __m256 sy = _mm256_sub_ps( _mm256_shuffle_ps( nextFirst, nextSecond, _MM_SHUFFLE( 3, 1, 3, 1 ) ), y0 );
+            __m256 dx = _mm256_sub_ps( px, x0 ), dy = _mm256_sub_ps( py, y0 );
+
+            __m256 cross = _mm256_sub_ps( _mm256_mul_ps( sx, dy ), _mm256_mul_ps( dx, sy ) );
+            __m256 below = _mm256_cmp_ps( y0, py, _CMP_LE_OQ );
+            __m256 end = _mm256_add_ps( y0, sy );
+            __m256 up = _mm256_and_ps( below, _mm256_and_ps( _mm256_cmp_ps( end, py, _CMP_GT_OQ ),
+                _mm256_cmp_ps( cross, zero, _CMP_GT_OQ ) ) );
+            __m256 down = _mm256_andnot_ps( below, _mm256_and_ps( _mm256_cmp_ps( end, py, _CMP_LE_OQ ),
+                _mm256_cmp_ps( cross, zero, _CMP_LT_OQ ) ) );
+            windings = _mm256_add_epi32( _mm256_sub_epi32( windings, _mm256_castps_si256( up ) ),
+                _mm256_castps_si256( down ) );
+
+            __m256 lengthSq = _mm256_add_ps( _mm256_mul_ps( sx, sx ), _mm256_mul_ps( sy, sy ) );
+            __m256 t = _mm256_div_ps( _mm256_add_ps( _mm256_mul_ps( dx, sx ), _mm256_mul_ps( dy, sy ) ), lengthSq );
+            t = _mm256_and_ps( t, _mm256_cmp_ps( lengthSq, zero, _CMP_GT_OQ ) );
+            t = _mm256_min_ps( _mm256_max_ps( t, zero ), one );
+            dx = _mm256_sub_ps( dx, _mm256_mul_ps( sx, t ) );
+            dy = _mm256_sub_ps( dy, _mm256_mul_ps( sy, t ) );
+            __m256 distanceSq = _mm256_add_ps( _mm256_mul_ps( dx, dx ), _mm256_mul_ps( dy, dy ) );
+            if( _mm256_movemask_ps( _mm256_cmp_ps( distanceSq, _mm256_set1_ps( limit ), _CMP_LE_OQ ) ) ) {
+                return 1;
+            }
+        }
+        int lanes[ 8 ];
+        _mm256_storeu_si256( (__m256i*) lanes, windings );
+        int winding = 0;
+        for( int lane = 0; lane < 8; ++lane ) {
+            winding += lanes[ lane ];
+        }
+        return outlineEdgesHit( points, i, pointCount, x, y, limit, &winding ) || winding != 0;
+    }
+#endif
+
+
+// Returns non-zero if (x, y) is inside the outline, by the nonzero winding rule, or within `tolerance` of its edge
+static int strokeOutlineHit( struct StrokeOutline const* outline, float x, float y, float tolerance ) {
+    if( outline->pointCount < 3 || x < outline->bounds.left - tolerance || x > outline->bounds.right + tolerance ||
+        y < outline->bounds.top - tolerance || y > outline->bounds.bottom + tolerance ) {
+        return 0;
+    }
+    return cpuKernels.outlineHit( outline->points, outline->pointCount, x, y, tolerance * tolerance );
+}
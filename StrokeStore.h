@@ -0,0 +1,173 @@
+// The strokes of the annotation window, and a log of the edits made to them, for undo and redo. Erasing a stroke only
+// marks it as erased and changing its color only changes its pen, so each edit is undone by flipping one field back,
+// without keeping any pixels: memory is the points of the strokes and eight bytes per edit, however large the snippet.
+// A stroke is freed once the edit adding it is undone and can no longer be redone. Nothing in here depends on
+// windows.h.
+
+
+// A list of line segments making up a single stroke
+struct Stroke {
+    int highlighter; // A stroke can be done with pen or highlighter
+    int penIndex; // The index (color) of the pen or highlighter used
+    int erased; // Set while the stroke is erased, or its adding is undone. Erased strokes are neither drawn nor hit
+    struct StrokePath path; // The points making up the stroke, and the cached polyline they flatten to
+    struct StrokeOutline outline; // Polygon around the polyline, which is what gets painted and hit by the eraser
+};
+
+
+enum StrokeEditType {
+    STROKE_EDIT_ADD,
+    STROKE_EDIT_ERASE,
+    STROKE_EDIT_RECOLOR,
+};
+
+
+struct StrokeEdit {
+    uint32_t stroke; // Index of the stroke edited
+    uint8_t type; // A `StrokeEditType`
+    uint8_t from; // For STROKE_EDIT_RECOLOR, the pen index before and after
+    uint8_t to;
+};
+
+
+struct StrokeStore {
+    int count; // Number of strokes
+    int capacity;
+    struct Stroke* strokes; // Strokes in paint order
+    int editCount; // Number of edits applied. The ones after, up to `editTotal`, were undone and can be redone
+    int editTotal;
+    int editCapacity;
+    struct StrokeEdit* edits;
+};
+
+
+// Forgets the edits which could be redone. Strokes added by them are freed: they are always the last strokes, as
+// any stroke added after them was added by a later edit, which was undone first
+static void dropRedoEdits( struct StrokeStore* store ) {
+    while( store->editTotal > store->editCount ) {
+        struct StrokeEdit const* edit = &store->edits[ --store->editTotal ];
+        if( edit->type == STROKE_EDIT_ADD && (int) edit->stroke == store->count - 1 ) {
+            struct Stroke* stroke = &store->strokes[ --store->count ];
+            releaseStrokePath( &stroke->path );
+            releaseStrokeOutline( &stroke->outline );
+        }
+    }
+}
+
+
+// Applies an edit and adds it to the log, after forgetting the edits which could be redone. Returns zero if out of
+// memory, in which case nothing changes
+static int logStrokeEdit( struct StrokeStore* store, enum StrokeEditType type, int stroke, int from, int to ) {
+    dropRedoEdits( store );
+    if( store->editTotal >= store->editCapacity ) {
+        int capacity = store->editCapacity ? store->editCapacity * 2 : 256;
+        struct StrokeEdit* edits = (struct StrokeEdit*) realloc( store->edits, sizeof( struct StrokeEdit ) * capacity );
+        if( !edits ) {
+            return 0;
+        }
+        store->edits = edits;
+        store->editCapacity = capacity;
+    }
+    struct StrokeEdit edit = { (uint32_t) stroke, (uint8_t) type, (uint8_t) from, (uint8_t) to };
+    store->edits[ store->editTotal++ ] = edit;
+    store->editCount = store->editTotal;
+    return 1;
+}
+
+
+// Adds a new, empty stroke. Memory for its points is allocated as they are added. Returns NULL if out of memory
+static struct Stroke* addStroke( struct StrokeStore* store, int highlighter, int penIndex ) {
+    dropRedoEdits( store );
+    if( store->count >= store->capacity ) {
+        int capacity = store->capacity ? store->capacity * 2 : 64;
+        struct Stroke* strokes = (struct Stroke*) realloc( store->strokes, sizeof( struct Stroke ) * capacity );
+        if( !strokes ) {
+            return NULL;
+        }
+        store->strokes = strokes;
+        store->capacity = capacity;
+    }
+    if( !logStrokeEdit( store, STROKE_EDIT_ADD, store->count, 0, 0 ) ) {
+        return NULL;
+    }
+    struct Stroke* stroke = &store->strokes[ store->count++ ];
+    memset( stroke, 0, sizeof( *stroke ) );
+    stroke->highlighter = highlighter;
+    stroke->penIndex = penIndex;
+    return stroke;
+}
+
+
+// Removes the stroke added last, along with its edit, if that was the last edit. For strokes which ended up too short
+// to be drawn, so undo doesn't have to go through them
+static void discardLastStroke( struct StrokeStore* store ) {
+    dropRedoEdits( store );
+    if( store->editCount > 0 && store->edits[ store->editCount - 1 ].type == STROKE_EDIT_ADD &&
+        (int) store->edits[ store->editCount - 1 ].stroke == store->count - 1 ) {
+        --store->editCount;
+        dropRedoEdits( store );
+    }
+}
+
+
+// Erasing or recoloring a stroke which is erased does nothing. In particular, strokes which are only kept for redo
+// can't be edited, as the edit would forget them
+static void eraseStroke( struct StrokeStore* store, int index ) {
+    if( !store->strokes[ index ].erased && logStrokeEdit( store, STROKE_EDIT_ERASE, index, 0, 0 ) ) {
+        store->strokes[ index ].erased = 1;
+    }
+}
+
+
+static void recolorStroke( struct StrokeStore* store, int index, int penIndex ) {
+    struct Stroke* stroke = &store->strokes[ index ];
+    if( !stroke->erased && stroke->penIndex != penIndex &&
+        logStrokeEdit( store, STROKE_EDIT_RECOLOR, index, stroke->penIndex, penIndex ) ) {
+        stroke->penIndex = penIndex;
+    }
+}
+
+
+// Undoes the last edit applied. Returns the index of the stroke it changed, so the area it covers can be repainted, or
+// -1 if there was nothing to undo
+static int undoStrokeEdit( struct StrokeStore* store ) {
+    if( store->editCount == 0 ) {
+        return -1;
+    }
+    struct StrokeEdit const* edit = &store->edits[ --store->editCount ];
+    struct Stroke* stroke = &store->strokes[ edit->stroke ];
+    if( edit->type == STROKE_EDIT_RECOLOR ) {
+        stroke->penIndex = edit->from;
+    } else {
+        stroke->erased = edit->type == STROKE_EDIT_ADD;
+    }
+    return (int) edit->stroke;
+}
+
+
+// Applies the first edit which was undone again. Returns the index of the stroke it changed, or -1 if there was
+// nothing to redo
+static int redoStrokeEdit( struct StrokeStore* store ) {
+    if( store->editCount == store->editTotal ) {
+        return -1;
+    }
+    struct StrokeEdit const* edit = &store->edits[ store->editCount++ ];
+    struct Stroke* stroke = &store->strokes[ edit->stroke ];
+    if( edit->type == STROKE_EDIT_RECOLOR ) {
+        stroke->penIndex = edit->to;
+    } else {
+        stroke->erased = edit->type == STROKE_EDIT_ERASE;
+    }
+    return (int) edit->stroke;
+}
+
+
+static void releaseStrokeStore( struct StrokeStore* store ) {
+    for( int i = 0; i < store->count; ++i ) {
+        releaseStrokePath( &store->strokes[ i ].path );
+        releaseStrokeOutline( &store->strokes[ i ].outline );
+    }
+    free( store->strokes );
+    free( store->edits );
+    memset( store, 0, sizeof( *store ) );
+}
@@ -0,0 +1,239 @@
+// Freehand stroke geometry. The points of a stroke describe a cardinal spline (the same curve GDI+ `DrawCurve` draws
+// with its default tension), which is flattened into a polyline once, as points are added. Painting and hit testing
+// then only ever look at the cached polyline. Each control point has a width, which is interpolated along the curve,
+// so each vertex has one too. Nothing in here depends on windows.h.
+
+
+int const STROKE_MIN_STEPS = 4; // Fewest line segments per spline segment. Always a multiple of 4, for SSE
+int const STROKE_MAX_STEPS = 64;
+float const STROKE_STEP_LENGTH = 3.0f; // Approximate length of each line segment of the polyline, in pixels
+
+
+// A freehand stroke and its flattened polyline. `vertices` are x, y pairs, laid out so they can be passed straight
+// to anything taking an array of float points.
+struct StrokePath {
+    int pointCount;
+    int pointCapacity;
+    float* points; // Control points, as x, y pairs
+    float* widths; // Pen width at each control point
+    int* segmentStarts; // Index of the first vertex of the spline segment following each control point
+    int vertexCount;
+    int vertexCapacity;
+    float* vertices;
+    float* vertexWidths; // Pen width at each vertex
+    int changedVertex; // First vertex changed since the outline of the stroke was last brought up to date
+    float maxWidth; // Widest the pen gets anywhere along the stroke
+    struct PixelRect bounds; // Bounds of all vertices generated so far, grown by the margin passed to `addPathPoint`
+};
+
+
+// Number of line segments to use for a spline segment from (x0, y0) to (x1, y1)
+static int strokeSteps( float x0, float y0, float x1, float y1 ) {
+    float length = sqrtf( ( x1 - x0 ) * ( x1 - x0 ) + ( y1 - y0 ) * ( y1 - y0 ) );
+    int steps = ( (int)( length / STROKE_STEP_LENGTH ) + 3 ) & ~3;
+    return steps < STROKE_MIN_STEPS ? STROKE_MIN_STEPS : ( steps > STROKE_MAX_STEPS ? STROKE_MAX_STEPS : steps );
+}
+
+
+// Makes room for `count` more vertices
+static int reserveVertices( struct StrokePath* path, int count ) {
+    if( path->vertexCount + count <= path->vertexCapacity ) {
+        return 1;
+    }
+    int capacity = path->vertexCapacity ? path->vertexCapacity : 256;
+    while( capacity < path->vertexCount + count ) {
+        capacity *= 2;
+    }
+    float* vertices = (float*) realloc( path->vertices, sizeof( float ) * 2 * capacity );
+    if( vertices ) {
+        path->vertices = vertices;
+    }
+    float* widths = (float*) realloc( path->vertexWidths, sizeof( float ) * capacity );
+    if( widths ) {
+        path->vertexWidths = widths;
+    }
+    if( !vertices || !widths ) {
+        return 0;
+    }
+    path->vertexCapacity = capacity;
+    return 1;
+}
+
+
+// Appends the vertices for the spline segment between control points `index` and `index + 1`, excluding its first
+// vertex (which is the last vertex of the previous segment). The segment is converted to a cubic bezier, which is
+// evaluated four steps at a time. The width changes linearly from one control point to the next.
+static void flattenSegment( struct StrokePath* path, int index, int margin ) {
+    float const* p = path->points;
+    int last = path->pointCount - 1;
+    int i0 = index > 0 ? index - 1 : 0;
+    int i3 = index + 2 < last ? index + 2 : last;
+    float x0 = p[ i0 * 2 ], y0 = p[ i0 * 2 + 1 ];
+    float x1 = p[ index * 2 ], y1 = p[ index * 2 + 1 ];
+    float x2 = p[ index * 2 + 2 ], y2 = p[ index * 2 + 3 ];
+    float x3 = p[ i3 * 2 ], y3 = p[ i3 * 2 + 1 ];
+
+    // Bezier control points for a tension of 0.5, then the polynomial coefficients: B(t) = ((a t + b) t + c) t + d
+    float cx1 = x1 + ( x2 - x0 ) / 6.0f, cy1 = y1 + ( y2 - y0 ) / 6.0f;
+    float cx2 = x2 - ( x3 - x1 ) / 6.0f, cy2 = y2 - ( y3 - y1 ) / 6.0f;
+    float ax = x2 - x1 + 3.0f * ( cx1 - cx2 ), ay = y2 - y1 + 3.0f * ( cy1 - cy2 );
+    float bx = 3.0f * ( x1 - 2.0f * cx1 + cx2 ), by = 3.0f * ( y1 - 2.0f * cy1 + cy2 );
+    float cx = 3.0f * ( cx1 - x1 ), cy = 3.0f * ( cy1 - y1 );
+
+    int steps = strokeSteps( x1, y1, x2, y2 );
+    path->segmentStarts[ index ] = path->vertexCount;
+    if( !reserveVertices( path, steps ) ) {
+        return;
+    }
+    float* out = path->vertices + path->vertexCount * 2;
+    float dt = 1.0f / steps;
+    #ifdef PIXELS_SSE2
+        __m128 t = _mm_mul_ps( _mm_setr_ps( 1.0f, 2.0f, 3.0f, 4.0f ), _mm_set1_ps( dt ) );
+        __m128 const advance = _mm_set1_ps( dt * 4.0f );
+        for( int s = 0; s < steps; s += 4 ) {
+            __m128 x = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( ax ), t ), _mm_set1_ps( bx ) );
+            __m128 y = _mm_add_ps( _mm_mul_ps( _mm_set1_ps( ay ), t ), _mm_set1_ps( by ) );
+            x = _mm_add_ps( _mm_mul_ps( x, t ), _mm_set1_ps( cx ) );
+            y = _mm_add_ps( _mm_mul_ps( y, t ), _mm_set1_ps( cy ) );
+            x = _mm_add_ps( _mm_mul_ps( x, t ), _mm_set1_ps( x1 ) );
+            y = _mm_add_ps( _mm_mul_ps( y, t ), _mm_set1_ps( y1 ) );
+            _mm_storeu_ps( out + s * 2, _mm_unpacklo_ps( x, y ) );
+            _mm_storeu_ps( out + s * 2 + 4, _mm_unpackhi_ps( x, y ) );
+            t = _mm_add_ps( t, advance );
+        }
+    #else
+        for( int s = 0; s < steps; ++s ) {
+            float t = ( s + 1 ) * dt;
+            out[ s * 2 ] = ( ( ax * t + bx ) * t + cx ) * t + x1;
+            out[ s * 2 + 1 ] = ( ( ay * t + by ) * t + cy ) * t + y1;
+        }
+    #endif
+    // Make the segment end exactly on its control point, whatever the rounding
+    out[ steps * 2 - 2 ] = x2;
+    out[ steps * 2 - 1 ] = y2;
+
+    float w1 = path->widths[ index ];
+    float dw = ( path->widths[ index + 1 ] - w1 ) * dt;
+    float* widths = path->vertexWidths + path->vertexCount;
+    for( int s = 0; s < steps; ++s ) {
+        widths[ s ] = w1 + dw * ( s + 1 );
+    }
+
+    for( int s = 0; s < steps; ++s ) {
+        int x = (int) out[ s * 2 ];
+        int y = (int) out[ s * 2 + 1 ];
+        struct PixelRect r = { x - margin, y - margin, x + margin + 1, y + margin + 1 };
+        path->bounds = unionPixelRect( path->bounds, r );
+    }
+    path->vertexCount += steps;
+}
+
+
+// Appends a control point to the stroke. The end of a cardinal spline depends on the point after it, so the previous
+// segment is flattened again along with the new one - everything before that is left as it is. `width` is the width
+// of the pen at the new point, and `margin` should be enough to cover half the widest the pen gets.
+static void addPathPoint( struct StrokePath* path, float x, float y, float width, int margin ) {
+    if( path->pointCount >= path->pointCapacity ) {
+        int capacity = path->pointCapacity ? path->pointCapacity * 2 : 64;
+        float* points = (float*) realloc( path->points, sizeof( float ) * 2 * capacity );
+        float* widths = (float*) realloc( path->widths, sizeof( float ) * capacity );
+        int* starts = (int*) realloc( path->segmentStarts, sizeof( int ) * capacity );
+        if( points ) {
+            path->points = points;
+        }
+        if( widths ) {
+            path->widths = widths;
+        }
+        if( starts ) {
+            path->segmentStarts = starts;
+        }
+        if( !points || !widths || !starts ) {
+            return;
+        }
+        path->pointCapacity = capacity;
+    }
+    int index = path->pointCount++;
+    path->points[ index * 2 ] = x;
+    path->points[ index * 2 + 1 ] = y;
+    path->widths[ index ] = width;
+    path->maxWidth = index == 0 || width > path->maxWidth ? width : path->maxWidth;
+
+    if( index == 0 ) {
+        if( !reserveVertices( path, 1 ) ) {
+            path->pointCount = 0;
+            return;
+        }
+        path->vertices[ 0 ] = x;
+        path->vertices[ 1 ] = y;
+        path->vertexWidths[ 0 ] = width;
+        path->vertexCount = 1;
+        path->changedVertex = 0;
+        struct PixelRect r = { (int) x - margin, (int) y - margin, (int) x + margin + 1, (int) y + margin + 1 };
+        path->bounds = r;
+        return;
+    }
+    int first = index >= 2 ? index - 2 : 0;
+    path->vertexCount = index >= 2 ? path->segmentStarts[ first ] : 1;
+    path->changedVertex = path->vertexCount < path->changedVertex ? path->vertexCount : path->changedVertex;
+    for( int i = first; i < index; ++i ) {
+        flattenSegment( path, i, margin );
+    }
+}
+
+
+// Flattens the whole stroke from scratch. The cache makes this unnecessary, but it is what every paint used to cost
+static void reflattenPath( struct StrokePath* path, int margin ) {
+    if( path->pointCount < 1 ) {
+        return;
+    }
+    path->vertexCount = 1;
+    path->changedVertex = 0;
+    for( int i = 0; i + 1 < path->pointCount; ++i ) {
+        flattenSegment( path, i, margin );
+    }
+}
+
+
+static void clearStrokePath( struct StrokePath* path ) {
+    path->pointCount = 0;
+    path->vertexCount = 0;
+    path->changedVertex = 0;
+}
+
+
+static void releaseStrokePath( struct StrokePath* path ) {
+    free( path->points );
+    free( path->widths );
+    free( path->segmentStarts );
+    free( path->vertices );
+    free( path->vertexWidths );
+    memset( path, 0, sizeof( *path ) );
+}
+
+
+// Returns non-zero if (x, y) is within `tolerance` of the polyline
+static int strokePathHit( struct StrokePath const* path, float x, float y, float tolerance ) {
+    if( path->vertexCount < 1 || x < path->bounds.left - tolerance || x > path->bounds.right + tolerance ||
+        y < path->bounds.top - tolerance || y > path->bounds.bottom + tolerance ) {
+        return 0;
+    }
+    float const* v = path->vertices;
+    float limit = tolerance * tolerance;
+    for( int i = 0; i < path->vertexCount; ++i ) {
+        float x0 = v[ i * 2 ], y0 = v[ i * 2 + 1 ];
+        float dx = x - x0, dy = y - y0;
+        if( i + 1 < path->vertexCount ) {
+            // Project onto the segment, clamping to its ends
+            float sx = v[ i * 2 + 2 ] - x0, sy = v[ i * 2 + 3 ] - y0;
+            float lengthSq = sx * sx + sy * sy;
+            float t = lengthSq > 0.0f ? ( dx * sx + dy * sy ) / lengthSq : 0.0f;
+            t = t < 0.0f ? 0.0f : ( t > 1.0f ? 1.0f : t );
+            dx -= sx * t;
+            dy -= sy * t;
+        }
+        if( dx * dx + dy * dy <= limit ) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,215 @@
+// Accounting of the memory and handles the tool uses in each phase of taking a snippet: selecting a region, grabbing
+// it, annotating it and saving it. When a phase ends, it records the private memory, bitmap memory and handle counts
+// in use at that point, and the most of each seen while it ran, so running out of memory or GDI handles on sessions
+// with many large displays can be traced to a phase. Bitmap memory is counted by the code creating and deleting the
+// bitmaps; the rest is read from the operating system. There is a Win32 version for the tool, and a version reading
+// /proc for testing and benchmarking on Linux. Phases can also leave named counters, like how many frames annotating
+// rendered. The phases and counters are written out as JSON.
+#include <chrono>
+#ifdef _WIN32
+    #include <windows.h>
+    #include <psapi.h>
+#else
+    #include <dirent.h>
+    #include <stdio.h>
+#endif
+
+
+int const TELEMETRY_MAX_PHASES = 16;
+int const TELEMETRY_MAX_COUNTERS = 16;
+
+
+struct ProcessUsage {
+    uint64_t privateBytes; // Memory committed for this process alone (resident anonymous memory on Linux)
+    uint64_t peakPrivateBytes; // The most private memory the process has had since it started (peak resident on Linux)
+    uint64_t bitmapBytes; // Pixel memory of the bitmaps counted with `trackBitmapBytes`
+    uint32_t gdiObjects; // GDI and USER objects. Always zero on Linux
+    uint32_t userObjects;
+    uint32_t handles; // Kernel handles, or open file descriptors on Linux
+};
+
+
+struct TelemetryPhase {
+    char const* name;
+    double durationMs;
+    struct ProcessUsage end; // Usage when the phase ended...
+    struct ProcessUsage peak; // ...and the most of each seen while it ran
+};
+
+
+struct Telemetry {
+    double phaseStart; // Time the current phase began, in milliseconds
+    uint64_t bitmapBytes; // Pixel memory of the bitmaps currently counted
+    struct ProcessUsage peak; // The most of each seen since the current phase began
+    int phaseCount;
+    struct TelemetryPhase phases[ TELEMETRY_MAX_PHASES ];
+    int counterCount;
+    char const* counterNames[ TELEMETRY_MAX_COUNTERS ];
+    uint64_t counters[ TELEMETRY_MAX_COUNTERS ];
+};
+
+
+static double telemetryClock( void ) {
+    return std::chrono::duration< double, std::milli >( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+
+// Reads the memory and handle use of the process, leaving zero whatever can't be read. Doesn't fill in `bitmapBytes`
+static void readProcessUsage( struct ProcessUsage* usage ) {
+    memset( usage, 0, sizeof( *usage ) );
+    #ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS_EX counters = { sizeof( counters ) };
+        if( GetProcessMemoryInfo( GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS*) &counters, sizeof( counters ) ) ) {
+            usage->privateBytes = counters.PrivateUsage;
+            usage->peakPrivateBytes = counters.PeakPagefileUsage; // The peak commit charge, which is all private
+        }
+        usage->gdiObjects = GetGuiResources( GetCurrentProcess(), GR_GDIOBJECTS );
+        usage->userObjects = GetGuiResources( GetCurrentProcess(), GR_USEROBJECTS );
+        DWORD handles = 0;
+        if( GetProcessHandleCount( GetCurrentProcess(), &handles ) ) {
+            usage->handles = handles;
+        }
+    #else
+        FILE* status = fopen( "/proc/self/status", "r" );
+        if( status ) {
+            char line[ 256 ];
+            unsigned long long kb;
+            while( fgets( line, sizeof( line ), status ) ) {
+                if( sscanf( line, "RssAnon: %llu kB", &kb ) == 1 ) {
+                    usage->privateBytes = kb << 10;
+                } else if( sscanf( line, "VmHWM: %llu kB", &kb ) == 1 ) {
+                    usage->peakPrivateBytes = kb << 10;
+                }
+            }
+            fclose( status );
+        }
+        DIR* fds = opendir( "/proc/self/fd" );
+        if( fds ) {
+            struct dirent* entry;
+            while( ( entry = readdir( fds ) ) != NULL ) {
+                usage->handles += entry->d_name[ 0 ] != '.';
+            }
+            closedir( fds );
+            usage->handles -= usage->handles > 0; // Not counting the one reading the folder
+        }
+    #endif
+}
+
+
+static void maxProcessUsage( struct ProcessUsage* peak, struct ProcessUsage const* usage ) {
+    peak->privateBytes = usage->privateBytes > peak->privateBytes ? usage->privateBytes : peak->privateBytes;
+    peak->peakPrivateBytes = usage->peakPrivateBytes > peak->peakPrivateBytes ?
+        usage->peakPrivateBytes : peak->peakPrivateBytes;
+    peak->bitmapBytes = usage->bitmapBytes > peak->bitmapBytes ? usage->bitmapBytes : peak->bitmapBytes;
+    peak->gdiObjects = usage->gdiObjects > peak->gdiObjects ? usage->gdiObjects : peak->gdiObjects;
+    peak->userObjects = usage->userObjects > peak->userObjects ? usage->userObjects : peak->userObjects;
+    peak->handles = usage->handles > peak->handles ? usage->handles : peak->handles;
+}
+
+
+// Reads the current usage into `usage`, and raises the peaks of the current phase to it
+static void readTelemetryUsage( struct Telemetry* telemetry, struct ProcessUsage* usage ) {
+    readProcessUsage( usage );
+    usage->bitmapBytes = telemetry->bitmapBytes;
+    maxProcessUsage( &telemetry->peak, usage );
+}
+
+
+// Starts the first phase
+static void initTelemetry( struct Telemetry* telemetry ) {
+    memset( telemetry, 0, sizeof( *telemetry ) );
+    struct ProcessUsage usage;
+    readTelemetryUsage( telemetry, &usage );
+    telemetry->phaseStart = telemetryClock();
+}
+
+
+// Raises the peaks of the current phase to the current usage. Call it where usage is expected to be highest, like
+// just before a phase releases what it used. Takes a NULL `telemetry`, for code which may run without
+static void sampleTelemetry( struct Telemetry* telemetry ) {
+    if( telemetry ) {
+        struct ProcessUsage usage;
+        readTelemetryUsage( telemetry, &usage );
+    }
+}
+
+
+// Counts `bytes` more bitmap memory, or less if negative. Takes a NULL `telemetry`, like `sampleTelemetry`
+static void trackBitmapBytes( struct Telemetry* telemetry, int64_t bytes ) {
+    if( telemetry ) {
+        telemetry->bitmapBytes += bytes;
+        if( telemetry->bitmapBytes > telemetry->peak.bitmapBytes ) {
+            telemetry->peak.bitmapBytes = telemetry->bitmapBytes;
+        }
+    }
+}
+
+
+// Sets the counter named `name`, adding it if there is none yet. `name` must stay valid as long as the telemetry is
+// used. Beyond TELEMETRY_MAX_COUNTERS, new counters are dropped. Takes a NULL `telemetry`, like `sampleTelemetry`
+static void setTelemetryCounter( struct Telemetry* telemetry, char const* name, uint64_t value ) {
+    if( telemetry ) {
+        int i = 0;
+        while( i < telemetry->counterCount && strcmp( telemetry->counterNames[ i ], name ) != 0 ) {
+            ++i;
+        }
+        if( i == TELEMETRY_MAX_COUNTERS ) {
+            return;
+        }
+        telemetry->counterCount += i == telemetry->counterCount;
+        telemetry->counterNames[ i ] = name;
+        telemetry->counters[ i ] = value;
+    }
+}
+
+
+// Records the end of the current phase, named `name`, and starts the next. `name` must stay valid as long as the
+// telemetry is used. Beyond TELEMETRY_MAX_PHASES, later phases are merged into the last
+static void endTelemetryPhase( struct Telemetry* telemetry, char const* name ) {
+    struct ProcessUsage usage;
+    readTelemetryUsage( telemetry, &usage );
+    double now = telemetryClock();
+    int merge = telemetry->phaseCount == TELEMETRY_MAX_PHASES;
+    struct TelemetryPhase* phase = &telemetry->phases[ merge ? TELEMETRY_MAX_PHASES - 1 : telemetry->phaseCount++ ];
+    if( merge ) {
+        maxProcessUsage( &phase->peak, &telemetry->peak );
+    } else {
+        phase->durationMs = 0.0;
+        phase->peak = telemetry->peak;
+    }
+    phase->name = name;
+    phase->durationMs += now - telemetry->phaseStart;
+    phase->end = usage;
+    telemetry->peak = usage;
+    telemetry->phaseStart = now;
+}
+
+
+static void appendProcessUsageJson( struct ByteBuffer* out, char const* prefix, struct ProcessUsage const* usage ) {
+    appendFormat( out, "\"%sprivate_bytes\":%llu,\"%sbitmap_bytes\":%llu,\"%sgdi_objects\":%u,\"%suser_objects\":%u,"
+        "\"%shandles\":%u", prefix, (unsigned long long) usage->privateBytes, prefix, 
+        (unsigned long long) usage->bitmapBytes, prefix, usage->gdiObjects, prefix, usage->userObjects, prefix, 
+        usage->handles );
+}
+
+
+// Appends the phases as a JSON object. Each phase has its usage at its end as `private_bytes`, `gdi_objects` and so
+// on, the most seen while it ran as `max_private_bytes`, `max_gdi_objects` and so on, and the peak private memory of
+// the process up to its end as `process_peak_private_bytes`. The counters follow as an object of their own
+static void writeTelemetryJson( struct Telemetry const* telemetry, struct ByteBuffer* out ) {
+    appendFormat( out, "{\"phases\":[" );
+    for( int i = 0; i < telemetry->phaseCount; ++i ) {
+        struct TelemetryPhase const* phase = &telemetry->phases[ i ];
+        appendFormat( out, "%s\n{\"name\":\"%s\",\"ms\":%.3f,", i ? "," : "", phase->name, phase->durationMs );
+        appendProcessUsageJson( out, "", &phase->end );
+        appendFormat( out, "," );
+        appendProcessUsageJson( out, "max_", &phase->peak );
+        appendFormat( out, ",\"process_peak_private_bytes\":%llu}", (unsigned long long) phase->end.peakPrivateBytes );
+    }
+    appendFormat( out, "\n],\"counters\":{" );
+    for( int i = 0; i < telemetry->counterCount; ++i ) {
+        appendFormat( out, "%s\"%s\":%llu", i ? "," : "", telemetry->counterNames[ i ],
+            (unsigned long long) telemetry->counters[ i ] );
+    }
+    appendFormat( out, "}}\n" );
+}
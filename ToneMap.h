@@ -0,0 +1,289 @@
+// Conversion of HDR and high bit depth captures to sRGB. With HDR on, the desktop is composed in scRGB: linear light
+// with the sRGB primaries, where 1.0 is 80 nits and SDR content sits at the SDR white level the user picked. Values are
+// scaled so SDR white becomes 1.0, anything brighter than a knee just below it is rolled off smoothly so highlights
+// keep some detail rather than clipping (by the largest channel, so hues don't shift), and the result is encoded with
+// the sRGB curve through a table. Desktops with 10 bits per channel but without HDR are sRGB encoded already, and only
+// need rescaling. Nothing in here depends on windows.h.
+
+
+enum HdrFormat {
+    HDR_FORMAT_RGB10A2, // 10 bits per channel, sRGB encoded, red in the low bits (DXGI_FORMAT_R10G10B10A2_UNORM)
+    HDR_FORMAT_RGBA16F, // Half floats in scRGB (DXGI_FORMAT_R16G16B16A16_FLOAT)
+};
+
+
+// A capture in one of the formats above. The alpha channel is ignored
+struct HdrBuffer {
+    void const* pixels;
+    int width;
+    int height;
+    int stride; // In bytes, as it is for a mapped texture
+    enum HdrFormat format;
+};
+
+
+float const TONE_MAP_KNEE = 0.75f; // Fraction of SDR white up to which values are kept as they are
+float const TONE_MAP_MAX_INPUT = 1024.0f; // Brighter values (and infinities) are treated as this, relative to SDR white
+
+
+int const TONE_MAP_FRACTION_BITS = 8; // Bits below the table index in the positions of 16-bit output
+
+
+static uint16_t toneMapSrgb16[ 65537 ]; // sRGB encoding of the linear value i / 65535, at 16 bits, and once more...
+static uint8_t toneMapSrgb8[ 65536 ]; // ...and at 8 bits
+static int toneMapReady;
+
+
+// The sRGB transfer function, for linear values from 0 to 1
+static float srgbEncode( float linear ) {
+    return linear <= 0.0031308f ? linear * 12.92f : 1.055f * powf( linear, 1.0f / 2.4f ) - 0.055f;
+}
+
+
+static void initToneMap( void ) {
+    if( toneMapReady ) {
+        return;
+    }
+    for( int i = 0; i < 65536; ++i ) {
+        float encoded = srgbEncode( i / 65535.0f );
+        toneMapSrgb16[ i ] = (uint16_t)( encoded * 65535.0f + 0.5f );
+        toneMapSrgb8[ i ] = (uint8_t)( encoded * 255.0f + 0.5f );
+    }
+    toneMapSrgb16[ 65536 ] = toneMapSrgb16[ 65535 ]; // So the last position can be interpolated like the others
+    toneMapReady = 1;
+}
+
+
+static float halfToFloat( uint16_t half ) {
+    uint32_t bits = (uint32_t)( half & 0x7fff ) << 13;
+    float value;
+    memcpy( &value, &bits, 4 );
+    value *= 5.192296858534828e33f; // 2^112, the difference between the exponent biases
+    if( bits >= 0x0f800000 ) { // Infinity or NaN
+        bits |= 0x7f800000;
+        memcpy( &value, &bits, 4 );
+    }
+    return half & 0x8000 ? -value : value;
+}
+
+
+// Rolls off a value relative to SDR white, so that everything maps below 1. Keeps the slope continuous at the knee
+static float toneCurve( float x ) {
+    if( x <= TONE_MAP_KNEE ) {
+        return x;
+    }
+    float over = ( x - TONE_MAP_KNEE ) / ( 1.0f - TONE_MAP_KNEE );
+    return TONE_MAP_KNEE + ( 1.0f - TONE_MAP_KNEE ) * over / ( 1.0f + over );
+}
+
+
+// Tone maps one scRGB pixel to linear values from 0 to 1, scaled so SDR white (as an scRGB value) becomes 1
+static void toneMapLinear( float r, float g, float b, float sdrWhite, float* out ) {
+    float c[ 3 ] = { r / sdrWhite, g / sdrWhite, b / sdrWhite };
+    for( int i = 0; i < 3; ++i ) {
+        // Negative values are colors outside of the sRGB gamut, which we clip. NaNs are treated as black
+        c[ i ] = c[ i ] > 0.0f ? ( c[ i ] < TONE_MAP_MAX_INPUT ? c[ i ] : TONE_MAP_MAX_INPUT ) : 0.0f;
+    }
+    float m = c[ 0 ] > c[ 1 ] ? c[ 0 ] : c[ 1 ];
+    m = m > c[ 2 ] ? m : c[ 2 ];
+    float scale = m > TONE_MAP_KNEE ? toneCurve( m ) / m : 1.0f;
+    for( int i = 0; i < 3; ++i ) {
+        out[ i ] = c[ i ] * scale;
+    }
+}
+
+
+// Straightforward version of the conversion of an FP16 scRGB pixel to 16-bit sRGB, computing the curve exactly. The
+// table-driven versions below are checked against this
+static void toneMapReference( uint16_t const* half, float sdrWhite, uint16_t* out ) {
+    float linear[ 3 ];
+    toneMapLinear( halfToFloat( half[ 0 ] ), halfToFloat( half[ 1 ] ), halfToFloat( half[ 2 ] ), sdrWhite, linear );
+    for( int i = 0; i < 3; ++i ) {
+        out[ i ] = (uint16_t)( srgbEncode( linear[ i ] ) * 65535.0f + 0.5f );
+    }
+}
+
+
+#ifdef PIXELS_SSE2
+    // Converts the half floats in the low 16 bits of each lane to floats, like `halfToFloat`
+    static __m128 halfToFloat4( __m128i half ) {
+        __m128i bits = _mm_slli_epi32( _mm_and_si128( half, _mm_set1_epi32( 0x7fff ) ), 13 );
+        __m128i sign = _mm_slli_epi32( _mm_and_si128( half, _mm_set1_epi32( 0x8000 ) ), 16 );
+        __m128 value = _mm_mul_ps( _mm_castsi128_ps( bits ), _mm_castsi128_ps( _mm_set1_epi32( 0x77800000 ) ) );
+        __m128i special = _mm_cmpgt_epi32( bits, _mm_set1_epi32( 0x0f7fffff ) );
+        value = _mm_or_ps( value, _mm_castsi128_ps( _mm_and_si128( special, _mm_set1_epi32( 0x7f800000 ) ) ) );
+        return _mm_or_ps( value, _mm_castsi128_ps( sign ) );
+    }
+
+
+    // Tone maps four FP16 pixels, giving table positions for red, green and blue: linear values scaled to 0-`last`,
+    // which is 65535 for table indices, or more for fixed point
+    static void toneMapPositions4( uint16_t const* half, __m128 invWhite, __m128 last, int32_t* positions ) {
+        __m128i a = _mm_loadu_si128( (__m128i const*) half );
+        __m128i b = _mm_loadu_si128( (__m128i const*)( half + 8 ) );
+        __m128i zero = _mm_setzero_si128();
+        __m128 p0 = halfToFloat4( _mm_unpacklo_epi16( a, zero ) );
+        __m128 p1 = halfToFloat4( _mm_unpackhi_epi16( a, zero ) );
+        __m128 p2 = halfToFloat4( _mm_unpacklo_epi16( b, zero ) );
+        __m128 p3 = halfToFloat4( _mm_unpackhi_epi16( b, zero ) );
+        _MM_TRANSPOSE4_PS( p0, p1, p2, p3 ); // Now red, green, blue and alpha of the four pixels
+
+        // Same as `toneMapLinear`. `max` with zero first turns NaNs into zero, as it returns its second operand then
+        __m128 c[ 3 ] = { p0, p1, p2 };
+        __m128 limit = _mm_set1_ps( TONE_MAP_MAX_INPUT );
+        for( int i = 0; i < 3; ++i ) {
+            c[ i ] = _mm_min_ps( _mm_max_ps( _mm_mul_ps( c[ i ], invWhite ), _mm_setzero_ps() ), limit );
+        }
+        __m128 m = _mm_max_ps( c[ 0 ], _mm_max_ps( c[ 1 ], c[ 2 ] ) );
+        __m128 knee = _mm_set1_ps( TONE_MAP_KNEE );
+        __m128 over = _mm_mul_ps( _mm_max_ps( _mm_sub_ps( m, knee ), _mm_setzero_ps() ),
+            _mm_set1_ps( 1.0f / ( 1.0f - TONE_MAP_KNEE ) ) );
+        __m128 curve = _mm_add_ps( knee, _mm_div_ps( _mm_mul_ps( _mm_set1_ps( 1.0f - TONE_MAP_KNEE ), over ),
+            _mm_add_ps( _mm_set1_ps( 1.0f ), over ) ) );
+        __m128 rolled = _mm_cmpgt_ps( m, knee );
+        __m128 scale = _mm_or_ps( _mm_and_ps( rolled, _mm_div_ps( curve, _mm_max_ps( m, knee ) ) ),
+            _mm_andnot_ps( rolled, _mm_set1_ps( 1.0f ) ) );
+        __m128 toPosition = _mm_mul_ps( scale, last );
+        for( int i = 0; i < 3; ++i ) {
+            __m128 position = _mm_min_ps( _mm_mul_ps( c[ i ], toPosition ), last );
+            _mm_storeu_si128( (__m128i*)( positions + i * 4 ), _mm_cvtps_epi32( position ) );
+        }
+    }
+
+
+    // The 16-bit sRGB encoding at four fixed point table positions, like `toneMapSrgb16At`
+    static __m128i toneMapSrgb16At4( int32_t const* positions ) {
+        uint32_t entries[ 4 ];
+        for( int i = 0; i < 4; ++i ) {
+            memcpy( &entries[ i ], toneMapSrgb16 + ( positions[ i ] >> TONE_MAP_FRACTION_BITS ), 4 );
+        }
+        __m128i pairs = _mm_loadu_si128( (__m128i const*) entries );
+        __m128i low = _mm_and_si128( pairs, _mm_set1_epi32( 0xffff ) );
+        __m128i step = _mm_sub_epi32( _mm_srli_epi32( pairs, 16 ), low );
+        __m128i fraction = _mm_and_si128( _mm_loadu_si128( (__m128i const*) positions ),
+            _mm_set1_epi32( ( 1 << TONE_MAP_FRACTION_BITS ) - 1 ) );
+        // Entries are loaded in pairs, the lower one in the low half. Steps between them are far below 2^15, so a
+        // 16-bit multiply-add gives the whole product
+        __m128i product = _mm_add_epi32( _mm_madd_epi16( step, fraction ),
+            _mm_set1_epi32( 1 << ( TONE_MAP_FRACTION_BITS - 1 ) ) );
+        return _mm_add_epi32( low, _mm_srli_epi32( product, TONE_MAP_FRACTION_BITS ) );
+    }
+#endif
+
+
+// Tone maps one FP16 pixel to a table position per channel, like `toneMapPositions4`
+static void toneMapPositions( uint16_t const* half, float sdrWhite, float last, int32_t* positions ) {
+    float linear[ 3 ];
+    toneMapLinear( halfToFloat( half[ 0 ] ), halfToFloat( half[ 1 ] ), halfToFloat( half[ 2 ] ), sdrWhite, linear );
+    for( int i = 0; i < 3; ++i ) {
+        float position = linear[ i ] * last + 0.5f;
+        positions[ i ] = (int32_t)( position < last ? position : last );
+    }
+}
+
+
+// The 16-bit sRGB encoding at a fixed point table position, interpolated between the entries on either side. The
+// curve is so steep near black that the nearest entry can be several steps off at 16 bits
+static uint16_t toneMapSrgb16At( int32_t position ) {
+    uint16_t const* entry = toneMapSrgb16 + ( position >> TONE_MAP_FRACTION_BITS );
+    int32_t fraction = position & ( ( 1 << TONE_MAP_FRACTION_BITS ) - 1 );
+    int32_t step = entry[ 1 ] - entry[ 0 ];
+    int32_t half = 1 << ( TONE_MAP_FRACTION_BITS - 1 );
+    return (uint16_t)( entry[ 0 ] + ( ( step * fraction + half ) >> TONE_MAP_FRACTION_BITS ) );
+}
+
+
+static uint16_t const* hdrRow16( struct HdrBuffer const* src, int y ) {
+    return (uint16_t const*)( (uint8_t const*) src->pixels + (ptrdiff_t) y * src->stride );
+}
+
+
+static uint32_t const* hdrRow32( struct HdrBuffer const* src, int y ) {
+    return (uint32_t const*)( (uint8_t const*) src->pixels + (ptrdiff_t) y * src->stride );
+}
+
+
+// Converts a capture to 8-bit sRGB. `dst` must be the same size. `sdrWhite` is the SDR white level as an scRGB value
+// (the white level in nits divided by 80), only used for FP16 captures
+static void toneMapToPixels( struct HdrBuffer const* src, float sdrWhite, struct PixelBuffer* dst ) {
+    initToneMap();
+    for( int y = 0; y < src->height; ++y ) {
+        uint32_t* out = pixelRow( dst, y );
+        if( src->format == HDR_FORMAT_RGB10A2 ) {
+            uint32_t const* in = hdrRow32( src, y );
+            for( int x = 0; x < src->width; ++x ) {
+                // ( v * 255 + 511 ) / 1023, rounding the same way as a division for all 10-bit values
+                uint32_t p = in[ x ];
+                uint32_t r = ( ( p & 0x3ff ) * 1021 + 2044 ) >> 12;
+                uint32_t g = ( ( ( p >> 10 ) & 0x3ff ) * 1021 + 2044 ) >> 12;
+                uint32_t b = ( ( ( p >> 20 ) & 0x3ff ) * 1021 + 2044 ) >> 12;
+                out[ x ] = 0xff000000 | ( r << 16 ) | ( g << 8 ) | b;
+            }
+            continue;
+        }
+        uint16_t const* in = hdrRow16( src, y );
+        int x = 0;
+        int32_t positions[ 12 ];
+        #ifdef PIXELS_SSE2
+            __m128 invWhite = _mm_set1_ps( 1.0f / sdrWhite );
+            __m128 last = _mm_set1_ps( 65535.0f );
+            for( ; x + 4 <= src->width; x += 4 ) {
+                toneMapPositions4( in + x * 4, invWhite, last, positions );
+                for( int i = 0; i < 4; ++i ) {
+                    out[ x + i ] = 0xff000000 | ( (uint32_t) toneMapSrgb8[ positions[ i ] ] << 16 ) |
+                        ( (uint32_t) toneMapSrgb8[ positions[ 4 + i ] ] << 8 ) | toneMapSrgb8[ positions[ 8 + i ] ];
+                }
+            }
+        #endif
+        for( ; x < src->width; ++x ) {
+            toneMapPositions( in + x * 4, sdrWhite, 65535.0f, positions );
+            out[ x ] = 0xff000000 | ( (uint32_t) toneMapSrgb8[ positions[ 0 ] ] << 16 ) |
+                ( (uint32_t) toneMapSrgb8[ positions[ 1 ] ] << 8 ) | toneMapSrgb8[ positions[ 2 ] ];
+        }
+    }
+}
+
+
+// Converts a capture to 16-bit sRGB, for saving with more precision than `toneMapToPixels` gives
+static void toneMapToWidePixels( struct HdrBuffer const* src, float sdrWhite, struct WidePixelBuffer* dst ) {
+    initToneMap();
+    for( int y = 0; y < src->height; ++y ) {
+        uint16_t* out = widePixelRow( dst, y );
+        if( src->format == HDR_FORMAT_RGB10A2 ) {
+            uint32_t const* in = hdrRow32( src, y );
+            for( int x = 0; x < src->width; ++x ) {
+                for( int i = 0; i < 3; ++i ) {
+                    uint32_t v = ( in[ x ] >> ( i * 10 ) ) & 0x3ff;
+                    out[ x * 4 + i ] = (uint16_t)( ( v << 6 ) | ( v >> 4 ) );
+                }
+                out[ x * 4 + 3 ] = 0xffff;
+            }
+            continue;
+        }
+        uint16_t const* in = hdrRow16( src, y );
+        int x = 0;
+        int32_t positions[ 12 ];
+        float lastPosition = 65535.0f * ( 1 << TONE_MAP_FRACTION_BITS );
+        #ifdef PIXELS_SSE2
+            __m128 invWhite = _mm_set1_ps( 1.0f / sdrWhite );
+            __m128 last = _mm_set1_ps( lastPosition );
+            for( ; x + 4 <= src->width; x += 4 ) {
+                toneMapPositions4( in + x * 4, invWhite, last, positions );
+                // Red and green, then blue and opaque alpha, in each lane, interleaved into pixels
+                __m128i rg = _mm_or_si128( toneMapSrgb16At4( positions ),
+                    _mm_slli_epi32( toneMapSrgb16At4( positions + 4 ), 16 ) );
+                __m128i ba = _mm_or_si128( toneMapSrgb16At4( positions + 8 ), _mm_set1_epi32( (int) 0xffff0000 ) );
+                _mm_storeu_si128( (__m128i*)( out + x * 4 ), _mm_unpacklo_epi32( rg, ba ) );
+                _mm_storeu_si128( (__m128i*)( out + x * 4 + 8 ), _mm_unpackhi_epi32( rg, ba ) );
+            }
+        #endif
+        for( ; x < src->width; ++x ) {
+            toneMapPositions( in + x * 4, sdrWhite, lastPosition, positions );
+            uint16_t* p = out + x * 4;
+            p[ 0 ] = toneMapSrgb16At( positions[ 0 ] );
+            p[ 1 ] = toneMapSrgb16At( positions[ 1 ] );
+            p[ 2 ] = toneMapSrgb16At( positions[ 2 ] );
+            p[ 3 ] = 0xffff;
+        }
+    }
+}
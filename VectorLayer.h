@@ -0,0 +1,295 @@
+// The annotations as vectors, so they can be stored separately from the image and redrawn at any resolution, or
+// left out. Written either as SVG, or as a compact binary format:
+//
+//     "SSVL", version byte, varint width, varint height, varint item count, then for each item:
+//     kind byte, varint pen index, uint32 color (BGRA, little endian), varint width in quarter pixels,
+//     varint point count, zigzag varint deltas of the point coordinates in quarter pixels (x and y interleaved,
+//     each relative to the previous point), and for text items a varint length followed by UTF-8 text.
+//
+// Redactions are never part of the vector layer. They destroy the pixels they cover, so they stay in the image.
+
+
+uint8_t const VECTOR_LAYER_VERSION = 1;
+float const VECTOR_LAYER_SCALE = 4.0f; // Coordinates and widths are stored in quarter pixels
+int const VECTOR_LAYER_MAX_POINTS = 1 << 24; // Sanity limit when reading
+
+
+enum VectorKind {
+    VECTOR_PEN,
+    VECTOR_HIGHLIGHTER,
+    VECTOR_ARROW,
+    VECTOR_RECTANGLE,
+    VECTOR_ELLIPSE,
+    VECTOR_TEXT,
+    VECTOR_KIND_COUNT,
+};
+
+
+// A stroke or shape. Strokes have the control points of a cardinal spline with a tension of 0.5, shapes have the
+// corners they were dragged between (the top-left corner, for text)
+struct VectorItem {
+    enum VectorKind kind;
+    int penIndex;
+    uint32_t color; // BGRA with straight alpha, the same as the ARGB value of a GDI+ color
+    float width;
+    int pointCount;
+    float* points; // x, y pairs
+    char* text; // UTF-8, only for text
+};
+
+
+struct VectorLayer {
+    int width; // Size of the snippet the annotations were made on
+    int height;
+    int count;
+    int capacity;
+    struct VectorItem* items;
+};
+
+
+// Adds a copy of the given item to the layer. Returns zero if out of memory
+static int addVectorItem( struct VectorLayer* layer, enum VectorKind kind, int penIndex, uint32_t color, float width,
+    float const* points, int pointCount, char const* text ) {
+
+    if( layer->count >= layer->capacity ) {
+        int capacity = layer->capacity ? layer->capacity * 2 : 64;
+        struct VectorItem* items = (struct VectorItem*) realloc( layer->items, sizeof( struct VectorItem ) * capacity );
+        if( !items ) {
+            return 0;
+        }
+        layer->items = items;
+        layer->capacity = capacity;
+    }
+    struct VectorItem item = { kind, penIndex, color, width, pointCount, NULL, NULL };
+    item.points = (float*) malloc( sizeof( float ) * 2 * ( pointCount > 0 ? pointCount : 1 ) );
+    if( text ) {
+        size_t length = strlen( text );
+        item.text = (char*) malloc( length + 1 );
+        if( item.text ) {
+            memcpy( item.text, text, length + 1 );
+        }
+    }
+    if( !item.points || ( text && !item.text ) ) {
+        free( item.points );
+        free( item.text );
+        return 0;
+    }
+    memcpy( item.points, points, sizeof( float ) * 2 * pointCount );
+    layer->items[ layer->count++ ] = item;
+    return 1;
+}
+
+
+// Makes the layer fit the part of the snippet inside `crop`, moving the items so they stay where they were on it
+static void cropVectorLayer( struct VectorLayer* layer, struct PixelRect crop ) {
+    layer->width = crop.right - crop.left;
+    layer->height = crop.bottom - crop.top;
+    for( int i = 0; i < layer->count; ++i ) {
+        struct VectorItem* item = &layer->items[ i ];
+        for( int j = 0; j < item->pointCount; ++j ) {
+            item->points[ j * 2 ] -= (float) crop.left;
+            item->points[ j * 2 + 1 ] -= (float) crop.top;
+        }
+    }
+}
+
+
+static void releaseVectorLayer( struct VectorLayer* layer ) {
+    for( int i = 0; i < layer->count; ++i ) {
+        free( layer->items[ i ].points );
+        free( layer->items[ i ].text );
+    }
+    free( layer->items );
+    memset( layer, 0, sizeof( *layer ) );
+}
+
+
+static void appendSvgColor( struct ByteBuffer* out, char const* attribute, uint32_t color ) {
+    appendFormat( out, " %s=\"#%06x\"", attribute, color & 0xffffff );
+    if( ( color >> 24 ) != 0xff ) {
+        appendFormat( out, " %s-opacity=\"%.3g\"", attribute, ( color >> 24 ) / 255.0f );
+    }
+}
+
+
+// Text content with the characters which are special in XML escaped
+static void appendSvgText( struct ByteBuffer* out, char const* text ) {
+    for( char const* c = text; *c; ++c ) {
+        switch( *c ) {
+            case '<': appendFormat( out, "&lt;" ); break;
+            case '>': appendFormat( out, "&gt;" ); break;
+            case '&': appendFormat( out, "&amp;" ); break;
+            case '"': appendFormat( out, "&quot;" ); break;
+            default: appendByte( out, (uint8_t) *c ); break;
+        }
+    }
+}
+
+
+// Writes the layer as an SVG document the size of the snippet. Strokes are converted to the same cubic beziers the
+// spline is flattened from in Strokes.h, so they look exactly like they did in the annotation window
+static void writeVectorSvg( struct VectorLayer const* layer, struct ByteBuffer* out ) {
+    appendFormat( out, "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" viewBox=\"0 0 %d %d\">\n",
+        layer->width, layer->height, layer->width, layer->height );
+    for( int i = 0; i < layer->count; ++i ) {
+        struct VectorItem const* item = &layer->items[ i ];
+        float const* p = item->points;
+        int n = item->pointCount;
+        if( ( item->kind == VECTOR_PEN || item->kind == VECTOR_HIGHLIGHTER ) && n > 1 ) {
+            appendFormat( out, "<path class=\"%s\" data-pen=\"%d\" fill=\"none\" stroke-width=\"%g\"",
+                item->kind == VECTOR_PEN ? "pen" : "highlighter", item->penIndex, item->width );
+            appendSvgColor( out, "stroke", item->color );
+            appendFormat( out, " d=\"M%g %g", p[ 0 ], p[ 1 ] );
+            for( int j = 0; j + 1 < n; ++j ) {
+                int i0 = j > 0 ? j - 1 : 0;
+                int i3 = j + 2 < n - 1 ? j + 2 : n - 1;
+                appendFormat( out, " C%g %g %g %g %g %g",
+                    p[ j * 2 ] + ( p[ j * 2 + 2 ] - p[ i0 * 2 ] ) / 6.0f,
+                    p[ j * 2 + 1 ] + ( p[ j * 2 + 3 ] - p[ i0 * 2 + 1 ] ) / 6.0f,
+                    p[ j * 2 + 2 ] - ( p[ i3 * 2 ] - p[ j * 2 ] ) / 6.0f,
+                    p[ j * 2 + 3 ] - ( p[ i3 * 2 + 1 ] - p[ j * 2 + 1 ] ) / 6.0f,
+                    p[ j * 2 + 2 ], p[ j * 2 + 3 ] );
+            }
+            appendFormat( out, "\"/>\n" );
+        } else if( item->kind >= VECTOR_ARROW && item->kind <= VECTOR_ELLIPSE && n == 2 ) {
+            float x0 = p[ 0 ] < p[ 2 ] ? p[ 0 ] : p[ 2 ];
+            float y0 = p[ 1 ] < p[ 3 ] ? p[ 1 ] : p[ 3 ];
+            float w = fabsf( p[ 2 ] - p[ 0 ] );
+            float h = fabsf( p[ 3 ] - p[ 1 ] );
+            if( item->kind == VECTOR_ARROW ) {
+                struct Shape shape = { SHAPE_ARROW, item->penIndex, item->width, p[ 0 ], p[ 1 ], p[ 2 ], p[ 3 ] };
+                float barbs[ 4 ];
+                shapeArrowHead( &shape, barbs );
+                appendFormat( out, "<path class=\"arrow\" data-pen=\"%d\" fill=\"none\" stroke-width=\"%g\"",
+                    item->penIndex, item->width );
+                appendSvgColor( out, "stroke", item->color );
+                appendFormat( out, " d=\"M%g %g L%g %g M%g %g L%g %g L%g %g\"/>\n", p[ 0 ], p[ 1 ], p[ 2 ], p[ 3 ],
+                    barbs[ 0 ], barbs[ 1 ], p[ 2 ], p[ 3 ], barbs[ 2 ], barbs[ 3 ] );
+            } else if( item->kind == VECTOR_RECTANGLE ) {
+                appendFormat( out, "<rect data-pen=\"%d\" x=\"%g\" y=\"%g\" width=\"%g\" height=\"%g\" fill=\"none\" "
+                    "stroke-width=\"%g\"", item->penIndex, x0, y0, w, h, item->width );
+                appendSvgColor( out, "stroke", item->color );
+                appendFormat( out, "/>\n" );
+            } else {
+                appendFormat( out, "<ellipse data-pen=\"%d\" cx=\"%g\" cy=\"%g\" rx=\"%g\" ry=\"%g\" fill=\"none\" "
+                    "stroke-width=\"%g\"", item->penIndex, x0 + w * 0.5f, y0 + h * 0.5f, w * 0.5f, h * 0.5f,
+                    item->width );
+                appendSvgColor( out, "stroke", item->color );
+                appendFormat( out, "/>\n" );
+            }
+        } else if( item->kind == VECTOR_TEXT && n >= 1 && item->text ) {
+            appendFormat( out, "<text data-pen=\"%d\" x=\"%g\" y=\"%g\" font-family=\"Segoe UI\" font-size=\"20\" "
+                "dominant-baseline=\"text-before-edge\"", item->penIndex, p[ 0 ], p[ 1 ] );
+            appendSvgColor( out, "fill", item->color );
+            appendFormat( out, ">" );
+            appendSvgText( out, item->text );
+            appendFormat( out, "</text>\n" );
+        }
+    }
+    appendFormat( out, "</svg>\n" );
+}
+
+
+static int32_t quantizeVector( float value ) {
+    return (int32_t) floorf( value * VECTOR_LAYER_SCALE + 0.5f );
+}
+
+
+// Writes the layer in the compact binary format described at the top of this file
+static void writeVectorBinary( struct VectorLayer const* layer, struct ByteBuffer* out ) {
+    appendBytes( out, "SSVL", 4 );
+    appendByte( out, VECTOR_LAYER_VERSION );
+    appendVarint( out, (uint64_t) layer->width );
+    appendVarint( out, (uint64_t) layer->height );
+    appendVarint( out, (uint64_t) layer->count );
+    for( int i = 0; i < layer->count; ++i ) {
+        struct VectorItem const* item = &layer->items[ i ];
+        appendByte( out, (uint8_t) item->kind );
+        appendVarint( out, (uint64_t) item->penIndex );
+        appendUint32( out, item->color );
+        appendVarint( out, (uint64_t) quantizeVector( item->width ) );
+        appendVarint( out, (uint64_t) item->pointCount );
+        int32_t x = 0;
+        int32_t y = 0;
+        for( int j = 0; j < item->pointCount; ++j ) {
+            int32_t qx = quantizeVector( item->points[ j * 2 ] );
+            int32_t qy = quantizeVector( item->points[ j * 2 + 1 ] );
+            appendSignedVarint( out, (int64_t) qx - x );
+            appendSignedVarint( out, (int64_t) qy - y );
+            x = qx;
+            y = qy;
+        }
+        if( item->kind == VECTOR_TEXT ) {
+            size_t length = item->text ? strlen( item->text ) : 0;
+            appendVarint( out, length );
+            appendBytes( out, item->text, length );
+        }
+    }
+}
+
+
+// Reads a layer written by `writeVectorBinary`. Returns zero if the data is malformed or memory runs out, in which case
+// `layer` is left empty
+static int readVectorBinary( uint8_t const* data, size_t size, struct VectorLayer* layer ) {
+    memset( layer, 0, sizeof( *layer ) );
+    struct ByteReader reader = { data, size, 0, 0 };
+    uint8_t const* magic = readBytes( &reader, 4 );
+    if( !magic || memcmp( magic, "SSVL", 4 ) != 0 || readByte( &reader ) != VECTOR_LAYER_VERSION ) {
+        return 0;
+    }
+    layer->width = (int) readVarint( &reader );
+    layer->height = (int) readVarint( &reader );
+    uint64_t count = readVarint( &reader );
+    float* points = NULL;
+    char* text = NULL;
+    for( uint64_t i = 0; i < count && !reader.failed; ++i ) {
+        uint8_t kind = readByte( &reader );
+        int penIndex = (int) readVarint( &reader );
+        uint32_t color = readUint32( &reader );
+        float width = readVarint( &reader ) / VECTOR_LAYER_SCALE;
+        uint64_t pointCount = readVarint( &reader );
+        // Every point takes at least two bytes, so a count larger than that is malformed
+        if( kind >= VECTOR_KIND_COUNT || pointCount > (uint64_t) VECTOR_LAYER_MAX_POINTS ||
+            pointCount * 2 > reader.size - reader.position ) {
+            reader.failed = 1;
+            break;
+        }
+        points = (float*) realloc( points, sizeof( float ) * 2 * ( pointCount > 0 ? pointCount : 1 ) );
+        if( !points ) {
+            reader.failed = 1;
+            break;
+        }
+        int32_t x = 0;
+        int32_t y = 0;
+        for( uint64_t j = 0; j < pointCount; ++j ) {
+            x += (int32_t) readSignedVarint( &reader );
+            y += (int32_t) readSignedVarint( &reader );
+            points[ j * 2 ] = x / VECTOR_LAYER_SCALE;
+            points[ j * 2 + 1 ] = y / VECTOR_LAYER_SCALE;
+        }
+        free( text );
+        text = NULL;
+        if( kind == VECTOR_TEXT ) {
+            uint64_t length = readVarint( &reader );
+            uint8_t const* bytes = readBytes( &reader, (size_t) length );
+            text = bytes ? (char*) malloc( (size_t) length + 1 ) : NULL;
+            if( !text ) {
+                reader.failed = 1;
+                break;
+            }
+            memcpy( text, bytes, (size_t) length );
+            text[ length ] = '\0';
+        }
+        if( reader.failed || !addVectorItem( layer, (enum VectorKind) kind, penIndex, color, width, points,
+            (int) pointCount, text ) ) {
+            reader.failed = 1;
+        }
+    }
+    free( points );
+    free( text );
+    if( reader.failed ) {
+        releaseVectorLayer( layer );
+        return 0;
+    }
+    return 1;
+}
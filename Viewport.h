@@ -0,0 +1,141 @@
+// View transform for the zoomable, pannable annotation window. Maps between view coordinates (pixels of the visible
+// area of the window) and image coordinates (pixels of the snippet), and renders only the part of the image which is
+// actually visible.
+
+
+float const VIEWPORT_MIN_ZOOM = 0.05f;
+float const VIEWPORT_MAX_ZOOM = 32.0f;
+
+
+struct Viewport {
+    float zoom; // Number of view pixels per image pixel
+    float offsetX; // Image coordinate shown at the top-left corner of the view
+    float offsetY;
+    int viewWidth; // Size of the visible area, in view pixels
+    int viewHeight;
+    int imageWidth; // Size of the image, in image pixels
+    int imageHeight;
+};
+
+
+static void viewToImage( struct Viewport const* view, float vx, float vy, float* ix, float* iy ) {
+    *ix = view->offsetX + vx / view->zoom;
+    *iy = view->offsetY + vy / view->zoom;
+}
+
+
+static void imageToView( struct Viewport const* view, float ix, float iy, float* vx, float* vy ) {
+    *vx = ( ix - view->offsetX ) * view->zoom;
+    *vy = ( iy - view->offsetY ) * view->zoom;
+}
+
+
+// Keeps as much of the image as possible in view. Along an axis where the whole image fits, it is centered instead.
+static void clampViewport( struct Viewport* view ) {
+    float visibleW = view->viewWidth / view->zoom;
+    float visibleH = view->viewHeight / view->zoom;
+    if( visibleW >= view->imageWidth ) {
+        view->offsetX = ( view->imageWidth - visibleW ) * 0.5f;
+    } else if( view->offsetX < 0.0f ) {
+        view->offsetX = 0.0f;
+    } else if( view->offsetX > view->imageWidth - visibleW ) {
+        view->offsetX = view->imageWidth - visibleW;
+    }
+    if( visibleH >= view->imageHeight ) {
+        view->offsetY = ( view->imageHeight - visibleH ) * 0.5f;
+    } else if( view->offsetY < 0.0f ) {
+        view->offsetY = 0.0f;
+    } else if( view->offsetY > view->imageHeight - visibleH ) {
+        view->offsetY = view->imageHeight - visibleH;
+    }
+}
+
+
+// Set a new zoom level, keeping the image point under view position (vx, vy) fixed
+static void zoomViewport( struct Viewport* view, float zoom, float vx, float vy ) {
+    if( zoom < VIEWPORT_MIN_ZOOM ) {
+        zoom = VIEWPORT_MIN_ZOOM;
+    } else if( zoom > VIEWPORT_MAX_ZOOM ) {
+        zoom = VIEWPORT_MAX_ZOOM;
+    }
+    float ix, iy;
+    viewToImage( view, vx, vy, &ix, &iy );
+    view->zoom = zoom;
+    view->offsetX = ix - vx / zoom;
+    view->offsetY = iy - vy / zoom;
+    clampViewport( view );
+}
+
+
+// Move the view by (dx, dy) view pixels
+static void panViewport( struct Viewport* view, float dx, float dy ) {
+    view->offsetX += dx / view->zoom;
+    view->offsetY += dy / view->zoom;
+    clampViewport( view );
+}
+
+
+// The image pixels touched by the view, clipped to the image
+static struct PixelRect visibleImageRect( struct Viewport const* view ) {
+    float x0, y0, x1, y1;
+    viewToImage( view, 0.0f, 0.0f, &x0, &y0 );
+    viewToImage( view, (float) view->viewWidth, (float) view->viewHeight, &x1, &y1 );
+    struct PixelRect visible = { (int) floorf( x0 ), (int) floorf( y0 ), (int) ceilf( x1 ), (int) ceilf( y1 ) };
+    struct PixelRect image = { 0, 0, view->imageWidth, view->imageHeight };
+    return intersectPixelRect( visible, image );
+}
+
+
+// Nearest-neighbor render of the visible part of `image` into `out`, which should be the size of the view. View pixels
+// outside the image are set to `background`. `columns` is scratch space for one int per view column.
+static void renderViewport( struct Viewport const* view, struct PixelBuffer const* image, struct PixelBuffer* out,
+    uint32_t background, int* columns ) {
+
+    // Source column for each view column, or -1 if outside the image. Leftmost and rightmost runs of -1 are found
+    // so the inner loop only deals with pixels inside the image
+    int first = out->width;
+    int last = 0;
+    for( int x = 0; x < out->width; ++x ) {
+        int sx = (int) floorf( view->offsetX + ( x + 0.5f ) / view->zoom );
+        columns[ x ] = ( sx >= 0 && sx < image->width ) ? sx : -1;
+        if( columns[ x ] >= 0 ) {
+            first = x < first ? x : first;
+            last = x + 1;
+        }
+    }
+
+    // Fast path for unscaled views aligned to whole pixels
+    int unscaled = view->zoom == 1.0f && view->offsetX == floorf( view->offsetX );
+
+    int prevSy = -1;
+    uint32_t* prevRow = NULL;
+    for( int y = 0; y < out->height; ++y ) {
+        uint32_t* row = pixelRow( out, y );
+        int sy = (int) floorf( view->offsetY + ( y + 0.5f ) / view->zoom );
+        if( sy < 0 || sy >= image->height || first >= last ) {
+            for( int x = 0; x < out->width; ++x ) {
+                row[ x ] = background;
+            }
+            continue;
+        }
+        for( int x = 0; x < first; ++x ) {
+            row[ x ] = background;
+        }
+        if( prevRow && sy == prevSy ) {
+            // When zoomed in, consecutive view rows often sample the same image row
+            memcpy( row + first, prevRow + first, sizeof( uint32_t ) * ( last - first ) );
+        } else if( unscaled ) {
+            memcpy( row + first, pixelRow( image, sy ) + columns[ first ], sizeof( uint32_t ) * ( last - first ) );
+        } else {
+            uint32_t const* in = pixelRow( image, sy );
+            for( int x = first; x < last; ++x ) {
+                row[ x ] = in[ columns[ x ] ];
+            }
+        }
+        for( int x = last; x < out->width; ++x ) {
+            row[ x ] = background;
+        }
+        prevRow = row;
+        prevSy = sy;
+    }
+}
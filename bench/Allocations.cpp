@@ -0,0 +1,100 @@
+// Heap allocation counting for the benchmarks. The core allocates with malloc/calloc/realloc, which are wrapped at
+// link time where the linker supports it (see CMakeLists.txt). Global `new` is replaced to count as well, as the
+// compositor and encoder allocate their jobs and threads with it. Where the allocator is wrapped, `free` is too, and
+// the bytes in use and their high-water mark are tracked, by the usable size of each block.
+#include <atomic>
+#include <new>
+#include <stdint.h>
+#include <stdlib.h>
+#ifdef BENCH_WRAP_MALLOC
+    #include <malloc.h>
+#endif
+
+
+static std::atomic<uint64_t> allocationCount( 0 );
+static std::atomic<int64_t> heapBytes( 0 );
+static std::atomic<int64_t> peakHeapBytes( 0 );
+
+
+uint64_t benchAllocationCount( void ) {
+    return allocationCount.load( std::memory_order_relaxed );
+}
+
+
+int64_t benchHeapBytes( void ) {
+    return heapBytes.load( std::memory_order_relaxed );
+}
+
+
+// Highest `benchHeapBytes` since the last call, which starts over from the bytes in use now
+int64_t benchTakePeakHeapBytes( void ) {
+    return peakHeapBytes.exchange( heapBytes.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+}
+
+
+#ifdef BENCH_WRAP_MALLOC
+    extern "C" {
+        void* __real_malloc( size_t size );
+        void* __real_calloc( size_t count, size_t size );
+        void* __real_realloc( void* pointer, size_t size );
+        void __real_free( void* pointer );
+
+        static void addHeapBytes( int64_t bytes ) {
+            int64_t now = heapBytes.fetch_add( bytes, std::memory_order_relaxed ) + bytes;
+            int64_t peak = peakHeapBytes.load( std::memory_order_relaxed );
+            while( now > peak && !peakHeapBytes.compare_exchange_weak( peak, now, std::memory_order_relaxed ) ) {
+            }
+        }
+
+        void* __wrap_malloc( size_t size ) {
+            allocationCount.fetch_add( 1, std::memory_order_relaxed );
+            void* pointer = __real_malloc( size );
+            addHeapBytes( (int64_t) malloc_usable_size( pointer ) );
+            return pointer;
+        }
+
+        void* __wrap_calloc( size_t count, size_t size ) {
+            allocationCount.fetch_add( 1, std::memory_order_relaxed );
+            void* pointer = __real_calloc( count, size );
+            addHeapBytes( (int64_t) malloc_usable_size( pointer ) );
+            return pointer;
+        }
+
+        void* __wrap_realloc( void* pointer, size_t size ) {
+            allocationCount.fetch_add( 1, std::memory_order_relaxed );
+            int64_t before = (int64_t) malloc_usable_size( pointer );
+            void* result = __real_realloc( pointer, size );
+            if( result || size == 0 ) {
+                addHeapBytes( (int64_t) malloc_usable_size( result ) - before );
+            }
+            return result;
+        }
+
+        void __wrap_free( void* pointer ) {
+            addHeapBytes( -(int64_t) malloc_usable_size( pointer ) );
+            __real_free( pointer );
+        }
+    }
+#endif
+
+
+void* operator new( size_t size ) {
+    #ifndef BENCH_WRAP_MALLOC
+        allocationCount.fetch_add( 1, std::memory_order_relaxed ); // Otherwise counted by the malloc wrapper
+    #endif
+    void* pointer = malloc( size ? size : 1 );
+    if( !pointer ) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+
+void operator delete( void* pointer ) noexcept {
+    free( pointer );
+}
+
+
+void operator delete( void* pointer, size_t ) noexcept {
+    free( pointer );
+}
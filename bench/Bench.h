@@ -0,0 +1,37 @@
+// Shared setup for the benchmarks. Throughput is reported through SetBytesProcessed, time per frame (or per user
+// action) as `frame_ms`, and heap allocations per iteration as `allocs`.
+#include "SnippetCore.h"
+#include "Corpus.h"
+#include <benchmark/benchmark.h>
+
+
+// Number of heap allocations made so far, by any thread (see Allocations.cpp)
+uint64_t benchAllocationCount( void );
+
+
+// Heap bytes in use, and the most in use since the last call to `benchTakePeakHeapBytes`. Zero where the allocator
+// can't be wrapped
+int64_t benchHeapBytes( void );
+int64_t benchTakePeakHeapBytes( void );
+
+
+// Reports the allocations made since `start`, a value returned by `benchAllocationCount` before the timing loop
+static void reportAllocations( benchmark::State& state, uint64_t start ) {
+    state.counters[ "allocs" ] = benchmark::Counter( (double)( benchAllocationCount() - start ),
+        benchmark::Counter::kAvgIterations );
+}
+
+
+// Reports the time per iteration in milliseconds, for work which happens once per frame or per user action
+static void reportFrameTime( benchmark::State& state ) {
+    state.counters[ "frame_ms" ] = benchmark::Counter( state.iterations() / 1000.0,
+        benchmark::Counter::kIsRate | benchmark::Counter::kInvert );
+}
+
+
+// Labels a benchmark with the corpus image it ran on
+static void setCorpusLabel( benchmark::State& state, int kind, int size ) {
+    char label[ 64 ];
+    snprintf( label, sizeof( label ), "%s %s", corpusKindNames[ kind ], corpusSizes[ size ].name );
+    state.SetLabel( label );
+}
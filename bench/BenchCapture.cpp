@@ -0,0 +1,349 @@
+// Benchmarks for working with the captured desktop: the selection loupe, edge snapping, redaction, zoomed display of
+// the snippet, hashing for the encode cache, tone mapping HDR captures, and the accounting of memory per phase.
+#include "Bench.h"
+
+
+// One tick of the loupe: a 160x160 view at 8x zoom, sampled from the desktop
+static void benchMagnifier( benchmark::State& state ) {
+    struct PixelBuffer const* desktop = corpusImage( CORPUS_UI, (int) state.range( 0 ) );
+    uint32_t loupe[ 160 * 160 ];
+    struct PixelBuffer view = { loupe, 160, 160, 160 };
+    int x = 0;
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        x = ( x + 37 ) % desktop->width;
+        magnifyNearest( desktop, x, desktop->height / 2, 8, 0xff000000, &view );
+        magnifierMarkCenter( &view, 8, 0xffffffff );
+        benchmark::DoNotOptimize( loupe[ 0 ] );
+    }
+    reportFrameTime( state );
+    reportAllocations( state, allocations );
+    setCorpusLabel( state, CORPUS_UI, (int) state.range( 0 ) );
+}
+BENCHMARK( benchMagnifier )->DenseRange( 0, CORPUS_SIZE_COUNT - 1 );
+
+
+// Building the edge map once the desktop is grabbed, before the selection windows show
+static void benchEdgeMap( benchmark::State& state ) {
+    int kind = (int) state.range( 0 );
+    int size = (int) state.range( 1 );
+    struct PixelBuffer const* desktop = corpusImage( kind, size );
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        struct EdgeMap map;
+        buildEdgeMap( desktop, &map );
+        benchmark::DoNotOptimize( map.verticalPrefix );
+        releaseEdgeMap( &map );
+    }
+    state.SetBytesProcessed( (int64_t) state.iterations() * desktop->width * desktop->height * 4 );
+    reportFrameTime( state );
+    reportAllocations( state, allocations );
+    setCorpusLabel( state, kind, size );
+}
+BENCHMARK( benchEdgeMap )->ArgsProduct( { { CORPUS_TEXT, CORPUS_UI, CORPUS_PHOTO }, { 0, 2, 3 } } )
+    ->Unit( benchmark::kMillisecond );
+
+
+// Snapping all four selection edges, as done on every timer tick while dragging
+static void benchEdgeSnap( benchmark::State& state ) {
+    struct PixelBuffer const* desktop = corpusImage( CORPUS_UI, (int) state.range( 0 ) );
+    struct EdgeMap map;
+    buildEdgeMap( desktop, &map );
+    int x0 = desktop->width / 5;
+    int y0 = desktop->height / 7;
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        x0 = ( x0 + 13 ) % ( desktop->width / 2 );
+        int x1 = x0 + desktop->width / 3;
+        int y1 = y0 + desktop->height / 2;
+        benchmark::DoNotOptimize( snapEdgeX( &map, x0, y0, y1, 8 ) );
+        benchmark::DoNotOptimize( snapEdgeX( &map, x1, y0, y1, 8 ) );
+        benchmark::DoNotOptimize( snapEdgeY( &map, y0, x0, x1, 8 ) );
+        benchmark::DoNotOptimize( snapEdgeY( &map, y1, x0, x1, 8 ) );
+    }
+    reportAllocations( state, allocations );
+    releaseEdgeMap( &map );
+    setCorpusLabel( state, CORPUS_UI, (int) state.range( 0 ) );
+}
+BENCHMARK( benchEdgeSnap )->Arg( 0 )->Arg( 3 );
+
+
+// Redacting an 800x600 area, with each mode at the strength the annotation window uses
+static void benchRedact( benchmark::State& state ) {
+    enum RedactMode mode = (enum RedactMode) state.range( 0 );
+    struct PixelBuffer const* source = corpusImage( CORPUS_MIXED, 0 );
+    struct PixelBuffer copy = *source;
+    copy.pixels = (uint32_t*) malloc( sizeof( uint32_t ) * source->width * source->height );
+    memcpy( copy.pixels, source->pixels, sizeof( uint32_t ) * source->width * source->height );
+    struct PixelRect rect = { 500, 200, 1300, 800 };
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        redactRect( &copy, rect, mode, 12 );
+        benchmark::DoNotOptimize( copy.pixels[ 0 ] );
+    }
+    state.SetBytesProcessed( (int64_t) state.iterations() * 800 * 600 * 4 );
+    reportFrameTime( state );
+    reportAllocations( state, allocations );
+    state.SetLabel( mode == REDACT_BLUR ? "blur" : "pixelate" );
+    free( copy.pixels );
+}
+BENCHMARK( benchRedact )->Arg( REDACT_BLUR )->Arg( REDACT_PIXELATE );
+
+
+// One repaint of a 1920x1080 annotation window showing the snippet zoomed by range( 1 ) / 4
+static void benchViewport( benchmark::State& state ) {
+    struct PixelBuffer const* image = corpusImage( CORPUS_MIXED, (int) state.range( 0 ) );
+    struct Viewport view = { 1.0f, 0.0f, 0.0f, 1920, 1080, image->width, image->height };
+    zoomViewport( &view, state.range( 1 ) / 4.0f, 960.0f, 540.0f );
+    struct PixelBuffer out = { (uint32_t*) malloc( sizeof( uint32_t ) * 1920 * 1080 ), 1920, 1080, 1920 };
+    int* columns = (int*) malloc( sizeof( int ) * 1920 );
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        panViewport( &view, 3.0f, 2.0f );
+        renderViewport( &view, image, &out, 0xff202020, columns );
+        benchmark::DoNotOptimize( out.pixels[ 0 ] );
+    }
+    state.SetBytesProcessed( (int64_t) state.iterations() * 1920 * 1080 * 4 );
+    reportFrameTime( state );
+    reportAllocations( state, allocations );
+    setCorpusLabel( state, CORPUS_MIXED, (int) state.range( 0 ) );
+    free( out.pixels );
+    free( columns );
+}
+BENCHMARK( benchViewport )->ArgsProduct( { { 0, 2 }, { 2, 4, 10 } } );
+
+
+// Hashing the pixels of a snippet for the encode cache key
+static void benchHashPixels( benchmark::State& state ) {
+    struct PixelBuffer const* image = corpusImage( CORPUS_MIXED, (int) state.range( 0 ) );
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        benchmark::DoNotOptimize( hashPixels( image, 1 ) );
+    }
+    state.SetBytesProcessed( (int64_t) state.iterations() * image->width * image->height * 4 );
+    reportFrameTime( state );
+    reportAllocations( state, allocations );
+    setCorpusLabel( state, CORPUS_MIXED, (int) state.range( 0 ) );
+}
+BENCHMARK( benchHashPixels )->DenseRange( 0, CORPUS_SIZE_COUNT - 1 );
+
+
+// Rounds a float to the nearest half float
+static uint16_t floatToHalf( float value ) {
+    uint32_t bits;
+    memcpy( &bits, &value, 4 );
+    uint32_t sign = ( bits >> 16 ) & 0x8000;
+    int exponent = (int)( ( bits >> 23 ) & 0xff ) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+    if( ( ( bits >> 23 ) & 0xff ) == 0xff ) {
+        return (uint16_t)( sign | 0x7c00 | ( mantissa ? 0x200 : 0 ) );
+    }
+    if( exponent >= 31 ) {
+        return (uint16_t)( sign | 0x7c00 );
+    }
+    if( exponent <= 0 ) {
+        if( exponent < -10 ) {
+            return (uint16_t) sign;
+        }
+        mantissa |= 0x800000;
+        int shift = 14 - exponent;
+        return (uint16_t)( sign | ( ( mantissa + ( 1u << ( shift - 1 ) ) ) >> shift ) );
+    }
+    return (uint16_t)( sign | ( ( ( exponent << 10 ) | ( mantissa >> 13 ) ) + ( ( mantissa >> 12 ) & 1 ) ) );
+}
+
+
+// An HDR desktop made from a corpus image: SDR content at a white level of 2.5 (200 nits), with the right half as
+// bright as 10 times that, and a sprinkling of out of gamut (negative) values
+static struct HdrBuffer makeHdrImage( int format, int size ) {
+    struct PixelBuffer const* image = corpusImage( CORPUS_MIXED, size );
+    struct HdrBuffer hdr = { NULL, image->width, image->height, 0, (enum HdrFormat) format };
+    if( format == HDR_FORMAT_RGB10A2 ) {
+        hdr.stride = image->width * 4;
+        uint32_t* pixels = (uint32_t*) malloc( (size_t) hdr.stride * image->height );
+        for( int y = 0; y < image->height; ++y ) {
+            for( int x = 0; x < image->width; ++x ) {
+                uint32_t p = pixelRow( image, y )[ x ];
+                uint32_t r = ( p >> 16 ) & 0xff;
+                uint32_t g = ( p >> 8 ) & 0xff;
+                uint32_t b = p & 0xff;
+                pixels[ y * image->width + x ] = 0xc0000000 | ( ( b * 4 + ( x & 3 ) ) << 20 ) |
+                    ( ( g * 4 + ( y & 3 ) ) << 10 ) | ( r * 4 );
+            }
+        }
+        hdr.pixels = pixels;
+        return hdr;
+    }
+    float linear[ 256 ];
+    for( int i = 0; i < 256; ++i ) {
+        float v = i / 255.0f;
+        linear[ i ] = v <= 0.04045f ? v / 12.92f : powf( ( v + 0.055f ) / 1.055f, 2.4f );
+    }
+    hdr.stride = image->width * 8;
+    uint16_t* pixels = (uint16_t*) malloc( (size_t) hdr.stride * image->height );
+    for( int y = 0; y < image->height; ++y ) {
+        for( int x = 0; x < image->width; ++x ) {
+            uint32_t p = pixelRow( image, y )[ x ];
+            float gain = 2.5f * ( x < image->width / 2 ? 1.0f : 1.0f + 9.0f * y / image->height );
+            uint16_t* out = pixels + ( (size_t) y * image->width + x ) * 4;
+            out[ 0 ] = floatToHalf( linear[ ( p >> 16 ) & 0xff ] * gain );
+            out[ 1 ] = floatToHalf( linear[ ( p >> 8 ) & 0xff ] * gain );
+            out[ 2 ] = floatToHalf( ( x * 7 + y * 3 ) % 101 == 0 ? -0.05f : linear[ p & 0xff ] * gain );
+            out[ 3 ] = floatToHalf( 1.0f );
+        }
+    }
+    hdr.pixels = pixels;
+    return hdr;
+}
+
+
+// Tone mapping a whole HDR capture to 8 bits (range( 2 ) = 0) or 16 bits per channel. Reports the largest difference
+// from `toneMapReference`, in units of the output
+static void benchToneMap( benchmark::State& state ) {
+    int format = (int) state.range( 0 );
+    int size = (int) state.range( 1 );
+    int wideOutput = (int) state.range( 2 );
+    struct HdrBuffer hdr = makeHdrImage( format, size );
+    struct PixelBuffer pixels = { (uint32_t*) malloc( sizeof( uint32_t ) * hdr.width * hdr.height ), hdr.width,
+        hdr.height, hdr.width };
+    struct WidePixelBuffer wide = { (uint16_t*) malloc( sizeof( uint16_t ) * 4 * hdr.width * hdr.height ), hdr.width,
+        hdr.height, hdr.width };
+    initToneMap();
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        if( wideOutput ) {
+            toneMapToWidePixels( &hdr, 2.5f, &wide );
+        } else {
+            toneMapToPixels( &hdr, 2.5f, &pixels );
+        }
+    }
+    state.SetBytesProcessed( (int64_t) state.iterations() * hdr.stride * hdr.height );
+    reportFrameTime( state );
+    reportAllocations( state, allocations );
+
+    if( format == HDR_FORMAT_RGBA16F ) {
+        int maxError = 0;
+        for( int y = 0; y < hdr.height; y += 7 ) {
+            for( int x = 0; x < hdr.width; ++x ) {
+                uint16_t reference[ 3 ];
+                toneMapReference( hdrRow16( &hdr, y ) + x * 4, 2.5f, reference );
+                for( int i = 0; i < 3; ++i ) {
+                    int error = wideOutput ? abs( widePixelRow( &wide, y )[ x * 4 + i ] - reference[ i ] ) :
+                        abs( (int)( ( pixelRow( &pixels, y )[ x ] >> ( 16 - i * 8 ) ) & 0xff ) -
+                            (int)( reference[ i ] / 257.0f + 0.5f ) );
+                    maxError = error > maxError ? error : maxError;
+                }
+            }
+        }
+        state.counters[ "max_err" ] = maxError;
+    }
+    char label[ 64 ];
+    snprintf( label, sizeof( label ), "%s to %d-bit %s", format == HDR_FORMAT_RGBA16F ? "fp16" : "10-bit",
+        wideOutput ? 16 : 8, corpusSizes[ size ].name );
+    state.SetLabel( label );
+    free( (void*) hdr.pixels );
+    free( pixels.pixels );
+    free( wide.pixels );
+}
+BENCHMARK( benchToneMap )->ArgsProduct( { { HDR_FORMAT_RGB10A2, HDR_FORMAT_RGBA16F }, { 0, 2 }, { 0, 1 } } )
+    ->Unit( benchmark::kMillisecond );
+
+
+// Allocates and touches a bitmap-sized block, counting it in `telemetry`
+static uint32_t* allocateTrackedBitmap( struct Telemetry* telemetry, int width, int height ) {
+    size_t bytes = sizeof( uint32_t ) * width * height;
+    uint32_t* pixels = (uint32_t*) malloc( bytes );
+    memset( pixels, 0x80, bytes );
+    trackBitmapBytes( telemetry, (int64_t) bytes );
+    return pixels;
+}
+
+
+static void freeTrackedBitmap( struct Telemetry* telemetry, uint32_t* pixels, int width, int height ) {
+    trackBitmapBytes( telemetry, -(int64_t)( sizeof( uint32_t ) * width * height ) );
+    free( pixels );
+}
+
+
+// The phases of taking a snippet, with the memory the tool allocates in each, for `range( 0 )` displays of corpus
+// size `range( 1 )`. Selecting holds a copy of the whole desktop and a backbuffer per display; grabbing keeps one
+// display; annotating adds a backbuffer and a view of the same size; saving encodes the snippet to PNG. Reports the
+// most private memory and bitmap memory seen while selecting as read by the telemetry, the heap high-water mark seen
+// by the allocation hooks over the same phase for comparison, and the file descriptors left open at the end
+static void benchTelemetryPhases( benchmark::State& state ) {
+    int displays = (int) state.range( 0 );
+    int size = (int) state.range( 1 );
+    int w = corpusSizes[ size ].width;
+    int h = corpusSizes[ size ].height;
+    struct Telemetry* telemetry = (struct Telemetry*) malloc( sizeof( struct Telemetry ) );
+    uint32_t* backbuffers[ 8 ];
+    struct ByteBuffer png = {};
+    int64_t heapPeak = 0;
+    for( auto _ : state ) {
+        initTelemetry( telemetry );
+        benchTakePeakHeapBytes();
+        int64_t heapStart = benchHeapBytes();
+        uint32_t* desktop = allocateTrackedBitmap( telemetry, w * displays, h );
+        for( int i = 0; i < displays; ++i ) {
+            backbuffers[ i ] = allocateTrackedBitmap( telemetry, w, h );
+        }
+        sampleTelemetry( telemetry );
+        for( int i = 0; i < displays; ++i ) {
+            freeTrackedBitmap( telemetry, backbuffers[ i ], w, h );
+        }
+        heapPeak = benchTakePeakHeapBytes() - heapStart;
+        endTelemetryPhase( telemetry, "select" );
+
+        struct PixelBuffer snippet = { allocateTrackedBitmap( telemetry, w, h ), w, h, w };
+        memcpy( snippet.pixels, corpusImage( CORPUS_UI, size )->pixels, sizeof( uint32_t ) * w * h );
+        freeTrackedBitmap( telemetry, desktop, w * displays, h );
+        endTelemetryPhase( telemetry, "grab" );
+
+        uint32_t* backbuffer = allocateTrackedBitmap( telemetry, w, h );
+        uint32_t* view = allocateTrackedBitmap( telemetry, w, h );
+        sampleTelemetry( telemetry );
+        freeTrackedBitmap( telemetry, view, w, h );
+        freeTrackedBitmap( telemetry, backbuffer, w, h );
+        endTelemetryPhase( telemetry, "annotate" );
+
+        png.size = 0;
+        encodePng( &snippet, 1, 0, &png );
+        endTelemetryPhase( telemetry, "save" );
+
+        freeTrackedBitmap( telemetry, snippet.pixels, w, h );
+        endTelemetryPhase( telemetry, "cleanup" );
+    }
+    struct TelemetryPhase const* select = &telemetry->phases[ 0 ];
+    struct TelemetryPhase const* cleanup = &telemetry->phases[ telemetry->phaseCount - 1 ];
+    state.counters[ "select_mb" ] = select->peak.privateBytes / 1048576.0;
+    state.counters[ "select_bitmap_mb" ] = select->peak.bitmapBytes / 1048576.0;
+    state.counters[ "select_heap_mb" ] = heapPeak / 1048576.0;
+    state.counters[ "open_fds" ] = (double) cleanup->end.handles - (double) telemetry->phases[ 0 ].end.handles;
+    char label[ 64 ];
+    snprintf( label, sizeof( label ), "%d x %s", displays, corpusSizes[ size ].name );
+    state.SetLabel( label );
+
+    // Also check that the summary comes out whole
+    struct ByteBuffer json = {};
+    writeTelemetryJson( telemetry, &json );
+    if( json.failed || json.size == 0 || json.data[ json.size - 2 ] != '}' ) {
+        state.SkipWithError( "Telemetry summary is incomplete" );
+    }
+    releaseByteBuffer( &json );
+    releaseByteBuffer( &png );
+    free( telemetry );
+}
+BENCHMARK( benchTelemetryPhases )->ArgsProduct( { { 1, 4 }, { 0, 2 } } )->Unit( benchmark::kMillisecond );
+
+
+// Cost of reading the process usage, done at the end of each phase and wherever a phase samples its peak
+static void benchTelemetrySample( benchmark::State& state ) {
+    struct Telemetry* telemetry = (struct Telemetry*) malloc( sizeof( struct Telemetry ) );
+    initTelemetry( telemetry );
+    for( auto _ : state ) {
+        sampleTelemetry( telemetry );
+    }
+    benchmark::DoNotOptimize( telemetry->peak.privateBytes );
+    free( telemetry );
+}
+BENCHMARK( benchTelemetrySample );
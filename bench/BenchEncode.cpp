@@ -0,0 +1,556 @@
+// Benchmarks for saving a snippet: the image codecs, cropping and trimming, reading the SnippingTool's DIB, the smaller
+// sizes saved with --multi-res, the annotation sidecars, the encode cache index, and writing the output file.
+#include "Bench.h"
+
+
+// Reports the encoded size as a fraction of the 24-bit pixel data
+static void reportRatio( benchmark::State& state, struct PixelBuffer const* image, size_t size ) {
+    state.counters[ "ratio" ] = (double) size / ( 3.0 * image->width * image->height );
+}
+
+
+// PNG at each level, single threaded, by corpus kind
+static void benchPngLevel( benchmark::State& state ) {
+    int kind = (int) state.range( 0 );
+    int level = (int) state.range( 1 );
+    struct PixelBuffer const* image = corpusImage( kind, 0 );
+    struct ByteBuffer out = {};
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        out.size = 0;
+        encodePng( image, level, 1, &out );
+    }
+    state.SetBytesProcessed( (int64_t) state.iterations() * image->width * image->height * 4 );
+    reportFrameTime( state );
+    reportAllocations( state, allocations );
+    reportRatio( state, image, out.size );
+    setCorpusLabel( state, kind, 0 );
+    releaseByteBuffer( &out );
+}
+BENCHMARK( benchPngLevel )->ArgsProduct( { benchmark::CreateDenseRange( 0, CORPUS_KIND_COUNT - 1, 1 ),
+    benchmark::CreateDenseRange( 0, PNG_LEVEL_COUNT - 1, 1 ) } )->Unit( benchmark::kMillisecond );
+
+
+// PNG at the default level, with range( 1 ) strips encoded in parallel
+static void benchPngThreads( benchmark::State& state ) {
+    int size = (int) state.range( 0 );
+    struct PixelBuffer const* image = corpusImage( CORPUS_MIXED, size );
+    struct ByteBuffer out = {};
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        out.size = 0;
+        encodePng( image, 2, (int) state.range( 1 ), &out );
+    }
+    state.SetBytesProcessed( (int64_t) state.iterations() * image->width * image->height * 4 );
+    reportFrameTime( state );
+    reportAllocations( state, allocations );
+    reportRatio( state, image, out.size );
+    setCorpusLabel( state, CORPUS_MIXED, size );
+    releaseByteBuffer( &out );
+}
+BENCHMARK( benchPngThreads )->ArgsProduct( { { 0, 2 }, { 1, 4 } } )->UseRealTime()->Unit( benchmark::kMillisecond );
+
+
+// 16-bit PNG of a corpus image widened to 16 bits per channel, with the low bits filled in as tone mapping would
+static void benchPng16( benchmark::State& state ) {
+    int size = (int) state.range( 0 );
+    struct PixelBuffer const* image = corpusImage( CORPUS_MIXED, size );
+    struct WidePixelBuffer wide = { (uint16_t*) malloc( sizeof( uint16_t ) * 4 * image->width * image->height ),
+        image->width, image->height, image->width };
+    for( int y = 0; y < image->height; ++y ) {
+        uint16_t* row = widePixelRow( &wide, y );
+        for( int x = 0; x < image->width; ++x ) {
+            uint32_t p = pixelRow( image, y )[ x ];
+            for( int i = 0; i < 3; ++i ) {
+                row[ x * 4 + i ] = (uint16_t)( ( ( p >> ( 16 - i * 8 ) ) & 0xff ) * 257 + ( ( x + y * 3 + i ) & 63 ) );
+            }
+            row[ x * 4 + 3 ] = 0xffff;
+        }
+    }
+    struct ByteBuffer out = {};
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        out.size = 0;
+        encodePng16( &wide, 2, (int) state.range( 1 ), &out );
+    }
+    state.SetBytesProcessed( (int64_t) state.iterations() * image->width * image->height * 8 );
+    reportFrameTime( state );
+    reportAllocations( state, allocations );
+    state.counters[ "ratio" ] = (double) out.size / ( 6.0 * image->width * image->height );
+    setCorpusLabel( state, CORPUS_MIXED, size );
+    releaseByteBuffer( &out );
+    free( wide.pixels );
+}
+BENCHMARK( benchPng16 )->ArgsProduct( { { 0, 2 }, { 1, 4 } } )->UseRealTime()->Unit( benchmark::kMillisecond );
+
+
+// PNG within a latency budget of range( 1 ) milliseconds. Compare `frame_ms` with the budget
+static void benchPngBudgeted( benchmark::State& state ) {
+    int kind = (int) state.range( 0 );
+    struct PixelBuffer const* image = corpusImage( kind, 0 );
+    struct ByteBuffer out = {};
+    int level = -1;
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        out.size = 0;
+        level = encodePngBudgeted( image, (double) state.range( 1 ), &out );
+    }
+    state.SetBytesProcessed( (int64_t) state.iterations() * image->width * image->height * 4 );
+    reportFrameTime( state );
+    reportAllocations( state, allocations );
+    reportRatio( state, image, out.size );
+    state.counters[ "level" ] = level;
+    setCorpusLabel( state, kind, 0 );
+    releaseByteBuffer( &out );
+}
+BENCHMARK( benchPngBudgeted )->ArgsProduct( { { CORPUS_TEXT, CORPUS_PHOTO, CORPUS_MIXED }, { 50, 250 } } )
+    ->UseRealTime()->Unit( benchmark::kMillisecond );
+
+
+// Encoding with each entry of `imageCodecs` that isn't PNG, covered above
+static void benchCodecEncode( benchmark::State& state ) {
+    struct ImageCodec const* codec = &imageCodecs[ state.range( 0 ) ];
+    int kind = (int) state.range( 1 );
+    int size = (int) state.range( 2 );
+    struct PixelBuffer const* image = corpusImage( kind, size );
+    struct ByteBuffer out = {};
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        out.size = 0;
+        codec->encode( image, 0.0, &out );
+    }
+    state.SetBytesProcessed( (int64_t) state.iterations() * image->width * image->height * 4 );
+    reportFrameTime( state );
+    reportAllocations( state, allocations );
+    reportRatio( state, image, out.size );
+    char label[ 64 ];
+    snprintf( label, sizeof( label ), "%ls %s %s", codec->name, corpusKindNames[ kind ], corpusSizes[ size ].name );
+    state.SetLabel( label );
+    releaseByteBuffer( &out );
+}
+BENCHMARK( benchCodecEncode )->ArgsProduct( { { 1, 2 }, { CORPUS_TEXT, CORPUS_UI, CORPUS_PHOTO }, { 0, 2 } } );
+
+
+static void benchCodecDecode( benchmark::State& state ) {
+    struct ImageCodec const* codec = &imageCodecs[ state.range( 0 ) ];
+    int kind = (int) state.range( 1 );
+    struct PixelBuffer const* image = corpusImage( kind, 0 );
+    struct ByteBuffer encoded = {};
+    codec->encode( image, 0.0, &encoded );
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        struct PixelBuffer decoded;
+        codec->decode( encoded.data, encoded.size, &decoded );
+        benchmark::DoNotOptimize( decoded.pixels );
+        free( decoded.pixels );
+    }
+    state.SetBytesProcessed( (int64_t) state.iterations() * image->width * image->height * 4 );
+    reportFrameTime( state );
+    reportAllocations( state, allocations );
+    char label[ 64 ];
+    snprintf( label, sizeof( label ), "%ls %s", codec->name, corpusKindNames[ kind ] );
+    state.SetLabel( label );
+    releaseByteBuffer( &encoded );
+}
+BENCHMARK( benchCodecDecode )->ArgsProduct( { { 1, 2 }, { CORPUS_TEXT, CORPUS_PHOTO } } );
+
+
+// Finding the borders to trim off a corpus image placed in the middle of a flat background, a tenth of its size on
+// each side, as when too much of a desktop was selected. `kept` is the fraction of the padded image left after trimming
+static void benchAutoTrim( benchmark::State& state ) {
+    int kind = (int) state.range( 0 );
+    int size = (int) state.range( 1 );
+    struct PixelBuffer const* image = corpusImage( kind, size );
+    int border = image->width / 10;
+    struct PixelBuffer padded = { NULL, image->width + border * 2, image->height + border * 2, 
+        image->width + border * 2 };
+    padded.pixels = (uint32_t*) malloc( sizeof( uint32_t ) * padded.stride * padded.height );
+    for( int i = 0; i < padded.stride * padded.height; ++i ) {
+        padded.pixels[ i ] = 0xff3c3c3c;
+    }
+    for( int y = 0; y < image->height; ++y ) {
+        memcpy( pixelRow( &padded, y + border ) + border, pixelRow( image, y ), sizeof( uint32_t ) * image->width );
+    }
+    struct PixelRect trim = {};
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        trim = findTrimRect( &padded, TRIM_TOLERANCE );
+        benchmark::DoNotOptimize( trim );
+    }
+    state.SetBytesProcessed( (int64_t) state.iterations() * padded.width * padded.height * 4 );
+    reportFrameTime( state );
+    reportAllocations( state, allocations );
+    state.counters[ "kept" ] = (double)( trim.right - trim.left ) * ( trim.bottom - trim.top ) / 
+        ( (double) padded.width * padded.height );
+    setCorpusLabel( state, kind, size );
+    free( padded.pixels );
+}
+BENCHMARK( benchAutoTrim )->ArgsProduct( { { CORPUS_TEXT, CORPUS_UI, CORPUS_PHOTO }, { 0, 2 } } );
+
+
+// PNG of the middle quarter of an image, read through a cropped view. `peak_heap_mb` is the most heap the encoder used
+// beyond its output, to compare with `crop_mb`, the size of a copy of the cropped pixels it doesn't make
+static void benchCroppedPng( benchmark::State& state ) {
+    int size = (int) state.range( 0 );
+    struct PixelBuffer const* image = corpusImage( CORPUS_MIXED, size );
+    struct PixelRect middle = { image->width / 4, image->height / 4, image->width * 3 / 4, image->height * 3 / 4 };
+    struct PixelBuffer crop = cropPixelBuffer( image, middle );
+    struct ByteBuffer out = {};
+    encodePng( &crop, 2, 1, &out ); // Leaves the output buffer large enough, so only the encoder allocates below
+    int64_t heapPeak = 0;
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        out.size = 0;
+        benchTakePeakHeapBytes();
+        int64_t heapStart = benchHeapBytes();
+        encodePng( &crop, 2, 1, &out );
+        heapPeak = benchTakePeakHeapBytes() - heapStart;
+    }
+    state.SetBytesProcessed( (int64_t) state.iterations() * crop.width * crop.height * 4 );
+    reportFrameTime( state );
+    reportAllocations( state, allocations );
+    reportRatio( state, &crop, out.size );
+    state.counters[ "peak_heap_mb" ] = heapPeak / 1048576.0;
+    state.counters[ "crop_mb" ] = crop.width * crop.height * 4 / 1048576.0;
+    setCorpusLabel( state, CORPUS_MIXED, size );
+    releaseByteBuffer( &out );
+}
+BENCHMARK( benchCroppedPng )->Arg( 0 )->Arg( 2 )->Unit( benchmark::kMillisecond );
+
+
+enum DibFixture {
+    DIB_FIXTURE_BGRX, // What screenshots come as: V5 header, 32-bit BI_RGB, bottom-up
+    DIB_FIXTURE_BGR, // Info header, 24-bit, bottom-up
+    DIB_FIXTURE_RGBA, // V5 header, 32-bit BI_BITFIELDS in RGBA order, top-down
+};
+
+
+// Packs a corpus image as a DIB the way it is found on the clipboard
+static void makeDibFixture( struct PixelBuffer const* image, int fixture, struct ByteBuffer* out ) {
+    int bitCount = fixture == DIB_FIXTURE_BGR ? 24 : 32;
+    uint32_t headerSize = (uint32_t)( fixture == DIB_FIXTURE_BGR ? DIB_INFO_HEADER_SIZE : DIB_V5_HEADER_SIZE );
+    size_t rowBytes = ( ( (size_t) image->width * bitCount + 31 ) / 32 ) * 4;
+    out->size = 0;
+    appendUint32( out, headerSize );
+    appendUint32( out, (uint32_t) image->width );
+    appendUint32( out, (uint32_t)( fixture == DIB_FIXTURE_RGBA ? -image->height : image->height ) );
+    appendUint32( out, 1 | ( bitCount << 16 ) ); // Planes and bit count
+    appendUint32( out, fixture == DIB_FIXTURE_RGBA ? DIB_BITFIELDS : DIB_RGB );
+    appendUint32( out, (uint32_t)( rowBytes * image->height ) );
+    for( int i = 0; i < 4; ++i ) {
+        appendUint32( out, 0 ); // Resolution and colors
+    }
+    uint32_t masks[ 4 ] = { 0x000000ff, 0x0000ff00, 0x00ff0000, 0xff000000 };
+    while( out->size < headerSize ) {
+        appendUint32( out, fixture == DIB_FIXTURE_RGBA && out->size < 56 ? masks[ ( out->size - 40 ) / 4 ] : 0 );
+    }
+    uint8_t* row = (uint8_t*) calloc( 1, rowBytes );
+    for( int i = 0; i < image->height; ++i ) {
+        uint32_t const* in = pixelRow( image, fixture == DIB_FIXTURE_RGBA ? i : image->height - 1 - i );
+        for( int x = 0; x < image->width; ++x ) {
+            if( fixture == DIB_FIXTURE_BGR ) {
+                memcpy( row + x * 3, &in[ x ], 3 );
+            } else {
+                uint32_t c = fixture == DIB_FIXTURE_RGBA ? ( in[ x ] & 0xff00ff00 ) | ( ( in[ x ] >> 16 ) & 0xff ) | 
+                    ( ( in[ x ] & 0xff ) << 16 ) : in[ x ];
+                memcpy( row + x * 4, &c, 4 );
+            }
+        }
+        appendBytes( out, row, rowBytes );
+    }
+    free( row );
+}
+
+
+// Getting the pixels of a snippet from the clipboard: parsing the DIB, and either viewing its rows in place or
+// converting them. `copied` is one if the rows were converted into a new buffer
+static void benchDibPixels( benchmark::State& state ) {
+    int fixture = (int) state.range( 0 );
+    int size = (int) state.range( 1 );
+    struct PixelBuffer const* image = corpusImage( CORPUS_MIXED, size );
+    struct ByteBuffer dib = {};
+    makeDibFixture( image, fixture, &dib );
+    int copied = 0;
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        struct DibImage parsed;
+        struct PixelBuffer pixels;
+        uint32_t* converted = NULL;
+        if( !parseDib( dib.data, dib.size, &parsed ) || !dibPixels( &parsed, &pixels, &converted ) ) {
+            state.SkipWithError( "DIB fixture rejected" );
+            break;
+        }
+        benchmark::DoNotOptimize( pixelRow( &pixels, pixels.height - 1 )[ pixels.width - 1 ] );
+        copied = converted != NULL;
+        free( converted );
+    }
+    state.SetBytesProcessed( (int64_t) state.iterations() * image->width * image->height * 4 );
+    reportFrameTime( state );
+    reportAllocations( state, allocations );
+    state.counters[ "copied" ] = copied;
+    setCorpusLabel( state, CORPUS_MIXED, size );
+    releaseByteBuffer( &dib );
+}
+BENCHMARK( benchDibPixels )->ArgsProduct( { { DIB_FIXTURE_BGRX, DIB_FIXTURE_BGR, DIB_FIXTURE_RGBA }, { 0, 2 } } );
+
+
+// Parsing damaged DIBs: a small fixture with one byte of its header set to a random value, or cut short at a random
+// length. `rejected` is the fraction parseDib turned down; the rest were still valid, and are checked to stay in bounds
+static void benchDibDamaged( benchmark::State& state ) {
+    struct PixelBuffer const* image = corpusImage( CORPUS_UI, 0 );
+    struct PixelRect corner = { 0, 0, 64, 48 };
+    struct PixelBuffer small = cropPixelBuffer( image, corner );
+    struct ByteBuffer fixtures[ 3 ] = {};
+    for( int i = 0; i < 3; ++i ) {
+        makeDibFixture( &small, i, &fixtures[ i ] );
+    }
+    uint8_t* damaged = (uint8_t*) malloc( fixtures[ 0 ].size + 64 );
+    uint32_t random = 12345;
+    uint64_t parsed = 0, rejected = 0;
+    for( auto _ : state ) {
+        random = random * 1664525u + 1013904223u;
+        struct ByteBuffer const* fixture = &fixtures[ parsed % 3 ];
+        size_t size = fixture->size;
+        memcpy( damaged, fixture->data, size );
+        if( random & 0x80000000u ) {
+            damaged[ ( random >> 8 ) % 160 % size ] = (uint8_t) random;
+        } else {
+            size = ( random >> 8 ) % size;
+        }
+        struct DibImage dib;
+        ++parsed;
+        if( !parseDib( damaged, size, &dib ) ) {
+            ++rejected;
+        } else if( dib.bits < damaged || dib.bits + dib.rowBytes * dib.height > damaged + size ) {
+            state.SkipWithError( "DIB rows out of bounds" );
+            break;
+        }
+    }
+    state.counters[ "rejected" ] = parsed ? (double) rejected / parsed : 0.0;
+    free( damaged );
+    for( int i = 0; i < 3; ++i ) {
+        releaseByteBuffer( &fixtures[ i ] );
+    }
+}
+BENCHMARK( benchDibDamaged );
+
+
+// The sizes saved with --multi-res for a snippet from a display at 150%
+static void multiResOutputs( struct PixelBuffer const* image, struct ImageCodec const* codec,
+    struct ResolutionOutput* outputs ) {
+
+    memset( outputs, 0, sizeof( struct ResolutionOutput ) * 3 );
+    outputs[ 0 ].width = image->width;
+    outputs[ 0 ].height = image->height;
+    outputs[ 1 ].width = (int)( image->width / 1.5f + 0.5f );
+    outputs[ 1 ].height = (int)( image->height / 1.5f + 0.5f );
+    thumbnailSize( image->width, image->height, &outputs[ 2 ].width, &outputs[ 2 ].height );
+    for( int i = 0; i < 3; ++i ) {
+        outputs[ i ].codec = codec;
+    }
+}
+
+
+// Only the resizing for --multi-res: from the pyramid (range( 1 ) = 1), or each size straight from the full image
+static void benchMultiResResize( benchmark::State& state ) {
+    int size = (int) state.range( 0 );
+    int pyramid = (int) state.range( 1 );
+    struct PixelBuffer const* image = corpusImage( CORPUS_MIXED, size );
+    struct ResolutionOutput outputs[ 3 ];
+    multiResOutputs( image, &imageCodecs[ 0 ], outputs );
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        struct Pyramid levels;
+        if( pyramid ) {
+            buildPyramid( &levels, image, outputs[ 2 ].width, outputs[ 2 ].height );
+        }
+        for( int i = 1; i < 3; ++i ) {
+            struct PixelBuffer resized = { (uint32_t*) malloc( sizeof( uint32_t ) * outputs[ i ].width *
+                outputs[ i ].height ), outputs[ i ].width, outputs[ i ].height, outputs[ i ].width };
+            if( pyramid ) {
+                free( resized.pixels );
+                resizeFromPyramid( &levels, outputs[ i ].width, outputs[ i ].height, &resized );
+            } else {
+                resamplePixels( image, &resized );
+            }
+            benchmark::DoNotOptimize( resized.pixels[ 0 ] );
+            free( resized.pixels );
+        }
+        if( pyramid ) {
+            releasePyramid( &levels );
+        }
+    }
+    state.SetBytesProcessed( (int64_t) state.iterations() * image->width * image->height * 4 );
+    reportFrameTime( state );
+    reportAllocations( state, allocations );
+    char label[ 64 ];
+    snprintf( label, sizeof( label ), "%s %s", pyramid ? "pyramid" : "direct", corpusSizes[ size ].name );
+    state.SetLabel( label );
+}
+BENCHMARK( benchMultiResResize )->ArgsProduct( { { 0, 2 }, { 0, 1 } } )->Unit( benchmark::kMillisecond );
+
+
+// Resizing and encoding all the sizes of --multi-res: in one pass with `encodeResolutions` (range( 1 ) = 1), or in
+// separate passes, each resizing the full image and encoding in turn. range( 2 ) is the codec
+static void benchMultiResEncode( benchmark::State& state ) {
+    int size = (int) state.range( 0 );
+    int onePass = (int) state.range( 1 );
+    struct ImageCodec const* codec = &imageCodecs[ state.range( 2 ) ];
+    struct PixelBuffer const* image = corpusImage( CORPUS_MIXED, size );
+    struct ResolutionOutput outputs[ 3 ];
+    multiResOutputs( image, codec, outputs );
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        if( onePass ) {
+            encodeResolutions( image, outputs, 3, 0.0 );
+        } else {
+            codec->encode( image, 0.0, &outputs[ 0 ].encoded );
+            for( int i = 1; i < 3; ++i ) {
+                struct PixelBuffer resized = { (uint32_t*) malloc( sizeof( uint32_t ) * outputs[ i ].width *
+                    outputs[ i ].height ), outputs[ i ].width, outputs[ i ].height, outputs[ i ].width };
+                resamplePixels( image, &resized );
+                codec->encode( &resized, 0.0, &outputs[ i ].encoded );
+                free( resized.pixels );
+            }
+        }
+        for( int i = 0; i < 3; ++i ) {
+            outputs[ i ].encoded.size = 0;
+        }
+    }
+    state.SetBytesProcessed( (int64_t) state.iterations() * image->width * image->height * 4 );
+    reportFrameTime( state );
+    reportAllocations( state, allocations );
+    char label[ 64 ];
+    snprintf( label, sizeof( label ), "%s %ls %s", onePass ? "one pass" : "separate", codec->name,
+        corpusSizes[ size ].name );
+    state.SetLabel( label );
+    for( int i = 0; i < 3; ++i ) {
+        releaseByteBuffer( &outputs[ i ].encoded );
+    }
+}
+BENCHMARK( benchMultiResEncode )->ArgsProduct( { { 0, 2 }, { 0, 1 }, { 0, 1 } } )->UseRealTime()
+    ->Unit( benchmark::kMillisecond );
+
+
+// A layer of range( 0 ) pen strokes of 64 points each, with a few shapes and labels mixed in
+static void fillVectorLayer( struct VectorLayer* layer, int count ) {
+    memset( layer, 0, sizeof( *layer ) );
+    layer->width = 1920;
+    layer->height = 1080;
+    float points[ 128 ];
+    for( int i = 0; i < count; ++i ) {
+        for( int j = 0; j < 64; ++j ) {
+            points[ j * 2 ] = 100.0f + ( i * 37 % 1700 ) + j * 1.5f;
+            points[ j * 2 + 1 ] = 100.0f + ( i * 23 % 900 ) + 20.0f * sinf( j * 0.3f );
+        }
+        if( i % 10 == 9 ) {
+            addVectorItem( layer, VECTOR_TEXT, i % 5, 0xffff0000, 3.0f, points, 2, "Look here" );
+        } else if( i % 10 == 8 ) {
+            addVectorItem( layer, VECTOR_ARROW, i % 5, 0xff00ff00, 3.0f, points, 2, NULL );
+        } else {
+            addVectorItem( layer, VECTOR_PEN, i % 5, 0xff0000ff, 3.0f, points, 64, NULL );
+        }
+    }
+}
+
+
+static void benchVectorSvg( benchmark::State& state ) {
+    struct VectorLayer layer;
+    fillVectorLayer( &layer, (int) state.range( 0 ) );
+    struct ByteBuffer out = {};
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        out.size = 0;
+        writeVectorSvg( &layer, &out );
+    }
+    state.SetBytesProcessed( (int64_t)( state.iterations() * out.size ) );
+    reportAllocations( state, allocations );
+    releaseByteBuffer( &out );
+    releaseVectorLayer( &layer );
+}
+BENCHMARK( benchVectorSvg )->Arg( 100 )->Arg( 2000 );
+
+
+static void benchVectorBinary( benchmark::State& state ) {
+    struct VectorLayer layer;
+    fillVectorLayer( &layer, (int) state.range( 0 ) );
+    struct ByteBuffer out = {};
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        out.size = 0;
+        writeVectorBinary( &layer, &out );
+    }
+    state.SetBytesProcessed( (int64_t)( state.iterations() * out.size ) );
+    reportAllocations( state, allocations );
+    releaseByteBuffer( &out );
+    releaseVectorLayer( &layer );
+}
+BENCHMARK( benchVectorBinary )->Arg( 100 )->Arg( 2000 );
+
+
+static void benchVectorRead( benchmark::State& state ) {
+    struct VectorLayer layer;
+    fillVectorLayer( &layer, (int) state.range( 0 ) );
+    struct ByteBuffer data = {};
+    writeVectorBinary( &layer, &data );
+    releaseVectorLayer( &layer );
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        readVectorBinary( data.data, data.size, &layer );
+        benchmark::DoNotOptimize( layer.count );
+        releaseVectorLayer( &layer );
+    }
+    state.SetBytesProcessed( (int64_t)( state.iterations() * data.size ) );
+    reportAllocations( state, allocations );
+    releaseByteBuffer( &data );
+}
+BENCHMARK( benchVectorRead )->Arg( 100 )->Arg( 2000 );
+
+
+// Looking up and inserting keys in an encode cache index holding range( 0 ) entries, a quarter of lookups missing
+static void benchEncodeCache( benchmark::State& state ) {
+    int count = (int) state.range( 0 );
+    struct EncodeCache cache;
+    initEncodeCache( &cache, (uint64_t) count * 1000000 );
+    for( int i = 0; i < count; ++i ) {
+        insertEncodeCache( &cache, hashBytes( &i, sizeof( i ), 1 ), 1000000, NULL, 0 );
+    }
+    uint64_t evicted[ 4 ];
+    int next = 0;
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        int probe = next++ % ( count + count / 3 );
+        uint64_t key = hashBytes( &probe, sizeof( probe ), 1 );
+        if( !lookupEncodeCache( &cache, key ) ) {
+            insertEncodeCache( &cache, key, 1000000, evicted, 4 );
+        }
+    }
+    reportAllocations( state, allocations );
+    releaseEncodeCache( &cache );
+}
+BENCHMARK( benchEncodeCache )->Arg( 256 )->Arg( 65536 );
+
+
+// Replacing an output file of the size of an encoded snippet, flushed to disk
+static void benchWriteFileAtomic( benchmark::State& state ) {
+    size_t size = (size_t) state.range( 0 ) << 20;
+    uint8_t* data = (uint8_t*) malloc( size );
+    for( size_t i = 0; i < size; ++i ) {
+        data[ i ] = (uint8_t)( i * 2654435761u >> 24 );
+    }
+    char filename[ 64 ];
+    snprintf( filename, sizeof( filename ), "/tmp/screensnippet_bench.%ld.png", (long) getpid() );
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        if( !writeFileAtomic( filename, data, size ) ) {
+            state.SkipWithError( "Could not write the file" );
+            break;
+        }
+    }
+    state.SetBytesProcessed( (int64_t)( state.iterations() * size ) );
+    reportFrameTime( state );
+    reportAllocations( state, allocations );
+    unlink( filename );
+    free( data );
+}
+BENCHMARK( benchWriteFileAtomic )->Arg( 1 )->Arg( 16 )->UseRealTime()->Unit( benchmark::kMillisecond );
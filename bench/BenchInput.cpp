@@ -0,0 +1,195 @@
+// Replays pointer traces through the input queue and predictor, as the annotation window would at 60 frames per
+// second, and reports how far the predicted stroke tip is from where the pointer really was when the frame showed.
+// Besides the built-in synthetic traces, a recorded one can be given in the file named by BENCH_INK_TRACE, with one
+// "time_ms x y" sample per line.
+#include "Bench.h"
+
+
+int const TRACE_SCRIBBLE = 0; // Handwriting-like loops at varying speed
+int const TRACE_FLICKS = 1; // Quick straight strokes, each ending in a stop
+int const TRACE_RECORDED = 2;
+double const TRACE_FRAME_MS = 1000.0 / 60.0;
+double const TRACE_LATENCY_MS = 8.0; // Same as `inkLatencyMs` in MakeAnnotations.h
+
+
+struct InkTrace {
+    int count;
+    struct InkSample* samples;
+};
+
+
+// The true pointer position of a synthetic trace at `t` milliseconds
+static void tracePosition( int kind, double t, float* x, float* y ) {
+    if( kind == TRACE_SCRIBBLE ) {
+        *x = (float)( 200.0 + 0.3 * t + 40.0 * sin( t * 0.012 ) );
+        *y = (float)( 500.0 + 80.0 * sin( t * 0.0071 ) + 30.0 * cos( t * 0.019 ) );
+    } else {
+        // 400 ms flicks with smoothstep speed, each followed by a 100 ms rest, in a different direction each time
+        int flick = (int)( t / 500.0 );
+        double u = ( t - flick * 500.0 ) / 400.0;
+        u = u < 1.0 ? u * u * ( 3.0 - 2.0 * u ) : 1.0;
+        double angle = flick * 2.4;
+        double fx = 960.0;
+        double fy = 540.0;
+        for( int i = 0; i < flick; ++i ) {
+            fx += 300.0 * cos( i * 2.4 );
+            fy += 300.0 * sin( i * 2.4 ) * 0.5;
+        }
+        *x = (float)( fx + 300.0 * cos( angle ) * u );
+        *y = (float)( fy + 300.0 * sin( angle ) * 0.5 * u );
+    }
+}
+
+
+// Samples a synthetic trace at `rate` Hz for three seconds, rounded to whole pixels like mouse positions
+static void makeTrace( int kind, int rate, struct InkTrace* trace ) {
+    trace->count = 3 * rate;
+    trace->samples = (struct InkSample*) malloc( sizeof( struct InkSample ) * trace->count );
+    for( int i = 0; i < trace->count; ++i ) {
+        double t = i * 1000.0 / rate;
+        float x;
+        float y;
+        tracePosition( kind, t, &x, &y );
+        struct InkSample sample = { floorf( x + 0.5f ), floorf( y + 0.5f ), t };
+        trace->samples[ i ] = sample;
+    }
+}
+
+
+static int loadTrace( char const* filename, struct InkTrace* trace ) {
+    trace->count = 0;
+    trace->samples = NULL;
+    FILE* file = fopen( filename, "r" );
+    if( !file ) {
+        return 0;
+    }
+    int capacity = 0;
+    struct InkSample sample;
+    while( fscanf( file, "%lf %f %f", &sample.time, &sample.x, &sample.y ) == 3 ) {
+        if( trace->count >= capacity ) {
+            capacity = capacity ? capacity * 2 : 1024;
+            trace->samples = (struct InkSample*) realloc( trace->samples, sizeof( struct InkSample ) * capacity );
+        }
+        trace->samples[ trace->count++ ] = sample;
+    }
+    fclose( file );
+    return trace->count > 1;
+}
+
+
+// Where the pointer really was at `t`. Synthetic traces know exactly; recorded ones are interpolated
+static void truePosition( int kind, struct InkTrace const* trace, double t, float* x, float* y ) {
+    if( kind != TRACE_RECORDED ) {
+        tracePosition( kind, t, x, y );
+        return;
+    }
+    int i = 1;
+    while( i < trace->count - 1 && trace->samples[ i ].time < t ) {
+        ++i;
+    }
+    struct InkSample const* a = &trace->samples[ i - 1 ];
+    struct InkSample const* b = &trace->samples[ i ];
+    double u = b->time > a->time ? ( t - a->time ) / ( b->time - a->time ) : 1.0;
+    u = u < 0.0 ? 0.0 : ( u > 1.0 ? 1.0 : u );
+    *x = (float)( a->x + ( b->x - a->x ) * u );
+    *y = (float)( a->y + ( b->y - a->y ) * u );
+}
+
+
+// Replays a whole trace: samples are queued as they arrive, and once per frame they are committed to a stroke and
+// the tip is predicted. `range( 0 )` is the trace, `range( 1 )` the mouse report rate for synthetic ones
+static void benchInkReplay( benchmark::State& state ) {
+    int kind = (int) state.range( 0 );
+    struct InkTrace trace = {};
+    if( kind == TRACE_RECORDED ) {
+        char const* filename = getenv( "BENCH_INK_TRACE" );
+        if( !filename || !loadTrace( filename, &trace ) ) {
+            state.SkipWithError( "Set BENCH_INK_TRACE to a trace file to replay" );
+            free( trace.samples );
+            return;
+        }
+    } else {
+        makeTrace( kind, (int) state.range( 1 ), &trace );
+    }
+    struct InkQueue* queue = (struct InkQueue*) malloc( sizeof( struct InkQueue ) );
+    struct InkPredictor predictor;
+    struct StrokePath path = {};
+    double predictedError = 0.0;
+    double heldError = 0.0;
+    int frames = 0;
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        queue->count = 0;
+        resetInkPredictor( &predictor );
+        clearStrokePath( &path );
+        predictedError = 0.0;
+        heldError = 0.0;
+        frames = 0;
+        double start = trace.samples[ 0 ].time;
+        double end = trace.samples[ trace.count - 1 ].time;
+        int next = 0;
+        for( double frame = start + TRACE_FRAME_MS; frame <= end; frame += TRACE_FRAME_MS ) {
+            while( next < trace.count && trace.samples[ next ].time <= frame ) {
+                queueInkSample( queue, trace.samples[ next ].x, trace.samples[ next ].y, trace.samples[ next ].time,
+                    0.0f );
+                ++next;
+            }
+            for( int i = 0; i < queue->count; ++i ) {
+                addInkSample( &predictor, queue->samples[ i ] );
+                float width = inkWidth( &predictor, 5.0f, path.pointCount > 0 ? path.widths[ path.pointCount - 1 ] : 0.0f );
+                addPathPoint( &path, queue->samples[ i ].x, queue->samples[ i ].y, width, 16 );
+            }
+            queue->count = 0;
+            if( predictor.count == 0 ) {
+                continue;
+            }
+
+            // Compare the tip that would be drawn, with and without prediction, to where the pointer is when shown
+            struct InkSample const* newest = newestInkSample( &predictor );
+            float x = newest->x;
+            float y = newest->y;
+            predictInk( &predictor, frame + TRACE_LATENCY_MS, &x, &y );
+            float tx;
+            float ty;
+            truePosition( kind, &trace, frame + TRACE_LATENCY_MS, &tx, &ty );
+            predictedError += sqrt( ( x - tx ) * ( x - tx ) + ( y - ty ) * ( y - ty ) );
+            heldError += sqrt( ( newest->x - tx ) * ( newest->x - tx ) + ( newest->y - ty ) * ( newest->y - ty ) );
+            ++frames;
+        }
+        benchmark::DoNotOptimize( path.vertexCount );
+    }
+    reportAllocations( state, allocations );
+    state.counters[ "samples" ] = trace.count;
+    state.counters[ "frames" ] = frames;
+    state.counters[ "err_px" ] = frames ? predictedError / frames : 0.0;
+    state.counters[ "held_err_px" ] = frames ? heldError / frames : 0.0;
+    static char const* const names[] = { "scribble", "flicks", "recorded" };
+    state.SetLabel( names[ kind ] );
+    releaseStrokePath( &path );
+    free( queue );
+    free( trace.samples );
+}
+BENCHMARK( benchInkReplay )->ArgsProduct( { { TRACE_SCRIBBLE, TRACE_FLICKS }, { 125, 1000 } } )
+    ->Args( { TRACE_RECORDED, 0 } );
+
+
+// Cost of a single prediction, made once per frame while drawing
+static void benchInkPredict( benchmark::State& state ) {
+    struct InkPredictor predictor;
+    resetInkPredictor( &predictor );
+    for( int i = 0; i < INK_HISTORY_SIZE; ++i ) {
+        float x;
+        float y;
+        tracePosition( TRACE_SCRIBBLE, i * 4.0, &x, &y );
+        struct InkSample sample = { x, y, i * 4.0 };
+        addInkSample( &predictor, sample );
+    }
+    double time = newestInkSample( &predictor )->time + TRACE_LATENCY_MS;
+    for( auto _ : state ) {
+        float x;
+        float y;
+        benchmark::DoNotOptimize( predictInk( &predictor, time, &x, &y ) );
+        benchmark::DoNotOptimize( x );
+    }
+}
+BENCHMARK( benchInkPredict );
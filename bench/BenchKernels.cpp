@@ -0,0 +1,156 @@
+// Benchmarks for the kernels bound at startup by instruction set level (CpuDispatch.h): each variant on a 4K row or a
+// long stroke, with range( 0 ) the level, and the self-test the tool runs with --self-test. Levels the processor
+// doesn't support are skipped.
+#include "Bench.h"
+
+
+// Picks the kernels for level range( 0 ), as `bindCpuKernels` would, without rebinding the ones the other benchmarks
+// use. Returns zero, skipping the benchmark, if the processor doesn't support the level
+static int benchKernels( benchmark::State& state, struct CpuKernels* kernels ) {
+    enum CpuIsa isa = (enum CpuIsa) state.range( 0 );
+    if( isa > cpuIsaDetected ) {
+        state.SkipWithError( "instruction set not supported" );
+        return 0;
+    }
+    selectCpuKernels( isa, kernels );
+    state.SetLabel( cpuIsaNames[ isa ] );
+    return 1;
+}
+
+
+// Setting a 4K row opaque, as the raw codec and the journal do
+static void benchKernelOpaqueRow( benchmark::State& state ) {
+    struct CpuKernels kernels;
+    if( !benchKernels( state, &kernels ) ) {
+        return;
+    }
+    struct PixelBuffer const* image = corpusImage( CORPUS_PHOTO, 2 );
+    uint32_t* out = (uint32_t*) malloc( sizeof( uint32_t ) * image->width );
+    for( auto _ : state ) {
+        kernels.opaqueRow( out, pixelRow( image, 0 ), image->width );
+        benchmark::DoNotOptimize( out[ 0 ] );
+    }
+    state.SetBytesProcessed( (int64_t) state.iterations() * image->width * 4 );
+    free( out );
+}
+BENCHMARK( benchKernelOpaqueRow )->DenseRange( CPU_ISA_SCALAR, CPU_ISA_AVX512 );
+
+
+// Sets up a 4K RGB row of a photo and the row above it, padded like `filterRows` does
+static uint8_t* benchFilterRows( int* size ) {
+    struct PixelBuffer const* image = corpusImage( CORPUS_PHOTO, 2 );
+    *size = image->width * 3;
+    uint8_t* rows = (uint8_t*) calloc( 3, 16 + *size );
+    pixelsToRgb( pixelRow( image, 0 ), image->width, rows + 16 );
+    pixelsToRgb( pixelRow( image, 1 ), image->width, rows + 16 * 2 + *size );
+    return rows;
+}
+
+
+// The Paeth filter, the slowest of the four, and picking between filters by cost
+static void benchKernelFilterRow( benchmark::State& state ) {
+    struct CpuKernels kernels;
+    if( !benchKernels( state, &kernels ) ) {
+        return;
+    }
+    int size;
+    uint8_t* rows = benchFilterRows( &size );
+    uint8_t* prior = rows + 16;
+    uint8_t* row = rows + 16 * 2 + size;
+    uint8_t* out = rows + 16 * 3 + size * 2;
+    for( auto _ : state ) {
+        kernels.filterRow( 4, row, prior, size, 3, out );
+        benchmark::DoNotOptimize( kernels.filterCost( out, size ) );
+    }
+    state.SetBytesProcessed( (int64_t) state.iterations() * size );
+    free( rows );
+}
+BENCHMARK( benchKernelFilterRow )->DenseRange( CPU_ISA_SCALAR, CPU_ISA_AVX512 );
+
+
+// Coverage of 64 pixels across a diagonal segment, at 4x supersampling
+static void benchKernelCoverSpan( benchmark::State& state ) {
+    struct CpuKernels kernels;
+    if( !benchKernels( state, &kernels ) ) {
+        return;
+    }
+    float row[ 64 ] = {};
+    struct SegmentCover segment = { 0.0f, 0.0f, 64.0f, 64.0f, 1.0f / ( 2 * 64.0f * 64.0f ), 8.0f, 0.0f, 4.0f,
+        1.0f / 16.0f, 4 };
+    int y = 0;
+    for( auto _ : state ) {
+        kernels.coverSpan( row, 0, 64, y, &segment );
+        y = ( y + 1 ) & 63;
+        benchmark::DoNotOptimize( row[ 0 ] );
+    }
+    state.SetItemsProcessed( (int64_t) state.iterations() * 64 );
+}
+BENCHMARK( benchKernelCoverSpan )->DenseRange( CPU_ISA_SCALAR, CPU_ISA_AVX512 );
+
+
+// Blending a semitransparent color over a 4K row which is half covered, like a highlighter stroke is
+static void benchKernelBlendSpan( benchmark::State& state ) {
+    struct CpuKernels kernels;
+    if( !benchKernels( state, &kernels ) ) {
+        return;
+    }
+    struct PixelBuffer const* image = corpusImage( CORPUS_PHOTO, 2 );
+    uint32_t* row = (uint32_t*) malloc( sizeof( uint32_t ) * image->width );
+    float* coverage = (float*) malloc( sizeof( float ) * image->width );
+    for( int x = 0; x < image->width; ++x ) {
+        coverage[ x ] = ( x / 64 ) & 1 ? 0.0f : ( x & 63 ) / 63.0f;
+    }
+    for( auto _ : state ) {
+        memcpy( row, pixelRow( image, 0 ), sizeof( uint32_t ) * image->width );
+        kernels.blendSpan( row, coverage, image->width, 0x80ffff00 );
+        benchmark::DoNotOptimize( row[ 0 ] );
+    }
+    state.SetBytesProcessed( (int64_t) state.iterations() * image->width * 4 );
+    free( coverage );
+    free( row );
+}
+BENCHMARK( benchKernelBlendSpan )->DenseRange( CPU_ISA_SCALAR, CPU_ISA_AVX512 );
+
+
+// Hit testing the outline of a long wavy stroke, about as many points as one of 1000 mouse points outlines to, at
+// random points around it
+static void benchKernelOutlineHit( benchmark::State& state ) {
+    struct CpuKernels kernels;
+    if( !benchKernels( state, &kernels ) ) {
+        return;
+    }
+    int const count = 2048;
+    float* points = (float*) malloc( sizeof( float ) * count * 2 );
+    for( int i = 0; i < count; ++i ) {
+        float angle = 6.2831853f * i / count;
+        float radius = 400.0f + 6.0f * sinf( angle * 100.0f ) + ( i < count / 2 ? 0.0f : -12.0f );
+        points[ i * 2 ] = 960.0f + radius * cosf( angle * 2.0f );
+        points[ i * 2 + 1 ] = 540.0f + radius * sinf( angle * 2.0f );
+    }
+    uint32_t probe = 1;
+    int hits = 0;
+    for( auto _ : state ) {
+        probe = probe * 1664525 + 1013904223;
+        float x = (float)( probe >> 8 & 2047 );
+        float y = (float)( probe >> 20 & 1023 );
+        hits += kernels.outlineHit( points, count, x, y, 36.0f );
+    }
+    state.counters[ "hit_rate" ] = state.iterations() ? (double) hits / state.iterations() : 0.0;
+    free( points );
+}
+BENCHMARK( benchKernelOutlineHit )->DenseRange( CPU_ISA_SCALAR, CPU_ISA_AVX512 );
+
+
+// Time to check every supported variant against the scalar kernels. `mismatches` must be zero
+static void benchKernelSelfTest( benchmark::State& state ) {
+    int mismatches = 0;
+    struct ByteBuffer report = {};
+    for( auto _ : state ) {
+        report.size = 0;
+        mismatches += selfTestCpuKernels( &report );
+    }
+    state.counters[ "mismatches" ] = benchmark::Counter( mismatches, benchmark::Counter::kAvgIterations );
+    state.SetLabel( cpuIsaNames[ cpuIsaDetected ] );
+    releaseByteBuffer( &report );
+}
+BENCHMARK( benchKernelSelfTest )->Unit( benchmark::kMillisecond );
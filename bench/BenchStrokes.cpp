@@ -0,0 +1,444 @@
+// Benchmarks for annotating: growing a pen stroke while the mouse moves, outlining variable width strokes, hit testing
+// for the eraser and selection, undo and redo, journaling edits and recovering them after a crash, and compositing
+// finished strokes into the snippet.
+#include "Bench.h"
+#include <signal.h>
+#include <sys/wait.h>
+
+
+// Mouse position of a scribble, a wandering curve like a hand-drawn circle around something
+static void scribblePoint( int index, float* x, float* y ) {
+    float angle = index * 0.05f;
+    *x = 960.0f + ( 400.0f + 60.0f * sinf( angle * 7.0f ) ) * cosf( angle );
+    *y = 540.0f + ( 300.0f + 40.0f * cosf( angle * 5.0f ) ) * sinf( angle );
+}
+
+
+// Cost of adding one mouse point to a stroke that already has range( 0 ) points, done incrementally
+static void benchAddPathPoint( benchmark::State& state ) {
+    int points = (int) state.range( 0 );
+    struct StrokePath path = {};
+    for( int i = 0; i < points; ++i ) {
+        float x, y;
+        scribblePoint( i, &x, &y );
+        addPathPoint( &path, x, y, 5.0f, 4 );
+    }
+    int index = points;
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        float x, y;
+        scribblePoint( index++, &x, &y );
+        addPathPoint( &path, x, y, 5.0f, 4 );
+        benchmark::DoNotOptimize( path.vertexCount );
+    }
+    reportAllocations( state, allocations );
+    releaseStrokePath( &path );
+}
+BENCHMARK( benchAddPathPoint )->Arg( 16 )->Arg( 256 )->Arg( 4096 );
+
+
+// The same, flattening the whole stroke again after each point, as was done before strokes grew incrementally
+static void benchReflattenPath( benchmark::State& state ) {
+    int points = (int) state.range( 0 );
+    struct StrokePath path = {};
+    for( int i = 0; i < points; ++i ) {
+        float x, y;
+        scribblePoint( i, &x, &y );
+        addPathPoint( &path, x, y, 5.0f, 4 );
+    }
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        reflattenPath( &path, 4 );
+        benchmark::DoNotOptimize( path.vertexCount );
+    }
+    reportAllocations( state, allocations );
+    releaseStrokePath( &path );
+}
+BENCHMARK( benchReflattenPath )->Arg( 16 )->Arg( 256 )->Arg( 4096 );
+
+
+// Hit testing a long stroke, at points spread over the snippet (mostly misses, as when moving the eraser)
+static void benchStrokeHit( benchmark::State& state ) {
+    struct StrokePath path = {};
+    for( int i = 0; i < (int) state.range( 0 ); ++i ) {
+        float x, y;
+        scribblePoint( i, &x, &y );
+        addPathPoint( &path, x, y, 5.0f, 4 );
+    }
+    uint32_t probe = 1;
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        probe = probe * 1664525 + 1013904223;
+        float x = (float)( probe >> 8 & 2047 );
+        float y = (float)( probe >> 20 & 1023 );
+        benchmark::DoNotOptimize( strokePathHit( &path, x, y, 6.0f ) );
+    }
+    reportAllocations( state, allocations );
+    releaseStrokePath( &path );
+}
+BENCHMARK( benchStrokeHit )->Arg( 256 )->Arg( 4096 );
+
+
+// A stroke of `points` points whose width swells and thins along its length, like a pen with changing pressure
+static void makeVariableStroke( struct StrokePath* path, int points ) {
+    for( int i = 0; i < points; ++i ) {
+        float x, y;
+        scribblePoint( i, &x, &y );
+        addPathPoint( path, x, y, 3.0f + 2.0f * sinf( i * 0.1f ), 4 );
+    }
+}
+
+
+// Outlining a whole stroke of range( 0 ) points from scratch, as if none of it had been outlined before
+static void benchStrokeOutline( benchmark::State& state ) {
+    struct StrokePath path = {};
+    makeVariableStroke( &path, (int) state.range( 0 ) );
+    struct StrokeOutline outline = {};
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        outline.vertexCount = 0;
+        updateStrokeOutline( &outline, &path );
+        benchmark::DoNotOptimize( outline.points );
+    }
+    state.SetItemsProcessed( (int64_t)( state.iterations() * path.vertexCount ) );
+    reportAllocations( state, allocations );
+    state.counters[ "vertices" ] = path.vertexCount;
+    state.counters[ "polygon" ] = outline.pointCount;
+    releaseStrokeOutline( &outline );
+    releaseStrokePath( &path );
+}
+BENCHMARK( benchStrokeOutline )->Arg( 256 )->Arg( 4096 )->Arg( 65536 );
+
+
+// Adding one point to a stroke of range( 0 ) points and bringing its outline up to date, as done for each point drawn
+static void benchStrokeOutlineGrow( benchmark::State& state ) {
+    int points = (int) state.range( 0 );
+    struct StrokePath path = {};
+    makeVariableStroke( &path, points );
+    struct StrokeOutline outline = {};
+    updateStrokeOutline( &outline, &path );
+    int index = points;
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        float x, y;
+        scribblePoint( index, &x, &y );
+        addPathPoint( &path, x, y, 3.0f + 2.0f * sinf( index * 0.1f ), 4 );
+        updateStrokeOutline( &outline, &path );
+        ++index;
+        benchmark::DoNotOptimize( outline.points );
+    }
+    reportAllocations( state, allocations );
+    releaseStrokeOutline( &outline );
+    releaseStrokePath( &path );
+}
+BENCHMARK( benchStrokeOutlineGrow )->Arg( 16 )->Arg( 256 )->Arg( 4096 );
+
+
+// Hit testing the outline of a long stroke, like `benchStrokeHit` does for the polyline
+static void benchStrokeOutlineHit( benchmark::State& state ) {
+    struct StrokePath path = {};
+    makeVariableStroke( &path, (int) state.range( 0 ) );
+    struct StrokeOutline outline = {};
+    updateStrokeOutline( &outline, &path );
+    uint32_t probe = 1;
+    int hits = 0;
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        probe = probe * 1664525 + 1013904223;
+        float x = (float)( probe >> 8 & 2047 );
+        float y = (float)( probe >> 20 & 1023 );
+        hits += strokeOutlineHit( &outline, x, y, 6.0f );
+    }
+    reportAllocations( state, allocations );
+    state.counters[ "hit_rate" ] = state.iterations() ? (double) hits / state.iterations() : 0.0;
+    releaseStrokeOutline( &outline );
+    releaseStrokePath( &path );
+}
+BENCHMARK( benchStrokeOutlineHit )->Arg( 256 )->Arg( 4096 );
+
+
+// Runs `count` random edits on `store`: adding strokes of 32 points, erasing and recoloring random strokes, and undoing
+// and redoing, in the proportions 4:2:1:2:1. Each is recorded in `journal` like the annotation window does, unless it
+// is NULL
+static void randomStrokeEdits( struct StrokeStore* store, int count, uint32_t* random, struct StrokeJournal* journal ) {
+    for( int i = 0; i < count; ++i ) {
+        *random = *random * 1664525 + 1013904223;
+        int op = ( *random >> 8 ) % 10;
+        int target = store->count ? (int)( ( *random >> 16 ) % store->count ) : -1;
+        if( op < 4 ) {
+            struct Stroke* stroke = addStroke( store, 0, op );
+            if( stroke ) {
+                journalAddStroke( journal, 0, op );
+                for( int j = 0; j < 32; ++j ) {
+                    float x, y;
+                    scribblePoint( i + j, &x, &y );
+                    addPathPoint( &stroke->path, x, y, 5.0f, 4 );
+                    journalStrokePoint( journal, x, y, 5.0f );
+                }
+                updateStrokeOutline( &stroke->outline, &stroke->path );
+            }
+        } else if( op < 6 && target >= 0 ) {
+            eraseStroke( store, target );
+            journalStrokeEdit( journal, JOURNAL_ERASE, target, 0 );
+        } else if( op < 7 && target >= 0 ) {
+            recolorStroke( store, target, ( *random >> 4 ) & 3 );
+            journalStrokeEdit( journal, JOURNAL_RECOLOR, target, ( *random >> 4 ) & 3 );
+        } else if( op < 9 ) {
+            undoStrokeEdit( store );
+            journalStrokeEdit( journal, JOURNAL_UNDO, 0, 0 );
+        } else {
+            redoStrokeEdit( store );
+            journalStrokeEdit( journal, JOURNAL_REDO, 0, 0 );
+        }
+    }
+}
+
+
+// Memory held by the stroke store after range( 0 ) random edits. Reports the heap bytes per stroke kept, which stays
+// the same however many edits were made, as no pixels are kept for undo, the bytes the edit log takes, and the heap
+// bytes left after releasing the store
+static void benchStrokeEdits( benchmark::State& state ) {
+    int count = (int) state.range( 0 );
+    int64_t held = 0;
+    int64_t leaked = 0;
+    int strokes = 0;
+    int logBytes = 0;
+    for( auto _ : state ) {
+        int64_t start = benchHeapBytes();
+        struct StrokeStore store = {};
+        uint32_t random = 1;
+        randomStrokeEdits( &store, count, &random, NULL );
+        held = benchHeapBytes() - start - (int64_t) sizeof( struct StrokeEdit ) * store.editCapacity;
+        strokes = store.count;
+        logBytes = (int) sizeof( struct StrokeEdit ) * store.editTotal;
+        releaseStrokeStore( &store );
+        leaked = benchHeapBytes() - start;
+    }
+    state.counters[ "strokes" ] = strokes;
+    state.counters[ "bytes_per_stroke" ] = strokes ? (double) held / strokes : 0.0;
+    state.counters[ "log_bytes" ] = logBytes;
+    state.counters[ "leaked" ] = (double) leaked;
+}
+BENCHMARK( benchStrokeEdits )->Arg( 1000 )->Arg( 10000 )->Unit( benchmark::kMillisecond );
+
+
+// Undoing and redoing an edit, with 10000 edits in the log. Each only flips one field of one stroke
+static void benchStrokeUndo( benchmark::State& state ) {
+    struct StrokeStore store = {};
+    uint32_t random = 1;
+    randomStrokeEdits( &store, 10000, &random, NULL );
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        benchmark::DoNotOptimize( undoStrokeEdit( &store ) );
+        benchmark::DoNotOptimize( redoStrokeEdit( &store ) );
+    }
+    reportAllocations( state, allocations );
+    releaseStrokeStore( &store );
+}
+BENCHMARK( benchStrokeUndo );
+
+
+static void journalBenchPath( char* path, size_t capacity ) {
+    snprintf( path, capacity, "/tmp/screensnippet_bench.%ld.journal", (long) getpid() );
+}
+
+
+// Cost of recording one point of a stroke in the journal, which the annotation window does for every point it adds.
+// Includes growing the mapping, every time it fills up
+static void benchJournalPoint( benchmark::State& state ) {
+    char path[ 64 ];
+    journalBenchPath( path, sizeof( path ) );
+    struct JournalHeader header = {};
+    struct StrokeJournal journal;
+    if( !openStrokeJournal( &journal, path, &header, NULL, 0 ) ) {
+        state.SkipWithError( "Could not create the journal" );
+        return;
+    }
+    int index = 0;
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        float x, y;
+        scribblePoint( index++, &x, &y );
+        journalStrokePoint( &journal, x, y, 5.0f );
+        if( journal.size >= ( 64u << 20 ) ) {
+            state.PauseTiming();
+            closeStrokeJournal( &journal, 0 );
+            openStrokeJournal( &journal, path, &header, NULL, 0 );
+            state.ResumeTiming();
+        }
+    }
+    reportAllocations( state, allocations );
+    state.counters[ "failed" ] = journal.failed;
+    closeStrokeJournal( &journal, 0 );
+}
+BENCHMARK( benchJournalPoint );
+
+
+// Resuming from a journal of range( 0 ) random edits: replaying it into an empty stroke store. `journal_kb` is its size
+static void benchJournalReplay( benchmark::State& state ) {
+    int count = (int) state.range( 0 );
+    char path[ 64 ];
+    journalBenchPath( path, sizeof( path ) );
+    struct JournalHeader header = {};
+    struct StrokeJournal journal;
+    if( !openStrokeJournal( &journal, path, &header, NULL, 0 ) ) {
+        state.SkipWithError( "Could not create the journal" );
+        return;
+    }
+    struct StrokeStore store = {};
+    uint32_t random = 1;
+    randomStrokeEdits( &store, count, &random, &journal );
+    releaseStrokeStore( &store );
+    for( auto _ : state ) {
+        replayStrokeJournal( journal.data, journal.size, &store, 4, 4, 0 );
+        benchmark::DoNotOptimize( store.count );
+        releaseStrokeStore( &store );
+    }
+    reportFrameTime( state );
+    state.counters[ "journal_kb" ] = journal.size / 1024.0;
+    closeStrokeJournal( &journal, 0 );
+}
+BENCHMARK( benchJournalReplay )->Arg( 1000 )->Arg( 10000 )->Unit( benchmark::kMillisecond );
+
+
+// A simulated crash: a child process makes a random number of random edits, journaling them, starts writing one more
+// record, and is killed with SIGKILL halfway through it. Times the crash and replaying the journal it leaves, which
+// tests/TestStrokeJournal.cpp checks gives the same strokes
+static void benchJournalCrash( benchmark::State& state ) {
+    char path[ 64 ];
+    journalBenchPath( path, sizeof( path ) );
+    uint32_t seed = 7;
+    for( auto _ : state ) {
+        seed = seed * 1664525 + 1013904223;
+        int count = 1 + (int)( ( seed >> 8 ) % 2000 );
+        pid_t child = fork();
+        if( child == 0 ) {
+            struct JournalHeader header = {};
+            struct StrokeJournal journal;
+            struct StrokeStore store = {};
+            uint32_t random = seed;
+            if( openStrokeJournal( &journal, path, &header, NULL, 0 ) ) {
+                randomStrokeEdits( &store, count, &random, &journal );
+                struct JournalRecord torn = { 0, 0, 0, 0, 0, 1.0f, 2.0f, 3.0f };
+                if( journal.size + JOURNAL_RECORD_SIZE <= journal.capacity ) {
+                    memcpy( journal.data + journal.size + 1, (uint8_t const*) &torn + 1, JOURNAL_RECORD_SIZE - 1 );
+                }
+                kill( getpid(), SIGKILL );
+            }
+            _exit( 1 );
+        }
+        int status = 0;
+        waitpid( child, &status, 0 );
+
+        struct StrokeStore replayed = {};
+        FILE* file = fopen( path, "rb" );
+        struct ByteBuffer data = {};
+        if( file ) {
+            uint8_t chunk[ 65536 ];
+            size_t read;
+            while( ( read = fread( chunk, 1, sizeof( chunk ), file ) ) > 0 ) {
+                appendBytes( &data, chunk, read );
+            }
+            fclose( file );
+        }
+        struct JournalHeader header;
+        if( readJournalHeader( data.data, data.size, &header ) ) {
+            replayStrokeJournal( data.data, data.size, &replayed, 4, 4, 0 );
+        }
+        benchmark::DoNotOptimize( replayed.count );
+        releaseByteBuffer( &data );
+        releaseStrokeStore( &replayed );
+    }
+    unlink( path );
+}
+BENCHMARK( benchJournalCrash )->Iterations( 50 )->Unit( benchmark::kMillisecond );
+
+
+// Fills a scene with range( 0 ) shapes scattered over a 4K snippet
+static void fillScene( struct Scene* scene, int count ) {
+    uint32_t state = 12345;
+    for( int i = 0; i < count; ++i ) {
+        state = state * 1664525 + 1013904223;
+        float x = (float)( state >> 8 & 4095 );
+        state = state * 1664525 + 1013904223;
+        float y = (float)( state >> 8 & 2047 );
+        float w = (float)( 20 + ( state >> 20 & 255 ) );
+        float h = (float)( 20 + ( state & 127 ) );
+        addShape( scene, (enum ShapeType)( i % 3 ), i % 5, 3.0f, x, y, x + w, y + h, NULL );
+    }
+}
+
+
+// Finding the shapes in a screen-sized area, as done when repainting part of the annotation window
+static void benchSceneQuery( benchmark::State& state ) {
+    struct Scene scene = {};
+    fillScene( &scene, (int) state.range( 0 ) );
+    struct PixelRect rect = { 0, 0, 400, 300 };
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        rect.left = ( rect.left + 97 ) % 3600;
+        rect.right = rect.left + 400;
+        int* results;
+        benchmark::DoNotOptimize( queryScene( &scene, rect, &results ) );
+    }
+    reportAllocations( state, allocations );
+    releaseScene( &scene );
+}
+BENCHMARK( benchSceneQuery )->Arg( 64 )->Arg( 1024 )->Arg( 16384 );
+
+
+// Finding the shape under the mouse
+static void benchSceneHitTest( benchmark::State& state ) {
+    struct Scene scene = {};
+    fillScene( &scene, (int) state.range( 0 ) );
+    uint32_t probe = 1;
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        probe = probe * 1664525 + 1013904223;
+        benchmark::DoNotOptimize( hitTestScene( &scene, (float)( probe >> 8 & 4095 ), (float)( probe >> 20 & 2047 ),
+            4.0f ) );
+    }
+    reportAllocations( state, allocations );
+    releaseScene( &scene );
+}
+BENCHMARK( benchSceneHitTest )->Arg( 64 )->Arg( 1024 )->Arg( 16384 );
+
+
+// Compositing 200 strokes into a 4K snippet at 4x supersampling, with range( 0 ) threads
+static void benchCompositeStrokes( benchmark::State& state ) {
+    int const strokeCount = 200;
+    struct StrokePath* paths = (struct StrokePath*) calloc( strokeCount, sizeof( struct StrokePath ) );
+    struct CompositeStroke* strokes = (struct CompositeStroke*) malloc( sizeof( struct CompositeStroke ) * strokeCount );
+    for( int i = 0; i < strokeCount; ++i ) {
+        float cx = (float)( 200 + ( i * 733 ) % 3400 );
+        float cy = (float)( 150 + ( i * 419 ) % 1800 );
+        for( int j = 0; j < 40; ++j ) {
+            float x, y;
+            scribblePoint( j + i * 17, &x, &y );
+            addPathPoint( &paths[ i ], cx + ( x - 960.0f ) * 0.3f, cy + ( y - 540.0f ) * 0.3f, 5.0f, 4 );
+        }
+        strokes[ i ].vertices = paths[ i ].vertices;
+        strokes[ i ].vertexCount = paths[ i ].vertexCount;
+        strokes[ i ].width = (float)( 2 + i % 6 );
+        strokes[ i ].color = 0xc0000000 | ( i * 0x3f1d27 & 0xffffff );
+    }
+    struct PixelBuffer const* source = corpusImage( CORPUS_MIXED, 2 );
+    struct PixelBuffer target = *source;
+    target.pixels = (uint32_t*) malloc( sizeof( uint32_t ) * source->width * source->height );
+    memcpy( target.pixels, source->pixels, sizeof( uint32_t ) * source->width * source->height );
+    uint64_t allocations = benchAllocationCount();
+    for( auto _ : state ) {
+        compositeStrokes( &target, strokes, strokeCount, 4, (int) state.range( 0 ) );
+        benchmark::DoNotOptimize( target.pixels[ 0 ] );
+    }
+    reportFrameTime( state );
+    reportAllocations( state, allocations );
+    for( int i = 0; i < strokeCount; ++i ) {
+        releaseStrokePath( &paths[ i ] );
+    }
+    free( paths );
+    free( strokes );
+    free( target.pixels );
+}
+BENCHMARK( benchCompositeStrokes )->RangeMultiplier( 2 )->Range( 1, 8 )->UseRealTime()
+    ->Unit( benchmark::kMillisecond );
@@ -0,0 +1,331 @@
+// Synthetic screenshot-like images for the benchmarks and tests, so results don't depend on whatever is on someone's
+// screen. Each kind mimics something snippets are commonly taken of: pages of text, application UI (flat panels,
+// borders, icons, lists), smooth gradients, photos (multi-octave value noise with grain), and a mix of all of them.
+// Images are generated from a fixed seed, so every run sees the same pixels.
+
+
+enum CorpusKind {
+    CORPUS_TEXT,
+    CORPUS_UI,
+    CORPUS_GRADIENT,
+    CORPUS_PHOTO,
+    CORPUS_MIXED,
+    CORPUS_KIND_COUNT,
+};
+
+
+static char const* const corpusKindNames[ CORPUS_KIND_COUNT ] = { "text", "ui", "gradient", "photo", "mixed" };
+
+
+struct CorpusSize {
+    char const* name;
+    int width;
+    int height;
+};
+
+
+int const CORPUS_SIZE_COUNT = 4;
+
+static struct CorpusSize const corpusSizes[ CORPUS_SIZE_COUNT ] = {
+    { "1080p", 1920, 1080 },
+    { "1440p", 2560, 1440 },
+    { "4K", 3840, 2160 },
+    { "8K", 7680, 4320 },
+};
+
+
+int const CORPUS_GLYPH_COUNT = 64;
+int const CORPUS_GLYPH_WIDTH = 5;
+int const CORPUS_GLYPH_HEIGHT = 7;
+
+
+static uint32_t corpusRandom( uint32_t* state ) {
+    // xorshift32
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+
+static uint32_t corpusHash( uint32_t x, uint32_t y, uint32_t seed ) {
+    uint32_t h = x * 0x8da6b343u ^ y * 0xd8163841u ^ seed * 0xcb1ab31fu;
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h;
+}
+
+
+static uint32_t corpusBlend( uint32_t background, uint32_t color, int alpha ) {
+    uint32_t result = 0xff000000;
+    for( int shift = 0; shift < 24; shift += 8 ) {
+        int b = ( background >> shift ) & 0xff;
+        int c = ( color >> shift ) & 0xff;
+        result |= (uint32_t)( b + ( ( c - b ) * alpha + 127 ) / 255 ) << shift;
+    }
+    return result;
+}
+
+
+static void corpusFill( struct PixelBuffer* image, struct PixelRect rect, uint32_t color ) {
+    struct PixelRect bounds = { 0, 0, image->width, image->height };
+    rect = intersectPixelRect( rect, bounds );
+    for( int y = rect.top; y < rect.bottom; ++y ) {
+        uint32_t* row = pixelRow( image, y );
+        for( int x = rect.left; x < rect.right; ++x ) {
+            row[ x ] = color;
+        }
+    }
+}
+
+
+// One pixel wide border just inside `rect`
+static void corpusFrame( struct PixelBuffer* image, struct PixelRect rect, uint32_t color ) {
+    struct PixelRect edges[ 4 ] = {
+        { rect.left, rect.top, rect.right, rect.top + 1 },
+        { rect.left, rect.bottom - 1, rect.right, rect.bottom },
+        { rect.left, rect.top, rect.left + 1, rect.bottom },
+        { rect.right - 1, rect.top, rect.right, rect.bottom },
+    };
+    for( int i = 0; i < 4; ++i ) {
+        corpusFill( image, edges[ i ], color );
+    }
+}
+
+
+// A fixed set of made-up glyphs, as 5x7 coverage maps. Stems get a faint fringe, like anti-aliased text
+static uint8_t const* corpusGlyphs( void ) {
+    static uint8_t glyphs[ CORPUS_GLYPH_COUNT ][ CORPUS_GLYPH_HEIGHT ][ CORPUS_GLYPH_WIDTH ];
+    static int made = 0;
+    if( !made ) {
+        uint32_t state = 0x1234567;
+        memset( glyphs, 0, sizeof( glyphs ) );
+        for( int g = 0; g < CORPUS_GLYPH_COUNT; ++g ) {
+            for( int y = 0; y < CORPUS_GLYPH_HEIGHT; ++y ) {
+                for( int x = 0; x < CORPUS_GLYPH_WIDTH; ++x ) {
+                    if( corpusRandom( &state ) % 100 < 42 ) {
+                        glyphs[ g ][ y ][ x ] = 255;
+                    }
+                }
+            }
+            for( int y = 0; y < CORPUS_GLYPH_HEIGHT; ++y ) {
+                for( int x = 0; x < CORPUS_GLYPH_WIDTH; ++x ) {
+                    if( !glyphs[ g ][ y ][ x ] && ( ( x > 0 && glyphs[ g ][ y ][ x - 1 ] == 255 ) ||
+                        ( x + 1 < CORPUS_GLYPH_WIDTH && glyphs[ g ][ y ][ x + 1 ] == 255 ) ) ) {
+                        glyphs[ g ][ y ][ x ] = 72;
+                    }
+                }
+            }
+        }
+        made = 1;
+    }
+    return &glyphs[ 0 ][ 0 ][ 0 ];
+}
+
+
+// Lines of words in `rect`, with ragged right edges, `lineHeight` pixels apart
+static void corpusText( struct PixelBuffer* image, struct PixelRect rect, int lineHeight, uint32_t color,
+    uint32_t background, uint32_t* state ) {
+
+    corpusFill( image, rect, background );
+    uint8_t const* glyphs = corpusGlyphs();
+    int cellHeight = lineHeight * 2 / 3;
+    int cellWidth = cellHeight * 3 / 5 > 3 ? cellHeight * 3 / 5 : 3;
+    rect = intersectPixelRect( rect, { 0, 0, image->width, image->height } );
+    for( int top = rect.top + lineHeight / 4; top + cellHeight <= rect.bottom; top += lineHeight ) {
+        int end = rect.right - (int)( corpusRandom( state ) % ( ( rect.right - rect.left ) / 4 + 1 ) );
+        int x = rect.left + cellWidth;
+        while( x + cellWidth <= end ) {
+            int letters = 2 + (int)( corpusRandom( state ) % 9 );
+            for( int i = 0; i < letters && x + cellWidth <= end; ++i, x += cellWidth ) {
+                uint8_t const* glyph = glyphs + ( corpusRandom( state ) % CORPUS_GLYPH_COUNT ) *
+                    CORPUS_GLYPH_WIDTH * CORPUS_GLYPH_HEIGHT;
+                for( int cy = 0; cy < cellHeight; ++cy ) {
+                    uint32_t* row = pixelRow( image, top + cy ) + x;
+                    uint8_t const* line = glyph + ( cy * CORPUS_GLYPH_HEIGHT / cellHeight ) * CORPUS_GLYPH_WIDTH;
+                    for( int cx = 0; cx < cellWidth - 1; ++cx ) {
+                        int alpha = line[ cx * CORPUS_GLYPH_WIDTH / ( cellWidth - 1 ) ];
+                        if( alpha ) {
+                            row[ cx ] = corpusBlend( background, color, alpha );
+                        }
+                    }
+                }
+            }
+            x += cellWidth; // Space between words
+        }
+    }
+}
+
+
+// Smooth two-way gradient across `rect`, with a little dither so it doesn't band
+static void corpusGradient( struct PixelBuffer* image, struct PixelRect rect, uint32_t from, uint32_t to,
+    uint32_t* state ) {
+
+    rect = intersectPixelRect( rect, { 0, 0, image->width, image->height } );
+    int width = rect.right - rect.left;
+    int height = rect.bottom - rect.top;
+    for( int y = rect.top; y < rect.bottom; ++y ) {
+        uint32_t* row = pixelRow( image, y );
+        for( int x = rect.left; x < rect.right; ++x ) {
+            int t = ( ( x - rect.left ) * 170 / ( width > 1 ? width : 1 ) ) + ( ( y - rect.top ) * 85 /
+                ( height > 1 ? height : 1 ) );
+            int dither = (int)( corpusRandom( state ) & 3 ) - 1;
+            t = t + dither < 0 ? 0 : ( t + dither > 255 ? 255 : t + dither );
+            row[ x ] = corpusBlend( from, to, t );
+        }
+    }
+}
+
+
+// Bilinearly interpolated lattice noise, 0-255, with a cell size of `1 << shift` pixels
+static int corpusValueNoise( int x, int y, int shift, uint32_t seed ) {
+    int cx = x >> shift;
+    int cy = y >> shift;
+    int fx = x & ( ( 1 << shift ) - 1 );
+    int fy = y & ( ( 1 << shift ) - 1 );
+    int v00 = (int)( corpusHash( cx, cy, seed ) & 0xff );
+    int v10 = (int)( corpusHash( cx + 1, cy, seed ) & 0xff );
+    int v01 = (int)( corpusHash( cx, cy + 1, seed ) & 0xff );
+    int v11 = (int)( corpusHash( cx + 1, cy + 1, seed ) & 0xff );
+    int top = ( v00 << shift ) + ( v10 - v00 ) * fx;
+    int bottom = ( v01 << shift ) + ( v11 - v01 ) * fx;
+    return ( ( top << shift ) + ( bottom - top ) * fy ) >> ( shift * 2 );
+}
+
+
+// Photo-like content: a few octaves of value noise for brightness, a slower one for hue, and per-pixel grain
+static void corpusPhoto( struct PixelBuffer* image, struct PixelRect rect, uint32_t seed, uint32_t* state ) {
+    rect = intersectPixelRect( rect, { 0, 0, image->width, image->height } );
+    int scale = image->height >= 2160 ? 1 : 0; // Features get bigger with the resolution, as they would on screen
+    for( int y = rect.top; y < rect.bottom; ++y ) {
+        uint32_t* row = pixelRow( image, y );
+        for( int x = rect.left; x < rect.right; ++x ) {
+            int luma = ( corpusValueNoise( x, y, 7 + scale, seed ) * 4 + corpusValueNoise( x, y, 5 + scale,
+                seed + 1 ) * 2 + corpusValueNoise( x, y, 3 + scale, seed + 2 ) ) / 7;
+            int hue = corpusValueNoise( x, y, 8 + scale, seed + 3 );
+            int grain = (int)( corpusRandom( state ) % 13 ) - 6;
+            int r = luma + ( hue - 128 ) / 3 + grain;
+            int g = luma + grain;
+            int b = luma - ( hue - 128 ) / 3 + grain;
+            r = r < 0 ? 0 : ( r > 255 ? 255 : r );
+            g = g < 0 ? 0 : ( g > 255 ? 255 : g );
+            b = b < 0 ? 0 : ( b > 255 ? 255 : b );
+            row[ x ] = 0xff000000 | ( (uint32_t) r << 16 ) | ( (uint32_t) g << 8 ) | (uint32_t) b;
+        }
+    }
+}
+
+
+// Application window: title bar, toolbar with icons, a sidebar list, a status bar, and a content area which is left
+// to the caller when `content` is given, or filled with cards of text otherwise
+static void corpusUi( struct PixelBuffer* image, struct PixelRect* content, uint32_t* state ) {
+    int w = image->width;
+    int h = image->height;
+    int unit = h / 54 > 8 ? h / 54 : 8; // 20 pixels at 1080p
+    corpusFill( image, { 0, 0, w, h }, 0xfff3f3f3 );
+    corpusFill( image, { 0, 0, w, unit * 2 }, 0xff2b579a );
+    corpusText( image, { unit, unit / 2, w / 3, unit * 3 / 2 }, unit, 0xffffffff, 0xff2b579a, state );
+    corpusFill( image, { 0, unit * 2, w, unit * 4 }, 0xfffafafa );
+    corpusFrame( image, { -1, unit * 2, w + 1, unit * 4 }, 0xffdadada );
+    for( int x = unit; x + unit * 2 < w / 2; x += unit * 2 ) {
+        uint32_t colors[ 4 ] = { 0xff4a90d9, 0xffe2574c, 0xff5cb85c, 0xfff0ad4e };
+        corpusFill( image, { x + unit / 4, unit * 2 + unit / 2, x + unit * 5 / 4, unit * 3 + unit / 2 },
+            colors[ corpusRandom( state ) % 4 ] );
+    }
+
+    int sidebar = w / 5;
+    corpusFill( image, { 0, unit * 4, sidebar, h - unit }, 0xffe9e9e9 );
+    for( int y = unit * 4, i = 0; y + unit * 2 <= h - unit; y += unit * 2, ++i ) {
+        struct PixelRect item = { 0, y, sidebar, y + unit * 2 };
+        uint32_t background = i == 3 ? 0xffcce4f7 : ( i & 1 ? 0xffe9e9e9 : 0xfff0f0f0 );
+        corpusFill( image, item, background );
+        corpusFill( image, { unit / 2, y + unit / 2, unit * 3 / 2, y + unit * 3 / 2 }, 0xff8a8a8a );
+        corpusText( image, { unit * 2, y + unit / 4, sidebar - unit, y + unit * 7 / 4 }, unit * 3 / 2, 0xff333333,
+            background, state );
+    }
+    corpusFrame( image, { sidebar - 1, unit * 4, sidebar + 1, h - unit }, 0xffcfcfcf );
+    corpusFill( image, { 0, h - unit, w, h }, 0xff007acc );
+
+    struct PixelRect area = { sidebar + unit, unit * 5, w - unit, h - unit * 2 };
+    if( content ) {
+        *content = area;
+        return;
+    }
+    int cardWidth = unit * 16;
+    int cardHeight = unit * 10;
+    for( int y = area.top; y + cardHeight <= area.bottom; y += cardHeight + unit ) {
+        for( int x = area.left; x + cardWidth <= area.right; x += cardWidth + unit ) {
+            struct PixelRect card = { x, y, x + cardWidth, y + cardHeight };
+            corpusFill( image, card, 0xffffffff );
+            corpusFrame( image, card, 0xffd0d0d0 );
+            corpusText( image, { x + unit / 2, y + unit / 2, x + cardWidth - unit / 2, y + cardHeight - unit * 3 },
+                unit, 0xff222222, 0xffffffff, state );
+            corpusFill( image, { x + unit / 2, y + cardHeight - unit * 2, x + unit * 5, y + cardHeight - unit / 2 },
+                0xff2b579a );
+        }
+    }
+}
+
+
+// Generates an image of the given kind into a newly allocated buffer, which the caller must free
+static int makeCorpusImage( enum CorpusKind kind, int width, int height, struct PixelBuffer* image ) {
+    image->pixels = (uint32_t*) malloc( sizeof( uint32_t ) * (size_t) width * height );
+    if( !image->pixels ) {
+        return 0;
+    }
+    image->width = width;
+    image->height = height;
+    image->stride = width;
+    uint32_t state = 0x9e3779b9u + (uint32_t) kind;
+    struct PixelRect all = { 0, 0, width, height };
+    switch( kind ) {
+        case CORPUS_TEXT:
+            corpusText( image, all, height / 60 > 12 ? height / 60 : 12, 0xff1e1e1e, 0xffffffff, &state );
+            break;
+        case CORPUS_UI:
+            corpusUi( image, NULL, &state );
+            break;
+        case CORPUS_GRADIENT:
+            corpusGradient( image, all, 0xff1d2b64, 0xfff8cdda, &state );
+            break;
+        case CORPUS_PHOTO:
+            corpusPhoto( image, all, 7, &state );
+            break;
+        default: {
+            struct PixelRect content;
+            corpusUi( image, &content, &state );
+            int middle = ( content.top + content.bottom ) / 2;
+            int center = ( content.left + content.right ) / 2;
+            corpusPhoto( image, { content.left, content.top, content.right, middle }, 11, &state );
+            corpusText( image, { content.left, middle, center, content.bottom }, height / 54 > 12 ? height / 54 : 12,
+                0xff1e1e1e, 0xffffffff, &state );
+            corpusGradient( image, { center, middle, content.right, content.bottom }, 0xff0f2027, 0xff2c5364,
+                &state );
+        } break;
+    }
+    return 1;
+}
+
+
+// The image for a kind and an index into `corpusSizes`. Only the most recent one is kept, as the benchmarks run the
+// same arguments back to back and 8K images are large
+static struct PixelBuffer const* corpusImage( int kind, int size ) {
+    static struct PixelBuffer image = {};
+    static int currentKind = -1;
+    static int currentSize = -1;
+    if( kind != currentKind || size != currentSize ) {
+        free( image.pixels );
+        image.pixels = NULL;
+        currentKind = kind;
+        currentSize = size;
+        if( !makeCorpusImage( (enum CorpusKind) kind, corpusSizes[ size ].width, corpusSizes[ size ].height,
+            &image ) ) {
+            currentKind = -1;
+            return NULL;
+        }
+    }
+    return &image;
+}
@@ -0,0 +1,29 @@
+// Shared by the tests. A failed check prints where it failed and the test carries on, so one run shows every failure.
+// Each test returns `testResult()` from main, which is non-zero if any check failed. The tests only need the core
+// headers and the synthetic corpus of the benchmarks, not Google Benchmark.
+#include "SnippetCore.h"
+#include "Corpus.h"
+#include <stdio.h>
+
+
+static int testChecks = 0;
+static int testFailures = 0;
+
+
+#define CHECK( condition ) checkTest( ( condition ) ? 1 : 0, #condition, __FILE__, __LINE__ )
+
+
+static int checkTest( int passed, char const* text, char const* file, int line ) {
+    ++testChecks;
+    if( !passed ) {
+        fprintf( stderr, "%s:%d: check failed: %s\n", file, line, text );
+        ++testFailures;
+    }
+    return passed;
+}
+
+
+static int testResult( void ) {
+    printf( "%d checks, %d failed\n", testChecks, testFailures );
+    return testFailures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,145 @@
+// Replacing a file while another thread keeps reading it: the reader sees either a whole earlier version or the whole
+// new one, never a file cut short or mixing the two. This is the POSIX version of AtomicFile.h.
+#include "Test.h"
+#include <atomic>
+#include <thread>
+
+
+int const ATOMIC_TEST_VERSIONS = 200;
+
+
+// Size of version `version` of the file. Sizes go up and down, from empty to a few megabytes, so a reader seeing a
+// partly written file would see one too short or too long for the version in its first bytes
+static size_t versionSize( int version ) {
+    size_t const sizes[] = { 4096, 3 << 20, 12, 70000, 1 << 20, 5 };
+    return version ? sizes[ version % ( sizeof( sizes ) / sizeof( *sizes ) ) ] : 0;
+}
+
+
+// Version `version` is its number (in the first four bytes, where there is room) followed by bytes derived from it
+static void fillVersion( uint8_t* data, int version ) {
+    size_t size = versionSize( version );
+    for( size_t i = 0; i < size; ++i ) {
+        data[ i ] = i < 4 ? (uint8_t)( version >> ( i * 8 ) ) : (uint8_t)( ( i * 2654435761u >> 13 ) + version );
+    }
+}
+
+
+// Returns non-zero if `data` is exactly some complete version, and sets `version` to it
+static int isWholeVersion( uint8_t const* data, size_t size, uint8_t* expected, int* version ) {
+    if( size < 4 ) {
+        // Only the empty version 0 and the short versions have no room for their number. Check those by content
+        for( int v = 0; v < ATOMIC_TEST_VERSIONS; ++v ) {
+            if( versionSize( v ) == size ) {
+                fillVersion( expected, v );
+                if( memcmp( expected, data, size ) == 0 ) {
+                    *version = v;
+                    return 1;
+                }
+            }
+        }
+        return 0;
+    }
+    int v = data[ 0 ] | ( data[ 1 ] << 8 ) | ( data[ 2 ] << 16 ) | ( data[ 3 ] << 24 );
+    if( v < 0 || v >= ATOMIC_TEST_VERSIONS || versionSize( v ) != size ) {
+        return 0;
+    }
+    fillVersion( expected, v );
+    *version = v;
+    return memcmp( expected, data, size ) == 0;
+}
+
+
+// Reads the whole file as it is, or returns zero if it can't be opened
+static int readWhole( char const* filename, uint8_t* data, size_t capacity, size_t* size ) {
+    FILE* file = fopen( filename, "rb" );
+    if( !file ) {
+        return 0;
+    }
+    *size = fread( data, 1, capacity, file );
+    fclose( file );
+    return 1;
+}
+
+
+static void testConcurrentReader( void ) {
+    char filename[ 64 ];
+    snprintf( filename, sizeof( filename ), "/tmp/screensnippet_test.%ld.bin", (long) getpid() );
+    size_t const capacity = 4 << 20;
+    uint8_t* written = (uint8_t*) malloc( capacity );
+    fillVersion( written, 0 );
+    CHECK( writeFileAtomic( filename, written, versionSize( 0 ) ) );
+
+    std::atomic< int > done( 0 );
+    int reads = 0, partial = 0, backwards = 0;
+    std::thread reader( [ & ]() {
+        uint8_t* data = (uint8_t*) malloc( capacity );
+        uint8_t* expected = (uint8_t*) malloc( capacity );
+        int last = 0;
+        while( !done.load() ) {
+            size_t size;
+            int version;
+            if( !readWhole( filename, data, capacity, &size ) ) {
+                ++partial; // The target is replaced in one step, so it never goes missing either
+            } else if( !isWholeVersion( data, size, expected, &version ) ) {
+                ++partial;
+            } else {
+                backwards += version < last;
+                last = version;
+            }
+            ++reads;
+        }
+        free( expected );
+        free( data );
+    } );
+
+    int committed = 1;
+    for( int version = 1; version < ATOMIC_TEST_VERSIONS; ++version ) {
+        fillVersion( written, version );
+        committed &= writeFileAtomic( filename, written, versionSize( version ) );
+    }
+    done = 1;
+    reader.join();
+    CHECK( committed );
+    CHECK( reads > 0 );
+    CHECK( partial == 0 );
+    CHECK( backwards == 0 );
+
+    // Once done, the file is the last version, and no temporary file is left behind
+    uint8_t* expected = (uint8_t*) malloc( capacity );
+    size_t size = 0;
+    int version = -1;
+    CHECK( readWhole( filename, written, capacity, &size ) && isWholeVersion( written, size, expected, &version ) &&
+        version == ATOMIC_TEST_VERSIONS - 1 );
+    char temp[ 96 ];
+    snprintf( temp, sizeof( temp ), "%s.%ld.tmp", filename, (long) getpid() );
+    CHECK( access( temp, F_OK ) != 0 );
+    unlink( filename );
+    free( expected );
+    free( written );
+}
+
+
+// An aborted replacement leaves the target as it was
+static void testAbort( void ) {
+    char filename[ 64 ];
+    snprintf( filename, sizeof( filename ), "/tmp/screensnippet_test.%ld.abort", (long) getpid() );
+    CHECK( writeFileAtomic( filename, "old", 3 ) );
+    struct AtomicFile file;
+    CHECK( beginAtomicFile( &file, filename, 5 ) );
+    memcpy( file.data, "newer", 5 );
+    abortAtomicFile( &file );
+    char data[ 8 ];
+    size_t size = 0;
+    CHECK( readWhole( filename, (uint8_t*) data, sizeof( data ), &size ) && size == 3 &&
+        memcmp( data, "old", 3 ) == 0 );
+    CHECK( access( file.temp, F_OK ) != 0 );
+    unlink( filename );
+}
+
+
+int main() {
+    testConcurrentReader();
+    testAbort();
+    return testResult();
+}
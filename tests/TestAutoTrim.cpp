@@ -0,0 +1,251 @@
+// Trimming the uniform borders gives the bounding box of every pixel which differs from the top-left one by more than
+// TRIM_TOLERANCE in a color channel, as a plain scan of every pixel finds it: for single colors, islands in the corners
+// and anywhere else, differences on either side of the tolerance in each channel, alpha alone, widths which leave a
+// tail after the groups of four, and bottom-up views. Cropping and trimming a view gives the pixels a copy would.
+#include "Test.h"
+
+
+// The trim rectangle by brute force: the bounding box of the pixels outside the tolerance, or all of the image if none
+// is
+static struct PixelRect referenceTrimRect( struct PixelBuffer const* image, int tolerance ) {
+    uint32_t color = pixelRow( image, 0 )[ 0 ];
+    struct PixelRect box = { image->width, image->height, 0, 0 };
+    for( int y = 0; y < image->height; ++y ) {
+        for( int x = 0; x < image->width; ++x ) {
+            for( int shift = 0; shift < 24; shift += 8 ) {
+                int d = (int)( ( pixelRow( image, y )[ x ] >> shift ) & 0xff ) - (int)( ( color >> shift ) & 0xff );
+                if( d > tolerance || d < -tolerance ) {
+                    box.left = x < box.left ? x : box.left;
+                    box.top = y < box.top ? y : box.top;
+                    box.right = x + 1 > box.right ? x + 1 : box.right;
+                    box.bottom = y + 1 > box.bottom ? y + 1 : box.bottom;
+                }
+            }
+        }
+    }
+    struct PixelRect all = { 0, 0, image->width, image->height };
+    return box.right > 0 ? box : all;
+}
+
+
+static int sameRect( struct PixelRect a, struct PixelRect b ) {
+    return a.left == b.left && a.top == b.top && a.right == b.right && a.bottom == b.bottom;
+}
+
+
+static int trimsLikeReference( struct PixelBuffer const* image ) {
+    return sameRect( findTrimRect( image, TRIM_TOLERANCE ), referenceTrimRect( image, TRIM_TOLERANCE ) );
+}
+
+
+static struct PixelBuffer makeFilled( int width, int height, uint32_t color ) {
+    struct PixelBuffer image = { (uint32_t*) malloc( sizeof( uint32_t ) * width * height ), width, height, width };
+    for( int i = 0; i < width * height; ++i ) {
+        image.pixels[ i ] = color;
+    }
+    return image;
+}
+
+
+// One color comes back whole, at every width from one pixel to a few groups of four
+static void testSingleColor( void ) {
+    int whole = 1;
+    for( int width = 1; width <= 13; ++width ) {
+        for( int height = 1; height <= 3; ++height ) {
+            struct PixelBuffer image = makeFilled( width, height, 0xff3366cc );
+            struct PixelRect all = { 0, 0, width, height };
+            whole &= sameRect( findTrimRect( &image, TRIM_TOLERANCE ), all );
+            free( image.pixels );
+        }
+    }
+    CHECK( whole );
+}
+
+
+// A single pixel in a corner trims down to just that pixel, except in the top-left, where it is taken as the border
+// color and everything else differs from it, so only a row of just that pixel is trimmed
+static void testCorners( void ) {
+    int const widths[] = { 1, 2, 3, 4, 5, 7, 8, 9, 37 };
+    int trimmed = 1;
+    for( size_t w = 0; w < sizeof( widths ) / sizeof( *widths ); ++w ) {
+        int width = widths[ w ], height = 6;
+        int const corners[ 4 ][ 2 ] = { { 0, 0 }, { width - 1, 0 }, { 0, height - 1 }, { width - 1, height - 1 } };
+        for( int c = 0; c < 4; ++c ) {
+            struct PixelBuffer image = makeFilled( width, height, 0xffffffff );
+            int x = corners[ c ][ 0 ], y = corners[ c ][ 1 ];
+            pixelRow( &image, y )[ x ] = 0xff000000;
+            struct PixelRect expected = { x, y, x + 1, y + 1 };
+            if( x == 0 && y == 0 ) {
+                struct PixelRect rest = { 0, width > 1 ? 0 : 1, width, height }; // Everything but a row of just it
+                expected = rest;
+            }
+            trimmed &= sameRect( findTrimRect( &image, TRIM_TOLERANCE ), expected ) && trimsLikeReference( &image );
+            free( image.pixels );
+        }
+    }
+    CHECK( trimmed );
+}
+
+
+// A pixel off by exactly the tolerance in one channel, up or down, is still border, and one step further is not. The
+// border colors include channels at 0 and 255, where the difference can only go one way
+static void testTolerance( void ) {
+    uint32_t const borders[] = { 0xff808080, 0xff000000, 0xffffffff, 0xff0aff05 };
+    int inside = 1;
+    int outside = 1;
+    for( size_t b = 0; b < sizeof( borders ) / sizeof( *borders ); ++b ) {
+        for( int shift = 0; shift < 24; shift += 8 ) {
+            for( int sign = -1; sign <= 1; sign += 2 ) {
+                for( int d = TRIM_TOLERANCE; d <= TRIM_TOLERANCE + 1; ++d ) {
+                    int channel = (int)( ( borders[ b ] >> shift ) & 0xff ) + sign * d;
+                    if( channel < 0 || channel > 255 ) {
+                        continue;
+                    }
+                    struct PixelBuffer image = makeFilled( 11, 5, borders[ b ] );
+                    uint32_t* pixel = &pixelRow( &image, 3 )[ 6 ];
+                    *pixel = ( *pixel & ~( 0xffu << shift ) ) | ( (uint32_t) channel << shift );
+                    struct PixelRect all = { 0, 0, 11, 5 };
+                    struct PixelRect one = { 6, 3, 7, 4 };
+                    struct PixelRect trim = findTrimRect( &image, TRIM_TOLERANCE );
+                    if( d == TRIM_TOLERANCE ) {
+                        inside &= sameRect( trim, all );
+                    } else {
+                        outside &= sameRect( trim, one );
+                    }
+                    free( image.pixels );
+                }
+            }
+        }
+    }
+    CHECK( inside );
+    CHECK( outside );
+}
+
+
+// Pixels which differ from the border only in alpha don't count, wherever they are
+static void testAlphaIgnored( void ) {
+    struct PixelBuffer image = makeFilled( 9, 4, 0xff204060 );
+    pixelRow( &image, 1 )[ 2 ] = 0x00204060;
+    pixelRow( &image, 3 )[ 8 ] = 0x7f204060;
+    pixelRow( &image, 0 )[ 5 ] = 0x01204060;
+    struct PixelRect all = { 0, 0, 9, 4 };
+    CHECK( sameRect( findTrimRect( &image, TRIM_TOLERANCE ), all ) );
+    pixelRow( &image, 2 )[ 4 ] = 0x00204061 + TRIM_TOLERANCE;
+    struct PixelRect one = { 4, 2, 5, 3 };
+    CHECK( sameRect( findTrimRect( &image, TRIM_TOLERANCE ), one ) );
+    free( image.pixels );
+}
+
+
+// A few islands at random places, at every width up to a few groups of four and beyond, so they land in the groups
+// and in the tails, at either end of the rows
+static void testRandomIslands( void ) {
+    uint32_t random = 17;
+    int same = 1;
+    for( int width = 1; width <= 21; ++width ) {
+        for( int run = 0; run < 40; ++run ) {
+            random = random * 1664525 + 1013904223;
+            int height = 1 + (int)( ( random >> 8 ) % 9 );
+            struct PixelBuffer image = makeFilled( width, height, 0xff102030 );
+            int islands = (int)( ( random >> 20 ) % 4 );
+            for( int i = 0; i < islands; ++i ) {
+                random = random * 1664525 + 1013904223;
+                uint32_t value = 0xff102030 + ( ( ( random >> 4 ) % 24 ) << ( ( random >> 12 ) % 3 * 8 ) );
+                pixelRow( &image, (int)( ( random >> 16 ) % height ) )[ ( random >> 24 ) % width ] = value;
+            }
+            same &= trimsLikeReference( &image );
+            free( image.pixels );
+        }
+    }
+    CHECK( same );
+}
+
+
+// A bottom-up view, whose first row is the last in memory, trims in its own coordinates
+static void testBottomUp( void ) {
+    int const width = 13, height = 7;
+    struct PixelBuffer image = makeFilled( width, height, 0xff445566 );
+    image.pixels[ 2 * width + 11 ] = 0xff000000; // Row 4 of the view
+    image.pixels[ 5 * width + 1 ] = 0xff000000; // Row 1 of the view
+    struct PixelBuffer bottomUp = { image.pixels + width * ( height - 1 ), width, height, -width };
+    struct PixelRect expected = { 1, 1, 12, 5 };
+    CHECK( sameRect( findTrimRect( &bottomUp, TRIM_TOLERANCE ), expected ) );
+    CHECK( trimsLikeReference( &bottomUp ) );
+    free( image.pixels );
+}
+
+
+// Copies the part of `image` inside `rect` into a packed buffer of its own
+static struct PixelBuffer copyPixels( struct PixelBuffer const* image, struct PixelRect rect ) {
+    int width = rect.right - rect.left, height = rect.bottom - rect.top;
+    struct PixelBuffer copy = { (uint32_t*) malloc( sizeof( uint32_t ) * ( width * height + 1 ) ), width, height,
+        width };
+    for( int y = 0; y < height; ++y ) {
+        memcpy( pixelRow( &copy, y ), pixelRow( image, rect.top + y ) + rect.left, sizeof( uint32_t ) * width );
+    }
+    return copy;
+}
+
+
+static int samePixelViews( struct PixelBuffer const* a, struct PixelBuffer const* b ) {
+    if( a->width != b->width || a->height != b->height ) {
+        return 0;
+    }
+    for( int y = 0; y < a->height; ++y ) {
+        if( memcmp( pixelRow( a, y ), pixelRow( b, y ), sizeof( uint32_t ) * a->width ) != 0 ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+// Cropping a screenshot with a margin drawn into it, then trimming, gives the same pixels as copying the crop out and
+// trimming the copy, from a top-down view and a bottom-up one, and without trimming gives the crop itself
+static void testCroppedPixels( void ) {
+    struct PixelBuffer const* corpus = corpusImage( CORPUS_UI, 0 );
+    struct PixelRect area = { 100, 80, 420, 300 };
+    struct PixelBuffer image = copyPixels( corpus, area );
+    for( int y = 0; y < image.height; ++y ) {
+        for( int x = 0; x < image.width; ++x ) {
+            if( x < 30 || x >= image.width - 17 || y < 21 || y >= image.height - 9 ) {
+                pixelRow( &image, y )[ x ] = 0xfff0f0f0;
+            } else if( x == 30 || y == 21 ) {
+                pixelRow( &image, y )[ x ] = 0xff000000; // So the content starts right there
+            }
+        }
+    }
+    struct PixelBuffer bottomUp = { image.pixels + image.width * ( image.height - 1 ), image.width, image.height,
+        -image.width };
+    struct PixelRect const crops[] = { { 10, 5, 300, 200 }, { 0, 0, image.width, image.height }, { 29, 20, 31, 22 },
+        { 40, 40, 41, 41 } };
+    int same = 1;
+    for( int view = 0; view < 2; ++view ) {
+        struct PixelBuffer const* source = view ? &bottomUp : &image;
+        for( size_t c = 0; c < sizeof( crops ) / sizeof( *crops ); ++c ) {
+            struct PixelBuffer copy = copyPixels( source, crops[ c ] );
+            struct PixelBuffer trimmed = cropPixelBuffer( &copy, findTrimRect( &copy, TRIM_TOLERANCE ) );
+            struct PixelBuffer cropped = croppedPixels( source, crops[ c ], 1 );
+            same &= samePixelViews( &cropped, &trimmed );
+            struct PixelBuffer untrimmed = croppedPixels( source, crops[ c ], 0 );
+            same &= samePixelViews( &untrimmed, &copy );
+            free( copy.pixels );
+        }
+    }
+    CHECK( same );
+    struct PixelBuffer cropped = croppedPixels( &image, crops[ 0 ], 1 );
+    CHECK( cropped.pixels == pixelRow( &image, 21 ) + 30 ); // Only the margin is trimmed, and nothing is copied
+    free( image.pixels );
+}
+
+
+int main( void ) {
+    testSingleColor();
+    testCorners();
+    testTolerance();
+    testAlphaIgnored();
+    testRandomIslands();
+    testBottomUp();
+    testCroppedPixels();
+    return testResult();
+}
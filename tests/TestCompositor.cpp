@@ -0,0 +1,108 @@
+// The tiled compositor draws exactly what drawing every stroke over the whole image at once does, one stroke after the
+// other on a single thread, whatever the number of threads and with or without supersampling: strokes along and
+// across tile edges, through tile corners, partly or wholly off the image, of varying width and semitransparent.
+#include "Test.h"
+
+
+int const COMPOSITE_TEST_WIDTH = COMPOSITE_TILE * 4 + 37; // Not a whole number of tiles either way
+int const COMPOSITE_TEST_HEIGHT = COMPOSITE_TILE * 3 + 5;
+
+
+// Draws `strokes` over all of `target` as a single tile, the way `compositeTile` draws each stroke over one
+static void referenceComposite( struct PixelBuffer* target, struct CompositeStroke const* strokes, int count,
+    int supersampling ) {
+
+    struct PixelRect rect = { 0, 0, target->width, target->height };
+    size_t area = (size_t) target->width * target->height;
+    float* coverage = (float*) malloc( sizeof( float ) * area );
+    for( int s = 0; s < count; ++s ) {
+        struct CompositeStroke const* stroke = &strokes[ s ];
+        memset( coverage, 0, sizeof( float ) * area );
+        float const* v = stroke->vertices;
+        float const* w = stroke->widths;
+        float halfWidth = ( w ? w[ 0 ] : stroke->width ) * 0.5f;
+        if( stroke->vertexCount == 1 ) {
+            coverSegment( coverage, rect, v[ 0 ], v[ 1 ], v[ 0 ], v[ 1 ], halfWidth, halfWidth, supersampling );
+        }
+        for( int i = 0; i + 1 < stroke->vertexCount; ++i ) {
+            float halfWidthEnd = w ? w[ i + 1 ] * 0.5f : halfWidth;
+            coverSegment( coverage, rect, v[ i * 2 ], v[ i * 2 + 1 ], v[ i * 2 + 2 ], v[ i * 2 + 3 ], halfWidth,
+                halfWidthEnd, supersampling );
+            halfWidth = halfWidthEnd;
+        }
+        blendCoverage( target, rect, coverage, stroke->color );
+    }
+    free( coverage );
+}
+
+
+static int samePixels( struct PixelBuffer const* a, struct PixelBuffer const* b ) {
+    for( int y = 0; y < a->height; ++y ) {
+        if( memcmp( pixelRow( a, y ), pixelRow( b, y ), sizeof( uint32_t ) * a->width ) != 0 ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+static void testMatchesReference( void ) {
+    float const t = (float) COMPOSITE_TILE;
+    // Along a tile edge, across several, through tile corners, a dot on a corner, off the left and top edges, off the
+    // image altogether, and a scribble of varying width back and forth across edges
+    float const along[] = { t, 10.0f, t, 150.0f };
+    float const across[] = { 20.0f, t * 2 - 0.5f, 280.0f, t * 2 + 0.5f };
+    float const corners[] = { t - 3.0f, t - 3.0f, t * 3 + 3.0f, t * 2 + 3.0f };
+    float const dot[] = { t * 2, t };
+    float const offEdge[] = { -20.0f, 30.0f, 40.0f, -15.0f, 90.0f, 20.0f };
+    float const offImage[] = { -200.0f, -200.0f, -150.0f, -180.0f };
+    float scribble[ 40 ];
+    float widths[ 20 ];
+    for( int i = 0; i < 20; ++i ) {
+        scribble[ i * 2 ] = t * 2 + 30.0f * sinf( i * 0.9f ) + i * 3.0f;
+        scribble[ i * 2 + 1 ] = t + 40.0f * cosf( i * 0.7f ) + i * 2.0f;
+        widths[ i ] = 2.0f + 9.0f * ( i % 5 ) / 4.0f;
+    }
+    struct CompositeStroke const strokes[] = {
+        { along, 2, 5.0f, 0xffcc2020, NULL },
+        { across, 2, 3.0f, 0x8020cc20, NULL }, // Semitransparent
+        { corners, 2, 7.5f, 0xc02020cc, NULL },
+        { dot, 1, 12.0f, 0xff000000, NULL },
+        { offEdge, 3, 9.0f, 0x60ffff00, NULL },
+        { offImage, 2, 4.0f, 0xffffffff, NULL },
+        { scribble, 20, 11.0f, 0x90ff00ff, widths },
+        { along, 2, 1.5f, 0x80ffffff, NULL }, // Over the first, so the order matters
+    };
+    int const strokeCount = (int)( sizeof( strokes ) / sizeof( *strokes ) );
+
+    struct PixelBuffer background = {};
+    if( !CHECK( makeCorpusImage( CORPUS_UI, COMPOSITE_TEST_WIDTH, COMPOSITE_TEST_HEIGHT, &background ) ) ) {
+        return;
+    }
+    size_t bytes = sizeof( uint32_t ) * COMPOSITE_TEST_WIDTH * COMPOSITE_TEST_HEIGHT;
+    struct PixelBuffer expected = background, actual = background;
+    expected.pixels = (uint32_t*) malloc( bytes );
+    actual.pixels = (uint32_t*) malloc( bytes );
+    int const threadCounts[] = { 1, 2, 3, 8 };
+    for( int supersampling = 1; supersampling <= 4; supersampling += 3 ) {
+        memcpy( expected.pixels, background.pixels, bytes );
+        referenceComposite( &expected, strokes, strokeCount, supersampling );
+        CHECK( !samePixels( &expected, &background ) );
+        for( size_t i = 0; i < sizeof( threadCounts ) / sizeof( *threadCounts ); ++i ) {
+            memcpy( actual.pixels, background.pixels, bytes );
+            CHECK( compositeStrokes( &actual, strokes, strokeCount, supersampling, threadCounts[ i ] ) );
+            if( !CHECK( samePixels( &actual, &expected ) ) ) {
+                fprintf( stderr, "  supersampling %d, %d threads\n", supersampling, threadCounts[ i ] );
+            }
+        }
+    }
+    free( actual.pixels );
+    free( expected.pixels );
+    free( background.pixels );
+}
+
+
+int main( void ) {
+    testMatchesReference();
+    return testResult();
+}
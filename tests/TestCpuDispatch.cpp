@@ -0,0 +1,100 @@
+// Dispatch of the kernels by instruction set level: every variant the processor supports gives the same results as
+// the scalar one, each level name is found and nothing else is, binding never goes above the level detected, and a
+// level forced lower binds the variants of that level.
+#include "Test.h"
+
+
+static int sameKernels( struct CpuKernels const* a, struct CpuKernels const* b ) {
+    return a->opaqueRow == b->opaqueRow && a->sumPixels == b->sumPixels && a->averageSums == b->averageSums &&
+        a->filterCost == b->filterCost && a->filterRow == b->filterRow && a->coverSpan == b->coverSpan &&
+        a->blendSpan == b->blendSpan && a->outlineHit == b->outlineHit;
+}
+
+
+static void testSelfTest( void ) {
+    struct ByteBuffer report = {};
+    CHECK( selfTestCpuKernels( &report ) == 0 );
+    if( cpuIsaDetected > CPU_ISA_SCALAR ) {
+        CHECK( report.size > 0 );
+    }
+    if( report.size > 0 ) {
+        printf( "%.*s", (int) report.size, (char const*) report.data );
+    }
+    releaseByteBuffer( &report );
+}
+
+
+static void testFindIsa( void ) {
+    for( int isa = 0; isa < CPU_ISA_COUNT; ++isa ) {
+        CHECK( findCpuIsa( cpuIsaNames[ isa ] ) == isa );
+    }
+    CHECK( findCpuIsa( "avx" ) == CPU_ISA_COUNT );
+    CHECK( findCpuIsa( "SSE2" ) == CPU_ISA_COUNT );
+    CHECK( findCpuIsa( "" ) == CPU_ISA_COUNT );
+}
+
+
+// Asking for any level binds that level or the one detected, whichever is lower, and binds exactly the variants
+// `selectCpuKernels` picks for it
+static void testBindClamps( void ) {
+    int clamped = 1;
+    for( int isa = 0; isa < CPU_ISA_COUNT; ++isa ) {
+        enum CpuIsa bound = bindCpuKernels( (enum CpuIsa) isa );
+        struct CpuKernels expected;
+        selectCpuKernels( bound, &expected );
+        clamped &= bound == ( isa < cpuIsaDetected ? isa : cpuIsaDetected ) && sameKernels( &cpuKernels, &expected );
+    }
+    CHECK( clamped );
+    CHECK( bindCpuKernels( CPU_ISA_AVX512 ) == cpuIsaDetected );
+    bindCpuKernels( cpuIsaDetected );
+}
+
+
+// Each level the processor supports, when forced, binds its own variants, and the ones of the level below where it
+// has none
+static void testForcedLevels( void ) {
+    CHECK( bindCpuKernels( CPU_ISA_SCALAR ) == CPU_ISA_SCALAR );
+    CHECK( cpuKernels.opaqueRow == opaqueRowScalar && cpuKernels.sumPixels == sumPixelsScalar &&
+        cpuKernels.averageSums == averageSumsScalar && cpuKernels.filterCost == filterCostScalar &&
+        cpuKernels.filterRow == filterRowScalar && cpuKernels.coverSpan == coverSpanScalar &&
+        cpuKernels.blendSpan == blendSpanScalar && cpuKernels.outlineHit == outlineHitScalar );
+    #ifdef PIXELS_SSE2
+        if( cpuIsaDetected >= CPU_ISA_SSE2 ) {
+            CHECK( bindCpuKernels( CPU_ISA_SSE2 ) == CPU_ISA_SSE2 );
+            CHECK( cpuKernels.opaqueRow == opaqueRowSse2 && cpuKernels.sumPixels == sumPixelsSse2 &&
+                cpuKernels.averageSums == averageSumsSse2 && cpuKernels.filterCost == filterCostSse2 &&
+                cpuKernels.filterRow == filterRowSse2 && cpuKernels.coverSpan == coverSpanSse2 &&
+                cpuKernels.blendSpan == blendSpanSse2 && cpuKernels.outlineHit == outlineHitSse2 );
+        }
+        if( cpuIsaDetected >= CPU_ISA_SSE41 ) {
+            CHECK( bindCpuKernels( CPU_ISA_SSE41 ) == CPU_ISA_SSE41 );
+            CHECK( cpuKernels.filterRow == filterRowSse41 && cpuKernels.opaqueRow == opaqueRowSse2 &&
+                cpuKernels.outlineHit == outlineHitSse2 );
+        }
+    #endif
+    #ifdef PIXELS_AVX2
+        if( cpuIsaDetected >= CPU_ISA_AVX2 ) {
+            CHECK( bindCpuKernels( CPU_ISA_AVX2 ) == CPU_ISA_AVX2 );
+            CHECK( cpuKernels.opaqueRow == opaqueRowAvx2 && cpuKernels.sumPixels == sumPixelsAvx2 &&
+                cpuKernels.averageSums == averageSumsAvx2 && cpuKernels.filterCost == filterCostAvx2 &&
+                cpuKernels.filterRow == filterRowAvx2 && cpuKernels.coverSpan == coverSpanAvx2 &&
+                cpuKernels.blendSpan == blendSpanAvx2 && cpuKernels.outlineHit == outlineHitAvx2 );
+        }
+        if( cpuIsaDetected >= CPU_ISA_AVX512 ) {
+            struct CpuKernels avx2 = cpuKernels;
+            CHECK( bindCpuKernels( CPU_ISA_AVX512 ) == CPU_ISA_AVX512 );
+            CHECK( sameKernels( &cpuKernels, &avx2 ) );
+        }
+    #endif
+    bindCpuKernels( cpuIsaDetected );
+}
+
+
+int main( void ) {
+    printf( "Detected: %s\n", cpuIsaNames[ cpuIsaDetected ] );
+    testSelfTest();
+    testFindIsa();
+    testBindClamps();
+    testForcedLevels();
+    return testResult();
+}
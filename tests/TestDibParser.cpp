@@ -0,0 +1,190 @@
+// Packed DIBs as the clipboard holds them, built from a corner of the corpus: each layout the parser supports gives
+// exactly the pixels it was made from, BGRX rows are viewed in place, bottom-up ones through a negative stride, and a
+// DIB cut short anywhere, or with any one byte of its header changed, is either rejected or read within its bounds.
+#include "Test.h"
+
+
+enum DibFixture {
+    DIB_FIXTURE_BGRX, // What screenshots come as: V5 header, 32-bit BI_RGB, bottom-up
+    DIB_FIXTURE_BGR, // Info header, 24-bit, bottom-up
+    DIB_FIXTURE_RGBA, // V5 header, 32-bit BI_BITFIELDS in RGBA order, top-down
+    DIB_FIXTURE_MASKS, // Info header followed by three BI_BITFIELDS masks, in RGBX order, bottom-up
+    DIB_FIXTURE_COUNT,
+};
+
+
+// Swaps the red and blue channels of a pixel
+static uint32_t swapRedBlue( uint32_t c ) {
+    return ( c & 0xff00ff00 ) | ( ( c >> 16 ) & 0xff ) | ( ( c & 0xff ) << 16 );
+}
+
+
+// Makes a packed DIB of `image` in the layout of `fixture`
+static void makeDibFixture( struct PixelBuffer const* image, int fixture, struct ByteBuffer* out ) {
+    int bitCount = fixture == DIB_FIXTURE_BGR ? 24 : 32;
+    int info = fixture == DIB_FIXTURE_BGR || fixture == DIB_FIXTURE_MASKS;
+    uint32_t headerSize = (uint32_t)( info ? DIB_INFO_HEADER_SIZE : DIB_V5_HEADER_SIZE );
+    int topDown = fixture == DIB_FIXTURE_RGBA;
+    int bitfields = fixture == DIB_FIXTURE_RGBA || fixture == DIB_FIXTURE_MASKS;
+    size_t rowBytes = ( ( (size_t) image->width * bitCount + 31 ) / 32 ) * 4;
+    out->size = 0;
+    appendUint32( out, headerSize );
+    appendUint32( out, (uint32_t) image->width );
+    appendUint32( out, (uint32_t)( topDown ? -image->height : image->height ) );
+    appendUint32( out, 1 | ( bitCount << 16 ) ); // Planes and bit count
+    appendUint32( out, bitfields ? DIB_BITFIELDS : DIB_RGB );
+    appendUint32( out, (uint32_t)( rowBytes * image->height ) );
+    for( int i = 0; i < 4; ++i ) {
+        appendUint32( out, 0 ); // Resolution and colors
+    }
+    // Red, green, blue and alpha masks, in the V5 header, or the first three after the info header
+    uint32_t masks[ 4 ] = { 0x000000ff, 0x0000ff00, 0x00ff0000, fixture == DIB_FIXTURE_RGBA ? 0xff000000 : 0 };
+    size_t end = fixture == DIB_FIXTURE_MASKS ? headerSize + 12 : headerSize;
+    while( out->size < end ) {
+        appendUint32( out, bitfields && out->size < 40 + ( info ? 12u : 16u ) ? masks[ ( out->size - 40 ) / 4 ] : 0 );
+    }
+    uint8_t* row = (uint8_t*) calloc( 1, rowBytes );
+    for( int i = 0; i < image->height; ++i ) {
+        uint32_t const* in = pixelRow( image, topDown ? i : image->height - 1 - i );
+        for( int x = 0; x < image->width; ++x ) {
+            if( fixture == DIB_FIXTURE_BGR ) {
+                memcpy( row + x * 3, &in[ x ], 3 );
+            } else {
+                uint32_t c = bitfields ? swapRedBlue( in[ x ] ) : in[ x ];
+                memcpy( row + x * 4, &c, 4 );
+            }
+        }
+        appendBytes( out, row, rowBytes );
+    }
+    free( row );
+}
+
+
+// The pixel `fixture` should read back as, for pixel `c` of the image it was made from. Layouts without alpha are
+// opaque, except for BGRX, which is viewed as it is
+static uint32_t expectedPixel( int fixture, uint32_t c ) {
+    if( fixture == DIB_FIXTURE_BGR || fixture == DIB_FIXTURE_MASKS ) {
+        return c | 0xff000000;
+    }
+    return c;
+}
+
+
+static int samePixels( struct PixelBuffer const* image, struct PixelBuffer const* pixels, int fixture ) {
+    if( pixels->width != image->width || pixels->height != image->height ) {
+        return 0;
+    }
+    for( int y = 0; y < image->height; ++y ) {
+        for( int x = 0; x < image->width; ++x ) {
+            if( pixelRow( pixels, y )[ x ] != expectedPixel( fixture, pixelRow( image, y )[ x ] ) ) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+
+// Each layout, at an odd width so 24-bit rows are padded, gives exactly the pixels it was made from. Only BGRX is
+// viewed in place, bottom-up through a negative stride, starting at the last row in memory
+static void testLayouts( struct PixelBuffer const* image ) {
+    for( int fixture = 0; fixture < DIB_FIXTURE_COUNT; ++fixture ) {
+        struct ByteBuffer data = {};
+        makeDibFixture( image, fixture, &data );
+        struct DibImage dib;
+        struct PixelBuffer pixels;
+        uint32_t* converted = NULL;
+        if( CHECK( parseDib( data.data, data.size, &dib ) ) && CHECK( dibPixels( &dib, &pixels, &converted ) ) ) {
+            CHECK( samePixels( image, &pixels, fixture ) );
+            if( fixture == DIB_FIXTURE_BGRX ) {
+                CHECK( converted == NULL );
+                CHECK( pixels.stride == -(int)( dib.rowBytes / 4 ) );
+                CHECK( (uint8_t const*) pixels.pixels == data.data + data.size - dib.rowBytes );
+            } else {
+                CHECK( converted != NULL && pixels.pixels == converted && pixels.stride == image->width );
+            }
+        }
+        free( converted );
+        releaseByteBuffer( &data );
+    }
+}
+
+
+static volatile uint32_t pixelSink; // Where the pixels read go, so the reads aren't left out
+
+
+// Parses `size` bytes copied into a buffer of exactly that size, so any read past it is caught by the sanitizers, and
+// reads every pixel. Returns zero if the DIB was accepted but its rows aren't within the data
+static int parsesInBounds( uint8_t const* data, size_t size, int* accepted ) {
+    uint8_t* copy = (uint8_t*) malloc( size ? size : 1 );
+    memcpy( copy, data, size );
+    struct DibImage dib;
+    int inBounds = 1;
+    *accepted = parseDib( copy, size, &dib );
+    if( *accepted ) {
+        inBounds = dib.bits >= copy && dib.height > 0 && dib.rowBytes * dib.height <= size - ( dib.bits - copy );
+        struct PixelBuffer pixels;
+        uint32_t* converted = NULL;
+        if( inBounds && dibPixels( &dib, &pixels, &converted ) ) {
+            uint32_t sum = 0;
+            for( int y = 0; y < pixels.height; ++y ) {
+                for( int x = 0; x < pixels.width; ++x ) {
+                    sum += pixelRow( &pixels, y )[ x ];
+                }
+            }
+            pixelSink = sum;
+            free( converted );
+        }
+    }
+    free( copy );
+    return inBounds;
+}
+
+
+// Every length short of the whole DIB is rejected, and any one byte of the header, masks included, set to a few
+// different values is either rejected or parsed to rows within the data
+static void testDamaged( struct PixelBuffer const* image ) {
+    int truncatedRejected = 1;
+    int inBounds = 1;
+    int damagedAccepted = 0;
+    for( int fixture = 0; fixture < DIB_FIXTURE_COUNT; ++fixture ) {
+        struct ByteBuffer data = {};
+        makeDibFixture( image, fixture, &data );
+        for( size_t size = 0; size < data.size; ++size ) {
+            int accepted;
+            inBounds &= parsesInBounds( data.data, size, &accepted );
+            truncatedRejected &= !accepted;
+        }
+        size_t headerSize = fixture == DIB_FIXTURE_MASKS ? DIB_INFO_HEADER_SIZE + 12 :
+            ( fixture == DIB_FIXTURE_BGR ? DIB_INFO_HEADER_SIZE : DIB_V5_HEADER_SIZE );
+        for( size_t i = 0; i < headerSize; ++i ) {
+            uint8_t const values[] = { 0x00, 0xff, 0x80, 0x7f, (uint8_t)( data.data[ i ] ^ 0x01 ),
+                (uint8_t)( data.data[ i ] ^ 0x80 ) };
+            for( size_t v = 0; v < sizeof( values ); ++v ) {
+                uint8_t original = data.data[ i ];
+                data.data[ i ] = values[ v ];
+                int accepted;
+                inBounds &= parsesInBounds( data.data, data.size, &accepted );
+                damagedAccepted += accepted;
+                data.data[ i ] = original;
+            }
+        }
+        releaseByteBuffer( &data );
+    }
+    CHECK( truncatedRejected );
+    CHECK( inBounds );
+    CHECK( damagedAccepted > 0 ); // Some bytes, like the resolution, don't matter
+}
+
+
+int main( void ) {
+    struct PixelBuffer const* image = corpusImage( CORPUS_UI, 0 );
+    struct PixelRect corner = { 3, 5, 40, 28 }; // 37 x 23
+    struct PixelBuffer small = cropPixelBuffer( image, corner );
+    testLayouts( &small );
+    testDamaged( &small );
+    struct PixelRect dot = { 7, 7, 8, 8 };
+    struct PixelBuffer single = cropPixelBuffer( image, dot );
+    testLayouts( &single );
+    return testResult();
+}
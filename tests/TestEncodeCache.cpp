@@ -0,0 +1,148 @@
+// The encode cache index: saving the same pixels in the same format again is a hit, and anything else is a miss. Least
+// recently used entries are evicted to stay within the cap, and the index survives being written and read back.
+#include "Test.h"
+
+
+// What saving through the cache does with the index: look the image up, and on a miss, insert it with `size` as the
+// size of its encoded file. Returns non-zero on a hit
+static int saveThroughCache( struct EncodeCache* cache, struct PixelBuffer const* pixels, int codecIndex,
+    uint64_t size ) {
+
+    uint64_t key = encodeCacheKey( pixels, codecIndex );
+    if( lookupEncodeCache( cache, key ) ) {
+        return 1;
+    }
+    uint64_t evicted[ 4 ];
+    CHECK( insertEncodeCache( cache, key, size, evicted, 4 ) >= 0 );
+    return 0;
+}
+
+
+static void testHitsAndMisses( void ) {
+    struct PixelBuffer image = {}, copy = {};
+    CHECK( makeCorpusImage( CORPUS_UI, 301, 157, &image ) );
+    CHECK( makeCorpusImage( CORPUS_UI, 301, 157, &copy ) );
+    struct EncodeCache cache;
+    CHECK( initEncodeCache( &cache, 1 << 30 ) );
+
+    CHECK( !saveThroughCache( &cache, &image, 0, 1000 ) );
+    CHECK( saveThroughCache( &cache, &image, 0, 1000 ) );
+    CHECK( saveThroughCache( &cache, &copy, 0, 1000 ) ); // The same pixels, not the same buffer
+    CHECK( cache.hits == 2 && cache.misses == 1 );
+
+    // Another format is another file
+    CHECK( !saveThroughCache( &cache, &image, 1, 800 ) );
+    CHECK( saveThroughCache( &cache, &image, 1, 800 ) );
+    CHECK( cache.hits == 3 && cache.misses == 2 );
+
+    // So is any change to a pixel, even to only its alpha
+    pixelRow( &copy, 100 )[ 200 ] ^= 0x01000000;
+    CHECK( !saveThroughCache( &cache, &copy, 0, 1000 ) );
+    CHECK( cache.hits == 3 && cache.misses == 3 );
+
+    // A crop is keyed by the pixels in it, not where they came from: the same part of either image hits
+    struct PixelRect rect = { 10, 10, 110, 60 };
+    struct PixelBuffer cropped = cropPixelBuffer( &image, rect );
+    CHECK( !saveThroughCache( &cache, &cropped, 0, 300 ) );
+    struct PixelBuffer croppedCopy = cropPixelBuffer( &copy, rect );
+    CHECK( saveThroughCache( &cache, &croppedCopy, 0, 300 ) );
+    CHECK( cache.hits == 4 && cache.misses == 4 );
+    CHECK( cache.count == 4 && cache.totalSize == 1000 + 800 + 1000 + 300 );
+
+    releaseEncodeCache( &cache );
+    free( copy.pixels );
+    free( image.pixels );
+}
+
+
+static void testEviction( void ) {
+    struct EncodeCache cache;
+    CHECK( initEncodeCache( &cache, 300 ) );
+    uint64_t evicted[ 4 ];
+    for( uint64_t key = 1; key <= 3; ++key ) {
+        CHECK( insertEncodeCache( &cache, key, 100, evicted, 4 ) == 0 );
+    }
+    CHECK( lookupEncodeCache( &cache, 1 ) != NULL ); // Now 2 is the least recently used
+    CHECK( insertEncodeCache( &cache, 4, 100, evicted, 4 ) == 1 );
+    CHECK( evicted[ 0 ] == 2 );
+    CHECK( !lookupEncodeCache( &cache, 2 ) && lookupEncodeCache( &cache, 1 ) && lookupEncodeCache( &cache, 3 ) );
+
+    // An entry larger than the cap pushes out everything else, but stays
+    CHECK( insertEncodeCache( &cache, 5, 1000, evicted, 4 ) == 3 );
+    CHECK( cache.count == 1 && lookupEncodeCache( &cache, 5 ) && cache.totalSize == 1000 );
+    releaseEncodeCache( &cache );
+}
+
+
+// More entries to evict than there is room to report go over several inserts, so every key is reported exactly once
+// and none is dropped with its file left behind
+static void testEvictionLimit( void ) {
+    struct EncodeCache cache;
+    CHECK( initEncodeCache( &cache, 1000 ) );
+    uint64_t evicted[ 4 ];
+    for( uint64_t key = 1; key <= 10; ++key ) {
+        CHECK( insertEncodeCache( &cache, key, 100, evicted, 4 ) == 0 );
+    }
+    int reported[ 11 ] = {};
+    int counts[ 3 ];
+    uint64_t const inserts[ 3 ][ 2 ] = { { 11, 1000 }, { 12, 0 }, { 13, 0 } };
+    for( int i = 0; i < 3; ++i ) {
+        counts[ i ] = insertEncodeCache( &cache, inserts[ i ][ 0 ], inserts[ i ][ 1 ], evicted, 4 );
+        for( int j = 0; j < counts[ i ]; ++j ) {
+            reported[ evicted[ j ] <= 10 ? evicted[ j ] : 0 ] += 1;
+        }
+    }
+    CHECK( counts[ 0 ] == 4 && counts[ 1 ] == 4 && counts[ 2 ] == 2 );
+    int once = reported[ 0 ] == 0;
+    for( int key = 1; key <= 10; ++key ) {
+        once &= reported[ key ] == 1;
+    }
+    CHECK( once );
+    CHECK( cache.count == 3 && cache.totalSize == 1000 );
+    releaseEncodeCache( &cache );
+}
+
+
+static void testIndexRoundTrip( void ) {
+    struct EncodeCache cache;
+    CHECK( initEncodeCache( &cache, 1 << 20 ) );
+    for( uint64_t key = 1; key <= 200; ++key ) {
+        insertEncodeCache( &cache, key * 0x9e3779b97f4a7c15ull, key, NULL, 0 );
+    }
+    CHECK( lookupEncodeCache( &cache, 190 * 0x9e3779b97f4a7c15ull ) != NULL );
+    struct ByteBuffer index = {};
+    writeEncodeCacheIndex( &cache, &index );
+
+    struct EncodeCache loaded;
+    CHECK( initEncodeCache( &loaded, 1 << 20 ) );
+    CHECK( readEncodeCacheIndex( index.data, index.size, &loaded ) );
+    CHECK( loaded.count == cache.count && loaded.totalSize == cache.totalSize && loaded.clock == cache.clock );
+    int same = 1;
+    for( int i = 0; i < cache.count; ++i ) {
+        struct EncodeCacheEntry const* entry = &cache.entries[ i ];
+        int slot = loaded.slots[ findCacheSlot( &loaded, entry->key ) ];
+        same &= slot > 0 && loaded.entries[ slot - 1 ].size == entry->size &&
+            loaded.entries[ slot - 1 ].lastUsed == entry->lastUsed;
+    }
+    CHECK( same );
+
+    // A damaged index is an empty cache
+    struct EncodeCache damaged;
+    CHECK( initEncodeCache( &damaged, 1 << 20 ) );
+    CHECK( !readEncodeCacheIndex( index.data, index.size - 1, &damaged ) );
+    CHECK( damaged.count == 0 && damaged.totalSize == 0 );
+
+    releaseEncodeCache( &damaged );
+    releaseEncodeCache( &loaded );
+    releaseByteBuffer( &index );
+    releaseEncodeCache( &cache );
+}
+
+
+int main() {
+    testHitsAndMisses();
+    testEviction();
+    testEvictionLimit();
+    testIndexRoundTrip();
+    return testResult();
+}
@@ -0,0 +1,125 @@
+// Frame pacing, driven by a fake clock: at most one frame per display refresh, none while nothing changes, and frames
+// which render in time are never late.
+#include "Test.h"
+
+
+int const PACING_MAX_FRAMES = 512;
+
+
+struct PacingRun {
+    struct FrameScheduler scheduler;
+    int frameCount;
+    double begins[ PACING_MAX_FRAMES ]; // When each frame began
+    double deadlines[ PACING_MAX_FRAMES ];
+};
+
+
+// Three seconds of 1000 Hz input with a one second pause in the middle, on a 60 Hz display with its refreshes at 3 ms
+// past each interval, with each frame taking `renderMs` (give or take a fifth) to render. Like the message pump, input
+// which comes in while a frame renders is handled as soon as it is done
+static void runPacing( double renderMs, struct PacingRun* run ) {
+    memset( run, 0, sizeof( *run ) );
+    initFrameScheduler( &run->scheduler, 1000.0 / 60.0, 3.0 );
+    uint32_t random = 1;
+    double now = 0.0;
+    double input = 0.0; // Time of the next mouse sample
+    while( now < 4000.0 ) {
+        double delay = frameDelay( &run->scheduler, now );
+        if( delay < 0.0 || now + delay > input ) {
+            now = input > now ? input : now;
+            markFrameDirty( &run->scheduler );
+            input += 1.0;
+            if( input >= 1500.0 && input < 2500.0 ) {
+                input = 2500.0;
+            }
+        } else {
+            now += delay;
+            if( beginFrame( &run->scheduler, now ) ) {
+                if( run->frameCount < PACING_MAX_FRAMES ) {
+                    run->begins[ run->frameCount ] = now;
+                    run->deadlines[ run->frameCount++ ] = run->scheduler.deadline;
+                }
+                random = random * 1664525 + 1013904223;
+                now += renderMs * ( 0.8 + 0.4 * ( random >> 8 ) / 16777216.0 );
+                endFrame( &run->scheduler, now );
+            }
+        }
+    }
+}
+
+
+// No two frames are due at the same refresh, and none begins during the pause, once the last change before it is shown
+static int pacedToRefreshes( struct PacingRun const* run ) {
+    for( int i = 0; i < run->frameCount; ++i ) {
+        if( i > 0 && run->deadlines[ i ] < run->deadlines[ i - 1 ] + run->scheduler.interval - 1e-6 ) {
+            return 0;
+        }
+        if( run->begins[ i ] > 1500.0 + run->scheduler.interval * 2 && run->begins[ i ] < 2500.0 ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+static void testFastFrames( void ) {
+    struct PacingRun run;
+    runPacing( 4.0, &run );
+    CHECK( run.scheduler.requests == 3001 );
+    CHECK( run.scheduler.frames == (uint64_t) run.frameCount );
+    CHECK( pacedToRefreshes( &run ) );
+    // Three seconds of input at 60 Hz is 180 refreshes, and each should get a frame
+    CHECK( run.frameCount >= 178 && run.frameCount <= 182 );
+    CHECK( run.scheduler.missed == 0 );
+}
+
+
+// A frame taking most of an interval waits for the start of the next one rather than being late
+static void testSlowFrames( void ) {
+    struct PacingRun run;
+    runPacing( 12.0, &run );
+    CHECK( pacedToRefreshes( &run ) );
+    CHECK( run.frameCount >= 170 && run.frameCount <= 182 );
+    CHECK( run.scheduler.missed == 0 );
+}
+
+
+// Frames longer than an interval can only be shown every other refresh or so, so there are about half as many
+static void testOverlongFrames( void ) {
+    struct PacingRun run;
+    runPacing( 20.0, &run );
+    CHECK( pacedToRefreshes( &run ) );
+    CHECK( run.frameCount >= 85 && run.frameCount <= 100 );
+}
+
+
+// Nothing is rendered until something changes, and then right away if there is time before the refresh
+static void testIdle( void ) {
+    struct FrameScheduler scheduler;
+    initFrameScheduler( &scheduler, 10.0, 0.0 );
+    CHECK( frameDelay( &scheduler, 1.0 ) < 0.0 );
+    CHECK( !beginFrame( &scheduler, 1.0 ) );
+    markFrameDirty( &scheduler );
+    markFrameDirty( &scheduler );
+    CHECK( frameDelay( &scheduler, 1.0 ) == 0.0 );
+    CHECK( beginFrame( &scheduler, 1.0 ) );
+    CHECK( scheduler.deadline == 10.0 );
+    CHECK( endFrame( &scheduler, 3.0 ) );
+    CHECK( frameDelay( &scheduler, 3.0 ) < 0.0 );
+    // A change during the same interval waits for the next one
+    markFrameDirty( &scheduler );
+    CHECK( fabs( frameDelay( &scheduler, 4.0 ) - 6.0 ) < 1e-9 );
+    CHECK( !beginFrame( &scheduler, 4.0 ) );
+    CHECK( beginFrame( &scheduler, 10.0 ) );
+    CHECK( !endFrame( &scheduler, 21.0 ) ); // After its refresh at 20
+    CHECK( scheduler.frames == 2 && scheduler.requests == 3 && scheduler.missed == 1 );
+}
+
+
+int main() {
+    testIdle();
+    testFastFrames();
+    testSlowFrames();
+    testOverlongFrames();
+    return testResult();
+}
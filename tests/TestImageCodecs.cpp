@@ -0,0 +1,131 @@
+// The QOI and raw codecs decode what they encoded: the same pixels, at any size and from any view of a buffer. Both
+// write opaque images, so whatever alpha the pixels had comes back opaque.
+#include "Test.h"
+
+
+static uint32_t testRandom( uint32_t* state ) {
+    *state = *state * 1664525 + 1013904223;
+    return *state;
+}
+
+
+// Returns non-zero if `decoded` has the size of `source`, and its pixels with opaque alpha
+static int decodesTo( struct PixelBuffer const* decoded, struct PixelBuffer const* source ) {
+    if( decoded->width != source->width || decoded->height != source->height ) {
+        return 0;
+    }
+    for( int y = 0; y < source->height; ++y ) {
+        for( int x = 0; x < source->width; ++x ) {
+            if( pixelRow( decoded, y )[ x ] != ( pixelRow( source, y )[ x ] | 0xff000000 ) ) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+
+static void checkRoundTrip( struct PixelBuffer const* source, char const* what ) {
+    for( int i = 0; i < (int)( sizeof( imageCodecs ) / sizeof( *imageCodecs ) ); ++i ) {
+        struct ImageCodec const* codec = &imageCodecs[ i ];
+        if( !codec->decode ) {
+            continue;
+        }
+        struct ByteBuffer encoded = {};
+        struct PixelBuffer decoded = {};
+        CHECK( codec->encode( source, 0.0, &encoded ) );
+        if( !CHECK( codec->decode( encoded.data, encoded.size, &decoded ) && decodesTo( &decoded, source ) ) ) {
+            fprintf( stderr, "  %ls, %s, %dx%d\n", codec->name, what, source->width, source->height );
+        }
+        free( decoded.pixels );
+        releaseByteBuffer( &encoded );
+    }
+}
+
+
+// Every kind of corpus image at odd sizes, including single pixels, rows and columns
+static void testCorpus( void ) {
+    int const sizes[][ 2 ] = { { 1, 1 }, { 1, 37 }, { 53, 1 }, { 3, 5 }, { 257, 131 } };
+    for( int kind = 0; kind < CORPUS_KIND_COUNT; ++kind ) {
+        for( size_t s = 0; s < sizeof( sizes ) / sizeof( *sizes ); ++s ) {
+            struct PixelBuffer image = {};
+            CHECK( makeCorpusImage( (enum CorpusKind) kind, sizes[ s ][ 0 ], sizes[ s ][ 1 ], &image ) );
+            checkRoundTrip( &image, corpusKindNames[ kind ] );
+            free( image.pixels );
+        }
+    }
+}
+
+
+// Noise with random alpha, which only takes the full-color QOI op, a flat image long enough for several runs, and
+// crops and a bottom-up view of them, whose rows aren't packed
+static void testViews( void ) {
+    int const width = 131, height = 67;
+    struct PixelBuffer noise = { (uint32_t*) malloc( sizeof( uint32_t ) * width * height ), width, height, width };
+    struct PixelBuffer flat = { (uint32_t*) malloc( sizeof( uint32_t ) * width * height ), width, height, width };
+    uint32_t seed = 3;
+    for( int i = 0; i < width * height; ++i ) {
+        noise.pixels[ i ] = testRandom( &seed );
+        flat.pixels[ i ] = i < width * height / 2 ? 0x00336699 : 0x80336699;
+    }
+    checkRoundTrip( &noise, "noise" );
+    checkRoundTrip( &flat, "flat" );
+    struct PixelRect rect = { 7, 3, 100, 64 };
+    struct PixelBuffer cropped = cropPixelBuffer( &noise, rect );
+    checkRoundTrip( &cropped, "cropped noise" );
+    struct PixelBuffer bottomUp = { noise.pixels + width * ( height - 1 ), width, height, -width };
+    checkRoundTrip( &bottomUp, "bottom-up noise" );
+    free( flat.pixels );
+    free( noise.pixels );
+}
+
+
+// The QOI decoder also reads the alpha of 4-channel files written elsewhere: a full-color pixel with alpha, a run of
+// it, and a pixel from the index with its own alpha
+static void testQoiAlpha( void ) {
+    uint8_t const data[] = { 'q', 'o', 'i', 'f', 0, 0, 0, 4, 0, 0, 0, 1, 4, 0,
+        0xff, 0x10, 0x20, 0x30, 0x40, // QOI_OP_RGBA
+        0xc0 | 1, // QOI_OP_RUN of 2
+        0xfe, 0x11, 0x22, 0x33, // QOI_OP_RGB, keeping the alpha of 0x40
+        0, 0, 0, 0, 0, 0, 0, 1 };
+    struct PixelBuffer decoded = {};
+    CHECK( decodeQoi( data, sizeof( data ), &decoded ) );
+    CHECK( decoded.width == 4 && decoded.height == 1 );
+    if( decoded.pixels ) {
+        CHECK( decoded.pixels[ 0 ] == 0x40102030 && decoded.pixels[ 1 ] == 0x40102030 &&
+            decoded.pixels[ 2 ] == 0x40102030 && decoded.pixels[ 3 ] == 0x40112233 );
+    }
+    free( decoded.pixels );
+}
+
+
+// Encoded data cut short anywhere is rejected
+static void testTruncated( void ) {
+    struct PixelBuffer image = {};
+    CHECK( makeCorpusImage( CORPUS_UI, 37, 23, &image ) );
+    for( int i = 0; i < (int)( sizeof( imageCodecs ) / sizeof( *imageCodecs ) ); ++i ) {
+        struct ImageCodec const* codec = &imageCodecs[ i ];
+        if( !codec->decode ) {
+            continue;
+        }
+        struct ByteBuffer encoded = {};
+        CHECK( codec->encode( &image, 0.0, &encoded ) );
+        int rejected = 1;
+        for( size_t size = 0; size + QOI_END_SIZE < encoded.size; ++size ) {
+            struct PixelBuffer decoded = {};
+            rejected &= !codec->decode( encoded.data, size, &decoded ) && !decoded.pixels;
+        }
+        CHECK( rejected );
+        releaseByteBuffer( &encoded );
+    }
+    free( image.pixels );
+}
+
+
+int main() {
+    testCorpus();
+    testViews();
+    testQoiAlpha();
+    testTruncated();
+    return testResult();
+}
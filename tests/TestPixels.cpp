@@ -0,0 +1,63 @@
+// Pixel buffer views and rectangles, which the capture, redaction and encoding code all build on, and the corpus the
+// other tests and the benchmarks run on.
+#include "Test.h"
+
+
+static void testCropSharesPixels( void ) {
+    struct PixelBuffer image = {};
+    CHECK( makeCorpusImage( CORPUS_UI, 320, 200, &image ) );
+    struct PixelRect rect = { 10, 20, 110, 70 };
+    struct PixelBuffer view = cropPixelBuffer( &image, rect );
+    CHECK( view.width == 100 && view.height == 50 && view.stride == image.stride );
+    CHECK( pixelRow( &view, 0 ) == pixelRow( &image, 20 ) + 10 );
+    CHECK( pixelRow( &view, 49 ) == pixelRow( &image, 69 ) + 10 );
+    free( image.pixels );
+}
+
+
+// A bottom-up view, as a DIB is stored, is the same pixels with a negative stride
+static void testBottomUpRows( void ) {
+    uint32_t pixels[ 4 * 3 ];
+    for( int i = 0; i < 12; ++i ) {
+        pixels[ i ] = (uint32_t) i;
+    }
+    struct PixelBuffer bottomUp = { pixels + 4 * 2, 4, 3, -4 };
+    CHECK( pixelRow( &bottomUp, 0 )[ 0 ] == 8 );
+    CHECK( pixelRow( &bottomUp, 2 )[ 3 ] == 3 );
+    struct PixelRect rect = { 1, 1, 3, 3 };
+    struct PixelBuffer view = cropPixelBuffer( &bottomUp, rect );
+    CHECK( pixelRow( &view, 0 )[ 0 ] == 5 && pixelRow( &view, 1 )[ 1 ] == 2 );
+}
+
+
+static void testRects( void ) {
+    struct PixelRect a = { 0, 0, 10, 10 }, b = { 5, -5, 20, 8 }, c = { 10, 0, 12, 10 };
+    struct PixelRect i = intersectPixelRect( a, b );
+    CHECK( i.left == 5 && i.top == 0 && i.right == 10 && i.bottom == 8 );
+    struct PixelRect u = unionPixelRect( a, b );
+    CHECK( u.left == 0 && u.top == -5 && u.right == 20 && u.bottom == 10 );
+    CHECK( !pixelRectsIntersect( a, c ) ); // Right and bottom are exclusive
+    CHECK( pixelRectEmpty( intersectPixelRect( a, c ) ) );
+}
+
+
+// The corpus is generated from a fixed seed, so results can be compared between runs
+static void testCorpusIsRepeatable( void ) {
+    for( int kind = 0; kind < CORPUS_KIND_COUNT; ++kind ) {
+        struct PixelBuffer first = {}, second = {};
+        CHECK( makeCorpusImage( (enum CorpusKind) kind, 257, 131, &first ) );
+        CHECK( makeCorpusImage( (enum CorpusKind) kind, 257, 131, &second ) );
+        CHECK( hashPixels( &first, 0 ) == hashPixels( &second, 0 ) );
+        free( first.pixels );
+        free( second.pixels );
+    }
+}
+
+
+int main() {
+    testCropSharesPixels();
+    testBottomUpRows();
+    testRects();
+    testCorpusIsRepeatable();
+    return testResult();
+}
@@ -0,0 +1,416 @@
+// The PNG encoder decodes to what it encoded: every chunk has the right CRC, and the IDAT stream, inflated by the small
+// inflater here and unfiltered, gives exactly the source pixels, at 8 and 16 bits, at every level, with one thread or
+// several, for heights below, at and across multiples of the strip size, down to single pixels. The budgeted encoder
+// returns a level it has, and its output decodes the same way.
+#include "Test.h"
+
+
+int const PNG_TEST_THREADS = 4;
+
+
+static uint32_t readBigEndian32( uint8_t const* p ) {
+    return ( (uint32_t) p[ 0 ] << 24 ) | ( (uint32_t) p[ 1 ] << 16 ) | ( (uint32_t) p[ 2 ] << 8 ) | p[ 3 ];
+}
+
+
+// LSB-first bit reader over a deflate stream, like the `BitWriter` which wrote it
+struct Inflater {
+    uint8_t const* data;
+    size_t size;
+    size_t position;
+    uint32_t bits;
+    int count;
+    int failed; // Set on reading past the end, or anything a decoder would reject
+};
+
+
+static int inflateBits( struct Inflater* in, int count ) {
+    uint32_t value = in->bits;
+    while( in->count < count ) {
+        if( in->position >= in->size ) {
+            in->failed = 1;
+            return 0;
+        }
+        value |= (uint32_t) in->data[ in->position++ ] << in->count;
+        in->count += 8;
+    }
+    in->bits = value >> count;
+    in->count -= count;
+    return (int)( value & ( ( 1u << count ) - 1 ) );
+}
+
+
+// A canonical Huffman code: how many codes there are of each length, and the symbols in code order
+struct InflateCode {
+    int counts[ 16 ];
+    int symbols[ 288 ];
+};
+
+
+static void buildInflateCode( struct InflateCode* code, uint8_t const* lengths, int count ) {
+    int offsets[ 16 ] = {};
+    memset( code->counts, 0, sizeof( code->counts ) );
+    for( int i = 0; i < count; ++i ) {
+        ++code->counts[ lengths[ i ] ];
+    }
+    code->counts[ 0 ] = 0;
+    for( int length = 1; length < 15; ++length ) {
+        offsets[ length + 1 ] = offsets[ length ] + code->counts[ length ];
+    }
+    for( int i = 0; i < count; ++i ) {
+        if( lengths[ i ] ) {
+            code->symbols[ offsets[ lengths[ i ] ]++ ] = i;
+        }
+    }
+}
+
+
+// Reads one symbol a bit at a time, which is slow but needs no tables
+static int inflateSymbol( struct Inflater* in, struct InflateCode const* code ) {
+    int value = 0;
+    int first = 0;
+    int index = 0;
+    for( int length = 1; length < 16; ++length ) {
+        value |= inflateBits( in, 1 );
+        int count = code->counts[ length ];
+        if( value - first < count ) {
+            return code->symbols[ index + value - first ];
+        }
+        index += count;
+        first = ( first + count ) << 1;
+        value <<= 1;
+    }
+    in->failed = 1;
+    return 0;
+}
+
+
+// Inflates the literals and matches of one Huffman coded block
+static void inflateCodes( struct Inflater* in, struct InflateCode const* literals, struct InflateCode const* distances,
+    struct ByteBuffer* out ) {
+
+    while( !in->failed ) {
+        int symbol = inflateSymbol( in, literals );
+        if( symbol < 256 ) {
+            appendByte( out, (uint8_t) symbol );
+            continue;
+        }
+        if( symbol == 256 ) {
+            return;
+        }
+        symbol -= 257;
+        if( symbol >= 29 ) {
+            in->failed = 1;
+            return;
+        }
+        int length = deflateLengthBase[ symbol ] + inflateBits( in, deflateLengthExtra[ symbol ] );
+        int code = inflateSymbol( in, distances );
+        if( code >= 30 ) {
+            in->failed = 1;
+            return;
+        }
+        size_t distance = deflateDistanceBase[ code ] + inflateBits( in, deflateDistanceExtra[ code ] );
+        if( distance > out->size ) {
+            in->failed = 1;
+            return;
+        }
+        for( int i = 0; i < length; ++i ) {
+            appendByte( out, out->data[ out->size - distance ] );
+        }
+    }
+}
+
+
+// Reads the code lengths of a dynamic block and builds its two codes
+static void readDynamicCodes( struct Inflater* in, struct InflateCode* literals, struct InflateCode* distances ) {
+    int literalCount = inflateBits( in, 5 ) + 257;
+    int distanceCount = inflateBits( in, 5 ) + 1;
+    int lengthCount = inflateBits( in, 4 ) + 4;
+    uint8_t lengths[ 320 ] = {};
+    for( int i = 0; i < lengthCount; ++i ) {
+        lengths[ deflateCodeLengthOrder[ i ] ] = (uint8_t) inflateBits( in, 3 );
+    }
+    struct InflateCode lengthCode;
+    buildInflateCode( &lengthCode, lengths, 19 );
+    int total = literalCount + distanceCount;
+    for( int i = 0; i < total && !in->failed; ) {
+        int symbol = inflateSymbol( in, &lengthCode );
+        if( symbol < 16 ) {
+            lengths[ i++ ] = (uint8_t) symbol;
+            continue;
+        }
+        if( symbol == 16 && i == 0 ) {
+            in->failed = 1;
+            return;
+        }
+        uint8_t value = symbol == 16 ? lengths[ i - 1 ] : 0;
+        int repeat = symbol == 16 ? 3 + inflateBits( in, 2 ) :
+            ( symbol == 17 ? 3 + inflateBits( in, 3 ) : 11 + inflateBits( in, 7 ) );
+        if( i + repeat > total ) {
+            in->failed = 1;
+            return;
+        }
+        while( repeat-- > 0 ) {
+            lengths[ i++ ] = value;
+        }
+    }
+    buildInflateCode( literals, lengths, literalCount );
+    buildInflateCode( distances, lengths + literalCount, distanceCount );
+}
+
+
+// Inflates a whole zlib stream, checking its header and Adler-32. Returns zero if it is malformed in any way
+static int inflateZlib( uint8_t const* data, size_t size, struct ByteBuffer* out ) {
+    if( size < 6 || ( data[ 0 ] & 0x0f ) != 8 || ( data[ 0 ] * 256 + data[ 1 ] ) % 31 != 0 || ( data[ 1 ] & 0x20 ) ) {
+        return 0;
+    }
+    struct Inflater in = { data + 2, size - 6, 0, 0, 0, 0 };
+    int last = 0;
+    while( !last && !in.failed ) {
+        last = inflateBits( &in, 1 );
+        int type = inflateBits( &in, 2 );
+        if( type == 0 ) {
+            in.bits = 0; // The rest of the current byte
+            in.count = 0;
+            if( in.size - in.position < 4 ) {
+                return 0;
+            }
+            uint8_t const* header = in.data + in.position;
+            size_t length = header[ 0 ] | ( header[ 1 ] << 8 );
+            if( ( length ^ ( header[ 2 ] | ( header[ 3 ] << 8 ) ) ) != 0xffff || in.size - in.position - 4 < length ) {
+                return 0;
+            }
+            appendBytes( out, header + 4, length );
+            in.position += 4 + length;
+        } else if( type == 1 ) {
+            uint8_t lengths[ 320 ];
+            memset( lengths, 8, 144 );
+            memset( lengths + 144, 9, 112 );
+            memset( lengths + 256, 7, 24 );
+            memset( lengths + 280, 8, 8 );
+            memset( lengths + 288, 5, 30 );
+            struct InflateCode literals, distances;
+            buildInflateCode( &literals, lengths, 288 );
+            buildInflateCode( &distances, lengths + 288, 30 );
+            inflateCodes( &in, &literals, &distances, out );
+        } else if( type == 2 ) {
+            struct InflateCode literals, distances;
+            readDynamicCodes( &in, &literals, &distances );
+            inflateCodes( &in, &literals, &distances, out );
+        } else {
+            return 0;
+        }
+    }
+    return !in.failed && in.position == in.size && !out->failed &&
+        adler32( 1, out->data, out->size ) == readBigEndian32( data + size - 4 );
+}
+
+
+// A decoded PNG: its header, and its rows of big endian RGB samples, unfiltered and without the filter type bytes
+struct DecodedPng {
+    int width;
+    int height;
+    int bitDepth;
+    struct ByteBuffer rows;
+};
+
+
+// Undoes the filter of `type` on `row`, in place, given the unfiltered row above
+static int unfilterRow( int type, uint8_t* row, uint8_t const* prior, int size, int bpp ) {
+    if( type > 4 ) {
+        return 0;
+    }
+    for( int i = 0; i < size; ++i ) {
+        int a = i >= bpp ? row[ i - bpp ] : 0;
+        int b = prior[ i ];
+        int c = i >= bpp ? prior[ i - bpp ] : 0;
+        int p = a + b - c;
+        int pa = abs( p - a ), pb = abs( p - b ), pc = abs( p - c );
+        int predicted[ 5 ] = { 0, a, b, ( a + b ) / 2, pa <= pb && pa <= pc ? a : ( pb <= pc ? b : c ) };
+        row[ i ] = (uint8_t)( row[ i ] + predicted[ type ] );
+    }
+    return 1;
+}
+
+
+// Decodes an RGB PNG as the encoder writes it: checks the signature and every chunk's CRC, joins the IDAT chunks,
+// inflates them and unfilters the rows. Returns zero if anything is off
+static int decodePng( uint8_t const* data, size_t size, struct DecodedPng* png ) {
+    static uint8_t const signature[ 8 ] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    if( size < 8 || memcmp( data, signature, 8 ) != 0 ) {
+        return 0;
+    }
+    struct ByteBuffer stream = {};
+    size_t position = 8;
+    int ended = 0;
+    int valid = 1;
+    png->width = 0;
+    while( valid && !ended && size - position >= 12 ) {
+        uint8_t const* chunk = data + position;
+        uint32_t length = readBigEndian32( chunk );
+        if( size - position - 12 < length ) {
+            valid = 0;
+            break;
+        }
+        valid &= readBigEndian32( chunk + 8 + length ) == pngCrc( 0, chunk + 4, length + 4 );
+        if( memcmp( chunk + 4, "IHDR", 4 ) == 0 && length == 13 ) {
+            png->width = (int) readBigEndian32( chunk + 8 );
+            png->height = (int) readBigEndian32( chunk + 12 );
+            png->bitDepth = chunk[ 16 ];
+            valid &= ( png->bitDepth == 8 || png->bitDepth == 16 ) && chunk[ 17 ] == 2 && chunk[ 18 ] == 0 &&
+                chunk[ 19 ] == 0 && chunk[ 20 ] == 0;
+        } else if( memcmp( chunk + 4, "IDAT", 4 ) == 0 ) {
+            appendBytes( &stream, chunk + 8, length );
+        } else if( memcmp( chunk + 4, "IEND", 4 ) == 0 ) {
+            ended = 1;
+        }
+        position += 12 + length;
+    }
+    struct ByteBuffer filtered = {};
+    valid = valid && ended && position == size && png->width > 0 && inflateZlib( stream.data, stream.size, &filtered );
+    int bpp = png->bitDepth * 3 / 8;
+    size_t rowSize = (size_t) png->width * bpp;
+    valid = valid && filtered.size == ( rowSize + 1 ) * png->height;
+    png->rows.size = 0;
+    uint8_t* zeros = (uint8_t*) calloc( rowSize + 1, 1 );
+    for( int y = 0; valid && y < png->height; ++y ) {
+        uint8_t* line = filtered.data + ( rowSize + 1 ) * y;
+        appendBytes( &png->rows, line + 1, rowSize );
+        uint8_t const* prior = y > 0 ? png->rows.data + rowSize * ( y - 1 ) : zeros;
+        valid = !png->rows.failed && unfilterRow( line[ 0 ], png->rows.data + rowSize * y, prior, (int) rowSize, bpp );
+    }
+    free( zeros );
+    releaseByteBuffer( &filtered );
+    releaseByteBuffer( &stream );
+    return valid;
+}
+
+
+static int decodesToPixels( struct ByteBuffer const* encoded, struct PixelBuffer const* image ) {
+    struct DecodedPng png = {};
+    int same = decodePng( encoded->data, encoded->size, &png ) && png.bitDepth == 8 && png.width == image->width &&
+        png.height == image->height;
+    for( int y = 0; same && y < image->height; ++y ) {
+        uint8_t const* row = png.rows.data + (size_t) y * image->width * 3;
+        for( int x = 0; x < image->width; ++x ) {
+            uint32_t p = pixelRow( image, y )[ x ];
+            same &= row[ x * 3 ] == (uint8_t)( p >> 16 ) && row[ x * 3 + 1 ] == (uint8_t)( p >> 8 ) &&
+                row[ x * 3 + 2 ] == (uint8_t) p;
+        }
+    }
+    releaseByteBuffer( &png.rows );
+    return same;
+}
+
+
+static int decodesToWidePixels( struct ByteBuffer const* encoded, struct WidePixelBuffer const* image ) {
+    struct DecodedPng png = {};
+    int same = decodePng( encoded->data, encoded->size, &png ) && png.bitDepth == 16 && png.width == image->width &&
+        png.height == image->height;
+    for( int y = 0; same && y < image->height; ++y ) {
+        uint8_t const* row = png.rows.data + (size_t) y * image->width * 6;
+        for( int x = 0; x < image->width * 3; ++x ) {
+            same &= ( ( row[ x * 2 ] << 8 ) | row[ x * 2 + 1 ] ) == widePixelRow( image, y )[ x / 3 * 4 + x % 3 ];
+        }
+    }
+    releaseByteBuffer( &png.rows );
+    return same;
+}
+
+
+// Heights around the multiples of the strip size, where strips begin and end, and a few widths down to a single pixel
+static int const pngTestHeights[] = { 1, 2, PNG_STRIP_ROWS - 1, PNG_STRIP_ROWS, PNG_STRIP_ROWS + 1,
+    PNG_STRIP_ROWS * 2, PNG_STRIP_ROWS * 2 + 1, PNG_STRIP_ROWS * PNG_TEST_THREADS * 2 + 3 };
+static int const pngTestWidths[] = { 1, 2, 37 };
+
+
+// A corpus image of each kind at each size, at every level, with one thread and several
+static void test8Bit( void ) {
+    int decoded = 1;
+    for( int kind = 0; kind < CORPUS_KIND_COUNT; ++kind ) {
+        for( size_t w = 0; w < sizeof( pngTestWidths ) / sizeof( *pngTestWidths ); ++w ) {
+            for( size_t h = 0; h < sizeof( pngTestHeights ) / sizeof( *pngTestHeights ); ++h ) {
+                struct PixelBuffer image = {};
+                enum CorpusKind corpusKind = (enum CorpusKind) kind;
+                if( !CHECK( makeCorpusImage( corpusKind, pngTestWidths[ w ], pngTestHeights[ h ], &image ) ) ) {
+                    continue;
+                }
+                for( int level = 0; level < PNG_LEVEL_COUNT; ++level ) {
+                    for( int threads = 1; threads <= PNG_TEST_THREADS; threads += PNG_TEST_THREADS - 1 ) {
+                        struct ByteBuffer encoded = {};
+                        int same = encodePng( &image, level, threads, &encoded ) && decodesToPixels( &encoded, &image );
+                        if( !same ) {
+                            fprintf( stderr, "  %s, %dx%d, level %d, %d threads\n", corpusKindNames[ kind ],
+                                image.width, image.height, level, threads );
+                        }
+                        decoded &= same;
+                        releaseByteBuffer( &encoded );
+                    }
+                }
+                free( image.pixels );
+            }
+        }
+    }
+    CHECK( decoded );
+}
+
+
+// Random 16-bit samples in smooth ramps, so the levels find matches, from a view whose rows aren't packed
+static void test16Bit( void ) {
+    int decoded = 1;
+    uint32_t random = 5;
+    for( size_t w = 0; w < sizeof( pngTestWidths ) / sizeof( *pngTestWidths ); ++w ) {
+        for( size_t h = 0; h < sizeof( pngTestHeights ) / sizeof( *pngTestHeights ); ++h ) {
+            int width = pngTestWidths[ w ], height = pngTestHeights[ h ];
+            struct WidePixelBuffer image = { (uint16_t*) malloc( sizeof( uint16_t ) * 4 * ( width + 3 ) * height ),
+                width, height, width + 3 };
+            for( int y = 0; y < height; ++y ) {
+                for( int x = 0; x < ( width + 3 ) * 4; ++x ) {
+                    random = random * 1664525 + 1013904223;
+                    image.pixels[ y * ( width + 3 ) * 4 + x ] = (uint16_t)( ( random >> 28 ) + x * 97 + y * 1031 );
+                }
+            }
+            for( int level = 0; level < PNG_LEVEL_COUNT; ++level ) {
+                for( int threads = 1; threads <= PNG_TEST_THREADS; threads += PNG_TEST_THREADS - 1 ) {
+                    struct ByteBuffer encoded = {};
+                    int same = encodePng16( &image, level, threads, &encoded ) &&
+                        decodesToWidePixels( &encoded, &image );
+                    if( !same ) {
+                        fprintf( stderr, "  16-bit, %dx%d, level %d, %d threads\n", width, height, level, threads );
+                    }
+                    decoded &= same;
+                    releaseByteBuffer( &encoded );
+                }
+            }
+            free( image.pixels );
+        }
+    }
+    CHECK( decoded );
+}
+
+
+// No time at all gets the lowest level, and plenty gets a level in range, both decoding to the image
+static void testBudgeted( void ) {
+    struct PixelBuffer image = {};
+    if( !CHECK( makeCorpusImage( CORPUS_UI, 400, 300, &image ) ) ) {
+        return;
+    }
+    double const budgets[] = { 0.0, 1e6 };
+    for( size_t i = 0; i < sizeof( budgets ) / sizeof( *budgets ); ++i ) {
+        struct ByteBuffer encoded = {};
+        int level = encodePngBudgeted( &image, budgets[ i ], &encoded );
+        CHECK( level >= 0 && level < PNG_LEVEL_COUNT );
+        CHECK( budgets[ i ] > 0.0 || level == 0 );
+        CHECK( decodesToPixels( &encoded, &image ) );
+        releaseByteBuffer( &encoded );
+    }
+    free( image.pixels );
+}
+
+
+int main( void ) {
+    test8Bit();
+    test16Bit();
+    testBudgeted();
+    return testResult();
+}
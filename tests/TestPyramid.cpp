@@ -0,0 +1,127 @@
+// The smaller copies saved alongside a snippet, made through the pyramid and encoded in parallel, against scaling the
+// snippet down in a single pass of the box filter: the sizes are the same, and so are the pixels, to within rounding
+// where the scale is a power of two, and to within a few steps on smooth content otherwise. Elsewhere the pyramid's
+// filter is wider than a single box, which softens sharp text a little more, so only the average difference is held.
+#include "Test.h"
+
+
+int const PYRAMID_TEST_MEAN_ERROR = 10; // Largest average difference per channel, in steps, for any content
+int const PYRAMID_TEST_SMOOTH_ERROR = 8; // Largest difference in any channel for gradients and photos
+
+
+struct ScaleError {
+    int max;
+    double mean;
+};
+
+
+// Differences in the color channels between `a` and `b`, which must be the same size
+static struct ScaleError scaleError( struct PixelBuffer const* a, struct PixelBuffer const* b ) {
+    struct ScaleError error = { 0, 0.0 };
+    for( int y = 0; y < a->height; ++y ) {
+        for( int x = 0; x < a->width; ++x ) {
+            for( int shift = 0; shift < 24; shift += 8 ) {
+                int d = abs( (int)( ( pixelRow( a, y )[ x ] >> shift ) & 0xff ) -
+                    (int)( ( pixelRow( b, y )[ x ] >> shift ) & 0xff ) );
+                error.max = d > error.max ? d : error.max;
+                error.mean += d;
+            }
+        }
+    }
+    error.mean /= 3.0 * a->width * a->height;
+    return error;
+}
+
+
+// Saves `image` at its own size, at 1x for `scale`, and as a thumbnail, the way the tool does, through the raw codec so
+// the results can be read back. The first must be the image itself, and the others are checked against a single pass
+static void checkResolutions( struct PixelBuffer const* image, float scale, enum CorpusKind kind ) {
+    struct ImageCodec const* raw = findImageCodec( L"raw" );
+    int thumbWidth, thumbHeight;
+    thumbnailSize( image->width, image->height, &thumbWidth, &thumbHeight );
+    int width = (int)( image->width / scale + 0.5f );
+    int height = (int)( image->height / scale + 0.5f );
+    struct ResolutionOutput outputs[ 3 ] = {
+        { image->width, image->height, raw },
+        { width > 1 ? width : 1, height > 1 ? height : 1, raw },
+        { thumbWidth, thumbHeight, raw },
+    };
+    CHECK( encodeResolutions( image, outputs, 3, 0.0 ) );
+    for( int i = 0; i < 3; ++i ) {
+        struct PixelBuffer decoded = {};
+        if( !CHECK( outputs[ i ].result && raw->decode( outputs[ i ].encoded.data, outputs[ i ].encoded.size,
+            &decoded ) ) ) {
+            releaseByteBuffer( &outputs[ i ].encoded );
+            continue;
+        }
+        CHECK( decoded.width == outputs[ i ].width && decoded.height == outputs[ i ].height );
+        struct PixelBuffer single = { (uint32_t*) malloc( sizeof( uint32_t ) * decoded.width * decoded.height ),
+            decoded.width, decoded.height, decoded.width };
+        struct ScaleError error = { 0, 0.0 };
+        if( i == 0 ) {
+            error = scaleError( &decoded, image );
+        } else if( CHECK( resamplePixels( image, &single ) ) ) {
+            error = scaleError( &decoded, &single );
+        }
+        int powerOfTwo = 0;
+        for( int k = 0; k < PYRAMID_MAX_LEVELS; ++k ) {
+            powerOfTwo |= image->width == decoded.width << k && image->height == decoded.height << k;
+        }
+        int ok = 1;
+        if( i == 0 ) {
+            ok = error.max == 0;
+        } else if( powerOfTwo ) {
+            ok = error.max <= 1; // Rounded after each halving rather than once
+        } else {
+            int smooth = kind == CORPUS_GRADIENT || kind == CORPUS_PHOTO;
+            ok = error.mean <= PYRAMID_TEST_MEAN_ERROR && ( !smooth || error.max <= PYRAMID_TEST_SMOOTH_ERROR );
+        }
+        if( !CHECK( ok ) ) {
+            fprintf( stderr, "  %s, %dx%d to %dx%d, largest difference %d, average %.2f\n", corpusKindNames[ kind ],
+                image->width, image->height, decoded.width, decoded.height, error.max, error.mean );
+        }
+        free( single.pixels );
+        free( decoded.pixels );
+        releaseByteBuffer( &outputs[ i ].encoded );
+    }
+}
+
+
+// Display scales the tool sees, sizes which halve evenly and ones which don't, and sizes already below a thumbnail
+static void testResolutions( void ) {
+    int const sizes[][ 2 ] = { { 1920, 1080 }, { 1001, 777 }, { 1024, 512 }, { 200, 120 }, { 37, 1 } };
+    float const scales[] = { 1.0f, 1.25f, 1.5f, 2.0f, 4.0f };
+    for( int kind = 0; kind < CORPUS_KIND_COUNT; ++kind ) {
+        for( size_t s = 0; s < sizeof( sizes ) / sizeof( *sizes ); ++s ) {
+            struct PixelBuffer image = {};
+            if( !CHECK( makeCorpusImage( (enum CorpusKind) kind, sizes[ s ][ 0 ], sizes[ s ][ 1 ], &image ) ) ) {
+                continue;
+            }
+            for( size_t i = 0; i < sizeof( scales ) / sizeof( *scales ); ++i ) {
+                checkResolutions( &image, scales[ i ], (enum CorpusKind) kind );
+            }
+            free( image.pixels );
+        }
+    }
+}
+
+
+// The thumbnail has THUMBNAIL_SIZE on its longest side, keeping the aspect ratio, and no side below one pixel
+static void testThumbnailSize( void ) {
+    int width, height;
+    thumbnailSize( 1920, 1080, &width, &height );
+    CHECK( width == THUMBNAIL_SIZE && height == 1080 * THUMBNAIL_SIZE / 1920 );
+    thumbnailSize( 300, 4000, &width, &height );
+    CHECK( height == THUMBNAIL_SIZE && width == 300 * THUMBNAIL_SIZE / 4000 );
+    thumbnailSize( 10000, 3, &width, &height );
+    CHECK( width == THUMBNAIL_SIZE && height == 1 );
+    thumbnailSize( 200, 100, &width, &height );
+    CHECK( width == 200 && height == 100 );
+}
+
+
+int main( void ) {
+    testResolutions();
+    testThumbnailSize();
+    return testResult();
+}
@@ -0,0 +1,154 @@
+// Redaction, against a plain reference which averages every cell and window directly, for each instruction set level
+// the processor supports. All of them have to give exactly the same pixels.
+#include "Test.h"
+
+
+// The average of `count` pixels, rounded as the kernels round it
+static uint32_t referenceAverage( uint32_t const* pixels, int count ) {
+    uint32_t result = 0;
+    for( int c = 0; c < 4; ++c ) {
+        uint32_t sum = 0;
+        for( int i = 0; i < count; ++i ) {
+            sum += ( pixels[ i ] >> ( c * 8 ) ) & 0xff;
+        }
+        result |= ( ( sum + count / 2 ) / count ) << ( c * 8 );
+    }
+    return result;
+}
+
+
+// One box blur pass over `count` pixels `step` apart, with the window clamped to the ends
+static void referenceBlurLine( uint32_t* line, int count, int step, int radius ) {
+    uint32_t* in = (uint32_t*) malloc( sizeof( uint32_t ) * count );
+    uint32_t* window = (uint32_t*) malloc( sizeof( uint32_t ) * ( radius * 2 + 1 ) );
+    for( int i = 0; i < count; ++i ) {
+        in[ i ] = line[ i * step ];
+    }
+    for( int i = 0; i < count; ++i ) {
+        for( int j = -radius; j <= radius; ++j ) {
+            int k = i + j < 0 ? 0 : ( i + j >= count ? count - 1 : i + j );
+            window[ j + radius ] = in[ k ];
+        }
+        line[ i * step ] = referenceAverage( window, radius * 2 + 1 );
+    }
+    free( window );
+    free( in );
+}
+
+
+static void referenceRedact( struct PixelBuffer* image, struct PixelRect rect, enum RedactMode mode, int strength ) {
+    struct PixelRect bounds = { 0, 0, image->width, image->height };
+    rect = intersectPixelRect( rect, bounds );
+    if( pixelRectEmpty( rect ) || strength < 1 ) {
+        return;
+    }
+    uint32_t* cell = (uint32_t*) malloc( sizeof( uint32_t ) * strength * strength );
+    for( int y0 = rect.top; y0 < rect.bottom; y0 += strength ) {
+        for( int x0 = rect.left; x0 < rect.right; x0 += strength ) {
+            int y1 = y0 + strength < rect.bottom ? y0 + strength : rect.bottom;
+            int x1 = x0 + strength < rect.right ? x0 + strength : rect.right;
+            int count = 0;
+            for( int y = y0; y < y1; ++y ) {
+                for( int x = x0; x < x1; ++x ) {
+                    cell[ count++ ] = pixelRow( image, y )[ x ];
+                }
+            }
+            uint32_t color = referenceAverage( cell, count );
+            for( int y = y0; y < y1; ++y ) {
+                for( int x = x0; x < x1; ++x ) {
+                    pixelRow( image, y )[ x ] = color;
+                }
+            }
+        }
+    }
+    free( cell );
+
+    if( mode == REDACT_BLUR ) {
+        int radius = strength / 2 > 1 ? strength / 2 : 1;
+        int width = rect.right - rect.left;
+        int height = rect.bottom - rect.top;
+        for( int pass = 0; pass < 3; ++pass ) {
+            for( int y = rect.top; y < rect.bottom; ++y ) {
+                referenceBlurLine( pixelRow( image, y ) + rect.left, width, 1, radius );
+            }
+            for( int x = rect.left; x < rect.right; ++x ) {
+                referenceBlurLine( pixelRow( image, rect.top ) + x, height, image->stride, radius );
+            }
+        }
+    }
+}
+
+
+static int samePixels( struct PixelBuffer const* a, struct PixelBuffer const* b ) {
+    for( int y = 0; y < a->height; ++y ) {
+        if( memcmp( pixelRow( a, y ), pixelRow( b, y ), sizeof( uint32_t ) * a->width ) != 0 ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+// Rectangles with odd sizes, so every kernel has a tail, and partly outside the image
+static void testMatchesReference( enum CpuIsa isa ) {
+    struct PixelRect const rects[] = { { 0, 0, 173, 91 }, { 13, 7, 14, 120 }, { 150, 60, 400, 300 },
+        { -20, -20, 9, 9 } };
+    int const strengths[] = { 1, 3, 12, 40 };
+    for( int kind = 0; kind < CORPUS_KIND_COUNT; ++kind ) {
+        for( size_t r = 0; r < sizeof( rects ) / sizeof( *rects ); ++r ) {
+            for( size_t s = 0; s < sizeof( strengths ) / sizeof( *strengths ); ++s ) {
+                for( int mode = REDACT_BLUR; mode <= REDACT_PIXELATE; ++mode ) {
+                    struct PixelBuffer expected = {}, image = {};
+                    CHECK( makeCorpusImage( (enum CorpusKind) kind, 211, 133, &expected ) );
+                    CHECK( makeCorpusImage( (enum CorpusKind) kind, 211, 133, &image ) );
+                    referenceRedact( &expected, rects[ r ], (enum RedactMode) mode, strengths[ s ] );
+                    redactRect( &image, rects[ r ], (enum RedactMode) mode, strengths[ s ] );
+                    if( !CHECK( samePixels( &expected, &image ) ) ) {
+                        fprintf( stderr, "  %s, %s, rect %d, strength %d, %s\n", cpuIsaNames[ isa ],
+                            corpusKindNames[ kind ], (int) r, strengths[ s ],
+                            mode == REDACT_BLUR ? "blur" : "pixelate" );
+                    }
+                    free( expected.pixels );
+                    free( image.pixels );
+                }
+            }
+        }
+    }
+}
+
+
+// The vector variants divide by multiplying with a float reciprocal, which has to agree with dividing for every sum a
+// window or cell can have. All divisors up to 512, and the largest ones which are allowed
+static void checkDivisor( uint32_t n ) {
+    struct RedactDivisor divisor = redactDivisor( n );
+    float half = n / 2 + 0.5f;
+    int exact = divisor.reciprocal != 0.0f;
+    for( uint32_t sum = 0; sum <= 255 * n && exact; ++sum ) {
+        exact = (uint32_t)( ( (float) sum + half ) * divisor.reciprocal ) == ( sum + n / 2 ) / n;
+    }
+    if( !CHECK( exact ) ) {
+        fprintf( stderr, "  divisor %u\n", n );
+    }
+}
+
+
+static void testDivisorIsExact( void ) {
+    for( uint32_t n = 1; n <= 512; ++n ) {
+        checkDivisor( n );
+    }
+    for( uint32_t n = REDACT_MAX_DIVISOR - 64; n <= REDACT_MAX_DIVISOR; ++n ) {
+        checkDivisor( n );
+    }
+    CHECK( redactDivisor( REDACT_MAX_DIVISOR + 1 ).reciprocal == 0.0f );
+}
+
+
+int main() {
+    testDivisorIsExact();
+    for( int isa = CPU_ISA_SCALAR; isa <= cpuIsaDetected; ++isa ) {
+        bindCpuKernels( (enum CpuIsa) isa );
+        testMatchesReference( (enum CpuIsa) isa );
+    }
+    bindCpuKernels( cpuIsaDetected );
+    return testResult();
+}
@@ -0,0 +1,165 @@
+// The resource cache with a mock backend standing in for GDI: resources are created by the backend the cache was given,
+// handed out again while cached, destroyed by that same backend when evicted or released, and a resource which can't
+// be created is NULL without taking a place in the cache.
+#include "Test.h"
+
+
+// Counts the handles it holds of each kind. Handles are the mock's own address plus a serial number, so a handle tells
+// which mock made it
+struct MockResources {
+    int live[ RESOURCE_KIND_COUNT ];
+    uint64_t created;
+    uint64_t destroyed;
+    int failKind; // Kind of resource which can't be created, or -1
+    int foreign; // Number of handles destroyed which this mock didn't make
+    struct ResourceKey lastDestroyed;
+};
+
+
+static void initMockResources( struct MockResources* mock ) {
+    memset( mock, 0, sizeof( *mock ) );
+    mock->failKind = -1;
+}
+
+
+static void* createMockResource( void* context, struct ResourceKey const* key ) {
+    struct MockResources* mock = (struct MockResources*) context;
+    if( (int) key->kind == mock->failKind ) {
+        return NULL;
+    }
+    ++mock->live[ key->kind ];
+    return (void*)( (uintptr_t) mock + ++mock->created );
+}
+
+
+static void destroyMockResource( void* context, struct ResourceKey const* key, void* handle ) {
+    struct MockResources* mock = (struct MockResources*) context;
+    uint64_t serial = (uint64_t)( (uintptr_t) handle - (uintptr_t) mock );
+    mock->foreign += serial < 1 || serial > mock->created;
+    --mock->live[ key->kind ];
+    ++mock->destroyed;
+    mock->lastDestroyed = *key;
+}
+
+
+static int mockMade( struct MockResources const* mock, void* handle ) {
+    uint64_t serial = (uint64_t)( (uintptr_t) handle - (uintptr_t) mock );
+    return handle && serial >= 1 && serial <= mock->created;
+}
+
+
+// Each cache creates and destroys through its own backend, never the other's
+static void testBackendChosen( void ) {
+    struct MockResources first, second;
+    initMockResources( &first );
+    initMockResources( &second );
+    struct ResourceBackend firstBackend = { &first, createMockResource, destroyMockResource };
+    struct ResourceBackend secondBackend = { &second, createMockResource, destroyMockResource };
+    struct ResourceCache* a = (struct ResourceCache*) malloc( sizeof( struct ResourceCache ) );
+    struct ResourceCache* b = (struct ResourceCache*) malloc( sizeof( struct ResourceCache ) );
+    initResourceCache( a, &firstBackend );
+    initResourceCache( b, &secondBackend );
+
+    void* font = getResource( a, resourceKey( RESOURCE_FONT, 16, 0, 0 ) );
+    CHECK( mockMade( &first, font ) && first.created == 1 && second.created == 0 );
+    CHECK( getResource( a, resourceKey( RESOURCE_FONT, 16, 0, 0 ) ) == font && first.created == 1 );
+    void* brush = getResource( b, resourceKey( RESOURCE_BRUSH, 0, 0xff0000, 0 ) );
+    CHECK( mockMade( &second, brush ) && first.created == 1 && second.created == 1 );
+
+    releaseResourceCache( a );
+    CHECK( first.destroyed == 1 && second.destroyed == 0 && first.live[ RESOURCE_FONT ] == 0 );
+    releaseResourceCache( b );
+    CHECK( second.destroyed == 1 && second.live[ RESOURCE_BRUSH ] == 0 );
+    CHECK( first.foreign == 0 && second.foreign == 0 );
+    free( b );
+    free( a );
+}
+
+
+// When the backend can't create a resource, the lookup gives NULL, which the window falls back on by not drawing
+// that part. Nothing is cached or evicted for it, and the next lookup tries again
+static void testFallback( void ) {
+    struct MockResources mock;
+    initMockResources( &mock );
+    struct ResourceBackend backend = { &mock, createMockResource, destroyMockResource };
+    struct ResourceCache* cache = (struct ResourceCache*) malloc( sizeof( struct ResourceCache ) );
+    initResourceCache( cache, &backend );
+    void* bitmaps[ RESOURCE_CACHE_LIMIT ];
+    for( int i = 0; i < RESOURCE_CACHE_LIMIT; ++i ) {
+        bitmaps[ i ] = getResource( cache, resourceKey( RESOURCE_BITMAP, 20 + i, 0, 0 ) );
+    }
+
+    mock.failKind = RESOURCE_BITMAP;
+    CHECK( getResource( cache, resourceKey( RESOURCE_BITMAP, 99, 0, 0 ) ) == NULL );
+    CHECK( cache->live[ RESOURCE_BITMAP ] == RESOURCE_CACHE_LIMIT && mock.destroyed == 0 );
+    CHECK( cache->created == RESOURCE_CACHE_LIMIT );
+    // What was cached is still handed out, and other kinds are still created
+    int kept = 1;
+    for( int i = 0; i < RESOURCE_CACHE_LIMIT; ++i ) {
+        kept &= getResource( cache, resourceKey( RESOURCE_BITMAP, 20 + i, 0, 0 ) ) == bitmaps[ i ];
+    }
+    CHECK( kept );
+    CHECK( mockMade( &mock, getResource( cache, resourceKey( RESOURCE_DC, 0, 0, 0 ) ) ) );
+
+    mock.failKind = -1;
+    CHECK( mockMade( &mock, getResource( cache, resourceKey( RESOURCE_BITMAP, 99, 0, 0 ) ) ) );
+    CHECK( mock.destroyed == 1 && mock.lastDestroyed.size == 20 ); // The one unused the longest made room
+    releaseResourceCache( cache );
+    CHECK( mock.created == mock.destroyed && mock.foreign == 0 );
+    free( cache );
+}
+
+
+// A session of the annotation window: each repaint sets the font of the six buttons and draws the items of an open
+// menu, and every 100 repaints the window moves to the next of six displays with different scaling, or the menu
+// colors change. No kind ever holds more than the limit, resources are reused across repaints, and none is left
+// after releasing the cache
+static void testSession( void ) {
+    static float const scales[] = { 1.0f, 1.25f, 1.5f, 2.0f, 1.75f, 3.0f };
+    int const frames = 1000;
+    struct MockResources mock;
+    initMockResources( &mock );
+    struct ResourceBackend backend = { &mock, createMockResource, destroyMockResource };
+    struct ResourceCache* cache = (struct ResourceCache*) malloc( sizeof( struct ResourceCache ) );
+    initResourceCache( cache, &backend );
+    int withinLimit = 1, allMade = 1, counted = 1;
+    for( int frame = 0; frame < frames; ++frame ) {
+        float scale = scales[ ( frame / 100 ) % 6 ];
+        uint32_t menu = frame % 700 < 500 ? 0xf0f0f0 : 0x202020; // A switch to a dark theme and back
+        uint32_t hot = menu ^ 0x3399ff;
+        for( int button = 0; button < 6; ++button ) {
+            allMade &= mockMade( &mock, getResource( cache, resourceKey( RESOURCE_FONT, (int)( 16 * scale ), 0, 0 ) ) );
+        }
+        int h = (int)( 20 * scale );
+        for( int item = 0; item < 6; ++item ) {
+            uint32_t color = item == frame % 6 ? hot : menu;
+            allMade &= mockMade( &mock, getResource( cache, resourceKey( RESOURCE_BRUSH, 0, color, 0 ) ) );
+            allMade &= mockMade( &mock, getResource( cache, resourceKey( RESOURCE_BITMAP, h, color, 0 ) ) );
+            allMade &= mockMade( &mock, getResource( cache, resourceKey( RESOURCE_DC, 0, 0, 0 ) ) );
+        }
+        for( int kind = 0; kind < RESOURCE_KIND_COUNT; ++kind ) {
+            withinLimit &= mock.live[ kind ] <= RESOURCE_CACHE_LIMIT;
+            counted &= mock.live[ kind ] == cache->live[ kind ];
+        }
+    }
+    CHECK( allMade && withinLimit && counted );
+    // A font per display, a brush and bitmap per menu color and display, and one DC: far fewer than the 24000 lookups
+    CHECK( cache->clock == (uint64_t) frames * 24 );
+    CHECK( mock.created == cache->created && mock.created < 40 );
+
+    releaseResourceCache( cache );
+    int left = 0;
+    for( int kind = 0; kind < RESOURCE_KIND_COUNT; ++kind ) {
+        left += mock.live[ kind ];
+    }
+    CHECK( left == 0 && cache->count == 0 && mock.destroyed == mock.created && mock.foreign == 0 );
+    free( cache );
+}
+
+
+int main() {
+    testBackendChosen();
+    testFallback();
+    testSession();
+    return testResult();
+}
@@ -0,0 +1,241 @@
+// The stroke journal: a child process killed with SIGKILL in the middle of writing a record leaves a journal which
+// replays to exactly the strokes and undo log it had. A record whose type byte was never written, or whose check byte
+// is wrong, ends the replay there, and resuming zeroes whatever follows so new records carry straight on.
+#include "Test.h"
+#include <signal.h>
+#include <sys/wait.h>
+
+
+int const JOURNAL_TEST_CRASHES = 50;
+
+
+static void scribblePoint( int index, float* x, float* y ) {
+    float angle = index * 0.05f;
+    *x = 960.0f + ( 400.0f + 60.0f * sinf( angle * 7.0f ) ) * cosf( angle );
+    *y = 540.0f + ( 300.0f + 40.0f * cosf( angle * 5.0f ) ) * sinf( angle );
+}
+
+
+// Runs `count` random edits on `store`, like the benchmarks, recording each in `journal` like the annotation window
+// does, unless it is NULL
+static void randomStrokeEdits( struct StrokeStore* store, int count, uint32_t* random, struct StrokeJournal* journal ) {
+    for( int i = 0; i < count; ++i ) {
+        *random = *random * 1664525 + 1013904223;
+        int op = ( *random >> 8 ) % 10;
+        int target = store->count ? (int)( ( *random >> 16 ) % store->count ) : -1;
+        if( op < 4 ) {
+            struct Stroke* stroke = addStroke( store, 0, op );
+            if( stroke ) {
+                journalAddStroke( journal, 0, op );
+                for( int j = 0; j < 32; ++j ) {
+                    float x, y;
+                    scribblePoint( i + j, &x, &y );
+                    addPathPoint( &stroke->path, x, y, 5.0f, 4 );
+                    journalStrokePoint( journal, x, y, 5.0f );
+                }
+                updateStrokeOutline( &stroke->outline, &stroke->path );
+            }
+        } else if( op < 6 && target >= 0 ) {
+            eraseStroke( store, target );
+            journalStrokeEdit( journal, JOURNAL_ERASE, target, 0 );
+        } else if( op < 7 && target >= 0 ) {
+            recolorStroke( store, target, ( *random >> 4 ) & 3 );
+            journalStrokeEdit( journal, JOURNAL_RECOLOR, target, ( *random >> 4 ) & 3 );
+        } else if( op < 9 ) {
+            undoStrokeEdit( store );
+            journalStrokeEdit( journal, JOURNAL_UNDO, 0, 0 );
+        } else {
+            redoStrokeEdit( store );
+            journalStrokeEdit( journal, JOURNAL_REDO, 0, 0 );
+        }
+    }
+}
+
+
+// Non-zero if two stroke stores have the same strokes, points and undo log
+static int sameStrokeStores( struct StrokeStore const* a, struct StrokeStore const* b ) {
+    if( a->count != b->count || a->editCount != b->editCount || a->editTotal != b->editTotal ) {
+        return 0;
+    }
+    for( int i = 0; i < a->editTotal; ++i ) {
+        struct StrokeEdit const* e = &a->edits[ i ];
+        struct StrokeEdit const* f = &b->edits[ i ];
+        if( e->stroke != f->stroke || e->type != f->type || e->from != f->from || e->to != f->to ) {
+            return 0;
+        }
+    }
+    for( int i = 0; i < a->count; ++i ) {
+        struct Stroke const* s = &a->strokes[ i ];
+        struct Stroke const* t = &b->strokes[ i ];
+        if( s->erased != t->erased || s->penIndex != t->penIndex || s->highlighter != t->highlighter ||
+            s->path.pointCount != t->path.pointCount || ( s->path.pointCount > 0 &&
+            memcmp( s->path.points, t->path.points, sizeof( float ) * 2 * s->path.pointCount ) != 0 ) ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+static void readWholeFile( char const* path, struct ByteBuffer* data ) {
+    FILE* file = fopen( path, "rb" );
+    if( file ) {
+        uint8_t chunk[ 65536 ];
+        size_t read;
+        while( ( read = fread( chunk, 1, sizeof( chunk ), file ) ) > 0 ) {
+            appendBytes( data, chunk, read );
+        }
+        fclose( file );
+    }
+}
+
+
+// A child makes a random number of random edits, journaling them, writes all of one more record but its type, and
+// kills itself. Replaying what it left gives the same store as making the edits here
+static void testCrashes( char const* path ) {
+    uint32_t seed = 7;
+    int crashed = 0;
+    int matched = 0;
+    for( int run = 0; run < JOURNAL_TEST_CRASHES; ++run ) {
+        seed = seed * 1664525 + 1013904223;
+        int count = 1 + (int)( ( seed >> 8 ) % 2000 );
+        pid_t child = fork();
+        if( child == 0 ) {
+            struct JournalHeader header = {};
+            struct StrokeJournal journal;
+            struct StrokeStore store = {};
+            uint32_t random = seed;
+            if( openStrokeJournal( &journal, path, &header, NULL, 0 ) ) {
+                randomStrokeEdits( &store, count, &random, &journal );
+                struct JournalRecord torn = { 0, 0, 0, 0, 0, 1.0f, 2.0f, 3.0f };
+                if( journal.size + JOURNAL_RECORD_SIZE <= journal.capacity ) {
+                    memcpy( journal.data + journal.size + 1, (uint8_t const*) &torn + 1, JOURNAL_RECORD_SIZE - 1 );
+                }
+                kill( getpid(), SIGKILL );
+            }
+            _exit( 1 );
+        }
+        int status = 0;
+        waitpid( child, &status, 0 );
+        crashed += WIFSIGNALED( status ) && WTERMSIG( status ) == SIGKILL;
+
+        struct StrokeStore expected = {};
+        uint32_t random = seed;
+        randomStrokeEdits( &expected, count, &random, NULL );
+        struct ByteBuffer data = {};
+        readWholeFile( path, &data );
+        struct JournalHeader header;
+        struct StrokeStore replayed = {};
+        if( readJournalHeader( data.data, data.size, &header ) ) {
+            replayStrokeJournal( data.data, data.size, &replayed, 4, 4, 0 );
+            matched += sameStrokeStores( &expected, &replayed );
+        }
+        releaseByteBuffer( &data );
+        releaseStrokeStore( &expected );
+        releaseStrokeStore( &replayed );
+    }
+    unlink( path );
+    CHECK( crashed == JOURNAL_TEST_CRASHES );
+    CHECK( matched == JOURNAL_TEST_CRASHES );
+}
+
+
+// Damages record `index` of a copy of the journal, one way or another, and checks that replay stops right before it,
+// with the store the records before it make
+static void testDamagedRecords( struct StrokeJournal const* journal ) {
+    size_t records = ( journal->size - JOURNAL_HEADER_SIZE ) / JOURNAL_RECORD_SIZE;
+    uint8_t* copy = (uint8_t*) malloc( journal->size );
+    int stopped = 1;
+    int same = 1;
+    for( size_t index = 0; index < records; index += 1 + index / 3 ) {
+        struct StrokeStore before = {};
+        size_t end = JOURNAL_HEADER_SIZE + index * JOURNAL_RECORD_SIZE;
+        replayStrokeJournal( journal->data, end, &before, 4, 4, 0 );
+        for( int damage = 0; damage < 3; ++damage ) {
+            memcpy( copy, journal->data, journal->size );
+            uint8_t* record = copy + end;
+            if( damage == 0 ) {
+                record[ 0 ] = JOURNAL_END; // The type was never written
+            } else if( damage == 1 ) {
+                record[ 1 ] ^= 0x01; // The check byte is wrong
+            } else {
+                record[ 12 ] ^= 0x40; // The check byte no longer matches the rest
+            }
+            struct StrokeStore replayed = {};
+            stopped &= replayStrokeJournal( copy, journal->size, &replayed, 4, 4, 0 ) == index * JOURNAL_RECORD_SIZE;
+            stopped &= journalRecordsSize( copy, journal->size ) == index * JOURNAL_RECORD_SIZE;
+            same &= sameStrokeStores( &before, &replayed );
+            releaseStrokeStore( &replayed );
+        }
+        releaseStrokeStore( &before );
+    }
+    free( copy );
+    CHECK( stopped );
+    CHECK( same );
+}
+
+
+// Opens a journal whose records go wrong halfway, with a record which doesn't fit the strokes followed by good ones.
+// Resuming keeps the records before it, and zeroes the rest of the mapping, so a record appended next is read back
+static void testResumeZeroesTail( char const* path, struct StrokeJournal const* source ) {
+    size_t records = ( source->size - JOURNAL_HEADER_SIZE ) / JOURNAL_RECORD_SIZE;
+    size_t kept = records / 2;
+    uint8_t* data = (uint8_t*) malloc( source->size - JOURNAL_HEADER_SIZE );
+    memcpy( data, source->data + JOURNAL_HEADER_SIZE, source->size - JOURNAL_HEADER_SIZE );
+    struct JournalRecord bad = { JOURNAL_ERASE, 0, 0, 0, 1000000 }; // A stroke which doesn't exist
+    bad.check = journalRecordCheck( &bad );
+    memcpy( data + kept * JOURNAL_RECORD_SIZE, &bad, JOURNAL_RECORD_SIZE );
+
+    struct JournalHeader header = {};
+    struct StrokeJournal journal;
+    if( !CHECK( openStrokeJournal( &journal, path, &header, data, source->size - JOURNAL_HEADER_SIZE ) ) ) {
+        free( data );
+        return;
+    }
+    struct StrokeStore store = {};
+    resumeStrokeJournal( &journal, &store, 4, 4, 0 );
+    CHECK( journal.size == JOURNAL_HEADER_SIZE + kept * JOURNAL_RECORD_SIZE );
+    int zeroed = 1;
+    for( size_t i = journal.size; i < source->size; ++i ) {
+        zeroed &= journal.data[ i ] == 0;
+    }
+    CHECK( zeroed );
+
+    struct StrokeStore expected = {};
+    replayStrokeJournal( source->data, journal.size, &expected, 4, 4, 0 );
+    CHECK( sameStrokeStores( &expected, &store ) );
+    journalStrokeEdit( &journal, JOURNAL_UNDO, 0, 0 );
+    undoStrokeEdit( &expected );
+    struct StrokeStore replayed = {};
+    CHECK( replayStrokeJournal( journal.data, journal.capacity, &replayed, 4, 4, 0 ) ==
+        ( kept + 1 ) * JOURNAL_RECORD_SIZE );
+    CHECK( sameStrokeStores( &expected, &replayed ) );
+
+    releaseStrokeStore( &replayed );
+    releaseStrokeStore( &expected );
+    releaseStrokeStore( &store );
+    closeStrokeJournal( &journal, 0 );
+    free( data );
+}
+
+
+int main( void ) {
+    char path[ 64 ];
+    snprintf( path, sizeof( path ), "/tmp/screensnippet_test.%ld.journal", (long) getpid() );
+    testCrashes( path );
+
+    struct JournalHeader header = {};
+    struct StrokeJournal journal;
+    if( CHECK( openStrokeJournal( &journal, path, &header, NULL, 0 ) ) ) {
+        struct StrokeStore store = {};
+        uint32_t random = 11;
+        randomStrokeEdits( &store, 300, &random, &journal );
+        releaseStrokeStore( &store );
+        testDamagedRecords( &journal );
+        char resumed[ 80 ];
+        snprintf( resumed, sizeof( resumed ), "%s.resumed", path );
+        testResumeZeroesTail( resumed, &journal );
+        closeStrokeJournal( &journal, 0 );
+    }
+    return testResult();
+}
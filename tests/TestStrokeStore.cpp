@@ -0,0 +1,196 @@
+// The stroke store after ten thousand edits: the edit log takes eight bytes per edit, strokes are only kept while an
+// edit in the log adds them, and memory is their geometry and nothing more. Undoing every edit and redoing them all
+// brings back exactly the strokes there were.
+#include "Test.h"
+
+
+int const STROKE_TEST_EDITS = 10000;
+int const STROKE_TEST_POINTS = 32;
+
+
+static void scribblePoint( int index, float* x, float* y ) {
+    float angle = index * 0.05f;
+    *x = 960.0f + ( 400.0f + 60.0f * sinf( angle * 7.0f ) ) * cosf( angle );
+    *y = 540.0f + ( 300.0f + 40.0f * cosf( angle * 5.0f ) ) * sinf( angle );
+}
+
+
+// Runs `count` random edits on `store`, like the benchmarks: adding strokes, erasing and recoloring random strokes,
+// and undoing and redoing, in the proportions 4:2:1:2:1
+static void randomStrokeEdits( struct StrokeStore* store, int count, uint32_t* random ) {
+    for( int i = 0; i < count; ++i ) {
+        *random = *random * 1664525 + 1013904223;
+        int op = ( *random >> 8 ) % 10;
+        int target = store->count ? (int)( ( *random >> 16 ) % store->count ) : -1;
+        if( op < 4 ) {
+            struct Stroke* stroke = addStroke( store, op & 1, op );
+            if( stroke ) {
+                for( int j = 0; j < STROKE_TEST_POINTS; ++j ) {
+                    float x, y;
+                    scribblePoint( i + j, &x, &y );
+                    addPathPoint( &stroke->path, x, y, 5.0f, 4 );
+                }
+                updateStrokeOutline( &stroke->outline, &stroke->path );
+            }
+        } else if( op < 6 && target >= 0 ) {
+            eraseStroke( store, target );
+        } else if( op < 7 && target >= 0 ) {
+            recolorStroke( store, target, ( *random >> 4 ) & 3 );
+        } else if( op < 9 ) {
+            undoStrokeEdit( store );
+        } else {
+            redoStrokeEdit( store );
+        }
+    }
+}
+
+
+// Heap bytes taken by the geometry of a stroke: its points, polyline and outline
+static size_t strokeGeometryBytes( struct Stroke const* stroke ) {
+    struct StrokePath const* path = &stroke->path;
+    size_t bytes = (size_t) path->pointCapacity * ( sizeof( float ) * 3 + sizeof( int ) );
+    bytes += (size_t) path->vertexCapacity * sizeof( float ) * 3;
+    if( stroke->outline.buffer ) {
+        bytes += sizeof( float ) * 4 * ( stroke->outline.sideCapacity + OUTLINE_CAP_STEPS - 1 );
+    }
+    return bytes;
+}
+
+
+// A copy of what is drawn for each stroke, to compare with after undoing and redoing
+struct StrokeSnapshot {
+    int count;
+    struct Stroke* strokes; // Shallow copies, for the fields
+    float** points; // Deep copies of the control points and outline of each stroke
+    float** outlines;
+};
+
+
+static void takeSnapshot( struct StrokeStore const* store, struct StrokeSnapshot* snapshot ) {
+    snapshot->count = store->count;
+    snapshot->strokes = (struct Stroke*) malloc( sizeof( struct Stroke ) * store->count );
+    snapshot->points = (float**) malloc( sizeof( float* ) * store->count );
+    snapshot->outlines = (float**) malloc( sizeof( float* ) * store->count );
+    for( int i = 0; i < store->count; ++i ) {
+        struct Stroke const* stroke = &store->strokes[ i ];
+        snapshot->strokes[ i ] = *stroke;
+        snapshot->points[ i ] = (float*) malloc( sizeof( float ) * 2 * stroke->path.pointCount );
+        memcpy( snapshot->points[ i ], stroke->path.points, sizeof( float ) * 2 * stroke->path.pointCount );
+        snapshot->outlines[ i ] = (float*) malloc( sizeof( float ) * 2 * stroke->outline.pointCount );
+        memcpy( snapshot->outlines[ i ], stroke->outline.points, sizeof( float ) * 2 * stroke->outline.pointCount );
+    }
+}
+
+
+static int matchesSnapshot( struct StrokeStore const* store, struct StrokeSnapshot const* snapshot ) {
+    if( store->count != snapshot->count ) {
+        return 0;
+    }
+    for( int i = 0; i < store->count; ++i ) {
+        struct Stroke const* s = &store->strokes[ i ];
+        struct Stroke const* t = &snapshot->strokes[ i ];
+        if( s->erased != t->erased || s->penIndex != t->penIndex || s->highlighter != t->highlighter ||
+            s->path.pointCount != t->path.pointCount || s->outline.pointCount != t->outline.pointCount ||
+            memcmp( s->path.points, snapshot->points[ i ], sizeof( float ) * 2 * s->path.pointCount ) != 0 ||
+            memcmp( s->outline.points, snapshot->outlines[ i ], sizeof( float ) * 2 * s->outline.pointCount ) != 0 ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+static void releaseSnapshot( struct StrokeSnapshot* snapshot ) {
+    for( int i = 0; i < snapshot->count; ++i ) {
+        free( snapshot->points[ i ] );
+        free( snapshot->outlines[ i ] );
+    }
+    free( snapshot->outlines );
+    free( snapshot->points );
+    free( snapshot->strokes );
+}
+
+
+static void testMemoryBound( void ) {
+    struct StrokeStore store = {};
+    uint32_t random = 1;
+    randomStrokeEdits( &store, STROKE_TEST_EDITS, &random );
+
+    // Eight bytes per edit, at most one per edit made, in a log which at most doubles that
+    CHECK( sizeof( struct StrokeEdit ) == 8 );
+    CHECK( store.editCount <= store.editTotal && store.editTotal <= STROKE_TEST_EDITS );
+    CHECK( store.editCapacity <= 2 * store.editTotal );
+
+    // Every stroke kept is added by an edit still in the log, which is what freeing strokes once they can't be redone
+    // comes to
+    int adds = 0;
+    for( int i = 0; i < store.editTotal; ++i ) {
+        adds += store.edits[ i ].type == STROKE_EDIT_ADD;
+    }
+    CHECK( store.count == adds );
+    CHECK( store.capacity <= 2 * store.count );
+
+    // Besides the log and the array of strokes, memory is only the geometry of each stroke, which is the same however
+    // many edits were made and whatever size the snippet is
+    size_t geometry = 0;
+    for( int i = 0; i < store.count; ++i ) {
+        geometry += strokeGeometryBytes( &store.strokes[ i ] );
+    }
+    size_t total = geometry + sizeof( struct Stroke ) * store.capacity +
+        sizeof( struct StrokeEdit ) * store.editCapacity;
+    CHECK( geometry <= (size_t) store.count * 16384 );
+    CHECK( total <= (size_t) store.count * ( 16384 + 2 * sizeof( struct Stroke ) ) +
+        2 * sizeof( struct StrokeEdit ) * store.editTotal );
+    releaseStrokeStore( &store );
+}
+
+
+static void testUndoRedoAll( void ) {
+    struct StrokeStore store = {};
+    uint32_t random = 2;
+    randomStrokeEdits( &store, STROKE_TEST_EDITS, &random );
+    // The last few edits may have been undone. Redo them, to start with every edit in the log applied
+    while( redoStrokeEdit( &store ) >= 0 ) {
+    }
+    struct StrokeSnapshot snapshot;
+    takeSnapshot( &store, &snapshot );
+    int edits = store.editTotal;
+
+    int undone = 0, inRange = 1;
+    for( int stroke; ( stroke = undoStrokeEdit( &store ) ) >= 0; ++undone ) {
+        inRange &= stroke < store.count;
+    }
+    CHECK( undone == edits && inRange );
+    int anyShown = 0;
+    for( int i = 0; i < store.count; ++i ) {
+        anyShown |= !store.strokes[ i ].erased;
+    }
+    CHECK( !anyShown ); // With every edit undone, not even the strokes added are there
+    CHECK( store.count == snapshot.count && store.editTotal == edits ); // But they are kept, to be redone
+
+    int redone = 0;
+    while( redoStrokeEdit( &store ) >= 0 ) {
+        ++redone;
+    }
+    CHECK( redone == edits && store.editCount == edits );
+    CHECK( matchesSnapshot( &store, &snapshot ) );
+
+    // The same goes for undoing and redoing part of the way
+    for( int i = 0; i < edits / 3; ++i ) {
+        undoStrokeEdit( &store );
+    }
+    for( int i = 0; i < edits / 3; ++i ) {
+        redoStrokeEdit( &store );
+    }
+    CHECK( matchesSnapshot( &store, &snapshot ) );
+
+    releaseSnapshot( &snapshot );
+    releaseStrokeStore( &store );
+}
+
+
+int main() {
+    testMemoryBound();
+    testUndoRedoAll();
+    return testResult();
+}
@@ -0,0 +1,178 @@
+// Telemetry, with the /proc reading of the Linux version: bitmap memory raises the peak of the phase it is counted in
+// and phases end with what is still counted, phases past TELEMETRY_MAX_PHASES merge into the last, counters past
+// TELEMETRY_MAX_COUNTERS are dropped, an open file shows up as a handle, and the JSON has every key for every phase.
+#include "Test.h"
+
+
+// Bitmaps counted and released within a phase raise its peak, and its end only has what is left
+static void testBitmapBytes( void ) {
+    struct Telemetry telemetry;
+    initTelemetry( &telemetry );
+    trackBitmapBytes( &telemetry, 1000 );
+    trackBitmapBytes( &telemetry, 500 );
+    trackBitmapBytes( &telemetry, -1200 );
+    endTelemetryPhase( &telemetry, "grab" );
+    trackBitmapBytes( &telemetry, -300 );
+    endTelemetryPhase( &telemetry, "save" );
+    trackBitmapBytes( NULL, 100 ); // Ignored
+    CHECK( telemetry.phaseCount == 2 );
+    CHECK( telemetry.phases[ 0 ].peak.bitmapBytes == 1500 && telemetry.phases[ 0 ].end.bitmapBytes == 300 );
+    CHECK( telemetry.phases[ 1 ].peak.bitmapBytes == 300 && telemetry.phases[ 1 ].end.bitmapBytes == 0 );
+    CHECK( telemetry.phases[ 0 ].durationMs >= 0.0 && telemetry.phases[ 1 ].durationMs >= 0.0 );
+}
+
+
+// Phases past the last one there is room for are merged into it: it takes the name and end of the latest, and the
+// highest peak of any of them
+static void testPhasesMerge( void ) {
+    static char const* const names[] = { "p0", "p1", "p2", "p3", "p4", "p5", "p6", "p7", "p8", "p9", "p10", "p11",
+        "p12", "p13", "p14", "p15", "p16", "p17", "p18", "p19" };
+    int const count = (int)( sizeof( names ) / sizeof( *names ) );
+    struct Telemetry telemetry;
+    initTelemetry( &telemetry );
+    for( int i = 0; i < count; ++i ) {
+        int64_t bytes = i == TELEMETRY_MAX_PHASES + 1 ? 4096 : 16; // Most in one of the merged phases
+        trackBitmapBytes( &telemetry, bytes );
+        trackBitmapBytes( &telemetry, -bytes + 1 );
+        endTelemetryPhase( &telemetry, names[ i ] );
+    }
+    CHECK( telemetry.phaseCount == TELEMETRY_MAX_PHASES );
+    int named = 1;
+    for( int i = 0; i < TELEMETRY_MAX_PHASES - 1; ++i ) {
+        named &= strcmp( telemetry.phases[ i ].name, names[ i ] ) == 0;
+    }
+    CHECK( named );
+    struct TelemetryPhase const* last = &telemetry.phases[ TELEMETRY_MAX_PHASES - 1 ];
+    CHECK( strcmp( last->name, names[ count - 1 ] ) == 0 );
+    CHECK( last->end.bitmapBytes == (uint64_t) count );
+    CHECK( last->peak.bitmapBytes == TELEMETRY_MAX_PHASES + 1 + 4096 );
+}
+
+
+// Counters past the last one there is room for are dropped, while those already there can still be set
+static void testCountersDropped( void ) {
+    static char const* const names[] = { "c0", "c1", "c2", "c3", "c4", "c5", "c6", "c7", "c8", "c9", "c10", "c11",
+        "c12", "c13", "c14", "c15", "c16", "c17" };
+    int const count = (int)( sizeof( names ) / sizeof( *names ) );
+    struct Telemetry telemetry;
+    initTelemetry( &telemetry );
+    for( int i = 0; i < count; ++i ) {
+        setTelemetryCounter( &telemetry, names[ i ], (uint64_t) i );
+    }
+    setTelemetryCounter( &telemetry, "c3", 333 );
+    setTelemetryCounter( NULL, "c4", 444 ); // Ignored
+    CHECK( telemetry.counterCount == TELEMETRY_MAX_COUNTERS );
+    int kept = 1;
+    for( int i = 0; i < TELEMETRY_MAX_COUNTERS; ++i ) {
+        uint64_t value = i == 3 ? 333 : (uint64_t) i;
+        kept &= strcmp( telemetry.counterNames[ i ], names[ i ] ) == 0 && telemetry.counters[ i ] == value;
+    }
+    CHECK( kept );
+}
+
+
+// An open file is one more handle, at the end of the phase it was opened in, and one less once it is closed
+static void testHandles( void ) {
+    struct Telemetry telemetry;
+    initTelemetry( &telemetry );
+    endTelemetryPhase( &telemetry, "before" );
+    FILE* file = fopen( "/proc/self/status", "r" );
+    if( !CHECK( file != NULL ) ) {
+        return;
+    }
+    endTelemetryPhase( &telemetry, "open" );
+    fclose( file );
+    endTelemetryPhase( &telemetry, "closed" );
+    CHECK( telemetry.phases[ 0 ].end.handles > 0 );
+    CHECK( telemetry.phases[ 1 ].end.handles == telemetry.phases[ 0 ].end.handles + 1 );
+    CHECK( telemetry.phases[ 2 ].end.handles == telemetry.phases[ 0 ].end.handles );
+    CHECK( telemetry.phases[ 2 ].peak.handles == telemetry.phases[ 1 ].end.handles ); // From the start of the phase
+}
+
+
+// Number of times `key` appears in `json`, as a key
+static int countKey( struct ByteBuffer const* json, char const* key ) {
+    char quoted[ 64 ];
+    snprintf( quoted, sizeof( quoted ), "\"%s\":", key );
+    int count = 0;
+    for( char const* p = (char const*) json->data; ( p = strstr( p, quoted ) ) != NULL; p += strlen( quoted ) ) {
+        ++count;
+    }
+    return count;
+}
+
+
+// Brackets and braces outside of strings nest properly, and nothing follows the outermost object but a line break
+static int balancedJson( struct ByteBuffer const* json ) {
+    char stack[ 16 ];
+    int depth = 0;
+    int quoted = 0;
+    size_t i = 0;
+    for( ; i < json->size && ( i == 0 || depth > 0 ); ++i ) {
+        char c = (char) json->data[ i ];
+        if( quoted ) {
+            quoted = c != '"';
+        } else if( c == '"' ) {
+            quoted = 1;
+        } else if( c == '{' || c == '[' ) {
+            if( depth == (int) sizeof( stack ) ) {
+                return 0;
+            }
+            stack[ depth++ ] = c == '{' ? '}' : ']';
+        } else if( c == '}' || c == ']' ) {
+            if( depth == 0 || stack[ --depth ] != c ) {
+                return 0;
+            }
+        }
+    }
+    return depth == 0 && !quoted && i == json->size - 1 && json->data[ i ] == '\n';
+}
+
+
+// Every phase has each usage key at its end and at its peak, and the counters come after as an object of their own
+static void testJson( void ) {
+    struct Telemetry telemetry;
+    initTelemetry( &telemetry );
+    trackBitmapBytes( &telemetry, 1234 );
+    endTelemetryPhase( &telemetry, "select" );
+    setTelemetryCounter( &telemetry, "frames", 12 );
+    setTelemetryCounter( &telemetry, "strokes", 3 );
+    endTelemetryPhase( &telemetry, "annotate" );
+    struct ByteBuffer json = {};
+    writeTelemetryJson( &telemetry, &json );
+    appendByte( &json, 0 );
+    --json.size;
+    char const* text = (char const*) json.data;
+    CHECK( !json.failed && balancedJson( &json ) );
+    CHECK( strncmp( text, "{\"phases\":[", 11 ) == 0 );
+    CHECK( strstr( text, "{\"name\":\"select\",\"ms\":" ) != NULL );
+    CHECK( strstr( text, "{\"name\":\"annotate\",\"ms\":" ) != NULL );
+    CHECK( strstr( text, "\"bitmap_bytes\":1234," ) != NULL && strstr( text, "\"max_bitmap_bytes\":1234," ) != NULL );
+    char const* const keys[] = { "name", "ms", "private_bytes", "bitmap_bytes", "gdi_objects", "user_objects",
+        "handles", "max_private_bytes", "max_bitmap_bytes", "max_gdi_objects", "max_user_objects", "max_handles",
+        "process_peak_private_bytes" };
+    int everyPhase = 1;
+    for( size_t i = 0; i < sizeof( keys ) / sizeof( *keys ); ++i ) {
+        everyPhase &= countKey( &json, keys[ i ] ) == telemetry.phaseCount;
+    }
+    CHECK( everyPhase );
+    CHECK( strstr( text, "\n],\"counters\":{\"frames\":12,\"strokes\":3}}\n" ) != NULL );
+    releaseByteBuffer( &json );
+
+    struct Telemetry empty;
+    initTelemetry( &empty );
+    writeTelemetryJson( &empty, &json );
+    CHECK( json.size == strlen( "{\"phases\":[\n],\"counters\":{}}\n" ) &&
+        memcmp( json.data, "{\"phases\":[\n],\"counters\":{}}\n", json.size ) == 0 );
+    releaseByteBuffer( &json );
+}
+
+
+int main( void ) {
+    testBitmapBytes();
+    testPhasesMerge();
+    testCountersDropped();
+    testHandles();
+    testJson();
+    return testResult();
+}
@@ -0,0 +1,111 @@
+// Tone mapping against `toneMapReference`, which computes the curve exactly: random FP16 pixels, with negative, NaN,
+// infinite, denormal and brighter than white values among them, come out within one step of it at 8 and at 16 bits,
+// for widths which leave a tail after the groups of four. 10-bit captures come out within one step of rescaling.
+#include "Test.h"
+
+
+int const TONE_TEST_HEIGHT = 5;
+int const TONE_TEST_PADDING = 24; // Bytes after each row of the capture, so rows don't follow on from each other
+
+
+// FP16 values where conversion and clamping are most likely to go wrong: zeros, infinities, NaNs, the smallest and
+// largest denormals and normals, white and just around it, and negative values
+static uint16_t const specialHalves[] = { 0x0000, 0x8000, 0x7c00, 0xfc00, 0x7e00, 0xfe01, 0x7c01, 0x0001, 0x03ff,
+    0x8001, 0x0400, 0x3bff, 0x3c00, 0x3c01, 0x4100, 0x5bff, 0x7bff, 0xbc00, 0xfbff };
+
+
+// Fills a capture of `width` pixels by TONE_TEST_HEIGHT with random FP16 pixels, or random 10-bit ones. The special
+// values come first, in every channel
+static struct HdrBuffer makeCapture( int width, enum HdrFormat format, uint32_t* random ) {
+    int pixelBytes = format == HDR_FORMAT_RGBA16F ? 8 : 4;
+    struct HdrBuffer hdr = { NULL, width, TONE_TEST_HEIGHT, width * pixelBytes + TONE_TEST_PADDING, format };
+    uint8_t* data = (uint8_t*) malloc( (size_t) hdr.stride * hdr.height );
+    int special = 0;
+    int specialCount = (int)( sizeof( specialHalves ) / sizeof( *specialHalves ) );
+    for( int y = 0; y < hdr.height; ++y ) {
+        for( int x = 0; x < width * pixelBytes / 2; ++x ) {
+            *random = *random * 1664525 + 1013904223;
+            uint16_t value = (uint16_t)( *random >> 16 );
+            if( format == HDR_FORMAT_RGBA16F && special < specialCount ) {
+                value = specialHalves[ special++ ];
+            }
+            memcpy( data + (size_t) y * hdr.stride + x * 2, &value, 2 );
+        }
+    }
+    hdr.pixels = data;
+    return hdr;
+}
+
+
+// Largest difference between the 8 and 16-bit tone mapping of `hdr` and the reference, in steps of each
+static void toneMapErrors( struct HdrBuffer const* hdr, float sdrWhite, int* error8, int* error16 ) {
+    struct PixelBuffer pixels = { (uint32_t*) malloc( sizeof( uint32_t ) * hdr->width * hdr->height ), hdr->width,
+        hdr->height, hdr->width };
+    struct WidePixelBuffer wide = { (uint16_t*) malloc( sizeof( uint16_t ) * 4 * hdr->width * hdr->height ),
+        hdr->width, hdr->height, hdr->width };
+    toneMapToPixels( hdr, sdrWhite, &pixels );
+    toneMapToWidePixels( hdr, sdrWhite, &wide );
+    *error8 = 0;
+    *error16 = 0;
+    for( int y = 0; y < hdr->height; ++y ) {
+        for( int x = 0; x < hdr->width; ++x ) {
+            int reference[ 3 ];
+            if( hdr->format == HDR_FORMAT_RGBA16F ) {
+                uint16_t mapped[ 3 ];
+                toneMapReference( hdrRow16( hdr, y ) + x * 4, sdrWhite, mapped );
+                for( int i = 0; i < 3; ++i ) {
+                    reference[ i ] = mapped[ i ];
+                }
+            } else {
+                for( int i = 0; i < 3; ++i ) {
+                    uint32_t v = ( hdrRow32( hdr, y )[ x ] >> ( i * 10 ) ) & 0x3ff;
+                    reference[ i ] = (int)( ( v * 65535 + 511 ) / 1023 );
+                }
+            }
+            uint32_t pixel = pixelRow( &pixels, y )[ x ];
+            uint16_t const* widePixel = widePixelRow( &wide, y ) + x * 4;
+            for( int i = 0; i < 3; ++i ) {
+                int channel8 = (int)( ( pixel >> ( 16 - i * 8 ) ) & 0xff );
+                int e8 = abs( channel8 - ( reference[ i ] * 255 + 32767 ) / 65535 );
+                int e16 = abs( widePixel[ i ] - reference[ i ] );
+                *error8 = e8 > *error8 ? e8 : *error8;
+                *error16 = e16 > *error16 ? e16 : *error16;
+            }
+            // Alpha is ignored, and comes out opaque
+            *error8 = ( pixel >> 24 ) == 0xff ? *error8 : 256;
+            *error16 = widePixel[ 3 ] == 0xffff ? *error16 : 65536;
+        }
+    }
+    free( pixels.pixels );
+    free( wide.pixels );
+}
+
+
+static void testFormat( enum HdrFormat format ) {
+    int const widths[] = { 1, 2, 3, 4, 5, 6, 7, 9, 13, 37, 64, 1001 };
+    float const whites[] = { 1.0f, 2.5f, 6.25f };
+    uint32_t random = 2024;
+    int error8 = 0;
+    int error16 = 0;
+    for( size_t w = 0; w < sizeof( widths ) / sizeof( *widths ); ++w ) {
+        for( size_t s = 0; s < sizeof( whites ) / sizeof( *whites ); ++s ) {
+            struct HdrBuffer hdr = makeCapture( widths[ w ], format, &random );
+            int e8, e16;
+            toneMapErrors( &hdr, whites[ s ], &e8, &e16 );
+            error8 = e8 > error8 ? e8 : error8;
+            error16 = e16 > error16 ? e16 : error16;
+            free( (void*) hdr.pixels );
+        }
+    }
+    printf( "%s: largest error %d at 8 bits, %d at 16 bits\n", format == HDR_FORMAT_RGBA16F ? "fp16" : "10-bit",
+        error8, error16 );
+    CHECK( error8 <= 1 );
+    CHECK( error16 <= 1 );
+}
+
+
+int main( void ) {
+    testFormat( HDR_FORMAT_RGBA16F );
+    testFormat( HDR_FORMAT_RGB10A2 );
+    return testResult();
+}
@@ -0,0 +1,108 @@
+// The binary vector layer reads back the strokes and shapes written to it: the same items, pens and colors, with
+// points and widths rounded to the nearest quarter pixel.
+#include "Test.h"
+
+
+static uint32_t testRandom( uint32_t* state ) {
+    *state = *state * 1664525 + 1013904223;
+    return *state >> 8;
+}
+
+
+// Wavy strokes of every kind of pen, off the snippet as well as on it, and the shapes, with colors including
+// semitransparent ones
+static void fillTestLayer( struct VectorLayer* layer, int count ) {
+    memset( layer, 0, sizeof( *layer ) );
+    layer->width = 1366;
+    layer->height = 771;
+    uint32_t seed = 7;
+    float points[ 400 ];
+    for( int i = 0; i < count; ++i ) {
+        enum VectorKind kind = (enum VectorKind)( i % VECTOR_KIND_COUNT );
+        int pointCount = kind == VECTOR_PEN || kind == VECTOR_HIGHLIGHTER ? 1 + (int)( testRandom( &seed ) % 200 ) :
+            ( kind == VECTOR_TEXT ? 1 : 2 );
+        for( int j = 0; j < pointCount * 2; ++j ) {
+            points[ j ] = ( testRandom( &seed ) % 1600000 ) / 1000.0f - 100.0f;
+        }
+        uint32_t color = testRandom( &seed ) | ( testRandom( &seed ) << 24 );
+        float width = 1.0f + ( testRandom( &seed ) % 4000 ) / 100.0f;
+        CHECK( addVectorItem( layer, kind, i % 5, color, width, points, pointCount,
+            kind == VECTOR_TEXT ? "Ünïcödé <text> & \"quotes\"" : NULL ) );
+    }
+}
+
+
+static void testRoundTrip( void ) {
+    struct VectorLayer written;
+    fillTestLayer( &written, 120 );
+    struct ByteBuffer data = {};
+    writeVectorBinary( &written, &data );
+    CHECK( !data.failed );
+
+    struct VectorLayer read;
+    CHECK( readVectorBinary( data.data, data.size, &read ) );
+    CHECK( read.width == written.width && read.height == written.height );
+    CHECK( read.count == written.count );
+    int itemsMatch = 1, pointsMatch = 1;
+    for( int i = 0; i < read.count && i < written.count; ++i ) {
+        struct VectorItem const* a = &written.items[ i ];
+        struct VectorItem const* b = &read.items[ i ];
+        itemsMatch &= a->kind == b->kind && a->penIndex == b->penIndex && a->color == b->color &&
+            fabsf( a->width - b->width ) <= 0.125f && a->pointCount == b->pointCount;
+        itemsMatch &= a->kind == VECTOR_TEXT ? b->text && strcmp( a->text, b->text ) == 0 : !b->text;
+        for( int j = 0; j < a->pointCount * 2 && a->pointCount == b->pointCount; ++j ) {
+            pointsMatch &= fabsf( a->points[ j ] - b->points[ j ] ) <= 0.125f;
+        }
+    }
+    CHECK( itemsMatch );
+    CHECK( pointsMatch );
+
+    // What was read is already on the quarter pixel grid, so writing it again gives the same bytes
+    struct ByteBuffer again = {};
+    writeVectorBinary( &read, &again );
+    CHECK( again.size == data.size && memcmp( again.data, data.data, data.size ) == 0 );
+
+    releaseByteBuffer( &again );
+    releaseVectorLayer( &read );
+    releaseByteBuffer( &data );
+    releaseVectorLayer( &written );
+}
+
+
+// Cut short anywhere, or with a bad header, the data is rejected and nothing is left in the layer
+static void testMalformed( void ) {
+    struct VectorLayer written;
+    fillTestLayer( &written, 12 );
+    struct ByteBuffer data = {};
+    writeVectorBinary( &written, &data );
+    struct VectorLayer read;
+    int rejected = 1;
+    for( size_t size = 0; size < data.size; ++size ) {
+        rejected &= !readVectorBinary( data.data, size, &read ) && read.count == 0 && !read.items;
+    }
+    CHECK( rejected );
+    data.data[ 4 ] = VECTOR_LAYER_VERSION + 1;
+    CHECK( !readVectorBinary( data.data, data.size, &read ) );
+    releaseByteBuffer( &data );
+    releaseVectorLayer( &written );
+}
+
+
+static void testEmpty( void ) {
+    struct VectorLayer empty = { 10, 20, 0, 0, NULL };
+    struct ByteBuffer data = {};
+    writeVectorBinary( &empty, &data );
+    struct VectorLayer read;
+    CHECK( readVectorBinary( data.data, data.size, &read ) );
+    CHECK( read.width == 10 && read.height == 20 && read.count == 0 );
+    releaseVectorLayer( &read );
+    releaseByteBuffer( &data );
+}
+
+
+int main() {
+    testRoundTrip();
+    testMalformed();
+    testEmpty();
+    return testResult();
+}